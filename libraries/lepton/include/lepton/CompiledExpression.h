@@ -84,6 +84,25 @@ public:
      * Evaluate the expression.  The values of all variables should have been set before calling this.
      */
     double evaluate() const;
+    /**
+     * Specify which variables take a different value at each point when the expression is evaluated
+     * with evaluateBatch().  All other variables are read from their usual locations, exactly as for
+     * evaluate(), and have the same value at every point.  This must be called before evaluateBatch().
+     *
+     * @param names   the names of the variables whose values will be passed to evaluateBatch().  Names
+     *                that do not appear in the expression are allowed, and their values are ignored.
+     */
+    void setBatchVariables(const std::vector<std::string>& names);
+    /**
+     * Evaluate the expression at many points with a single call.  This is much faster than setting the
+     * variables and calling evaluate() once for each point.
+     *
+     * @param numPoints   the number of points at which to evaluate the expression
+     * @param values      values[i] is an array of length numPoints containing the values of the i'th
+     *                    variable that was passed to setBatchVariables()
+     * @param results     on exit, results[j] contains the value of the expression at the j'th point
+     */
+    void evaluateBatch(int numPoints, const double* const* values, double* results) const;
 private:
     friend class ParsedExpression;
     CompiledExpression(const ParsedExpression& expression);
@@ -99,10 +118,23 @@ private:
     mutable std::vector<double> workspace;
     mutable std::vector<double> argValues;
     std::map<std::string, double> dummyVariables;
+    std::vector<std::string> batchVariables;
+    std::vector<int> batchVariableIndices;
+    bool hasBatchVariables;
     void* jitCode;
+    void* batchJitCode;
+    void evaluateOperations() const;
 #ifdef LEPTON_USE_JIT
     void generateJitCode();
+    void generateBatchJitCode();
+    void generateAvxBatchJitCode();
+    void findConstants(std::vector<int>& operationConstantIndex);
     void generateSingleArgCall(asmjit::X86Compiler& c, asmjit::X86XmmVar& dest, asmjit::X86XmmVar& arg, double (*function)(double));
+    mutable std::vector<double> batchArgValues;
+    mutable std::vector<double> batchWorkspace;
+    mutable std::vector<double> batchPadding;
+    mutable std::vector<const double*> batchPaddingPointers;
+    int batchWidth;
     std::vector<double> constants;
     asmjit::JitRuntime runtime;
 #endif
@@ -32,7 +32,11 @@
 #include "lepton/CompiledExpression.h"
 #include "lepton/Operation.h"
 #include "lepton/ParsedExpression.h"
+#include <algorithm>
 #include <utility>
+#ifdef LEPTON_USE_JIT
+    #include <emmintrin.h>
+#endif
 
 using namespace Lepton;
 using namespace std;
@@ -40,10 +44,10 @@ using namespace std;
     using namespace asmjit;
 #endif
 
-CompiledExpression::CompiledExpression() : jitCode(NULL) {
+CompiledExpression::CompiledExpression() : hasBatchVariables(false), jitCode(NULL), batchJitCode(NULL) {
 }
 
-CompiledExpression::CompiledExpression(const ParsedExpression& expression) : jitCode(NULL) {
+CompiledExpression::CompiledExpression(const ParsedExpression& expression) : hasBatchVariables(false), jitCode(NULL), batchJitCode(NULL) {
     ParsedExpression expr = expression.optimize(); // Just in case it wasn't already optimized.
     vector<pair<ExpressionTreeNode, int> > temps;
     compileExpression(expr.getRootNode(), temps);
@@ -63,11 +67,23 @@ CompiledExpression::~CompiledExpression() {
             delete operation[i];
 }
 
-CompiledExpression::CompiledExpression(const CompiledExpression& expression) : jitCode(NULL) {
+CompiledExpression::CompiledExpression(const CompiledExpression& expression) : hasBatchVariables(false), jitCode(NULL), batchJitCode(NULL) {
     *this = expression;
 }
 
 CompiledExpression& CompiledExpression::operator=(const CompiledExpression& expression) {
+    // Discard any batch variables from the expression being replaced.  They refer to its workspace, and
+    // are set up again below if the new expression has batch variables.
+
+#ifdef LEPTON_USE_JIT
+    if (batchJitCode != NULL) {
+        runtime.release(batchJitCode);
+        batchJitCode = NULL;
+    }
+#endif
+    hasBatchVariables = false;
+    batchVariables.clear();
+    batchVariableIndices.clear();
     arguments = expression.arguments;
     target = expression.target;
     variableIndices = expression.variableIndices;
@@ -78,6 +94,8 @@ CompiledExpression& CompiledExpression::operator=(const CompiledExpression& expr
     for (int i = 0; i < (int) operation.size(); i++)
         operation[i] = expression.operation[i]->clone();
     setVariableLocations(variablePointers);
+    if (expression.hasBatchVariables)
+        setBatchVariables(expression.batchVariables);
     return *this;
 }
 
@@ -149,8 +167,11 @@ void CompiledExpression::setVariableLocations(map<string, double*>& variableLoca
 #ifdef LEPTON_USE_JIT
     // Rebuild the JIT code.
     
-    if (workspace.size() > 0)
+    if (workspace.size() > 0) {
         generateJitCode();
+        if (hasBatchVariables)
+            generateBatchJitCode();
+    }
 #else
     // Make a list of all variables we will need to copy before evaluating the expression.
     
@@ -169,7 +190,69 @@ double CompiledExpression::evaluate() const {
 #else
     for (int i = 0; i < variablesToCopy.size(); i++)
         *variablesToCopy[i].first = *variablesToCopy[i].second;
+    evaluateOperations();
+    return workspace[workspace.size()-1];
+#endif
+}
+
+void CompiledExpression::setBatchVariables(const vector<string>& names) {
+    hasBatchVariables = true;
+    batchVariables = names;
+    batchVariableIndices.clear();
+    for (int i = 0; i < (int) names.size(); i++) {
+        map<string, int>::iterator index = variableIndices.find(names[i]);
+        batchVariableIndices.push_back(index == variableIndices.end() ? -1 : index->second);
+    }
+#ifdef LEPTON_USE_JIT
+    if (workspace.size() > 0)
+        generateBatchJitCode();
+#endif
+}
+
+void CompiledExpression::evaluateBatch(int numPoints, const double* const* values, double* results) const {
+    if (!hasBatchVariables)
+        throw Exception("evaluateBatch: setBatchVariables() has not been called");
+#ifdef LEPTON_USE_JIT
+    typedef void (*BatchFunction)(intptr_t, const double* const*, double*);
+    if (batchWidth == 2) {
+        ((BatchFunction) batchJitCode)(numPoints, values, results);
+        return;
+    }
+
+    // The AVX code only processes complete blocks of four points.  Copy any remaining points into
+    // a padded block, repeating the last one so every lane sees valid arguments.
+
+    int numFullPoints = numPoints-numPoints%4;
+    if (numFullPoints > 0)
+        ((BatchFunction) batchJitCode)(numFullPoints, values, results);
+    if (numFullPoints < numPoints) {
+        int numVariables = batchVariableIndices.size();
+        batchPadding.resize(4*numVariables);
+        batchPaddingPointers.resize(numVariables);
+        for (int i = 0; i < numVariables; i++) {
+            for (int j = 0; j < 4; j++)
+                batchPadding[4*i+j] = values[i][min(numFullPoints+j, numPoints-1)];
+            batchPaddingPointers[i] = &batchPadding[4*i];
+        }
+        double paddedResults[4];
+        ((BatchFunction) batchJitCode)(4, (numVariables == 0 ? NULL : &batchPaddingPointers[0]), paddedResults);
+        for (int j = numFullPoints; j < numPoints; j++)
+            results[j] = paddedResults[j-numFullPoints];
+    }
+#else
+    for (int i = 0; i < variablesToCopy.size(); i++)
+        *variablesToCopy[i].first = *variablesToCopy[i].second;
+    for (int point = 0; point < numPoints; point++) {
+        for (int i = 0; i < (int) batchVariableIndices.size(); i++)
+            if (batchVariableIndices[i] != -1)
+                workspace[batchVariableIndices[i]] = values[i][point];
+        evaluateOperations();
+        results[point] = workspace[workspace.size()-1];
+    }
+#endif
+}
 
+void CompiledExpression::evaluateOperations() const {
     // Loop over the operations and evaluate each one.
     
     for (int step = 0; step < operation.size(); step++) {
@@ -182,8 +265,6 @@ double CompiledExpression::evaluate() const {
             workspace[target[step]] = operation[step]->evaluate(&argValues[0], dummyVariables);
         }
     }
-    return workspace[workspace.size()-1];
-#endif
 }
 
 #ifdef LEPTON_USE_JIT
@@ -212,39 +293,8 @@ void CompiledExpression::generateJitCode() {
 
     // Make a list of all constants that will be needed for evaluation.
     
-    vector<int> operationConstantIndex(operation.size(), -1);
-    for (int step = 0; step < (int) operation.size(); step++) {
-        // Find the constant value (if any) used by this operation.
-        
-        Operation& op = *operation[step];
-        double value;
-        if (op.getId() == Operation::CONSTANT)
-            value = dynamic_cast<Operation::Constant&>(op).getValue();
-        else if (op.getId() == Operation::ADD_CONSTANT)
-            value = dynamic_cast<Operation::AddConstant&>(op).getValue();
-        else if (op.getId() == Operation::MULTIPLY_CONSTANT)
-            value = dynamic_cast<Operation::MultiplyConstant&>(op).getValue();
-        else if (op.getId() == Operation::RECIPROCAL)
-            value = 1.0;
-        else if (op.getId() == Operation::STEP)
-            value = 1.0;
-        else if (op.getId() == Operation::DELTA)
-            value = 1.0;
-        else
-            continue;
-        
-        // See if we already have a variable for this constant.
-        
-        for (int i = 0; i < (int) constants.size(); i++)
-            if (value == constants[i]) {
-                operationConstantIndex[step] = i;
-                break;
-            }
-        if (operationConstantIndex[step] == -1) {
-            operationConstantIndex[step] = constants.size();
-            constants.push_back(value);
-        }
-    }
+    vector<int> operationConstantIndex;
+    findConstants(operationConstantIndex);
     
     // Load constants into variables.
     
@@ -390,6 +440,561 @@ void CompiledExpression::generateJitCode() {
     jitCode = c.make();
 }
 
+void CompiledExpression::findConstants(vector<int>& operationConstantIndex) {
+    operationConstantIndex.resize(operation.size(), -1);
+    for (int step = 0; step < (int) operation.size(); step++) {
+        // Find the constant value (if any) used by this operation.
+        
+        Operation& op = *operation[step];
+        double value;
+        if (op.getId() == Operation::CONSTANT)
+            value = dynamic_cast<Operation::Constant&>(op).getValue();
+        else if (op.getId() == Operation::ADD_CONSTANT)
+            value = dynamic_cast<Operation::AddConstant&>(op).getValue();
+        else if (op.getId() == Operation::MULTIPLY_CONSTANT)
+            value = dynamic_cast<Operation::MultiplyConstant&>(op).getValue();
+        else if (op.getId() == Operation::RECIPROCAL)
+            value = 1.0;
+        else if (op.getId() == Operation::STEP)
+            value = 1.0;
+        else if (op.getId() == Operation::DELTA)
+            value = 1.0;
+        else
+            continue;
+        
+        // See if we already have a variable for this constant.
+        
+        for (int i = 0; i < (int) constants.size(); i++)
+            if (value == constants[i]) {
+                operationConstantIndex[step] = i;
+                break;
+            }
+        if (operationConstantIndex[step] == -1) {
+            operationConstantIndex[step] = constants.size();
+            constants.push_back(value);
+        }
+    }
+}
+
+/**
+ * Get the math library function that computes a single argument operation, or NULL if there is none.
+ */
+static double (*getBatchFunction(Operation::Id id))(double) {
+    switch (id) {
+        case Operation::LOG: return log;
+        case Operation::SIN: return sin;
+        case Operation::COS: return cos;
+        case Operation::TAN: return tan;
+        case Operation::ASIN: return asin;
+        case Operation::ACOS: return acos;
+        case Operation::ATAN: return atan;
+        case Operation::SINH: return sinh;
+        case Operation::COSH: return cosh;
+        case Operation::TANH: return tanh;
+        case Operation::ABS: return fabs;
+        case Operation::FLOOR: return floor;
+        case Operation::CEIL: return ceil;
+        default: return NULL;
+    }
+}
+
+template <int WIDTH>
+static void evaluateOperationBatch(Operation* op, double* args) {
+    map<string, double>* dummyVariables = NULL;
+    int numArgs = op->getNumArguments();
+    double results[WIDTH];
+    for (int i = 0; i < WIDTH; i++)
+        results[i] = op->evaluate(args+i*numArgs, *dummyVariables);
+    for (int i = 0; i < WIDTH; i++)
+        args[i] = results[i];
+}
+
+template <int WIDTH>
+static void evaluateFunctionBatch(double (*function)(double), double* args) {
+    for (int i = 0; i < WIDTH; i++)
+        args[i] = function(args[i]);
+}
+
+/**
+ * Compute exp() of WIDTH values in place, two at a time with packed SSE2 arithmetic.  This uses the
+ * Pade approximation from the Cephes library, which is accurate to about 2e-16.  Values outside the
+ * range where the result is a normalized number, as well as NaN, are passed to exp() one at a time.
+ */
+template <int WIDTH>
+static void evaluateExpBatch(double* args) {
+    const __m128d log2e = _mm_set1_pd(1.4426950408889634073599);
+    const __m128d c1 = _mm_set1_pd(6.93145751953125e-1);
+    const __m128d c2 = _mm_set1_pd(1.42860682030941723212e-6);
+    for (int i = 0; i < WIDTH; i += 2) {
+        __m128d x = _mm_loadu_pd(args+i);
+        __m128d inRange = _mm_and_pd(_mm_cmpge_pd(x, _mm_set1_pd(-708.0)), _mm_cmple_pd(x, _mm_set1_pd(709.0)));
+
+        // Write exp(x) = 2^n * exp(r), where n is an integer and |r| <= ln(2)/2.
+
+        __m128i n = _mm_cvtpd_epi32(_mm_mul_pd(x, log2e));
+        __m128d nd = _mm_cvtepi32_pd(n);
+        __m128d r = _mm_sub_pd(_mm_sub_pd(x, _mm_mul_pd(nd, c1)), _mm_mul_pd(nd, c2));
+        __m128d r2 = _mm_mul_pd(r, r);
+        __m128d p = _mm_add_pd(_mm_mul_pd(r2, _mm_set1_pd(1.26177193074810590878e-4)), _mm_set1_pd(3.02994407707441961300e-2));
+        p = _mm_mul_pd(r, _mm_add_pd(_mm_mul_pd(p, r2), _mm_set1_pd(9.99999999999999999910e-1)));
+        __m128d q = _mm_add_pd(_mm_mul_pd(r2, _mm_set1_pd(3.00198505138664455042e-6)), _mm_set1_pd(2.52448340349684104192e-3));
+        q = _mm_add_pd(_mm_mul_pd(q, r2), _mm_set1_pd(2.27265548208155028766e-1));
+        q = _mm_add_pd(_mm_mul_pd(q, r2), _mm_set1_pd(2.00000000000000000009e0));
+        __m128d expr = _mm_add_pd(_mm_set1_pd(1.0), _mm_mul_pd(_mm_set1_pd(2.0), _mm_div_pd(p, _mm_sub_pd(q, p))));
+
+        // Build 2^n directly from its bit pattern.
+
+        __m128i exponent = _mm_unpacklo_epi32(_mm_add_epi32(n, _mm_set1_epi32(1023)), _mm_setzero_si128());
+        __m128d scale = _mm_castsi128_pd(_mm_slli_epi64(exponent, 52));
+        _mm_storeu_pd(args+i, _mm_mul_pd(expr, scale));
+        int mask = _mm_movemask_pd(inRange);
+        if (mask != 3) {
+            double values[2];
+            _mm_storeu_pd(values, x);
+            for (int j = 0; j < 2; j++)
+                if ((mask & (1<<j)) == 0)
+                    args[i+j] = exp(values[j]);
+        }
+    }
+}
+
+void CompiledExpression::generateBatchJitCode() {
+    if (X86CpuInfo::getHost()->hasFeature(kX86CpuFeatureAVX)) {
+        generateAvxBatchJitCode();
+        return;
+    }
+    batchWidth = 2;
+
+    // The generated function processes two points at a time, using packed double precision SSE2
+    // instructions.  If the number of points is odd, the final point is copied to both halves of
+    // each register so that every operation still sees valid arguments.
+
+    X86Compiler c(&runtime);
+    c.addFunc(kFuncConvHost, FuncBuilder3<void, intptr_t, const double* const*, double*>());
+    X86GpVar numPoints(c, kVarTypeIntPtr);
+    X86GpVar valuesPointer(c, kVarTypeIntPtr);
+    X86GpVar resultsPointer(c, kVarTypeIntPtr);
+    c.setArg(0, numPoints);
+    c.setArg(1, valuesPointer);
+    c.setArg(2, resultsPointer);
+    vector<X86XmmVar> workspaceVar(workspace.size());
+    for (int i = 0; i < (int) workspaceVar.size(); i++)
+        workspaceVar[i] = c.newXmmVar(kX86VarTypeXmmPd);
+    int maxArguments = 1;
+    for (int i = 0; i < (int) operation.size(); i++)
+        if (operation[i]->getNumArguments() > maxArguments)
+            maxArguments = operation[i]->getNumArguments();
+    batchArgValues.resize(2*maxArguments);
+    X86GpVar argsPointer(c);
+    c.mov(argsPointer, imm_ptr(&batchArgValues[0]));
+
+    // Load the variables that are the same for every point, and the pointers to the arrays for
+    // the ones that vary.
+
+    vector<bool> isBatchVariable(workspace.size(), false);
+    vector<pair<int, X86GpVar> > batchArrays;
+    for (int i = 0; i < (int) batchVariableIndices.size(); i++) {
+        int index = batchVariableIndices[i];
+        if (index == -1 || isBatchVariable[index])
+            continue;
+        isBatchVariable[index] = true;
+        X86GpVar arrayPointer(c, kVarTypeIntPtr);
+        c.mov(arrayPointer, x86::ptr(valuesPointer, (int) (i*sizeof(double*)), 0));
+        batchArrays.push_back(make_pair(index, arrayPointer));
+    }
+    for (set<string>::const_iterator iter = variableNames.begin(); iter != variableNames.end(); ++iter) {
+        map<string, int>::iterator index = variableIndices.find(*iter);
+        if (isBatchVariable[index->second])
+            continue;
+        X86GpVar variablePointer(c);
+        c.mov(variablePointer, imm_ptr(&getVariableReference(index->first)));
+        c.movsd(workspaceVar[index->second], x86::ptr(variablePointer, 0, 0));
+        c.unpcklpd(workspaceVar[index->second], workspaceVar[index->second]);
+    }
+
+    // Load constants into variables.
+
+    vector<int> operationConstantIndex;
+    findConstants(operationConstantIndex);
+    vector<X86XmmVar> constantVar(constants.size());
+    if (constants.size() > 0) {
+        X86GpVar constantsPointer(c);
+        c.mov(constantsPointer, imm_ptr(&constants[0]));
+        for (int i = 0; i < (int) constants.size(); i++) {
+            constantVar[i] = c.newXmmVar(kX86VarTypeXmmPd);
+            c.movsd(constantVar[i], x86::ptr(constantsPointer, 8*i, 0));
+            c.unpcklpd(constantVar[i], constantVar[i]);
+        }
+    }
+
+    // Loop over points.
+
+    X86GpVar index(c, kVarTypeIntPtr);
+    X86GpVar remaining(c, kVarTypeIntPtr);
+    Label loopStart = c.newLabel();
+    Label loadSingle = c.newLabel();
+    Label compute = c.newLabel();
+    Label storeSingle = c.newLabel();
+    Label done = c.newLabel();
+    c.mov(index, imm(0));
+    c.bind(loopStart);
+    c.mov(remaining, numPoints);
+    c.sub(remaining, index);
+    c.cmp(remaining, imm(0));
+    c.jle(done);
+    c.cmp(remaining, imm(1));
+    c.je(loadSingle);
+    for (int i = 0; i < (int) batchArrays.size(); i++)
+        c.movupd(workspaceVar[batchArrays[i].first], x86::ptr(batchArrays[i].second, index, 3, 0));
+    c.jmp(compute);
+    c.bind(loadSingle);
+    for (int i = 0; i < (int) batchArrays.size(); i++) {
+        c.movsd(workspaceVar[batchArrays[i].first], x86::ptr(batchArrays[i].second, index, 3, 0));
+        c.unpcklpd(workspaceVar[batchArrays[i].first], workspaceVar[batchArrays[i].first]);
+    }
+    c.bind(compute);
+
+    // Evaluate the operations.
+
+    for (int step = 0; step < (int) operation.size(); step++) {
+        Operation& op = *operation[step];
+        vector<int> args = arguments[step];
+        if (args.size() == 1) {
+            // One or more sequential arguments.  Fill out the list.
+
+            for (int i = 1; i < op.getNumArguments(); i++)
+                args.push_back(args[0]+i);
+        }
+        X86XmmVar& dest = workspaceVar[target[step]];
+
+        // Generate instructions to execute this operation.
+
+        switch (op.getId()) {
+            case Operation::CONSTANT:
+                c.movapd(dest, constantVar[operationConstantIndex[step]]);
+                break;
+            case Operation::ADD:
+                c.movapd(dest, workspaceVar[args[0]]);
+                c.addpd(dest, workspaceVar[args[1]]);
+                break;
+            case Operation::SUBTRACT:
+                c.movapd(dest, workspaceVar[args[0]]);
+                c.subpd(dest, workspaceVar[args[1]]);
+                break;
+            case Operation::MULTIPLY:
+                c.movapd(dest, workspaceVar[args[0]]);
+                c.mulpd(dest, workspaceVar[args[1]]);
+                break;
+            case Operation::DIVIDE:
+                c.movapd(dest, workspaceVar[args[0]]);
+                c.divpd(dest, workspaceVar[args[1]]);
+                break;
+            case Operation::NEGATE:
+                c.xorpd(dest, dest);
+                c.subpd(dest, workspaceVar[args[0]]);
+                break;
+            case Operation::SQRT:
+                c.sqrtpd(dest, workspaceVar[args[0]]);
+                break;
+            case Operation::STEP:
+                c.xorpd(dest, dest);
+                c.cmppd(dest, workspaceVar[args[0]], imm(18)); // Comparison mode is _CMP_LE_OQ = 18
+                c.andpd(dest, constantVar[operationConstantIndex[step]]);
+                break;
+            case Operation::DELTA:
+                c.xorpd(dest, dest);
+                c.cmppd(dest, workspaceVar[args[0]], imm(16)); // Comparison mode is _CMP_EQ_OS = 16
+                c.andpd(dest, constantVar[operationConstantIndex[step]]);
+                break;
+            case Operation::SQUARE:
+                c.movapd(dest, workspaceVar[args[0]]);
+                c.mulpd(dest, workspaceVar[args[0]]);
+                break;
+            case Operation::CUBE:
+                c.movapd(dest, workspaceVar[args[0]]);
+                c.mulpd(dest, workspaceVar[args[0]]);
+                c.mulpd(dest, workspaceVar[args[0]]);
+                break;
+            case Operation::RECIPROCAL:
+                c.movapd(dest, constantVar[operationConstantIndex[step]]);
+                c.divpd(dest, workspaceVar[args[0]]);
+                break;
+            case Operation::ADD_CONSTANT:
+                c.movapd(dest, workspaceVar[args[0]]);
+                c.addpd(dest, constantVar[operationConstantIndex[step]]);
+                break;
+            case Operation::MULTIPLY_CONSTANT:
+                c.movapd(dest, workspaceVar[args[0]]);
+                c.mulpd(dest, constantVar[operationConstantIndex[step]]);
+                break;
+            default: {
+                // Call a function for each of the two points.
+
+                double (*function)(double) = getBatchFunction(op.getId());
+                X86GpVar fn(c, kVarTypeIntPtr);
+                if (op.getId() == Operation::EXP) {
+                    c.movupd(x86::ptr(argsPointer, 0, 0), workspaceVar[args[0]]);
+                    c.mov(fn, imm_ptr((void*) evaluateExpBatch<2>));
+                    X86CallNode* call = c.call(fn, kFuncConvHost, FuncBuilder1<void, double*>());
+                    call->setArg(0, imm_ptr(&batchArgValues[0]));
+                }
+                else if (function != NULL) {
+                    c.movupd(x86::ptr(argsPointer, 0, 0), workspaceVar[args[0]]);
+                    c.mov(fn, imm_ptr((void*) evaluateFunctionBatch<2>));
+                    X86CallNode* call = c.call(fn, kFuncConvHost, FuncBuilder2<void, void*, double*>());
+                    call->setArg(0, imm_ptr((void*) function));
+                    call->setArg(1, imm_ptr(&batchArgValues[0]));
+                }
+                else {
+                    // The arguments for the first point are followed by the arguments for the second one.
+
+                    int numArgs = args.size();
+                    for (int i = 0; i < numArgs; i++) {
+                        c.movlpd(x86::ptr(argsPointer, 8*i, 0), workspaceVar[args[i]]);
+                        c.movhpd(x86::ptr(argsPointer, 8*(numArgs+i), 0), workspaceVar[args[i]]);
+                    }
+                    c.mov(fn, imm_ptr((void*) evaluateOperationBatch<2>));
+                    X86CallNode* call = c.call(fn, kFuncConvHost, FuncBuilder2<void, Operation*, double*>());
+                    call->setArg(0, imm_ptr(&op));
+                    call->setArg(1, imm_ptr(&batchArgValues[0]));
+                }
+                c.movupd(dest, x86::ptr(argsPointer, 0, 0));
+            }
+        }
+    }
+
+    // Store the results.
+
+    c.cmp(remaining, imm(1));
+    c.je(storeSingle);
+    c.movupd(x86::ptr(resultsPointer, index, 3, 0), workspaceVar[workspace.size()-1]);
+    c.add(index, imm(2));
+    c.jmp(loopStart);
+    c.bind(storeSingle);
+    c.movsd(x86::ptr(resultsPointer, index, 3, 0), workspaceVar[workspace.size()-1]);
+    c.bind(done);
+    c.ret();
+    c.endFunc();
+    if (batchJitCode != NULL)
+        runtime.release(batchJitCode);
+    batchJitCode = c.make();
+}
+
+void CompiledExpression::generateAvxBatchJitCode() {
+    // The generated function processes four points at a time, using packed double precision AVX
+    // instructions.  The asmjit register allocator cannot save YMM registers, so each slot of the
+    // workspace (and each constant) is kept in batchWorkspace as four consecutive values, and every
+    // operation loads its arguments into fixed registers and stores its result back.  The number of
+    // points must be a multiple of four.  evaluateBatch() handles any remainder.
+
+    batchWidth = 4;
+    X86Compiler c(&runtime);
+    c.addFunc(kFuncConvHost, FuncBuilder3<void, intptr_t, const double* const*, double*>());
+    X86GpVar numPoints(c, kVarTypeIntPtr);
+    X86GpVar valuesPointer(c, kVarTypeIntPtr);
+    X86GpVar resultsPointer(c, kVarTypeIntPtr);
+    c.setArg(0, numPoints);
+    c.setArg(1, valuesPointer);
+    c.setArg(2, resultsPointer);
+    int maxArguments = 1;
+    for (int i = 0; i < (int) operation.size(); i++)
+        if (operation[i]->getNumArguments() > maxArguments)
+            maxArguments = operation[i]->getNumArguments();
+    batchArgValues.resize(4*maxArguments);
+    X86GpVar argsPointer(c);
+    c.mov(argsPointer, imm_ptr(&batchArgValues[0]));
+
+    // Constants are stored after the workspace slots.  Their values never change, so they can be
+    // filled in now.
+
+    vector<int> operationConstantIndex;
+    findConstants(operationConstantIndex);
+    int numSlots = workspace.size()+constants.size();
+    batchWorkspace.resize(4*numSlots);
+    for (int i = 0; i < (int) constants.size(); i++)
+        for (int j = 0; j < 4; j++)
+            batchWorkspace[4*(workspace.size()+i)+j] = constants[i];
+    X86GpVar workspacePointer(c);
+    c.mov(workspacePointer, imm_ptr(&batchWorkspace[0]));
+    vector<X86Mem> slot(numSlots);
+    for (int i = 0; i < numSlots; i++)
+        slot[i] = x86::ptr(workspacePointer, 32*i, 0);
+    vector<X86Mem> constantSlot(operation.size());
+    for (int step = 0; step < (int) operation.size(); step++)
+        if (operationConstantIndex[step] != -1)
+            constantSlot[step] = slot[workspace.size()+operationConstantIndex[step]];
+
+    // Load the variables that are the same for every point, and the pointers to the arrays for
+    // the ones that vary.
+
+    vector<bool> isBatchVariable(workspace.size(), false);
+    vector<pair<int, X86GpVar> > batchArrays;
+    for (int i = 0; i < (int) batchVariableIndices.size(); i++) {
+        int index = batchVariableIndices[i];
+        if (index == -1 || isBatchVariable[index])
+            continue;
+        isBatchVariable[index] = true;
+        X86GpVar arrayPointer(c, kVarTypeIntPtr);
+        c.mov(arrayPointer, x86::ptr(valuesPointer, (int) (i*sizeof(double*)), 0));
+        batchArrays.push_back(make_pair(index, arrayPointer));
+    }
+    for (set<string>::const_iterator iter = variableNames.begin(); iter != variableNames.end(); ++iter) {
+        map<string, int>::iterator index = variableIndices.find(*iter);
+        if (isBatchVariable[index->second])
+            continue;
+        X86GpVar variablePointer(c);
+        c.mov(variablePointer, imm_ptr(&getVariableReference(index->first)));
+        c.emit(kX86InstIdVbroadcastsd, x86::ymm0, x86::ptr(variablePointer, 0, 0));
+        c.emit(kX86InstIdVmovupd, slot[index->second], x86::ymm0);
+    }
+
+    // Loop over points.
+
+    X86GpVar index(c, kVarTypeIntPtr);
+    Label loopStart = c.newLabel();
+    Label done = c.newLabel();
+    c.mov(index, imm(0));
+    c.bind(loopStart);
+    c.cmp(index, numPoints);
+    c.jge(done);
+    for (int i = 0; i < (int) batchArrays.size(); i++) {
+        c.emit(kX86InstIdVmovupd, x86::ymm0, x86::ptr(batchArrays[i].second, index, 3, 0));
+        c.emit(kX86InstIdVmovupd, slot[batchArrays[i].first], x86::ymm0);
+    }
+
+    // Evaluate the operations.  Each one leaves its result in ymm0.
+
+    for (int step = 0; step < (int) operation.size(); step++) {
+        Operation& op = *operation[step];
+        vector<int> args = arguments[step];
+        if (args.size() == 1) {
+            // One or more sequential arguments.  Fill out the list.
+
+            for (int i = 1; i < op.getNumArguments(); i++)
+                args.push_back(args[0]+i);
+        }
+
+        // Generate instructions to execute this operation.
+
+        switch (op.getId()) {
+            case Operation::CONSTANT:
+                c.emit(kX86InstIdVmovupd, x86::ymm0, constantSlot[step]);
+                break;
+            case Operation::ADD:
+                c.emit(kX86InstIdVmovupd, x86::ymm0, slot[args[0]]);
+                c.emit(kX86InstIdVaddpd, x86::ymm0, x86::ymm0, slot[args[1]]);
+                break;
+            case Operation::SUBTRACT:
+                c.emit(kX86InstIdVmovupd, x86::ymm0, slot[args[0]]);
+                c.emit(kX86InstIdVsubpd, x86::ymm0, x86::ymm0, slot[args[1]]);
+                break;
+            case Operation::MULTIPLY:
+                c.emit(kX86InstIdVmovupd, x86::ymm0, slot[args[0]]);
+                c.emit(kX86InstIdVmulpd, x86::ymm0, x86::ymm0, slot[args[1]]);
+                break;
+            case Operation::DIVIDE:
+                c.emit(kX86InstIdVmovupd, x86::ymm0, slot[args[0]]);
+                c.emit(kX86InstIdVdivpd, x86::ymm0, x86::ymm0, slot[args[1]]);
+                break;
+            case Operation::NEGATE:
+                c.emit(kX86InstIdVxorpd, x86::ymm1, x86::ymm1, x86::ymm1);
+                c.emit(kX86InstIdVsubpd, x86::ymm0, x86::ymm1, slot[args[0]]);
+                break;
+            case Operation::SQRT:
+                c.emit(kX86InstIdVsqrtpd, x86::ymm0, slot[args[0]]);
+                break;
+            case Operation::STEP:
+                c.emit(kX86InstIdVxorpd, x86::ymm1, x86::ymm1, x86::ymm1);
+                c.emit(kX86InstIdVcmppd, x86::ymm0, x86::ymm1, slot[args[0]], imm(18)); // Comparison mode is _CMP_LE_OQ = 18
+                c.emit(kX86InstIdVandpd, x86::ymm0, x86::ymm0, constantSlot[step]);
+                break;
+            case Operation::DELTA:
+                c.emit(kX86InstIdVxorpd, x86::ymm1, x86::ymm1, x86::ymm1);
+                c.emit(kX86InstIdVcmppd, x86::ymm0, x86::ymm1, slot[args[0]], imm(16)); // Comparison mode is _CMP_EQ_OS = 16
+                c.emit(kX86InstIdVandpd, x86::ymm0, x86::ymm0, constantSlot[step]);
+                break;
+            case Operation::SQUARE:
+                c.emit(kX86InstIdVmovupd, x86::ymm1, slot[args[0]]);
+                c.emit(kX86InstIdVmulpd, x86::ymm0, x86::ymm1, x86::ymm1);
+                break;
+            case Operation::CUBE:
+                c.emit(kX86InstIdVmovupd, x86::ymm1, slot[args[0]]);
+                c.emit(kX86InstIdVmulpd, x86::ymm0, x86::ymm1, x86::ymm1);
+                c.emit(kX86InstIdVmulpd, x86::ymm0, x86::ymm0, x86::ymm1);
+                break;
+            case Operation::RECIPROCAL:
+                c.emit(kX86InstIdVmovupd, x86::ymm0, constantSlot[step]);
+                c.emit(kX86InstIdVdivpd, x86::ymm0, x86::ymm0, slot[args[0]]);
+                break;
+            case Operation::ADD_CONSTANT:
+                c.emit(kX86InstIdVmovupd, x86::ymm0, slot[args[0]]);
+                c.emit(kX86InstIdVaddpd, x86::ymm0, x86::ymm0, constantSlot[step]);
+                break;
+            case Operation::MULTIPLY_CONSTANT:
+                c.emit(kX86InstIdVmovupd, x86::ymm0, slot[args[0]]);
+                c.emit(kX86InstIdVmulpd, x86::ymm0, x86::ymm0, constantSlot[step]);
+                break;
+            default: {
+                // Call a function that processes all four points.  Nothing is held in YMM registers
+                // across the call, so the upper halves can be cleared first to avoid AVX-SSE
+                // transition penalties in the called code.
+
+                double (*function)(double) = getBatchFunction(op.getId());
+                X86GpVar fn(c, kVarTypeIntPtr);
+                if (op.getId() == Operation::EXP || function != NULL) {
+                    c.emit(kX86InstIdVmovupd, x86::ymm0, slot[args[0]]);
+                    c.emit(kX86InstIdVmovupd, x86::ptr(argsPointer, 0, 0), x86::ymm0);
+                    c.emit(kX86InstIdVzeroupper);
+                }
+                else {
+                    // The arguments for each point are stored one after another.
+
+                    c.emit(kX86InstIdVzeroupper);
+                    int numArgs = args.size();
+                    for (int i = 0; i < numArgs; i++)
+                        for (int j = 0; j < 4; j++) {
+                            c.emit(kX86InstIdMovsd, x86::xmm0, x86::ptr(workspacePointer, 32*args[i]+8*j, 0));
+                            c.emit(kX86InstIdMovsd, x86::ptr(argsPointer, 8*(j*numArgs+i), 0), x86::xmm0);
+                        }
+                }
+                if (op.getId() == Operation::EXP) {
+                    c.mov(fn, imm_ptr((void*) evaluateExpBatch<4>));
+                    X86CallNode* call = c.call(fn, kFuncConvHost, FuncBuilder1<void, double*>());
+                    call->setArg(0, imm_ptr(&batchArgValues[0]));
+                }
+                else if (function != NULL) {
+                    c.mov(fn, imm_ptr((void*) evaluateFunctionBatch<4>));
+                    X86CallNode* call = c.call(fn, kFuncConvHost, FuncBuilder2<void, void*, double*>());
+                    call->setArg(0, imm_ptr((void*) function));
+                    call->setArg(1, imm_ptr(&batchArgValues[0]));
+                }
+                else {
+                    c.mov(fn, imm_ptr((void*) evaluateOperationBatch<4>));
+                    X86CallNode* call = c.call(fn, kFuncConvHost, FuncBuilder2<void, Operation*, double*>());
+                    call->setArg(0, imm_ptr(&op));
+                    call->setArg(1, imm_ptr(&batchArgValues[0]));
+                }
+                c.emit(kX86InstIdVmovupd, x86::ymm0, x86::ptr(argsPointer, 0, 0));
+            }
+        }
+        c.emit(kX86InstIdVmovupd, slot[target[step]], x86::ymm0);
+    }
+
+    // Store the results.
+
+    c.emit(kX86InstIdVmovupd, x86::ymm0, slot[workspace.size()-1]);
+    c.emit(kX86InstIdVmovupd, x86::ptr(resultsPointer, index, 3, 0), x86::ymm0);
+    c.add(index, imm(4));
+    c.jmp(loopStart);
+    c.bind(done);
+    c.emit(kX86InstIdVzeroupper);
+    c.ret();
+    c.endFunc();
+    if (batchJitCode != NULL)
+        runtime.release(batchJitCode);
+    batchJitCode = c.make();
+}
+
 void CompiledExpression::generateSingleArgCall(X86Compiler& c, X86XmmVar& dest, X86XmmVar& arg, double (*function)(double)) {
     X86GpVar fn(c, kVarTypeIntPtr);
     c.mov(fn, imm_ptr((void*) function));
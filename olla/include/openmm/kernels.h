@@ -1367,19 +1367,22 @@ public:
      * @param gridx        the x size of the PME grid
      * @param gridy        the y size of the PME grid
      * @param gridz        the z size of the PME grid
+     * @param order        the B-spline interpolation order
      * @param numParticles the number of particles in the system
      * @param alpha        the Ewald blending parameter
      * @param deterministic whether it should attempt to make the resulting forces deterministic
      */
-    virtual void initialize(int gridx, int gridy, int gridz, int numParticles, double alpha, bool deterministic) = 0;
+    virtual void initialize(int gridx, int gridy, int gridz, int order, int numParticles, double alpha, bool deterministic) = 0;
     /**
      * Begin computing the force and energy.
      *
      * @param io                  an object that coordinates data transfer
      * @param periodicBoxVectors  the vectors defining the periodic box (measured in nm)
+     * @param includeForces       true if forces should be computed.  If this is false, finishComputation()
+     *                            does not call setForce() on the IO.
      * @param includeEnergy       true if potential energy should be computed
      */
-    virtual void beginComputation(IO& io, const Vec3* periodicBoxVectors, bool includeEnergy) = 0;
+    virtual void beginComputation(IO& io, const Vec3* periodicBoxVectors, bool includeForces, bool includeEnergy) = 0;
     /**
      * Finish computing the force and energy.
      * 
@@ -1441,19 +1444,22 @@ public:
      * @param gridx        the x size of the PME grid
      * @param gridy        the y size of the PME grid
      * @param gridz        the z size of the PME grid
+     * @param order        the B-spline interpolation order
      * @param numParticles the number of particles in the system
      * @param alpha        the Ewald blending parameter
      * @param deterministic whether it should attempt to make the resulting forces deterministic
      */
-    virtual void initialize(int gridx, int gridy, int gridz, int numParticles, double alpha, bool deterministic) = 0;
+    virtual void initialize(int gridx, int gridy, int gridz, int order, int numParticles, double alpha, bool deterministic) = 0;
     /**
      * Begin computing the force and energy.
      *
      * @param io                  an object that coordinates data transfer
      * @param periodicBoxVectors  the vectors defining the periodic box (measured in nm)
+     * @param includeForces       true if forces should be computed.  If this is false, finishComputation()
+     *                            does not call setForce() on the IO.
      * @param includeEnergy       true if potential energy should be computed
      */
-    virtual void beginComputation(IO& io, const Vec3* periodicBoxVectors, bool includeEnergy) = 0;
+    virtual void beginComputation(IO& io, const Vec3* periodicBoxVectors, bool includeForces, bool includeEnergy) = 0;
     /**
      * Finish computing the force and energy.
      * 
@@ -268,6 +268,26 @@ public:
      * @param[out] nz      the number of grid points along the Z axis
      */
     void getLJPMEParametersInContext(const Context& context, double& alpha, int& nx, int& ny, int& nz) const;
+    /**
+     * Get the B-spline interpolation order used to spread charges onto the PME grid and to interpolate
+     * forces back from it.  This applies to both the electrostatic and (for LJPME) the dispersion grids.
+     * The default value is 5.
+     */
+    int getPMEInterpolationOrder() const;
+    /**
+     * Set the B-spline interpolation order used to spread charges onto the PME grid and to interpolate
+     * forces back from it.  This applies to both the electrostatic and (for LJPME) the dispersion grids.
+     * Higher orders give a more accurate reciprocal space calculation for a given grid, so they allow a
+     * coarser grid to be used at the same accuracy.  Grid dimensions chosen automatically from the Ewald
+     * error tolerance assume the default order, so when changing it you will usually want to specify the
+     * grid dimensions explicitly with setPMEParameters() and setLJPMEParameters().
+     *
+     * Not all platforms support every order.  The Reference and CPU platforms support orders 4 through 8.
+     * Other platforms only support the default order of 5, and throw an exception if any other value is used.
+     *
+     * @param order    the interpolation order.  Legal values are between 4 and 8 (inclusive).
+     */
+    void setPMEInterpolationOrder(int order);
     /**
      * Add the nonbonded force parameters for a particle.  This should be called once for each particle
      * in the System.  When it is called for the i'th time, it specifies the parameters for the i'th particle.
@@ -423,7 +443,7 @@ private:
     NonbondedMethod nonbondedMethod;
     double cutoffDistance, switchingDistance, rfDielectric, ewaldErrorTol, alpha, dalpha;
     bool useSwitchingFunction, useDispersionCorrection;
-    int recipForceGroup, nx, ny, nz, dnx, dny, dnz;
+    int recipForceGroup, nx, ny, nz, dnx, dny, dnz, pmeOrder;
     void addExclusionsToSet(const std::vector<std::set<int> >& bonded12, std::set<int>& exclusions, int baseParticle, int fromParticle, int currentLevel) const;
     std::vector<ParticleInfo> particles;
     std::vector<ExceptionInfo> exceptions;
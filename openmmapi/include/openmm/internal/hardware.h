@@ -92,6 +92,10 @@ static int getNumProcessors() {
  */
 #ifdef WIN32
 #define cpuid __cpuid
+#define cpuidex __cpuidex
+    static inline unsigned long long getExtendedControlRegister() {
+        return _xgetbv(0);
+    }
 #else
 #if !defined(__ANDROID__) && !defined(__PNACL__)
     static void cpuid(int cpuInfo[4], int infoType){
@@ -118,6 +122,46 @@ static int getNumProcessors() {
         );
     #endif
     }
+
+    /**
+     * Query a subleaf of a cpuid leaf, such as leaf 7 which reports the AVX-512 extensions.
+     */
+    static inline void cpuidex(int cpuInfo[4], int infoType, int subType){
+    #ifdef __LP64__
+        __asm__ __volatile__ (
+            "cpuid":
+            "=a" (cpuInfo[0]),
+            "=b" (cpuInfo[1]),
+            "=c" (cpuInfo[2]),
+            "=d" (cpuInfo[3]) :
+            "a" (infoType),
+            "c" (subType)
+        );
+    #else
+        __asm__ __volatile__ (
+            "pushl %%ebx\n"
+            "cpuid\n"
+            "movl %%ebx, %1\n"
+            "popl %%ebx\n" :
+            "=a" (cpuInfo[0]),
+            "=r" (cpuInfo[1]),
+            "=c" (cpuInfo[2]),
+            "=d" (cpuInfo[3]) :
+            "a" (infoType),
+            "c" (subType)
+        );
+    #endif
+    }
+
+    /**
+     * Get the value of XCR0, which tells which register sets the operating system saves on context switches.
+     * Only call this if cpuid reports that OSXSAVE is enabled.
+     */
+    static inline unsigned long long getExtendedControlRegister() {
+        unsigned int eax, edx;
+        __asm__ __volatile__ ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+        return ((unsigned long long) edx << 32) | eax;
+    }
     #endif
 #endif
 
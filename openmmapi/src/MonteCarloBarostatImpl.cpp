@@ -73,9 +73,10 @@ void MonteCarloBarostatImpl::updateContextState(ContextImpl& context, bool& forc
         return;
     step = 0;
 
-    // Compute the current potential energy.
+    // Compute the current potential energy.  This also computes forces, since some platforms save the current
+    // forces in scaleCoordinates() and restore them if the step is rejected.
 
-    double initialEnergy = context.getOwner().getState(State::Energy).getPotentialEnergy();
+    double initialEnergy = context.calcForcesAndEnergy(true, true);
 
     // Modify the periodic box size.
 
@@ -88,9 +89,11 @@ void MonteCarloBarostatImpl::updateContextState(ContextImpl& context, bool& forc
     kernel.getAs<ApplyMonteCarloBarostatKernel>().scaleCoordinates(context, lengthScale, lengthScale, lengthScale);
     context.getOwner().setPeriodicBoxVectors(box[0]*lengthScale, box[1]*lengthScale, box[2]*lengthScale);
 
-    // Compute the energy of the modified system.
+    // Compute the energy of the modified system.  Forces are not needed.  If the step is rejected, the forces
+    // computed above are either preserved by the platform or restored by restoreCoordinates().  If it is
+    // accepted, they are marked invalid.
     
-    double finalEnergy = context.getOwner().getState(State::Energy).getPotentialEnergy();
+    double finalEnergy = context.calcForcesAndEnergy(false, true);
     double pressure = context.getParameter(MonteCarloBarostat::Pressure())*(AVOGADRO*1e-25);
     double kT = BOLTZ*context.getParameter(MonteCarloBarostat::Temperature());
     double w = finalEnergy-initialEnergy + pressure*deltaVolume - context.getMolecules().size()*kT*std::log(newVolume/volume);
@@ -49,7 +49,7 @@ using std::vector;
 
 NonbondedForce::NonbondedForce() : nonbondedMethod(NoCutoff), cutoffDistance(1.0), switchingDistance(-1.0), rfDielectric(78.3),
         ewaldErrorTol(5e-4), alpha(0.0), dalpha(0.0), useSwitchingFunction(false), useDispersionCorrection(true), recipForceGroup(-1),
-        nx(0), ny(0), nz(0), dnx(0), dny(0), dnz(0) {
+        nx(0), ny(0), nz(0), dnx(0), dny(0), dnz(0), pmeOrder(5) {
 }
 
 NonbondedForce::NonbondedMethod NonbondedForce::getNonbondedMethod() const {
@@ -138,6 +138,16 @@ void NonbondedForce::getLJPMEParametersInContext(const Context& context, double&
     dynamic_cast<const NonbondedForceImpl&>(getImplInContext(context)).getLJPMEParameters(alpha, nx, ny, nz);
 }
 
+int NonbondedForce::getPMEInterpolationOrder() const {
+    return pmeOrder;
+}
+
+void NonbondedForce::setPMEInterpolationOrder(int order) {
+    if (order < 4 || order > 8)
+        throw OpenMMException("PME interpolation order must be between 4 and 8");
+    pmeOrder = order;
+}
+
 int NonbondedForce::addParticle(double charge, double sigma, double epsilon) {
     particles.push_back(ParticleInfo(charge, sigma, epsilon));
     return particles.size()-1;
@@ -173,6 +173,14 @@ void NonbondedForceImpl::calcPMEParameters(const System& system, const Nonbonded
         ysize = max(ysize, 6);
         zsize = max(zsize, 6);
     }
+
+    // Each dimension must be at least the interpolation order, so the B-spline for an atom wraps around
+    // the grid at most once.
+
+    int minSize = force.getPMEInterpolationOrder();
+    xsize = max(xsize, minSize);
+    ysize = max(ysize, minSize);
+    zsize = max(zsize, minSize);
 }
 
 int NonbondedForceImpl::findZero(const NonbondedForceImpl::ErrorFunction& f, int initialGuess) {
@@ -53,14 +53,41 @@ public:
     void initialize(int numAtoms, int numBonds, int numAtomsPerBond, int** bondAtoms, ThreadPool& threads);
     /**
      * Compute the forces from all bonds.
+     *
+     * @param includeForces  if false, only the energy is computed and forces is left unchanged
      */
     void calculateForce(std::vector<OpenMM::Vec3>& atomCoordinates, double** parameters, std::vector<OpenMM::Vec3>& forces, 
-            double* totalEnergy, ReferenceBondIxn& referenceBondIxn);
+            double* totalEnergy, ReferenceBondIxn& referenceBondIxn, bool includeForces);
+    /**
+     * Compute the forces from all bonds, using a different ReferenceBondIxn for each thread.  This is needed when
+     * the interaction cannot safely be evaluated by several threads at once, for example because it evaluates
+     * CompiledExpressions.
+     * 
+     * @param threadBondIxns     the ReferenceBondIxn to use for each thread
+     * @param energyParamDerivs  the derivatives of the energy with respect to global parameters are added to this.
+     *                           Each thread accumulates its own values, which are then summed.
+     * @param includeForces      if false, only the energy and its derivatives are computed and forces is left unchanged
+     */
+    void calculateForce(std::vector<OpenMM::Vec3>& atomCoordinates, double** parameters, std::vector<OpenMM::Vec3>& forces, 
+            double* totalEnergy, std::vector<ReferenceBondIxn*>& threadBondIxns, std::vector<double>& energyParamDerivs, bool includeForces);
     /**
      * This routine contains the code executed by each thread.
      */
     void threadComputeForce(ThreadPool& threads, int threadIndex, std::vector<OpenMM::Vec3>& atomCoordinates, double** parameters,
-            std::vector<OpenMM::Vec3>& forces, double* totalEnergy, ReferenceBondIxn& referenceBondIxn);
+            std::vector<OpenMM::Vec3>& forces, double* totalEnergy, ReferenceBondIxn& referenceBondIxn, double* energyParamDerivs);
+    /**
+     * Get the bonds assigned to a thread.  No two threads are assigned bonds that share an atom, so the threads
+     * can compute their bonds at the same time.
+     */
+    const std::vector<int>& getThreadBonds(int threadIndex) const {
+        return threadBonds[threadIndex];
+    }
+    /**
+     * Get the bonds that could not be assigned to any thread.  These must be computed after all the threads finish.
+     */
+    const std::vector<int>& getExtraBonds() const {
+        return extraBonds;
+    }
 private:
     bool canAssignBond(int bond, int thread, std::vector<int>& atomThread);
     void assignBond(int bond, int thread, std::vector<int>& atomThread, std::vector<int>& bondThread, std::vector<std::set<int> >& atomBonds, std::list<int>& candidateBonds);
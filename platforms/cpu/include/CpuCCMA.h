@@ -0,0 +1,108 @@
+#ifndef OPENMM_CPUCCMA_H_
+#define OPENMM_CPUCCMA_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2018 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "ReferenceCCMAAlgorithm.h"
+#include "windowsExportCpu.h"
+#include "openmm/System.h"
+#include "openmm/internal/ThreadPool.h"
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * This class implements the CCMA algorithm in parallel.  Constraints are divided into clusters of
+ * constraints that share atoms.  The inverse coupling matrix is block diagonal in the clusters, so each
+ * one can be solved independently.  Small clusters are distributed between threads, with each one being
+ * solved by a single thread.  Large clusters (such as a protein backbone with all bonds constrained) are
+ * solved by all threads together, splitting the matrix multiplication and position updates between them.
+ */
+class OPENMM_EXPORT_CPU CpuCCMA : public ReferenceConstraintAlgorithm {
+public:
+    CpuCCMA(const System& system, const ReferenceCCMAAlgorithm& ccma, ThreadPool& threads);
+
+    /**
+     * Apply the constraint algorithm.
+     * 
+     * @param atomCoordinates  the original atom coordinates
+     * @param atomCoordinatesP the new atom coordinates
+     * @param inverseMasses    1/mass
+     * @param tolerance        the constraint tolerance
+     */
+    void apply(std::vector<OpenMM::Vec3>& atomCoordinates, std::vector<OpenMM::Vec3>& atomCoordinatesP, std::vector<double>& inverseMasses, double tolerance);
+
+    /**
+     * Apply the constraint algorithm to velocities.
+     * 
+     * @param atomCoordinates  the atom coordinates
+     * @param atomCoordinatesP the velocities to modify
+     * @param inverseMasses    1/mass
+     * @param tolerance        the constraint tolerance
+     */
+    void applyToVelocities(std::vector<OpenMM::Vec3>& atomCoordinates, std::vector<OpenMM::Vec3>& velocities, std::vector<double>& inverseMasses, double tolerance);
+private:
+    void applyConstraints(std::vector<OpenMM::Vec3>& atomCoordinates, std::vector<OpenMM::Vec3>& atomCoordinatesP,
+            std::vector<double>& inverseMasses, bool constrainingVelocities, double tolerance);
+    /**
+     * Solve a cluster on the calling thread.
+     */
+    void solveCluster(int cluster, std::vector<OpenMM::Vec3>& atomCoordinates, std::vector<OpenMM::Vec3>& atomCoordinatesP,
+            std::vector<double>& inverseMasses, bool constrainingVelocities, double tolerance);
+    /**
+     * Solve one of the large clusters using all threads.
+     */
+    void solveClusterInParallel(int largeCluster, std::vector<OpenMM::Vec3>& atomCoordinates, std::vector<OpenMM::Vec3>& atomCoordinatesP,
+            std::vector<double>& inverseMasses, bool constrainingVelocities, double tolerance);
+    void computeDisplacements(int start, int end, std::vector<OpenMM::Vec3>& atomCoordinates);
+    int computeConstraintDeltas(int start, int end, std::vector<OpenMM::Vec3>& atomCoordinatesP, bool constrainingVelocities, double tolerance);
+    void multiplyByMatrix(int start, int end);
+    ThreadPool& threads;
+    int numConstraints, maxIterations;
+    bool hasInitializedMasses;
+    std::vector<int> atom1, atom2;
+    std::vector<double> distance, reducedMasses, d_ij2, constraintDelta, tempDelta;
+    std::vector<OpenMM::Vec3> r_ij;
+    // Constraints are sorted so that each cluster occupies a contiguous range.
+    std::vector<int> clusterStart;
+    // The inverse coupling matrix in CSR format.
+    std::vector<int> matrixRowStart, matrixColIndex;
+    std::vector<double> matrixValue;
+    // Small clusters are grouped into blocks that are processed by a single thread.
+    std::vector<int> smallClusters, blockStart;
+    // For each large cluster, the atoms it contains and the constraints involving each atom.
+    std::vector<int> largeClusters, largeClusterAtomStart, clusterAtoms, atomConstraintStart, atomConstraints;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_CPUCCMA_H_*/
@@ -0,0 +1,101 @@
+
+/* Portions copyright (c) 2018 Stanford University and Simbios.
+ * Authors: Peter Eastman
+ * Contributors: 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __CPU_CMAP_TORSION_IXN_H__
+#define __CPU_CMAP_TORSION_IXN_H__
+
+#include "ReferenceBondIxn.h"
+#include "ReferenceForce.h"
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * This class computes a single CMAP torsion pair, so it can be used with CpuBondForce.  It
+ * differs from ReferenceCMAPTorsionIxn in storing the spline coefficients for all maps in a
+ * single packed array, with the 16 coefficients for each patch stored contiguously.  It can
+ * also compute four torsion pairs at once, evaluating their splines with SIMD instructions.
+ */
+class CpuCMAPTorsionIxn : public ReferenceBondIxn {
+public:
+    /**
+     * Constructor.
+     *
+     * @param coeff       the spline coefficients for all maps.  Patch p of map m starts at element mapOffset[m]+16*p.
+     * @param mapOffset   the index within coeff of the first coefficient for each map
+     * @param mapSize     the number of grid points along each axis of each map
+     */
+    CpuCMAPTorsionIxn(const std::vector<float>& coeff, const std::vector<int>& mapOffset, const std::vector<int>& mapSize);
+
+    /**
+     * Set the force to use periodic boundary conditions.
+     *
+     * @param vectors    the vectors defining the periodic box
+     */
+    void setPeriodic(OpenMM::Vec3* vectors);
+
+    /**
+     * Calculate the interaction for one torsion pair.
+     *
+     * @param atomIndices      the eight atoms forming the two torsions
+     * @param atomCoordinates  atom coordinates
+     * @param parameters       parameters: parameters[0] = the index of the map to use
+     * @param forces           force array (forces added)
+     * @param totalEnergy      if not null, the energy will be added to this
+     */
+    void calculateBondIxn(int* atomIndices, std::vector<OpenMM::Vec3>& atomCoordinates,
+                          double* parameters, std::vector<OpenMM::Vec3>& forces,
+                          double* totalEnergy, double* energyParamDerivs);
+
+    /**
+     * Calculate the interactions for four torsion pairs.
+     *
+     * @param atomIndices      atomIndices[i] holds the eight atoms forming the i'th torsion pair
+     * @param atomCoordinates  atom coordinates
+     * @param parameters       parameters[i][0] = the index of the map to use for the i'th torsion pair
+     * @param forces           force array (forces added)
+     * @param totalEnergy      if not null, the energy will be added to this
+     */
+    void calculateBlockIxn(int** atomIndices, std::vector<OpenMM::Vec3>& atomCoordinates, double** parameters,
+                           std::vector<OpenMM::Vec3>& forces, double* totalEnergy);
+
+private:
+    /**
+     * Compute the two dihedral angles of a torsion pair, each in the range [0, 2*pi).  This also records the
+     * deltas and cross products needed by applyTorsionForce().
+     */
+    void computeAngles(int* atomIndices, std::vector<OpenMM::Vec3>& atomCoordinates, double (*deltaA)[ReferenceForce::LastDeltaRIndex],
+                       double (*deltaB)[ReferenceForce::LastDeltaRIndex], double** cpA, double** cpB, double& angleA, double& angleB);
+    void applyTorsionForce(int* atoms, double dEdAngle, double (*delta)[ReferenceForce::LastDeltaRIndex], double** crossProduct, std::vector<OpenMM::Vec3>& forces) const;
+    const std::vector<float>& coeff;
+    const std::vector<int>& mapOffset;
+    const std::vector<int>& mapSize;
+    bool usePeriodic;
+    Vec3 boxVectors[3];
+};
+
+} // namespace OpenMM
+
+#endif // __CPU_CMAP_TORSION_IXN_H__
@@ -0,0 +1,104 @@
+
+/* Portions copyright (c) 2018 Stanford University and Simbios.
+ * Authors: Peter Eastman
+ * Contributors: 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __CPU_CUSTOM_DYNAMICS_H__
+#define __CPU_CUSTOM_DYNAMICS_H__
+
+#include "ReferenceCustomDynamics.h"
+#include "CpuRandom.h"
+#include "openmm/internal/ThreadPool.h"
+#include <map>
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * This class extends ReferenceCustomDynamics to evaluate per-DOF computations in parallel.
+ * Each thread has its own copy of every per-DOF expression, bound to its own set of per-DOF
+ * variables, and processes a contiguous range of atoms.  Global variables and the values
+ * of other steps are shared between all the copies through the CompiledExpressionSet.
+ * The per-DOF inputs are gathered for blocks of atoms, and each block is evaluated with
+ * a single call to CompiledExpression::evaluateBatch().
+ */
+class CpuCustomDynamics : public ReferenceCustomDynamics {
+public:
+    /**
+     * Constructor.
+     *
+     * @param numberOfAtoms  number of atoms
+     * @param integrator     the integrator definition to use
+     * @param threads        thread pool for parallelizing computation
+     * @param random         random number generator
+     */
+    CpuCustomDynamics(int numberOfAtoms, const OpenMM::CustomIntegrator& integrator, OpenMM::ThreadPool& threads, OpenMM::CpuRandom& random);
+
+    /**
+     * Destructor.
+     */
+    ~CpuCustomDynamics();
+
+protected:
+    void initialize(OpenMM::ContextImpl& context, std::vector<double>& masses, std::map<std::string, double>& globals);
+
+    void computePerDof(int numberOfAtoms, std::vector<OpenMM::Vec3>& results, const std::vector<OpenMM::Vec3>& atomCoordinates,
+                  const std::vector<OpenMM::Vec3>& velocities, const std::vector<OpenMM::Vec3>& forces, const std::vector<double>& masses,
+                  const std::vector<std::vector<OpenMM::Vec3> >& perDof, const Lepton::CompiledExpression& expression);
+
+    double computeSum(int numberOfAtoms, const std::vector<OpenMM::Vec3>& atomCoordinates,
+                  const std::vector<OpenMM::Vec3>& velocities, const std::vector<OpenMM::Vec3>& forces, const std::vector<double>& masses,
+                  const std::vector<std::vector<OpenMM::Vec3> >& perDof, const Lepton::CompiledExpression& expression);
+
+private:
+    class ThreadData;
+    /**
+     * Information about a per-DOF expression that is shared by all the thread copies.
+     */
+    struct ExpressionInfo {
+        bool needsGaussian, needsUniform;
+        std::vector<int> perDofVariables;
+    };
+    void launch(int numberOfAtoms, OpenMM::Vec3* results, const std::vector<OpenMM::Vec3>& atomCoordinates,
+                const std::vector<OpenMM::Vec3>& velocities, const std::vector<OpenMM::Vec3>& forces, const std::vector<double>& masses,
+                const std::vector<std::vector<OpenMM::Vec3> >& perDof, const Lepton::CompiledExpression& expression);
+    void threadComputePerDof(int threadIndex);
+    OpenMM::ThreadPool& threads;
+    OpenMM::CpuRandom& random;
+    std::vector<ThreadData*> threadData;
+    std::vector<ExpressionInfo> expressionInfo;
+    std::map<const Lepton::CompiledExpression*, int> expressionIndex;
+    std::vector<double> threadSum;
+    // The following variables are used to make information accessible to the individual threads.
+    int numberOfAtoms, currentExpression;
+    OpenMM::Vec3* results;
+    const OpenMM::Vec3* atomCoordinates;
+    const OpenMM::Vec3* velocities;
+    const OpenMM::Vec3* forces;
+    const double* masses;
+    const std::vector<std::vector<OpenMM::Vec3> >* perDof;
+};
+
+} // namespace OpenMM
+
+#endif // __CPU_CUSTOM_DYNAMICS_H__
@@ -0,0 +1,207 @@
+
+/* Portions copyright (c) 2018 Stanford University and Simbios.
+ * Authors: Peter Eastman
+ * Contributors: 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef OPENMM_CPU_CUSTOM_HBOND_FORCE_H__
+#define OPENMM_CPU_CUSTOM_HBOND_FORCE_H__
+
+#include "AlignedArray.h"
+#include "CpuNeighborList.h"
+#include "ReferenceForce.h"
+#include "openmm/CustomHbondForce.h"
+#include "openmm/internal/CompiledExpressionSet.h"
+#include "openmm/internal/ThreadPool.h"
+#include "lepton/CompiledExpression.h"
+#include "lepton/ParsedExpression.h"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * This class computes a CustomHbondForce on the CPU.  When a cutoff is used, the candidate donor-acceptor
+ * pairs are found with a CpuNeighborList built from the primary atom of each donor and acceptor, so the
+ * cost scales linearly with the size of the system.  Donors are divided between threads, each of which
+ * has its own copy of the compiled expressions.
+ */
+class CpuCustomHbondForce {
+private:
+
+    class DistanceTermInfo;
+    class AngleTermInfo;
+    class DihedralTermInfo;
+    class ThreadData;
+    int numDonors, numAcceptors;
+    bool useCutoff, usePeriodic;
+    double cutoffDistance;
+    Vec3 periodicBoxVectors[3];
+    CpuNeighborList* neighborList;
+    ThreadPool& threads;
+    std::vector<std::vector<int> > donorAtoms, acceptorAtoms;
+    std::vector<std::set<int> > exclusions;
+    std::vector<std::vector<int> > donorNeighbors;
+    AlignedArray<float> groupPositions;
+    std::vector<std::set<int> > groupExclusions;
+    std::vector<ThreadData*> threadData;
+    // The following variables are used to make information accessible to the individual threads.
+    std::vector<Vec3>* atomCoordinates;
+    double** donorParameters;
+    double** acceptorParameters;
+    const std::map<std::string, double>* globalParameters;
+    std::vector<AlignedArray<float> >* threadForce;
+    bool includeForces, includeEnergy;
+    void* atomicCounter;
+
+    /**
+     * Find the acceptors each donor might interact with.  This is only used when a cutoff is applied.
+     */
+    void findNeighbors(std::vector<Vec3>& atomCoordinates);
+
+    /**
+     * This routine contains the code executed by each thread.
+     */
+    void threadComputeForce(ThreadPool& threads, int threadIndex);
+
+    /**
+     * Calculate the interaction between a donor and an acceptor.
+     *
+     * @param donor     the index of the donor
+     * @param acceptor  the index of the acceptor
+     * @param forces    force array (forces added)
+     * @param data      information and workspace for the current thread
+     */
+    void calculateOneIxn(int donor, int acceptor, float* forces, ThreadData& data);
+
+    /**
+     * Compute the displacement between two atoms, optionally using periodic boundary conditions.
+     */
+    void computeDelta(int atom1, int atom2, double* delta) const;
+
+    static double computeAngle(double* vec1, double* vec2);
+
+public:
+    /**
+     * Create a new CpuCustomHbondForce.
+     *
+     * @param force      the CustomHbondForce to create it for
+     * @param threads    the thread pool to use
+     */
+    CpuCustomHbondForce(const OpenMM::CustomHbondForce& force, ThreadPool& threads);
+
+    ~CpuCustomHbondForce();
+
+    /**
+     * Set the force to use a cutoff.
+     * 
+     * @param distance   the cutoff distance
+     */
+    void setUseCutoff(double distance);
+
+    /**
+     * Set the force to use periodic boundary conditions.  This requires that a cutoff has
+     * already been set, and the smallest side of the periodic box is at least twice the cutoff
+     * distance.
+     * 
+     * @param periodicBoxVectors    the vectors defining the periodic box
+     */
+    void setPeriodic(Vec3* periodicBoxVectors);
+
+    /**
+     * Get the list of atoms for each donor group.
+     */
+    const std::vector<std::vector<int> >& getDonorAtoms() const {
+        return donorAtoms;
+    }
+
+    /**
+     * Get the list of atoms for each acceptor group.
+     */
+    const std::vector<std::vector<int> >& getAcceptorAtoms() const {
+        return acceptorAtoms;
+    }
+
+    /**
+     * Calculate the interaction.
+     * 
+     * @param atomCoordinates    atom coordinates
+     * @param donorParameters    donor parameter values (donorParameters[donorIndex][parameterIndex])
+     * @param acceptorParameters acceptor parameter values (acceptorParameters[acceptorIndex][parameterIndex])
+     * @param globalParameters   the values of global parameters
+     * @param threadForce        the collection of arrays for each thread to add forces to
+     * @param includeForces      whether to compute forces
+     * @param includeEnergy      whether to compute energy
+     * @param energy             the total energy is added to this
+     */
+    void calculateIxn(std::vector<Vec3>& atomCoordinates, double** donorParameters, double** acceptorParameters,
+                      const std::map<std::string, double>& globalParameters, std::vector<AlignedArray<float> >& threadForce,
+                      bool includeForces, bool includeEnergy, double& energy);
+};
+
+class CpuCustomHbondForce::DistanceTermInfo {
+public:
+    int p1, p2, variableIndex;
+    Lepton::CompiledExpression forceExpression;
+    double delta[ReferenceForce::LastDeltaRIndex];
+    DistanceTermInfo(const std::string& name, const std::vector<int>& atoms, const Lepton::CompiledExpression& forceExpression, ThreadData& data);
+};
+
+class CpuCustomHbondForce::AngleTermInfo {
+public:
+    int p1, p2, p3, variableIndex;
+    Lepton::CompiledExpression forceExpression;
+    double delta1[ReferenceForce::LastDeltaRIndex];
+    double delta2[ReferenceForce::LastDeltaRIndex];
+    AngleTermInfo(const std::string& name, const std::vector<int>& atoms, const Lepton::CompiledExpression& forceExpression, ThreadData& data);
+};
+
+class CpuCustomHbondForce::DihedralTermInfo {
+public:
+    int p1, p2, p3, p4, variableIndex;
+    Lepton::CompiledExpression forceExpression;
+    double delta1[ReferenceForce::LastDeltaRIndex];
+    double delta2[ReferenceForce::LastDeltaRIndex];
+    double delta3[ReferenceForce::LastDeltaRIndex];
+    double cross1[3];
+    double cross2[3];
+    DihedralTermInfo(const std::string& name, const std::vector<int>& atoms, const Lepton::CompiledExpression& forceExpression, ThreadData& data);
+};
+
+class CpuCustomHbondForce::ThreadData {
+public:
+    CompiledExpressionSet expressionSet;
+    Lepton::CompiledExpression energyExpression;
+    std::vector<int> donorParamIndices, acceptorParamIndices;
+    std::vector<DistanceTermInfo> distanceTerms;
+    std::vector<AngleTermInfo> angleTerms;
+    std::vector<DihedralTermInfo> dihedralTerms;
+    double energy;
+    ThreadData(const CustomHbondForce& force, Lepton::ParsedExpression& energyExpr, std::map<std::string, std::vector<int> >& distances,
+            std::map<std::string, std::vector<int> >& angles, std::map<std::string, std::vector<int> >& dihedrals);
+};
+
+} // namespace OpenMM
+
+#endif // OPENMM_CPU_CUSTOM_HBOND_FORCE_H__
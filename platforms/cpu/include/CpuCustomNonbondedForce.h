@@ -168,6 +168,19 @@ private:
      */
     void calculateOneIxn(int atom1, int atom2, ThreadData& data, float* forces, double& totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize);
 
+    /**
+     * Calculate the interactions between one atom and a set of others.  The displacements, distances,
+     * and parameters for the interactions must already have been stored in the batch arrays of the
+     * ThreadData.  The expressions are evaluated for all of them with a single call.
+     * 
+     * @param atom1            the index of the first atom
+     * @param numInteractions  the number of interactions stored in the batch arrays
+     * @param data             workspace for the current thread
+     * @param forces           force array (forces added)
+     * @param totalEnergy      total energy
+     */
+    void calculateBatchIxn(int atom1, int numInteractions, ThreadData& data, float* forces, double& totalEnergy);
+
     /**
      * Compute the displacement and squared distance between two points, optionally using
      * periodic boundary conditions.
@@ -186,6 +199,16 @@ public:
     std::vector<double> particleParam;
     double r;
     std::vector<double> energyParamDerivs; 
+    /**
+     * Make sure the batch arrays can hold at least the specified number of interactions.
+     */
+    void resizeBatch(int size);
+    // The following arrays hold a batch of interactions to be evaluated together.
+    std::vector<int> batchAtom;
+    AlignedArray<fvec4> batchDelta;
+    std::vector<double> batchR, batchForce, batchEnergy, batchEnergyParamDerivs;
+    std::vector<std::vector<double> > batchParam;
+    std::vector<const double*> batchValues;
 };
 
 } // namespace OpenMM
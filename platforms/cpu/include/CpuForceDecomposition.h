@@ -0,0 +1,138 @@
+#ifndef OPENMM_CPU_FORCE_DECOMPOSITION_H_
+#define OPENMM_CPU_FORCE_DECOMPOSITION_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2018 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "AlignedArray.h"
+#include "CpuNeighborList.h"
+#include "windowsExportCpu.h"
+#include "openmm/Vec3.h"
+#include "openmm/internal/ThreadPool.h"
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * This class decides how the per-thread force buffers are summed at the end of a force computation.
+ *
+ * When a neighbor list is available, the blocks of the neighbor list are divided into contiguous ranges along
+ * the Hilbert curve used to sort them, and each thread is assigned one range.  A thread that only computes
+ * interactions for its own blocks writes the forces on its own atoms, plus a halo of neighboring atoms owned
+ * by other threads.  Summing the buffers then only requires each thread to read its own atoms plus the halo
+ * entries other threads have written for them, so the cost scales with the surface area of each thread's region
+ * instead of with the number of threads times the number of atoms.
+ *
+ * Any code that writes to arbitrary elements of a thread's buffer must call markDense() for that thread.  If the
+ * decomposition is not enabled, every buffer is treated as dense.  The buffers are cleared as they are summed, so
+ * they are always zero at the start of a computation.
+ */
+class OPENMM_EXPORT_CPU CpuForceDecomposition {
+public:
+    CpuForceDecomposition(int numThreads);
+    /**
+     * Set whether the decomposition is enabled.  It should only be enabled if every force in the System either
+     * does not use the per-thread buffers, or uses them as described above.
+     */
+    void setEnabled(bool enabled);
+    /**
+     * Get whether the decomposition is enabled.
+     */
+    bool isEnabled() const {
+        return enabled;
+    }
+    /**
+     * Get whether threads should restrict themselves to the blocks assigned to them by getThreadBlockRange().
+     * This is true if the decomposition is enabled and update() has been called.
+     */
+    bool isActive() const {
+        return (enabled && neighborList != NULL);
+    }
+    /**
+     * Divide the blocks of a neighbor list between threads.  This must be called every time the neighbor list
+     * is rebuilt.
+     *
+     * @param neighborList   the neighbor list whose blocks should be divided
+     * @param numAtoms       the number of atoms in the System
+     * @param threads        the thread pool that will be used to compute forces
+     */
+    void update(const CpuNeighborList& neighborList, int numAtoms, ThreadPool& threads);
+    /**
+     * Get the range of neighbor list blocks assigned to a thread.
+     *
+     * @param threadIndex    the index of the thread
+     * @param start          on exit, the index of the first block assigned to the thread
+     * @param end            on exit, one past the index of the last block assigned to the thread
+     */
+    void getThreadBlockRange(int threadIndex, int& start, int& end) const;
+    /**
+     * Get the range of indices into the neighbor list's sorted atoms that are owned by a thread.
+     *
+     * @param threadIndex    the index of the thread
+     * @param start          on exit, the first index owned by the thread
+     * @param end            on exit, one past the last index owned by the thread
+     */
+    void getThreadAtomRange(int threadIndex, int& start, int& end) const;
+    /**
+     * Record that a thread's buffer may contain nonzero forces for any atom.  This remains in effect until
+     * the next call to sumForces().
+     */
+    void markDense(int threadIndex);
+    /**
+     * Record that every thread's buffer may contain nonzero forces for any atom.
+     */
+    void markAllDense();
+    /**
+     * Add the forces from all the per-thread buffers to an array, then clear the buffers.
+     *
+     * @param threadForce    the per-thread force buffers
+     * @param forces         the forces are added to this
+     * @param threads        the thread pool to use
+     */
+    void sumForces(std::vector<AlignedArray<float> >& threadForce, std::vector<Vec3>& forces, ThreadPool& threads);
+    /**
+     * Clear every element of every per-thread buffer.  This is used to recover if a computation was interrupted
+     * before the buffers could be summed.
+     */
+    void clearForces(std::vector<AlignedArray<float> >& threadForce, ThreadPool& threads);
+private:
+    bool enabled;
+    const CpuNeighborList* neighborList;
+    int numAtoms;
+    std::vector<int> threadBlockStart;
+    std::vector<int> atomOwner;
+    std::vector<std::vector<std::vector<int> > > haloAtoms;
+    std::vector<char> isDense;
+};
+
+} // namespace OpenMM
+
+#endif // OPENMM_CPU_FORCE_DECOMPOSITION_H_
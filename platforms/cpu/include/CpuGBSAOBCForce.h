@@ -26,6 +26,7 @@
 #define OPENMM_CPU_GBSAOBC_FORCE_H__
 
 #include "AlignedArray.h"
+#include "CpuNeighborList.h"
 #include "openmm/internal/ThreadPool.h"
 #include "openmm/internal/vectorize.h"
 #include <set>
@@ -38,6 +39,8 @@ class CpuGBSAOBCForce {
 public:
     CpuGBSAOBCForce();
 
+    virtual ~CpuGBSAOBCForce();
+
     /**
      * Set the force to use a cutoff.
      * 
@@ -45,6 +48,14 @@ public:
      */
     void setUseCutoff(float distance);
 
+    /**
+     * Set the neighbor list to use for finding interacting pairs.  This requires that a cutoff has
+     * already been set.  The neighbor list may be shared with other forces; its exclusions are ignored.
+     *
+     * @param neighbors   the neighbor list to use
+     */
+    void setNeighborList(const CpuNeighborList& neighbors);
+
     /**
      * 
      * Set the force to use periodic boundary conditions.  This requires that a cutoff has
@@ -85,33 +96,73 @@ public:
      * Calculate LJ Coulomb pair ixn
      *
      * @param posq             atom coordinates and charges
-     * @param forces           force array (forces added)
+     * @param threadForce      per-thread force arrays (forces added)
+     * @param includeForces    whether to compute forces.  If false, the chain rule pass is skipped and
+     *                         threadForce is left unchanged.
      * @param totalEnergy      total energy
      * @param threads          the thread pool to use
      */
-    void computeForce(const AlignedArray<float>& posq, std::vector<AlignedArray<float> >& threadForce, double* totalEnergy, ThreadPool& threads);
+    void computeForce(const AlignedArray<float>& posq, std::vector<AlignedArray<float> >& threadForce, bool includeForces, double* totalEnergy, ThreadPool& threads);
+
+    /**
+     * Prepare to accumulate the Born radius sums as part of another force's pass over the neighbor list.  Call
+     * computeFusedBornSums() for every block of the list, and the next call to computeForce() then uses those
+     * sums instead of computing them itself.  This requires that a neighbor list has been set.
+     *
+     * @param posq             atom coordinates and charges
+     * @param threads          the thread pool the other force will use
+     */
+    void beginFusedBornSums(const float* posq, ThreadPool& threads);
+
+    /**
+     * Clear one thread's Born radius sums.  Each thread of the other force must call this before its first call
+     * to computeFusedBornSums(), even if it processes no blocks.
+     *
+     * @param threadIndex      the index of the calling thread
+     */
+    void clearFusedBornSums(int threadIndex);
+
+    /**
+     * Accumulate the Born radius sums for the interactions of one neighbor list block.  This is called by
+     * another force's threads after beginFusedBornSums().
+     *
+     * @param blockIndex       the index of the neighbor list block
+     * @param threadIndex      the index of the calling thread
+     * @param boxSize          the X, Y, and Z widths of the periodic box
+     * @param invBoxSize       the inverse widths of the periodic box
+     */
+    void computeFusedBornSums(int blockIndex, int threadIndex, const fvec4& boxSize, const fvec4& invBoxSize);
 
     /**
      * This routine contains the code executed by each thread.
      */
     void threadComputeForce(ThreadPool& threads, int threadIndex);
 
-private:
+    /**
+     * This routine contains the code executed by each thread when a neighbor list is used.
+     */
+    void threadComputeForceWithNeighborList(ThreadPool& threads, int threadIndex);
+
+protected:
     bool cutoff;
     bool periodic;
+    bool hasFusedBornSums, useFusedBornSums;
     float periodicBoxSize[3];
     float cutoffDistance, soluteDielectric, solventDielectric, surfaceAreaFactor;
     std::vector<std::pair<float, float> > particleParams;        
     AlignedArray<float> bornRadii;
     std::vector<AlignedArray<float> > threadBornForces;
     AlignedArray<float> obcChain;
+    AlignedArray<float> scaledBornForces;
+    std::vector<int> sortedIndex;
+    const CpuNeighborList* neighborList;
     std::vector<double> threadEnergy;
     std::vector<float> logTable;
     float logDX, logDXInv;
     // The following variables are used to make information accessible to the individual threads.
     float const* posq;
     std::vector<AlignedArray<float> >* threadForce;
-    bool includeEnergy;
+    bool includeForces, includeEnergy;
     void* atomicCounter;
   
     static const int NUM_TABLE_POINTS;
@@ -128,6 +179,52 @@ private:
      * Evaluate log(x) using a lookup table for speed.
      */
     fvec4 fastLog(const fvec4& x);
+
+    /**
+     * Record where each atom appears in the neighbor list.
+     */
+    void findSortedIndices();
+
+    /**
+     * Compute the Born radius and chain rule factor for an atom from its accumulated sum.
+     */
+    void computeBornRadius(int atom, float sum);
+
+    /**
+     * Compute this thread's share of the ACE surface area term, and initialize its Born forces with it.
+     */
+    double computeSurfaceArea(int threadIndex);
+
+    /**
+     * Get which of four consecutive atoms in a neighbor list block interact with one of the block's neighbors.
+     */
+    ivec4 getNeighborMask(int blockIndex, int firstLane, int numInBlock, int neighbor) const;
+
+    /**
+     * Compute the contribution of atom J to the Born radius sum of atom I.
+     */
+    fvec4 computeBornSumTerm(const fvec4& offsetRadiusI, const fvec4& scaledRadiusJ, const fvec4& r, const fvec4& rInverse, ivec4 include);
+
+    /**
+     * Compute the derivative of atom I's Born radius sum with respect to its distance from atom J (times r).
+     */
+    fvec4 computeChainRuleTerm(const fvec4& offsetRadiusI, const fvec4& scaledRadiusJ, const fvec4& r, const fvec4& r2Inverse, ivec4 include);
+
+    /**
+     * Accumulate the Born radius sums for the interactions of one neighbor list block.
+     */
+    virtual void computeNeighborBornSums(int blockIndex, float* sums, const fvec4& boxSize, const fvec4& invBoxSize);
+
+    /**
+     * Compute the Born energy, and its derivatives with respect to positions and Born radii, for the
+     * interactions of one neighbor list block.
+     */
+    void computeNeighborBornEnergy(int blockIndex, float* forces, float* bornForces, double& energy, const fvec4& boxSize, const fvec4& invBoxSize);
+
+    /**
+     * Apply the chain rule forces for the interactions of one neighbor list block.
+     */
+    virtual void computeNeighborChainRule(int blockIndex, float* forces, const fvec4& boxSize, const fvec4& invBoxSize);
 };
 
 } // namespace OpenMM
@@ -0,0 +1,95 @@
+/* Portions copyright (c) 2006-2017 Stanford University and Simbios.
+ * Contributors: Pande Group
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef OPENMM_CPU_GBSAOBC_FORCE_VEC8_H__
+#define OPENMM_CPU_GBSAOBC_FORCE_VEC8_H__
+
+#include "CpuGBSAOBCForce.h"
+
+#ifdef __AVX__
+
+#include "openmm/internal/vectorize8.h"
+
+// ---------------------------------------------------------------------------------------
+
+namespace OpenMM {
+
+/**
+ * This version of CpuGBSAOBCForce evaluates the Born radius sums and the chain rule terms for eight
+ * atoms of a neighbor list block at once.  It requires a neighbor list whose block size is a multiple of 8.
+ */
+class CpuGBSAOBCForceVec8 : public CpuGBSAOBCForce {
+public:
+    CpuGBSAOBCForceVec8();
+
+protected:
+    /**
+     * Accumulate the Born radius sums for the interactions of one neighbor list block.
+     */
+    void computeNeighborBornSums(int blockIndex, float* sums, const fvec4& boxSize, const fvec4& invBoxSize);
+
+    /**
+     * Apply the chain rule forces for the interactions of one neighbor list block.
+     */
+    void computeNeighborChainRule(int blockIndex, float* forces, const fvec4& boxSize, const fvec4& invBoxSize);
+
+private:
+    /**
+     * Load the positions and parameters of eight consecutive atoms in a neighbor list block.
+     */
+    void loadBlockAtoms(const int* atoms, fvec8& x, fvec8& y, fvec8& z, fvec8& offsetRadius, fvec8& scaledRadius) const;
+
+    /**
+     * Get which of eight consecutive atoms in a neighbor list block interact with one of the block's neighbors.
+     */
+    ivec8 getNeighborMask(int blockIndex, int firstLane, int numInBlock, int neighbor) const;
+
+    /**
+     * Compute the displacement and squared distance between a collection of points, optionally using
+     * periodic boundary conditions.
+     */
+    void getDeltaR(const fvec4& posI, const fvec8& x, const fvec8& y, const fvec8& z, fvec8& dx, fvec8& dy, fvec8& dz, fvec8& r2, const fvec4& boxSize, const fvec4& invBoxSize) const;
+
+    /**
+     * Evaluate log(x) using a lookup table for speed.
+     */
+    fvec8 fastLog(const fvec8& x) const;
+
+    /**
+     * Compute the contribution of atom J to the Born radius sum of atom I.
+     */
+    fvec8 computeBornSumTerm(const fvec8& offsetRadiusI, const fvec8& scaledRadiusJ, const fvec8& r, const fvec8& rInverse, ivec8 include) const;
+
+    /**
+     * Compute the derivative of atom I's Born radius sum with respect to its distance from atom J (times r).
+     */
+    fvec8 computeChainRuleTerm(const fvec8& offsetRadiusI, const fvec8& scaledRadiusJ, const fvec8& r, const fvec8& r2Inverse, ivec8 include) const;
+};
+
+} // namespace OpenMM
+
+// ---------------------------------------------------------------------------------------
+
+#endif // __AVX__
+
+#endif // OPENMM_CPU_GBSAOBC_FORCE_VEC8_H__
@@ -37,6 +37,7 @@
 #include "windowsExportCpu.h"
 #include "openmm/internal/gmx_atomic.h"
 #include "openmm/internal/ThreadPool.h"
+#include <cstdint>
 #include <set>
 #include <utility>
 #include <vector>
@@ -47,24 +48,40 @@ class OPENMM_EXPORT_CPU CpuNeighborList {
 public:
     class Voxels;
     CpuNeighborList(int blockSize);
+    ~CpuNeighborList();
     void computeNeighborList(int numAtoms, const AlignedArray<float>& atomLocations, const std::vector<std::set<int> >& exclusions,
             const Vec3* periodicBoxVectors, bool usePeriodic, float maxDistance, ThreadPool& threads);
+    /**
+     * Rebuild the neighbor list after atoms have moved.  This takes the same arguments as computeNeighborList().
+     * If the box, cutoff, and number of atoms are unchanged since the last build and no atom has moved too far,
+     * it reuses the existing voxels and block ordering, and only re-bins the atoms that have moved into a different
+     * voxel.  Otherwise it falls back to building the list from scratch.
+     */
+    void updateNeighborList(int numAtoms, const AlignedArray<float>& atomLocations, const std::vector<std::set<int> >& exclusions,
+            const Vec3* periodicBoxVectors, bool usePeriodic, float maxDistance, ThreadPool& threads);
     int getNumBlocks() const;
     int getBlockSize() const;
     const std::vector<int>& getSortedAtoms() const;
     const std::vector<int>& getBlockNeighbors(int blockIndex) const;
-    const std::vector<char>& getBlockExclusions(int blockIndex) const;
+    /**
+     * Get the exclusion flags for the neighbors of a block.  Bit i of each element is set if the neighbor should not
+     * interact with atom i of the block.  Blocks may contain up to 16 atoms.
+     */
+    const std::vector<int16_t>& getBlockExclusions(int blockIndex) const;
     /**
      * This routine contains the code executed by each thread.
      */
     void threadComputeNeighborList(ThreadPool& threads, int threadIndex);
     void runThread(int index);
 private:
+    void threadFindBlockNeighbors();
+    void excludePaddingAtoms();
     int blockSize;
     std::vector<int> sortedAtoms;
     std::vector<float> sortedPositions;
+    std::vector<float> builtPositions;
     std::vector<std::vector<int> > blockNeighbors;
-    std::vector<std::vector<char> > blockExclusions;
+    std::vector<std::vector<int16_t> > blockExclusions;
     // The following variables are used to make information accessible to the individual threads.
     float minx, maxx, miny, maxy, minz, maxz;
     std::vector<std::pair<int, int> > atomBins;
@@ -75,6 +92,8 @@ private:
     int numAtoms;
     bool usePeriodic;
     float maxDistance;
+    int numIncrementalUpdates;
+    std::vector<std::vector<int> > threadMovedAtoms;
     gmx_atomic_t atomicCounter;
 };
 
@@ -26,6 +26,8 @@
 #define OPENMM_CPU_NONBONDED_FORCE_H__
 
 #include "AlignedArray.h"
+#include "CpuForceDecomposition.h"
+#include "CpuGBSAOBCForce.h"
 #include "CpuNeighborList.h"
 #include "ReferencePairIxn.h"
 #include "openmm/internal/ThreadPool.h"
@@ -124,6 +126,38 @@ class CpuNonbondedForce {
 
       void setUseLJPME(float alpha, int meshSize[3]);
 
+      /**---------------------------------------------------------------------------------------
+
+         Set the B-spline interpolation order used for PME and LJPME.  The default is 5.
+
+         @param order    the interpolation order
+
+         --------------------------------------------------------------------------------------- */
+
+      void setPMEInterpolationOrder(int order);
+
+      /**---------------------------------------------------------------------------------------
+
+         Set the decomposition that determines which neighbor list blocks each thread processes.
+         If this is NULL, blocks are distributed between threads dynamically.
+
+         @param decomposition    the decomposition to use, or NULL
+
+         --------------------------------------------------------------------------------------- */
+
+      void setForceDecomposition(const CpuForceDecomposition* decomposition);
+
+      /**---------------------------------------------------------------------------------------
+
+         Set a GBSAOBCForce whose Born radius sums should be accumulated while computing the direct
+         space interactions.  It must use the same cutoff and neighbor list as this force.
+
+         @param gbsa    the force to compute the sums for, or NULL
+
+         --------------------------------------------------------------------------------------- */
+
+      void setFusedGBSAOBC(CpuGBSAOBCForce* gbsa);
+
       /**---------------------------------------------------------------------------------------
       
          Calculate Ewald ixn
@@ -154,14 +188,16 @@ class CpuNonbondedForce {
          @param atomParameters   atom parameters (sigma/2, 2*sqrt(epsilon))
          @param exclusions       atom exclusion indices
                                  exclusions[atomIndex] contains the list of exclusions for that atom
-         @param forces           force array (forces added)
+         @param threadForce      per-thread force arrays (forces added)
+         @param includeForces    whether to compute forces.  If false, only the energy is computed and
+                                 threadForce is left unchanged.
          @param totalEnergy      total energy
          @param threads          the thread pool to use
       
          --------------------------------------------------------------------------------------- */
           
       void calculateDirectIxn(int numberOfAtoms, float* posq, const std::vector<Vec3>& atomCoordinates, const std::vector<std::pair<float, float> >& atomParameters,
-            const std::vector<float>& C6params, const std::vector<std::set<int> >& exclusions, std::vector<AlignedArray<float> >& threadForce, double* totalEnergy, ThreadPool& threads);
+            const std::vector<float>& C6params, const std::vector<std::set<int> >& exclusions, std::vector<AlignedArray<float> >& threadForce, bool includeForces, double* totalEnergy, ThreadPool& threads);
 
     /**
      * This routine contains the code executed by each thread.
@@ -177,6 +213,8 @@ protected:
         bool ljpme, pme;
         bool tableIsValid, expTableIsValid;
         const CpuNeighborList* neighborList;
+        const CpuForceDecomposition* decomposition;
+        CpuGBSAOBCForce* fusedGBSAOBC;
         float recipBoxSize[3];
         Vec3 periodicBoxVectors[3];
         AlignedArray<fvec4> periodicBoxVec4;
@@ -185,6 +223,7 @@ protected:
         float alphaEwald, alphaDispersionEwald;
         int numRx, numRy, numRz;
         int meshDim[3], dispersionMeshDim[3];
+        int pmeOrder;
         std::vector<float> erfcTable, ewaldScaleTable;
         std::vector<float> exptermsTable, dExptermsTable;
         float ewaldDX, ewaldDXInv, erfcDXInv, exptermsDX, exptermsDXInv;
@@ -197,7 +236,7 @@ protected:
         float const *C6params;
         std::set<int> const* exclusions;
         std::vector<AlignedArray<float> >* threadForce;
-        bool includeEnergy;
+        bool includeForces, includeEnergy;
         float inverseRcut6;
         float inverseRcut6Expterm;
         void* atomicCounter;
@@ -217,6 +256,20 @@ protected:
          --------------------------------------------------------------------------------------- */
           
       void calculateOneIxn(int atom1, int atom2, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize);
+
+      /**---------------------------------------------------------------------------------------
+
+         Subtract the reciprocal space interactions between an atom and the atoms it excludes.
+
+         @param atom             the index of the atom
+         @param ownedOnly        if true, apply forces only to this atom and process all of its exclusions;
+                                 otherwise apply forces to both atoms and process only exclusions with higher indices
+         @param forces           force array (forces added)
+         @param energy           the energy is subtracted from this
+
+         --------------------------------------------------------------------------------------- */
+
+      void subtractExclusions(int atom, bool ownedOnly, float* forces, double& energy, const fvec4& boxSize, const fvec4& invBoxSize);
             
       /**---------------------------------------------------------------------------------------
       
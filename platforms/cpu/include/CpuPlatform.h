@@ -33,6 +33,7 @@
  * -------------------------------------------------------------------------- */
 
 #include "AlignedArray.h"
+#include "CpuForceDecomposition.h"
 #include "CpuRandom.h"
 #include "CpuNeighborList.h"
 #include "ReferencePlatform.h"
@@ -42,6 +43,8 @@
 #include <map>
 
 namespace OpenMM {
+
+class CpuGBSAOBCForce;
     
 /**
  * This Platform subclass uses CPU implementations of the OpenMM kernels.
@@ -77,6 +80,30 @@ public:
         static const std::string key = "DeterministicForces";
         return key;
     }
+    /**
+     * This is the name of the parameter for selecting the padding (in nm) added to the cutoff when building
+     * the neighbor list.  It may be set to a distance, or to "auto" to have it adjusted at run time to minimize
+     * the time per step.  If it is empty (the default), or if "auto" is used with deterministic forces, a fixed
+     * padding chosen by the Forces is used.
+     */
+    static const std::string& CpuNeighborListPadding() {
+        static const std::string key = "NeighborListPadding";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for selecting the SIMD instruction set used by the vectorized kernels.
+     * It may be "SSE4.1", "AVX", "AVX512", or "auto" (the default) to use the widest one supported by the
+     * processor.  Requesting an instruction set the processor does not support is an error.  On processors
+     * that use NEON, "SSE4.1" refers to the equivalent 4 wide NEON kernels.
+     */
+    static const std::string& CpuInstructionSet() {
+        static const std::string key = "InstructionSet";
+        return key;
+    }
+    /**
+     * Get the width of the widest SIMD vectors supported by the processor: 4, 8, or 16.
+     */
+    static int getMaxVectorWidth();
     /**
      * We cannot use the standard mechanism for platform data, because that is already used by the superclass.
      * Instead, we maintain a table of ContextImpls to PlatformDatas.
@@ -89,7 +116,12 @@ private:
 
 class CpuPlatform::PlatformData {
 public:
-    PlatformData(int numParticles, int numThreads, bool deterministicForces);
+    /**
+     * Create a PlatformData.  If neighborListPadding is negative, the padding is chosen by the Forces that request
+     * a neighbor list, and if tunePadding is true it is then tuned at run time.  vectorWidth selects which vectorized
+     * kernels to use.
+     */
+    PlatformData(int numParticles, int numThreads, bool deterministicForces, double neighborListPadding, bool tunePadding, int vectorWidth);
     ~PlatformData();
     void requestNeighborList(double cutoffDistance, double padding, bool useExclusions, const std::vector<std::set<int> >& exclusionList);
     AlignedArray<float> posq;
@@ -99,9 +131,14 @@ public:
     CpuRandom random;
     std::map<std::string, std::string> propertyValues;
     CpuNeighborList* neighborList;
-    double cutoff, paddedCutoff;
-    bool anyExclusions, deterministicForces;
+    CpuForceDecomposition forceDecomposition;
+    double cutoff, paddedCutoff, neighborListPadding;
+    int vectorWidth;
+    bool anyExclusions, deterministicForces, tuneNeighborListPadding;
     std::vector<std::set<int> > exclusions;
+    // If this is not NULL, the NonbondedForce accumulates the Born radius sums for this GBSAOBCForce during its
+    // direct space pass over the neighbor list.
+    CpuGBSAOBCForce* fusedGBSAOBC;
 };
 
 } // namespace OpenMM
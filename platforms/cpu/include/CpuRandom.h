@@ -46,6 +46,11 @@ public:
     CpuRandom();
     ~CpuRandom();
     void initialize(int seed, int numThreads);
+    /**
+     * Restart every thread's generator from a new seed.  Unlike initialize(), this may be called
+     * repeatedly with different seeds.  initialize() must have been called first.
+     */
+    void setSeed(int seed);
     float getGaussianRandom(int threadIndex);
     float getUniformRandom(int threadIndex);
 private:
@@ -41,11 +41,16 @@
 namespace OpenMM {
 
 /**
- * This class uses multiple ReferenceSETTLEAlgorithm objects to execute the algorithm in parallel.
+ * This class executes the SETTLE algorithm in parallel.  Clusters are divided into groups that are
+ * processed with SIMD instructions, with one cluster per vector lane (4 with SSE or NEON, 8 with AVX).
+ * The groups in turn are divided into blocks which are distributed between threads.
  */
 class OPENMM_EXPORT_CPU CpuSETTLE : public ReferenceConstraintAlgorithm {
 public:
-    CpuSETTLE(const System& system, const ReferenceSETTLEAlgorithm& settle, ThreadPool& threads);
+    /**
+     * Create a CpuSETTLE.  If useVec8 is true, clusters are processed in groups of 8 with AVX instructions.
+     */
+    CpuSETTLE(const System& system, const ReferenceSETTLEAlgorithm& settle, ThreadPool& threads, bool useVec8);
     ~CpuSETTLE();
 
     /**
@@ -68,8 +73,15 @@ public:
      */
     void applyToVelocities(std::vector<OpenMM::Vec3>& atomCoordinates, std::vector<OpenMM::Vec3>& velocities, std::vector<double>& inverseMasses, double tolerance);
 private:
-    std::vector<ReferenceSETTLEAlgorithm*> threadSettle;
+    void applyToGroup(int group, std::vector<OpenMM::Vec3>& atomCoordinates, std::vector<OpenMM::Vec3>& atomCoordinatesP);
+    void applyToGroupVelocities(int group, std::vector<OpenMM::Vec3>& atomCoordinates, std::vector<OpenMM::Vec3>& velocities, std::vector<double>& inverseMasses);
     ThreadPool& threads;
+    int numClusters, groupWidth;
+    bool useVec8;
+    // Per-cluster parameters, padded to a multiple of groupWidth by repeating the last cluster.
+    std::vector<int> atom1, atom2, atom3;
+    std::vector<float> mass1, mass2, mass3, distance1, distance2;
+    std::vector<int> blockStart;
 };
 
 } // namespace OpenMM
@@ -0,0 +1,259 @@
+#ifndef OPENMM_CPUSETTLEVECTORIZED_H_
+#define OPENMM_CPUSETTLEVECTORIZED_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2018 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+// This file contains the SETTLE equations written in terms of a generic vector type, so the same code
+// can be compiled for fvec4 and fvec8.  Each vector lane processes one cluster.  All inputs and outputs
+// are stored in structure of arrays form: an argument holding a 3 component quantity points to
+// three consecutive blocks of L floats (x, y, then z), where L is the number of lanes in the vector.
+// All coordinates are relative to the original position of the cluster's atoms, so single precision
+// is sufficient.
+
+namespace OpenMM {
+
+/**
+ * Apply SETTLE to the positions of a group of clusters.
+ *
+ * @param m0      the mass of the first atom
+ * @param m1      the mass of the second atom
+ * @param m2      the mass of the third atom
+ * @param dist1   the distance between the first atom and the other two
+ * @param dist2   the distance between the second and third atoms
+ * @param b0      the original position of the second atom relative to the first one
+ * @param c0      the original position of the third atom relative to the first one
+ * @param xp0     on input, the displacement of the first atom.  On output, the constrained displacement.
+ * @param xp1     on input, the displacement of the second atom.  On output, the constrained displacement.
+ * @param xp2     on input, the displacement of the third atom.  On output, the constrained displacement.
+ */
+template <class FVEC>
+void settlePositionsVectorized(const float* m0, const float* m1, const float* m2, const float* dist1, const float* dist2,
+        const float* b0, const float* c0, float* xp0, float* xp1, float* xp2) {
+    const int L = sizeof(FVEC)/sizeof(float);
+    FVEC mass0(m0), mass1(m1), mass2(m2);
+    FVEC xb0(b0), yb0(b0+L), zb0(b0+2*L);
+    FVEC xc0(c0), yc0(c0+L), zc0(c0+2*L);
+    FVEC xp0x(xp0), xp0y(xp0+L), xp0z(xp0+2*L);
+    FVEC xp1x(xp1), xp1y(xp1+L), xp1z(xp1+2*L);
+    FVEC xp2x(xp2), xp2y(xp2+L), xp2z(xp2+2*L);
+
+    FVEC invTotalMass = 1.0f/(mass0+mass1+mass2);
+    FVEC xcom = (xp0x*mass0 + (xb0+xp1x)*mass1 + (xc0+xp2x)*mass2)*invTotalMass;
+    FVEC ycom = (xp0y*mass0 + (yb0+xp1y)*mass1 + (yc0+xp2y)*mass2)*invTotalMass;
+    FVEC zcom = (xp0z*mass0 + (zb0+xp1z)*mass1 + (zc0+xp2z)*mass2)*invTotalMass;
+
+    FVEC xa1 = xp0x - xcom;
+    FVEC ya1 = xp0y - ycom;
+    FVEC za1 = xp0z - zcom;
+    FVEC xb1 = xb0 + xp1x - xcom;
+    FVEC yb1 = yb0 + xp1y - ycom;
+    FVEC zb1 = zb0 + xp1z - zcom;
+    FVEC xc1 = xc0 + xp2x - xcom;
+    FVEC yc1 = yc0 + xp2y - ycom;
+    FVEC zc1 = zc0 + xp2z - zcom;
+
+    FVEC xaksZd = yb0*zc0 - zb0*yc0;
+    FVEC yaksZd = zb0*xc0 - xb0*zc0;
+    FVEC zaksZd = xb0*yc0 - yb0*xc0;
+    FVEC xaksXd = ya1*zaksZd - za1*yaksZd;
+    FVEC yaksXd = za1*xaksZd - xa1*zaksZd;
+    FVEC zaksXd = xa1*yaksZd - ya1*xaksZd;
+    FVEC xaksYd = yaksZd*zaksXd - zaksZd*yaksXd;
+    FVEC yaksYd = zaksZd*xaksXd - xaksZd*zaksXd;
+    FVEC zaksYd = xaksZd*yaksXd - yaksZd*xaksXd;
+
+    FVEC axlng = sqrt(xaksXd*xaksXd + yaksXd*yaksXd + zaksXd*zaksXd);
+    FVEC aylng = sqrt(xaksYd*xaksYd + yaksYd*yaksYd + zaksYd*zaksYd);
+    FVEC azlng = sqrt(xaksZd*xaksZd + yaksZd*yaksZd + zaksZd*zaksZd);
+    FVEC trns11 = xaksXd / axlng;
+    FVEC trns21 = yaksXd / axlng;
+    FVEC trns31 = zaksXd / axlng;
+    FVEC trns12 = xaksYd / aylng;
+    FVEC trns22 = yaksYd / aylng;
+    FVEC trns32 = zaksYd / aylng;
+    FVEC trns13 = xaksZd / azlng;
+    FVEC trns23 = yaksZd / azlng;
+    FVEC trns33 = zaksZd / azlng;
+
+    FVEC xb0d = trns11*xb0 + trns21*yb0 + trns31*zb0;
+    FVEC yb0d = trns12*xb0 + trns22*yb0 + trns32*zb0;
+    FVEC xc0d = trns11*xc0 + trns21*yc0 + trns31*zc0;
+    FVEC yc0d = trns12*xc0 + trns22*yc0 + trns32*zc0;
+    FVEC za1d = trns13*xa1 + trns23*ya1 + trns33*za1;
+    FVEC xb1d = trns11*xb1 + trns21*yb1 + trns31*zb1;
+    FVEC yb1d = trns12*xb1 + trns22*yb1 + trns32*zb1;
+    FVEC zb1d = trns13*xb1 + trns23*yb1 + trns33*zb1;
+    FVEC xc1d = trns11*xc1 + trns21*yc1 + trns31*zc1;
+    FVEC yc1d = trns12*xc1 + trns22*yc1 + trns32*zc1;
+    FVEC zc1d = trns13*xc1 + trns23*yc1 + trns33*zc1;
+
+    //                                        --- Step2  A2' ---
+
+    FVEC d1(dist1), d2(dist2);
+    FVEC rc = 0.5f*d2;
+    FVEC rb = sqrt(d1*d1-rc*rc);
+    FVEC ra = rb*(mass1+mass2)*invTotalMass;
+    rb -= ra;
+    FVEC sinphi = za1d / ra;
+    FVEC cosphi = sqrt(1.0f - sinphi*sinphi);
+    FVEC sinpsi = (zb1d - zc1d) / (2.0f*rc*cosphi);
+    FVEC cospsi = sqrt(1.0f - sinpsi*sinpsi);
+
+    FVEC ya2d = ra*cosphi;
+    FVEC xb2d = -rc*cospsi;
+    FVEC yb2d = -rb*cosphi - rc*sinpsi*sinphi;
+    FVEC yc2d = -rb*cosphi + rc*sinpsi*sinphi;
+    FVEC xb2d2 = xb2d*xb2d;
+    FVEC hh2 = 4.0f*xb2d2 + (yb2d-yc2d)*(yb2d-yc2d) + (zb1d-zc1d)*(zb1d-zc1d);
+    FVEC deltx = 2.0f*xb2d + sqrt(4.0f*xb2d2 - hh2 + d2*d2);
+    xb2d -= deltx*0.5f;
+
+    //                                        --- Step3  al,be,ga ---
+
+    FVEC alpha = (xb2d*(xb0d-xc0d) + yb0d*yb2d + yc0d*yc2d);
+    FVEC beta = (xb2d*(yc0d-yb0d) + xb0d*yb2d + xc0d*yc2d);
+    FVEC gamma = xb0d*yb1d - xb1d*yb0d + xc0d*yc1d - xc1d*yc0d;
+
+    FVEC al2be2 = alpha*alpha + beta*beta;
+    FVEC sintheta = (alpha*gamma - beta*sqrt(al2be2 - gamma*gamma)) / al2be2;
+
+    //                                        --- Step4  A3' ---
+
+    FVEC costheta = sqrt(1.0f - sintheta*sintheta);
+    FVEC xa3d = -ya2d*sintheta;
+    FVEC ya3d = ya2d*costheta;
+    FVEC za3d = za1d;
+    FVEC xb3d = xb2d*costheta - yb2d*sintheta;
+    FVEC yb3d = xb2d*sintheta + yb2d*costheta;
+    FVEC zb3d = zb1d;
+    FVEC xc3d = -xb2d*costheta - yc2d*sintheta;
+    FVEC yc3d = -xb2d*sintheta + yc2d*costheta;
+    FVEC zc3d = zc1d;
+
+    //                                        --- Step5  A3 ---
+
+    FVEC xa3 = trns11*xa3d + trns12*ya3d + trns13*za3d;
+    FVEC ya3 = trns21*xa3d + trns22*ya3d + trns23*za3d;
+    FVEC za3 = trns31*xa3d + trns32*ya3d + trns33*za3d;
+    FVEC xb3 = trns11*xb3d + trns12*yb3d + trns13*zb3d;
+    FVEC yb3 = trns21*xb3d + trns22*yb3d + trns23*zb3d;
+    FVEC zb3 = trns31*xb3d + trns32*yb3d + trns33*zb3d;
+    FVEC xc3 = trns11*xc3d + trns12*yc3d + trns13*zc3d;
+    FVEC yc3 = trns21*xc3d + trns22*yc3d + trns23*zc3d;
+    FVEC zc3 = trns31*xc3d + trns32*yc3d + trns33*zc3d;
+
+    (xcom + xa3).store(xp0);
+    (ycom + ya3).store(xp0+L);
+    (zcom + za3).store(xp0+2*L);
+    (xcom + xb3 - xb0).store(xp1);
+    (ycom + yb3 - yb0).store(xp1+L);
+    (zcom + zb3 - zb0).store(xp1+2*L);
+    (xcom + xc3 - xc0).store(xp2);
+    (ycom + yc3 - yc0).store(xp2+L);
+    (zcom + zc3 - zc0).store(xp2+2*L);
+}
+
+/**
+ * Apply SETTLE to the velocities of a group of clusters.
+ *
+ * @param m0      the mass of the first atom
+ * @param m1      the mass of the second atom
+ * @param m2      the mass of the third atom
+ * @param invm0   the inverse mass of the first atom
+ * @param invm1   the inverse mass of the second atom
+ * @param invm2   the inverse mass of the third atom
+ * @param ab      the vector from the first atom to the second one
+ * @param bc      the vector from the second atom to the third one
+ * @param ca      the vector from the third atom to the first one
+ * @param v0      on input, the velocity of the first atom.  On output, the change in its velocity.
+ * @param v1      on input, the velocity of the second atom.  On output, the change in its velocity.
+ * @param v2      on input, the velocity of the third atom.  On output, the change in its velocity.
+ */
+template <class FVEC>
+void settleVelocitiesVectorized(const float* m0, const float* m1, const float* m2, const float* invm0, const float* invm1, const float* invm2,
+        const float* ab, const float* bc, const float* ca, float* v0, float* v1, float* v2) {
+    const int L = sizeof(FVEC)/sizeof(float);
+    FVEC mA(m0), mB(m1), mC(m2);
+    FVEC eABx(ab), eABy(ab+L), eABz(ab+2*L);
+    FVEC eBCx(bc), eBCy(bc+L), eBCz(bc+2*L);
+    FVEC eCAx(ca), eCAy(ca+L), eCAz(ca+2*L);
+    FVEC v0x(v0), v0y(v0+L), v0z(v0+2*L);
+    FVEC v1x(v1), v1y(v1+L), v1z(v1+2*L);
+    FVEC v2x(v2), v2y(v2+L), v2z(v2+2*L);
+
+    // Compute intermediate quantities: the bond directions, the relative velocities,
+    // and the angle cosines and sines.
+
+    FVEC invLength = 1.0f/sqrt(eABx*eABx + eABy*eABy + eABz*eABz);
+    eABx *= invLength;
+    eABy *= invLength;
+    eABz *= invLength;
+    invLength = 1.0f/sqrt(eBCx*eBCx + eBCy*eBCy + eBCz*eBCz);
+    eBCx *= invLength;
+    eBCy *= invLength;
+    eBCz *= invLength;
+    invLength = 1.0f/sqrt(eCAx*eCAx + eCAy*eCAy + eCAz*eCAz);
+    eCAx *= invLength;
+    eCAy *= invLength;
+    eCAz *= invLength;
+    FVEC vAB = (v1x-v0x)*eABx + (v1y-v0y)*eABy + (v1z-v0z)*eABz;
+    FVEC vBC = (v2x-v1x)*eBCx + (v2y-v1y)*eBCy + (v2z-v1z)*eBCz;
+    FVEC vCA = (v0x-v2x)*eCAx + (v0y-v2y)*eCAy + (v0z-v2z)*eCAz;
+    FVEC cA = -(eABx*eCAx + eABy*eCAy + eABz*eCAz);
+    FVEC cB = -(eABx*eBCx + eABy*eBCy + eABz*eBCz);
+    FVEC cC = -(eBCx*eCAx + eBCy*eCAy + eBCz*eCAz);
+    FVEC s2A = 1.0f-cA*cA;
+    FVEC s2B = 1.0f-cB*cB;
+    FVEC s2C = 1.0f-cC*cC;
+
+    // Solve the equations.  See ReferenceSETTLEAlgorithm::applyToVelocities() for details.
+
+    FVEC mABCinv = 1.0f/(mA*mB*mC);
+    FVEC denom = (((s2A*mB+s2B*mA)*mC+(s2A*mB*mB+2.0f*(cA*cB*cC+1.0f)*mA*mB+s2B*mA*mA))*mC+s2C*mA*mB*(mA+mB))*mABCinv;
+    FVEC tab = ((cB*cC*mA-cA*mB-cA*mC)*vCA + (cA*cC*mB-cB*mC-cB*mA)*vBC + (s2C*mA*mA*mB*mB*mABCinv+(mA+mB+mC))*vAB)/denom;
+    FVEC tbc = ((cA*cB*mC-cC*mB-cC*mA)*vCA + (s2A*mB*mB*mC*mC*mABCinv+(mA+mB+mC))*vBC + (cA*cC*mB-cB*mA-cB*mC)*vAB)/denom;
+    FVEC tca = ((s2B*mA*mA*mC*mC*mABCinv+(mA+mB+mC))*vCA + (cA*cB*mC-cC*mB-cC*mA)*vBC + (cB*cC*mA-cA*mB-cA*mC)*vAB)/denom;
+    FVEC invMass0(invm0), invMass1(invm1), invMass2(invm2);
+    ((eABx*tab - eCAx*tca)*invMass0).store(v0);
+    ((eABy*tab - eCAy*tca)*invMass0).store(v0+L);
+    ((eABz*tab - eCAz*tca)*invMass0).store(v0+2*L);
+    ((eBCx*tbc - eABx*tab)*invMass1).store(v1);
+    ((eBCy*tbc - eABy*tab)*invMass1).store(v1+L);
+    ((eBCz*tbc - eABz*tab)*invMass1).store(v1+2*L);
+    ((eCAx*tca - eBCx*tbc)*invMass2).store(v2);
+    ((eCAy*tca - eBCy*tbc)*invMass2).store(v2+L);
+    ((eCAz*tca - eBCz*tbc)*invMass2).store(v2+2*L);
+}
+
+} // namespace OpenMM
+
+#endif /*OPENMM_CPUSETTLEVECTORIZED_H_*/
@@ -165,13 +165,25 @@ void CpuBondForce::assignBond(int bond, int thread, vector<int>& atomThread, vec
 }
 
 void CpuBondForce::calculateForce(vector<Vec3>& atomCoordinates, double** parameters, vector<Vec3>& forces, 
-        double* totalEnergy, ReferenceBondIxn& referenceBondIxn) {
+        double* totalEnergy, ReferenceBondIxn& referenceBondIxn, bool includeForces) {
+    vector<ReferenceBondIxn*> threadBondIxns(threads->getNumThreads(), &referenceBondIxn);
+    vector<double> energyParamDerivs;
+    calculateForce(atomCoordinates, parameters, forces, totalEnergy, threadBondIxns, energyParamDerivs, includeForces);
+}
+
+void CpuBondForce::calculateForce(vector<Vec3>& atomCoordinates, double** parameters, vector<Vec3>& forces, 
+        double* totalEnergy, vector<ReferenceBondIxn*>& threadBondIxns, vector<double>& energyParamDerivs, bool includeForces) {
     // Have the worker threads compute their forces.
     
-    vector<double> threadEnergy(threads->getNumThreads(), 0);
+    int numThreads = threads->getNumThreads();
+    for (ReferenceBondIxn* ixn : threadBondIxns)
+        ixn->setIncludeForces(includeForces);
+    int numDerivs = energyParamDerivs.size();
+    vector<double> threadEnergy(numThreads, 0);
+    vector<vector<double> > threadDerivs(numThreads, vector<double>(numDerivs+1, 0));
     threads->execute([&] (ThreadPool& threads, int threadIndex) {
         double* energy = (totalEnergy == NULL ? NULL : &threadEnergy[threadIndex]);
-        threadComputeForce(threads, threadIndex, atomCoordinates, parameters, forces, energy, referenceBondIxn);
+        threadComputeForce(threads, threadIndex, atomCoordinates, parameters, forces, energy, *threadBondIxns[threadIndex], &threadDerivs[threadIndex][0]);
     });
     threads->waitForThreads();
     
@@ -179,22 +191,25 @@ void CpuBondForce::calculateForce(vector<Vec3>& atomCoordinates, double** parame
     
     for (int i = 0; i < extraBonds.size(); i++) {
         int bond = extraBonds[i];
-        referenceBondIxn.calculateBondIxn(bondAtoms[bond], atomCoordinates, parameters[bond], forces, totalEnergy, NULL);
+        threadBondIxns[0]->calculateBondIxn(bondAtoms[bond], atomCoordinates, parameters[bond], forces, totalEnergy, &threadDerivs[0][0]);
     }
 
-    // Compute the total energy.
+    // Compute the total energy and derivatives.
     
     if (totalEnergy != NULL)
-        for (int i = 0; i < threads->getNumThreads(); i++)
+        for (int i = 0; i < numThreads; i++)
             *totalEnergy += threadEnergy[i];
+    for (int i = 0; i < numThreads; i++)
+        for (int j = 0; j < numDerivs; j++)
+            energyParamDerivs[j] += threadDerivs[i][j];
 }
 
 void CpuBondForce::threadComputeForce(ThreadPool& threads, int threadIndex, vector<Vec3>& atomCoordinates, double** parameters, vector<Vec3>& forces, 
-            double* totalEnergy, ReferenceBondIxn& referenceBondIxn) {
+            double* totalEnergy, ReferenceBondIxn& referenceBondIxn, double* energyParamDerivs) {
     vector<int>& bonds = threadBonds[threadIndex];
     int numBonds = bonds.size();
     for (int i = 0; i < numBonds; i++) {
         int bond = bonds[i];
-        referenceBondIxn.calculateBondIxn(bondAtoms[bond], atomCoordinates, parameters[bond], forces, totalEnergy, NULL);
+        referenceBondIxn.calculateBondIxn(bondAtoms[bond], atomCoordinates, parameters[bond], forces, totalEnergy, energyParamDerivs);
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,307 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2018 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuCCMA.h"
+#include "openmm/internal/gmx_atomic.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+using namespace OpenMM;
+using namespace std;
+
+static const int MinParallelClusterSize = 100;
+
+CpuCCMA::CpuCCMA(const System& system, const ReferenceCCMAAlgorithm& ccma, ThreadPool& threads) : threads(threads), hasInitializedMasses(false) {
+    numConstraints = ccma.getNumberOfConstraints();
+    maxIterations = ccma.getMaximumNumberOfIterations();
+    int numParticles = system.getNumParticles();
+    int numThreads = threads.getNumThreads();
+    vector<int> refAtom1(numConstraints), refAtom2(numConstraints);
+    vector<double> refDistance(numConstraints);
+    for (int i = 0; i < numConstraints; i++)
+        ccma.getConstraintParameters(i, refAtom1[i], refAtom2[i], refDistance[i]);
+
+    // Find clusters of constraints connected by shared atoms.
+
+    vector<int> atomCluster(numParticles);
+    for (int i = 0; i < numParticles; i++)
+        atomCluster[i] = i;
+    for (int i = 0; i < numConstraints; i++) {
+        int root1 = refAtom1[i], root2 = refAtom2[i];
+        while (atomCluster[root1] != root1)
+            root1 = atomCluster[root1] = atomCluster[atomCluster[root1]];
+        while (atomCluster[root2] != root2)
+            root2 = atomCluster[root2] = atomCluster[atomCluster[root2]];
+        atomCluster[max(root1, root2)] = min(root1, root2);
+    }
+    map<int, int> rootToCluster;
+    vector<vector<int> > clusterConstraints;
+    for (int i = 0; i < numConstraints; i++) {
+        int root = refAtom1[i];
+        while (atomCluster[root] != root)
+            root = atomCluster[root];
+        if (rootToCluster.find(root) == rootToCluster.end()) {
+            rootToCluster[root] = clusterConstraints.size();
+            clusterConstraints.push_back(vector<int>());
+        }
+        clusterConstraints[rootToCluster[root]].push_back(i);
+    }
+
+    // Sort the constraints so each cluster is contiguous, and record the inverse matrix in the new order.
+
+    int numClusters = clusterConstraints.size();
+    vector<int> newIndex(numConstraints);
+    vector<int> order;
+    for (int i = 0; i < numClusters; i++) {
+        clusterStart.push_back(order.size());
+        for (int constraint : clusterConstraints[i]) {
+            newIndex[constraint] = order.size();
+            order.push_back(constraint);
+        }
+    }
+    clusterStart.push_back(numConstraints);
+    atom1.resize(numConstraints);
+    atom2.resize(numConstraints);
+    distance.resize(numConstraints);
+    const vector<vector<pair<int, double> > >& matrix = ccma.getMatrix();
+    for (int i = 0; i < numConstraints; i++) {
+        int index = order[i];
+        atom1[i] = refAtom1[index];
+        atom2[i] = refAtom2[index];
+        distance[i] = refDistance[index];
+        matrixRowStart.push_back(matrixValue.size());
+        for (auto& element : matrix[index]) {
+            matrixColIndex.push_back(newIndex[element.first]);
+            matrixValue.push_back(element.second);
+        }
+    }
+    matrixRowStart.push_back(matrixValue.size());
+    reducedMasses.resize(numConstraints);
+    d_ij2.resize(numConstraints);
+    constraintDelta.resize(numConstraints);
+    tempDelta.resize(numConstraints);
+    r_ij.resize(numConstraints);
+
+    // Decide which clusters are large enough to be worth solving with all threads together.
+
+    for (int i = 0; i < numClusters; i++) {
+        int size = clusterStart[i+1]-clusterStart[i];
+        if (numThreads > 1 && size >= MinParallelClusterSize && size*numThreads > numConstraints)
+            largeClusters.push_back(i);
+        else
+            smallClusters.push_back(i);
+    }
+    int numBlocks = min(10*numThreads, (int) smallClusters.size());
+    for (int i = 0; i < numBlocks; i++)
+        blockStart.push_back(i*smallClusters.size()/numBlocks);
+    blockStart.push_back(smallClusters.size());
+
+    // For the large clusters, record which constraints involve each atom so positions can be updated in parallel.
+
+    for (int cluster : largeClusters) {
+        largeClusterAtomStart.push_back(clusterAtoms.size());
+        map<int, vector<int> > constraintsForAtom;
+        for (int i = clusterStart[cluster]; i < clusterStart[cluster+1]; i++) {
+            constraintsForAtom[atom1[i]].push_back(i);
+            constraintsForAtom[atom2[i]].push_back(i);
+        }
+        for (auto& atom : constraintsForAtom) {
+            clusterAtoms.push_back(atom.first);
+            atomConstraintStart.push_back(atomConstraints.size());
+            for (int constraint : atom.second)
+                atomConstraints.push_back(constraint);
+        }
+    }
+    largeClusterAtomStart.push_back(clusterAtoms.size());
+    atomConstraintStart.push_back(atomConstraints.size());
+}
+
+void CpuCCMA::apply(vector<OpenMM::Vec3>& atomCoordinates, vector<OpenMM::Vec3>& atomCoordinatesP, vector<double>& inverseMasses, double tolerance) {
+    applyConstraints(atomCoordinates, atomCoordinatesP, inverseMasses, false, tolerance);
+}
+
+void CpuCCMA::applyToVelocities(vector<OpenMM::Vec3>& atomCoordinates, vector<OpenMM::Vec3>& velocities, vector<double>& inverseMasses, double tolerance) {
+    applyConstraints(atomCoordinates, velocities, inverseMasses, true, tolerance);
+}
+
+void CpuCCMA::applyConstraints(vector<Vec3>& atomCoordinates, vector<Vec3>& atomCoordinatesP,
+        vector<double>& inverseMasses, bool constrainingVelocities, double tolerance) {
+    if (!hasInitializedMasses) {
+        hasInitializedMasses = true;
+        for (int i = 0; i < numConstraints; i++)
+            reducedMasses[i] = 0.5/(inverseMasses[atom1[i]]+inverseMasses[atom2[i]]);
+    }
+
+    // Solve the small clusters, with each one handled by a single thread.
+
+    if (smallClusters.size() > 0) {
+        int numBlocks = blockStart.size()-1;
+        gmx_atomic_t atomicCounter;
+        gmx_atomic_set(&atomicCounter, 0);
+        threads.execute([&] (ThreadPool& threads, int threadIndex) {
+            while (true) {
+                int block = gmx_atomic_fetch_add(&atomicCounter, 1);
+                if (block >= numBlocks)
+                    break;
+                for (int i = blockStart[block]; i < blockStart[block+1]; i++)
+                    solveCluster(smallClusters[i], atomCoordinates, atomCoordinatesP, inverseMasses, constrainingVelocities, tolerance);
+            }
+        });
+        threads.waitForThreads();
+    }
+
+    // Solve the large clusters, with all threads working on each one.
+
+    int numLargeClusters = largeClusters.size();
+    for (int i = 0; i < numLargeClusters; i++)
+        solveClusterInParallel(i, atomCoordinates, atomCoordinatesP, inverseMasses, constrainingVelocities, tolerance);
+}
+
+void CpuCCMA::solveCluster(int cluster, vector<Vec3>& atomCoordinates, vector<Vec3>& atomCoordinatesP,
+        vector<double>& inverseMasses, bool constrainingVelocities, double tolerance) {
+    int start = clusterStart[cluster];
+    int end = clusterStart[cluster+1];
+    computeDisplacements(start, end, atomCoordinates);
+    for (int iteration = 0; iteration < maxIterations; iteration++) {
+        if (computeConstraintDeltas(start, end, atomCoordinatesP, constrainingVelocities, tolerance) == end-start)
+            break;
+        multiplyByMatrix(start, end);
+        for (int i = start; i < end; i++) {
+            Vec3 dr = r_ij[i]*tempDelta[i];
+            atomCoordinatesP[atom1[i]] += dr*inverseMasses[atom1[i]];
+            atomCoordinatesP[atom2[i]] -= dr*inverseMasses[atom2[i]];
+        }
+    }
+}
+
+void CpuCCMA::solveClusterInParallel(int largeCluster, vector<Vec3>& atomCoordinates, vector<Vec3>& atomCoordinatesP,
+        vector<double>& inverseMasses, bool constrainingVelocities, double tolerance) {
+    int cluster = largeClusters[largeCluster];
+    int numThreads = threads.getNumThreads();
+    vector<int> threadConverged(numThreads);
+    bool converged = false;
+    threads.execute([&] (ThreadPool& threads, int threadIndex) {
+        int clusterSize = clusterStart[cluster+1]-clusterStart[cluster];
+        int start = clusterStart[cluster]+threadIndex*clusterSize/numThreads;
+        int end = clusterStart[cluster]+(threadIndex+1)*clusterSize/numThreads;
+        int numAtoms = largeClusterAtomStart[largeCluster+1]-largeClusterAtomStart[largeCluster];
+        int startAtom = largeClusterAtomStart[largeCluster]+threadIndex*numAtoms/numThreads;
+        int endAtom = largeClusterAtomStart[largeCluster]+(threadIndex+1)*numAtoms/numThreads;
+        computeDisplacements(start, end, atomCoordinates);
+        for (int iteration = 0; iteration < maxIterations; iteration++) {
+            threadConverged[threadIndex] = computeConstraintDeltas(start, end, atomCoordinatesP, constrainingVelocities, tolerance);
+            threads.syncThreads();
+            if (converged)
+                break;
+            multiplyByMatrix(start, end);
+            threads.syncThreads();
+
+            // Each thread updates a subset of the atoms, so there are no conflicts between threads.
+
+            for (int i = startAtom; i < endAtom; i++) {
+                int atom = clusterAtoms[i];
+                Vec3 dr;
+                for (int j = atomConstraintStart[i]; j < atomConstraintStart[i+1]; j++) {
+                    int constraint = atomConstraints[j];
+                    if (atom1[constraint] == atom)
+                        dr += r_ij[constraint]*tempDelta[constraint];
+                    else
+                        dr -= r_ij[constraint]*tempDelta[constraint];
+                }
+                atomCoordinatesP[atom] += dr*inverseMasses[atom];
+            }
+            threads.syncThreads();
+        }
+    });
+    int clusterSize = clusterStart[cluster+1]-clusterStart[cluster];
+    for (int iteration = 0; iteration < maxIterations; iteration++) {
+        // Check whether all constraints in the cluster have converged.
+
+        threads.waitForThreads();
+        int numConverged = 0;
+        for (int i = 0; i < numThreads; i++)
+            numConverged += threadConverged[i];
+        converged = (numConverged == clusterSize);
+        threads.resumeThreads();
+        if (converged)
+            break;
+
+        // Wait while the threads multiply by the matrix and update the positions.
+
+        threads.waitForThreads();
+        threads.resumeThreads();
+        threads.waitForThreads();
+        threads.resumeThreads();
+    }
+    threads.waitForThreads();
+}
+
+void CpuCCMA::computeDisplacements(int start, int end, vector<Vec3>& atomCoordinates) {
+    for (int i = start; i < end; i++) {
+        r_ij[i] = atomCoordinates[atom1[i]]-atomCoordinates[atom2[i]];
+        d_ij2[i] = r_ij[i].dot(r_ij[i]);
+    }
+}
+
+int CpuCCMA::computeConstraintDeltas(int start, int end, vector<Vec3>& atomCoordinatesP, bool constrainingVelocities, double tolerance) {
+    double lowerTol = 1-2*tolerance+tolerance*tolerance;
+    double upperTol = 1+2*tolerance+tolerance*tolerance;
+    int numConverged = 0;
+    for (int i = start; i < end; i++) {
+        Vec3 rp_ij = atomCoordinatesP[atom1[i]]-atomCoordinatesP[atom2[i]];
+        if (constrainingVelocities) {
+            double rrpr = rp_ij.dot(r_ij[i]);
+            constraintDelta[i] = -2*reducedMasses[i]*rrpr/d_ij2[i];
+            if (fabs(constraintDelta[i]) <= tolerance)
+                numConverged++;
+        }
+        else {
+            double rp2 = rp_ij.dot(rp_ij);
+            double dist2 = distance[i]*distance[i];
+            double diff = dist2-rp2;
+            double rrpr = rp_ij.dot(r_ij[i]);
+            constraintDelta[i] = reducedMasses[i]*diff/rrpr;
+            if (rp2 >= lowerTol*dist2 && rp2 <= upperTol*dist2)
+                numConverged++;
+        }
+    }
+    return numConverged;
+}
+
+void CpuCCMA::multiplyByMatrix(int start, int end) {
+    for (int i = start; i < end; i++) {
+        double sum = 0.0;
+        for (int j = matrixRowStart[i]; j < matrixRowStart[i+1]; j++)
+            sum += matrixValue[j]*constraintDelta[matrixColIndex[j]];
+        tempDelta[i] = sum;
+    }
+}
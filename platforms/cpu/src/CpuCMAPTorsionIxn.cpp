@@ -0,0 +1,204 @@
+
+/* Portions copyright (c) 2018 Stanford University and Simbios.
+ * Authors: Peter Eastman
+ * Contributors: 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "CpuCMAPTorsionIxn.h"
+#include "SimTKOpenMMUtilities.h"
+#include "openmm/internal/vectorize.h"
+#include <cmath>
+
+using namespace OpenMM;
+using namespace std;
+
+CpuCMAPTorsionIxn::CpuCMAPTorsionIxn(const vector<float>& coeff, const vector<int>& mapOffset, const vector<int>& mapSize) :
+        coeff(coeff), mapOffset(mapOffset), mapSize(mapSize), usePeriodic(false) {
+}
+
+void CpuCMAPTorsionIxn::setPeriodic(Vec3* vectors) {
+    usePeriodic = true;
+    boxVectors[0] = vectors[0];
+    boxVectors[1] = vectors[1];
+    boxVectors[2] = vectors[2];
+}
+
+void CpuCMAPTorsionIxn::computeAngles(int* atomIndices, vector<Vec3>& atomCoordinates, double (*deltaA)[ReferenceForce::LastDeltaRIndex],
+                                      double (*deltaB)[ReferenceForce::LastDeltaRIndex], double** cpA, double** cpB, double& angleA, double& angleB) {
+    int* atomsA = atomIndices;
+    int* atomsB = atomIndices+4;
+
+    // Compute deltas between the various atoms involved.
+
+    if (usePeriodic) {
+        ReferenceForce::getDeltaRPeriodic(atomCoordinates[atomsA[1]], atomCoordinates[atomsA[0]], boxVectors, deltaA[0]);
+        ReferenceForce::getDeltaRPeriodic(atomCoordinates[atomsA[1]], atomCoordinates[atomsA[2]], boxVectors, deltaA[1]);
+        ReferenceForce::getDeltaRPeriodic(atomCoordinates[atomsA[3]], atomCoordinates[atomsA[2]], boxVectors, deltaA[2]);
+        ReferenceForce::getDeltaRPeriodic(atomCoordinates[atomsB[1]], atomCoordinates[atomsB[0]], boxVectors, deltaB[0]);
+        ReferenceForce::getDeltaRPeriodic(atomCoordinates[atomsB[1]], atomCoordinates[atomsB[2]], boxVectors, deltaB[1]);
+        ReferenceForce::getDeltaRPeriodic(atomCoordinates[atomsB[3]], atomCoordinates[atomsB[2]], boxVectors, deltaB[2]);
+    }
+    else {
+        ReferenceForce::getDeltaR(atomCoordinates[atomsA[1]], atomCoordinates[atomsA[0]], deltaA[0]);
+        ReferenceForce::getDeltaR(atomCoordinates[atomsA[1]], atomCoordinates[atomsA[2]], deltaA[1]);
+        ReferenceForce::getDeltaR(atomCoordinates[atomsA[3]], atomCoordinates[atomsA[2]], deltaA[2]);
+        ReferenceForce::getDeltaR(atomCoordinates[atomsB[1]], atomCoordinates[atomsB[0]], deltaB[0]);
+        ReferenceForce::getDeltaR(atomCoordinates[atomsB[1]], atomCoordinates[atomsB[2]], deltaB[1]);
+        ReferenceForce::getDeltaR(atomCoordinates[atomsB[3]], atomCoordinates[atomsB[2]], deltaB[2]);
+    }
+
+    // Compute the dihedral angles.
+
+    double dotDihedral;
+    double signOfAngle;
+    angleA = getDihedralAngleBetweenThreeVectors(deltaA[0], deltaA[1], deltaA[2], cpA, &dotDihedral, deltaA[0], &signOfAngle, 1);
+    angleB = getDihedralAngleBetweenThreeVectors(deltaB[0], deltaB[1], deltaB[2], cpB, &dotDihedral, deltaB[0], &signOfAngle, 1);
+    angleA = fmod(angleA+2.0*M_PI, 2.0*M_PI);
+    angleB = fmod(angleB+2.0*M_PI, 2.0*M_PI);
+}
+
+void CpuCMAPTorsionIxn::calculateBondIxn(int* atomIndices, vector<Vec3>& atomCoordinates, double* parameters,
+                                         vector<Vec3>& forces, double* totalEnergy, double* energyParamDerivs) {
+    int map = (int) parameters[0];
+    double deltaA[3][ReferenceForce::LastDeltaRIndex];
+    double deltaB[3][ReferenceForce::LastDeltaRIndex];
+    double crossProductMemory[12];
+    double* cpA[2] = {crossProductMemory, crossProductMemory+3};
+    double* cpB[2] = {crossProductMemory+6, crossProductMemory+9};
+    double angleA, angleB;
+    computeAngles(atomIndices, atomCoordinates, deltaA, deltaB, cpA, cpB, angleA, angleB);
+
+    // Identify which patch this is in.
+
+    int size = mapSize[map];
+    double delta = 2*M_PI/size;
+    int s = min((int) (angleA/delta), size-1);
+    int t = min((int) (angleB/delta), size-1);
+    const float* c = &coeff[mapOffset[map]+16*(s+size*t)];
+    double da = angleA/delta-s;
+    double db = angleB/delta-t;
+
+    // Evaluate the spline to determine the energy and gradients.
+
+    double energy = 0;
+    double dEdA = 0;
+    double dEdB = 0;
+    for (int i = 3; i >= 0; i--) {
+        energy = da*energy + ((c[i*4+3]*db + c[i*4+2])*db + c[i*4+1])*db + c[i*4+0];
+        dEdA = db*dEdA + (3.0*c[i+3*4]*da + 2.0*c[i+2*4])*da + c[i+1*4];
+        dEdB = da*dEdB + (3.0*c[i*4+3]*db + 2.0*c[i*4+2])*db + c[i*4+1];
+    }
+    dEdA /= delta;
+    dEdB /= delta;
+    if (totalEnergy != NULL)
+        *totalEnergy += energy;
+    if (!includeForces)
+        return;
+
+    // Apply the forces to the two torsions.
+
+    applyTorsionForce(atomIndices, dEdA, deltaA, cpA, forces);
+    applyTorsionForce(atomIndices+4, dEdB, deltaB, cpB, forces);
+}
+
+void CpuCMAPTorsionIxn::calculateBlockIxn(int** atomIndices, vector<Vec3>& atomCoordinates, double** parameters,
+                                          vector<Vec3>& forces, double* totalEnergy) {
+    // Compute the dihedral angles of each torsion pair and identify which patch it is in.
+
+    double deltaA[4][3][ReferenceForce::LastDeltaRIndex];
+    double deltaB[4][3][ReferenceForce::LastDeltaRIndex];
+    double crossProductMemory[4][12];
+    double* cpA[4][2];
+    double* cpB[4][2];
+    float da[4], db[4], delta[4];
+    fvec4 c[16];
+    for (int k = 0; k < 4; k++) {
+        cpA[k][0] = crossProductMemory[k];
+        cpA[k][1] = crossProductMemory[k]+3;
+        cpB[k][0] = crossProductMemory[k]+6;
+        cpB[k][1] = crossProductMemory[k]+9;
+        double angleA, angleB;
+        computeAngles(atomIndices[k], atomCoordinates, deltaA[k], deltaB[k], cpA[k], cpB[k], angleA, angleB);
+        int map = (int) parameters[k][0];
+        int size = mapSize[map];
+        double patchWidth = 2*M_PI/size;
+        int s = min((int) (angleA/patchWidth), size-1);
+        int t = min((int) (angleB/patchWidth), size-1);
+        const float* patch = &coeff[mapOffset[map]+16*(s+size*t)];
+        for (int i = 0; i < 4; i++)
+            c[4*i+k] = fvec4(&patch[4*i]);
+        da[k] = (float) (angleA/patchWidth-s);
+        db[k] = (float) (angleB/patchWidth-t);
+        delta[k] = (float) patchWidth;
+    }
+
+    // Transpose the coefficients so each vector holds one coefficient for all four patches, then evaluate
+    // the splines together.
+
+    for (int i = 0; i < 4; i++)
+        transpose(c[4*i], c[4*i+1], c[4*i+2], c[4*i+3]);
+    fvec4 a(da), b(db);
+    fvec4 energy(0.0f), dEdA(0.0f), dEdB(0.0f);
+    for (int i = 3; i >= 0; i--) {
+        energy = a*energy + ((c[i*4+3]*b + c[i*4+2])*b + c[i*4+1])*b + c[i*4+0];
+        dEdA = b*dEdA + (3.0f*c[i+3*4]*a + 2.0f*c[i+2*4])*a + c[i+1*4];
+        dEdB = a*dEdB + (3.0f*c[i*4+3]*b + 2.0f*c[i*4+2])*b + c[i*4+1];
+    }
+    fvec4 invDelta = 1.0f/fvec4(delta);
+    float energies[4], dEdAngleA[4], dEdAngleB[4];
+    energy.store(energies);
+    (dEdA*invDelta).store(dEdAngleA);
+    (dEdB*invDelta).store(dEdAngleB);
+
+    // Apply the forces to the torsions.
+
+    for (int k = 0; k < 4; k++) {
+        if (totalEnergy != NULL)
+            *totalEnergy += energies[k];
+        if (!includeForces)
+            continue;
+        applyTorsionForce(atomIndices[k], dEdAngleA[k], deltaA[k], cpA[k], forces);
+        applyTorsionForce(atomIndices[k]+4, dEdAngleB[k], deltaB[k], cpB[k], forces);
+    }
+}
+
+void CpuCMAPTorsionIxn::applyTorsionForce(int* atoms, double dEdAngle, double (*delta)[ReferenceForce::LastDeltaRIndex], double** crossProduct, vector<Vec3>& forces) const {
+    double forceFactors[4];
+    double normCross1 = DOT3(crossProduct[0], crossProduct[0]);
+    double normBC = delta[1][ReferenceForce::RIndex];
+    forceFactors[0] = (-dEdAngle*normBC)/normCross1;
+    double normCross2 = DOT3(crossProduct[1], crossProduct[1]);
+    forceFactors[3] = (dEdAngle*normBC)/normCross2;
+    forceFactors[1] = DOT3(delta[0], delta[1]);
+    forceFactors[1] /= delta[1][ReferenceForce::R2Index];
+    forceFactors[2] = DOT3(delta[2], delta[1]);
+    forceFactors[2] /= delta[1][ReferenceForce::R2Index];
+    for (int i = 0; i < 3; i++) {
+        double f0 = forceFactors[0]*crossProduct[0][i];
+        double f3 = forceFactors[3]*crossProduct[1][i];
+        double s = forceFactors[1]*f0 - forceFactors[2]*f3;
+        forces[atoms[0]][i] += f0;
+        forces[atoms[1]][i] -= f0-s;
+        forces[atoms[2]][i] -= f3+s;
+        forces[atoms[3]][i] += f3;
+    }
+}
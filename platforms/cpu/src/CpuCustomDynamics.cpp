@@ -0,0 +1,242 @@
+
+/* Portions copyright (c) 2018 Stanford University and Simbios.
+ * Authors: Peter Eastman
+ * Contributors: 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "CpuCustomDynamics.h"
+#include <algorithm>
+#include <sstream>
+
+using namespace OpenMM;
+using namespace Lepton;
+using namespace std;
+
+/**
+ * Each thread gathers the inputs for this many atoms, then evaluates the expression for all their degrees of
+ * freedom with a single call to evaluateBatch().
+ */
+static const int AtomsPerBlock = 32;
+
+class CpuCustomDynamics::ThreadData {
+public:
+    double x, v, m, f, gaussian, uniform;
+    vector<double> perDofVariable;
+    vector<CompiledExpression> expressions;
+    // The following arrays hold the inputs and results for a block of degrees of freedom.
+    vector<double> blockX, blockV, blockM, blockF, blockGaussian, blockUniform, blockResult;
+    vector<vector<double> > blockPerDofVariable;
+    vector<const double*> blockValues;
+};
+
+CpuCustomDynamics::CpuCustomDynamics(int numberOfAtoms, const CustomIntegrator& integrator, ThreadPool& threads, CpuRandom& random) :
+           ReferenceCustomDynamics(numberOfAtoms, integrator), threads(threads), random(random) {
+    threadSum.resize(threads.getNumThreads());
+}
+
+CpuCustomDynamics::~CpuCustomDynamics() {
+    for (auto data : threadData)
+        delete data;
+}
+
+void CpuCustomDynamics::initialize(ContextImpl& context, vector<double>& masses, map<string, double>& globals) {
+    ReferenceCustomDynamics::initialize(context, masses, globals);
+
+    // Find all the expressions that get evaluated for every degree of freedom.
+
+    vector<const CompiledExpression*> perDofExpressions;
+    for (int i = 0; i < (int) stepType.size(); i++)
+        if (stepType[i] == CustomIntegrator::ComputePerDof || stepType[i] == CustomIntegrator::ComputeSum)
+            perDofExpressions.push_back(&stepExpressions[i][0]);
+    perDofExpressions.push_back(&kineticEnergyExpression);
+    int numPerDofVariables = integrator.getNumPerDofVariables();
+    expressionInfo.resize(perDofExpressions.size());
+    for (int i = 0; i < (int) perDofExpressions.size(); i++) {
+        const set<string>& variables = perDofExpressions[i]->getVariables();
+        expressionIndex[perDofExpressions[i]] = i;
+        expressionInfo[i].needsGaussian = (variables.find("gaussian") != variables.end());
+        expressionInfo[i].needsUniform = (variables.find("uniform") != variables.end());
+        for (int j = 0; j < numPerDofVariables; j++)
+            if (variables.find(integrator.getPerDofVariableName(j)) != variables.end())
+                expressionInfo[i].perDofVariables.push_back(j);
+    }
+
+    // Create a copy of each expression for every thread.  The per-DOF inputs point to variables owned by
+    // the thread, while everything else is updated through the expression set.
+
+    for (int i = 0; i < threads.getNumThreads(); i++) {
+        ThreadData* data = new ThreadData();
+        threadData.push_back(data);
+        data->perDofVariable.resize(numPerDofVariables);
+        map<string, double*> variableLocations;
+        variableLocations["x"] = &data->x;
+        variableLocations["v"] = &data->v;
+        variableLocations["m"] = &data->m;
+        variableLocations["f"] = &data->f;
+        variableLocations["energy"] = &energy;
+        variableLocations["gaussian"] = &data->gaussian;
+        variableLocations["uniform"] = &data->uniform;
+        for (int j = 0; j < numPerDofVariables; j++)
+            variableLocations[integrator.getPerDofVariableName(j)] = &data->perDofVariable[j];
+        for (int j = 0; j < 32; j++) {
+            stringstream fname;
+            fname << "f" << j;
+            variableLocations[fname.str()] = &data->f;
+            stringstream ename;
+            ename << "energy" << j;
+            variableLocations[ename.str()] = &energy;
+        }
+
+        // Every input that varies between degrees of freedom is passed to evaluateBatch() in an array.
+
+        int blockSize = 3*AtomsPerBlock;
+        data->blockX.resize(blockSize);
+        data->blockV.resize(blockSize);
+        data->blockM.resize(blockSize);
+        data->blockF.resize(blockSize);
+        data->blockGaussian.resize(blockSize);
+        data->blockUniform.resize(blockSize);
+        data->blockResult.resize(blockSize);
+        data->blockPerDofVariable.resize(numPerDofVariables, vector<double>(blockSize));
+        vector<string> batchVariables;
+        batchVariables.push_back("x");
+        data->blockValues.push_back(&data->blockX[0]);
+        batchVariables.push_back("v");
+        data->blockValues.push_back(&data->blockV[0]);
+        batchVariables.push_back("m");
+        data->blockValues.push_back(&data->blockM[0]);
+        batchVariables.push_back("f");
+        data->blockValues.push_back(&data->blockF[0]);
+        batchVariables.push_back("gaussian");
+        data->blockValues.push_back(&data->blockGaussian[0]);
+        batchVariables.push_back("uniform");
+        data->blockValues.push_back(&data->blockUniform[0]);
+        for (int j = 0; j < numPerDofVariables; j++) {
+            batchVariables.push_back(integrator.getPerDofVariableName(j));
+            data->blockValues.push_back(&data->blockPerDofVariable[j][0]);
+        }
+        for (int j = 0; j < 32; j++) {
+            stringstream fname;
+            fname << "f" << j;
+            batchVariables.push_back(fname.str());
+            data->blockValues.push_back(&data->blockF[0]);
+        }
+        data->expressions.resize(perDofExpressions.size());
+        for (int j = 0; j < (int) perDofExpressions.size(); j++) {
+            data->expressions[j] = *perDofExpressions[j];
+            data->expressions[j].setVariableLocations(variableLocations);
+            data->expressions[j].setBatchVariables(batchVariables);
+            expressionSet.registerExpression(data->expressions[j]);
+        }
+    }
+}
+
+void CpuCustomDynamics::computePerDof(int numberOfAtoms, vector<Vec3>& results, const vector<Vec3>& atomCoordinates,
+              const vector<Vec3>& velocities, const vector<Vec3>& forces, const vector<double>& masses,
+              const vector<vector<Vec3> >& perDof, const CompiledExpression& expression) {
+    launch(numberOfAtoms, &results[0], atomCoordinates, velocities, forces, masses, perDof, expression);
+}
+
+double CpuCustomDynamics::computeSum(int numberOfAtoms, const vector<Vec3>& atomCoordinates,
+              const vector<Vec3>& velocities, const vector<Vec3>& forces, const vector<double>& masses,
+              const vector<vector<Vec3> >& perDof, const CompiledExpression& expression) {
+    launch(numberOfAtoms, NULL, atomCoordinates, velocities, forces, masses, perDof, expression);
+
+    // Combine the partial sums from the threads in a fixed order so the result is reproducible.
+
+    double sum = 0.0;
+    for (double s : threadSum)
+        sum += s;
+    return sum;
+}
+
+void CpuCustomDynamics::launch(int numberOfAtoms, Vec3* results, const vector<Vec3>& atomCoordinates,
+              const vector<Vec3>& velocities, const vector<Vec3>& forces, const vector<double>& masses,
+              const vector<vector<Vec3> >& perDof, const CompiledExpression& expression) {
+    // Record the parameters for the threads.
+
+    this->numberOfAtoms = numberOfAtoms;
+    this->results = results;
+    this->atomCoordinates = &atomCoordinates[0];
+    this->velocities = &velocities[0];
+    this->forces = &forces[0];
+    this->masses = &masses[0];
+    this->perDof = &perDof;
+    currentExpression = expressionIndex.at(&expression);
+
+    // Signal the threads to start running and wait for them to finish.
+
+    threads.execute([&] (ThreadPool& threads, int threadIndex) { threadComputePerDof(threadIndex); });
+    threads.waitForThreads();
+}
+
+void CpuCustomDynamics::threadComputePerDof(int threadIndex) {
+    ThreadData& data = *threadData[threadIndex];
+    const CompiledExpression& expression = data.expressions[currentExpression];
+    const ExpressionInfo& info = expressionInfo[currentExpression];
+    int start = threadIndex*numberOfAtoms/threads.getNumThreads();
+    int end = (threadIndex+1)*numberOfAtoms/threads.getNumThreads();
+    double sum = 0.0;
+    for (int blockStart = start; blockStart < end; blockStart += AtomsPerBlock) {
+        int blockEnd = min(blockStart+AtomsPerBlock, end);
+
+        // Gather the inputs for every degree of freedom in the block.
+
+        int numPoints = 0;
+        for (int i = blockStart; i < blockEnd; i++) {
+            if (masses[i] != 0.0) {
+                for (int j = 0; j < 3; j++) {
+                    data.blockX[numPoints] = atomCoordinates[i][j];
+                    data.blockV[numPoints] = velocities[i][j];
+                    data.blockM[numPoints] = masses[i];
+                    data.blockF[numPoints] = forces[i][j];
+                    if (info.needsUniform)
+                        data.blockUniform[numPoints] = random.getUniformRandom(threadIndex);
+                    if (info.needsGaussian)
+                        data.blockGaussian[numPoints] = random.getGaussianRandom(threadIndex);
+                    for (int k : info.perDofVariables)
+                        data.blockPerDofVariable[k][numPoints] = (*perDof)[k][i][j];
+                    numPoints++;
+                }
+            }
+        }
+        if (numPoints == 0)
+            continue;
+
+        // Evaluate the expression and store the results.
+
+        expression.evaluateBatch(numPoints, &data.blockValues[0], &data.blockResult[0]);
+        numPoints = 0;
+        for (int i = blockStart; i < blockEnd; i++) {
+            if (masses[i] != 0.0) {
+                for (int j = 0; j < 3; j++) {
+                    double value = data.blockResult[numPoints++];
+                    if (results == NULL)
+                        sum += value;
+                    else
+                        results[i][j] = value;
+                }
+            }
+        }
+    }
+    threadSum[threadIndex] = sum;
+}
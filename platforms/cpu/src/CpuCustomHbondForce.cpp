@@ -0,0 +1,400 @@
+
+/* Portions copyright (c) 2018 Stanford University and Simbios.
+ * Authors: Peter Eastman
+ * Contributors: 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "CpuCustomHbondForce.h"
+#include "ReferenceBondIxn.h"
+#include "ReferenceTabulatedFunction.h"
+#include "SimTKOpenMMUtilities.h"
+#include "openmm/internal/CustomHbondForceImpl.h"
+#include "openmm/internal/gmx_atomic.h"
+#include "lepton/CustomFunction.h"
+
+using namespace OpenMM;
+using namespace std;
+
+CpuCustomHbondForce::CpuCustomHbondForce(const CustomHbondForce& force, ThreadPool& threads) :
+            useCutoff(false), usePeriodic(false), neighborList(NULL), threads(threads) {
+    numDonors = force.getNumDonors();
+    numAcceptors = force.getNumAcceptors();
+    donorAtoms.resize(numDonors);
+    acceptorAtoms.resize(numAcceptors);
+    vector<double> parameters;
+    for (int i = 0; i < numDonors; i++) {
+        int d1, d2, d3;
+        force.getDonorParameters(i, d1, d2, d3, parameters);
+        donorAtoms[i].push_back(d1);
+        donorAtoms[i].push_back(d2);
+        donorAtoms[i].push_back(d3);
+    }
+    for (int i = 0; i < numAcceptors; i++) {
+        int a1, a2, a3;
+        force.getAcceptorParameters(i, a1, a2, a3, parameters);
+        acceptorAtoms[i].push_back(a1);
+        acceptorAtoms[i].push_back(a2);
+        acceptorAtoms[i].push_back(a3);
+    }
+
+    // Record exclusions.
+
+    exclusions.resize(numDonors);
+    for (int i = 0; i < force.getNumExclusions(); i++) {
+        int donor, acceptor;
+        force.getExclusionParticles(i, donor, acceptor);
+        exclusions[donor].insert(acceptor);
+    }
+
+    // Create custom functions for the tabulated functions.
+
+    map<string, Lepton::CustomFunction*> functions;
+    for (int i = 0; i < force.getNumFunctions(); i++)
+        functions[force.getTabulatedFunctionName(i)] = createReferenceTabulatedFunction(force.getTabulatedFunction(i));
+
+    // Parse the expression and create the objects used to calculate the interaction.
+
+    map<string, vector<int> > distances;
+    map<string, vector<int> > angles;
+    map<string, vector<int> > dihedrals;
+    Lepton::ParsedExpression energyExpr = CustomHbondForceImpl::prepareExpression(force, functions, distances, angles, dihedrals);
+    for (int i = 0; i < threads.getNumThreads(); i++)
+        threadData.push_back(new ThreadData(force, energyExpr, distances, angles, dihedrals));
+    if (force.getNonbondedMethod() != CustomHbondForce::NoCutoff)
+        setUseCutoff(force.getCutoffDistance());
+
+    // Delete the custom functions.
+
+    for (auto& function : functions)
+        delete function.second;
+}
+
+CpuCustomHbondForce::~CpuCustomHbondForce() {
+    if (neighborList != NULL)
+        delete neighborList;
+    for (auto data : threadData)
+        delete data;
+}
+
+void CpuCustomHbondForce::setUseCutoff(double distance) {
+    useCutoff = true;
+    cutoffDistance = distance;
+    if (neighborList == NULL)
+        neighborList = new CpuNeighborList(4);
+}
+
+void CpuCustomHbondForce::setPeriodic(Vec3* periodicBoxVectors) {
+    assert(useCutoff);
+    assert(periodicBoxVectors[0][0] >= 2.0*cutoffDistance);
+    assert(periodicBoxVectors[1][1] >= 2.0*cutoffDistance);
+    assert(periodicBoxVectors[2][2] >= 2.0*cutoffDistance);
+    usePeriodic = true;
+    this->periodicBoxVectors[0] = periodicBoxVectors[0];
+    this->periodicBoxVectors[1] = periodicBoxVectors[1];
+    this->periodicBoxVectors[2] = periodicBoxVectors[2];
+}
+
+void CpuCustomHbondForce::calculateIxn(vector<Vec3>& atomCoordinates, double** donorParameters, double** acceptorParameters,
+                                       const map<string, double>& globalParameters, vector<AlignedArray<float> >& threadForce,
+                                       bool includeForces, bool includeEnergy, double& energy) {
+    // Record the parameters for the threads.
+
+    this->atomCoordinates = &atomCoordinates;
+    this->donorParameters = donorParameters;
+    this->acceptorParameters = acceptorParameters;
+    this->globalParameters = &globalParameters;
+    this->threadForce = &threadForce;
+    this->includeForces = includeForces;
+    this->includeEnergy = includeEnergy;
+    gmx_atomic_t counter;
+    gmx_atomic_set(&counter, 0);
+    this->atomicCounter = &counter;
+    if (useCutoff)
+        findNeighbors(atomCoordinates);
+
+    // Signal the threads to start running and wait for them to finish.
+
+    threads.execute([&] (ThreadPool& threads, int threadIndex) { threadComputeForce(threads, threadIndex); });
+    threads.waitForThreads();
+
+    // Combine the energies from all the threads.
+
+    if (includeEnergy) {
+        int numThreads = threads.getNumThreads();
+        for (int i = 0; i < numThreads; i++)
+            energy += threadData[i]->energy;
+    }
+}
+
+void CpuCustomHbondForce::findNeighbors(vector<Vec3>& atomCoordinates) {
+    donorNeighbors.resize(numDonors);
+    for (int i = 0; i < numDonors; i++)
+        donorNeighbors[i].clear();
+
+    // Build a neighbor list from the primary atoms of the donors and acceptors.  Donor i is represented
+    // by point i and acceptor j by point numDonors+j.  The list is padded slightly so that rounding in
+    // single precision never loses a pair.  The exact cutoff is applied later in calculateOneIxn().
+
+    int numPoints = numDonors+numAcceptors;
+    groupPositions.resize(4*numPoints);
+    groupExclusions.resize(numPoints);
+    for (int i = 0; i < numPoints; i++) {
+        const Vec3& pos = atomCoordinates[i < numDonors ? donorAtoms[i][0] : acceptorAtoms[i-numDonors][0]];
+        groupPositions[4*i] = (float) pos[0];
+        groupPositions[4*i+1] = (float) pos[1];
+        groupPositions[4*i+2] = (float) pos[2];
+        groupPositions[4*i+3] = 0.0f;
+    }
+    neighborList->computeNeighborList(numPoints, groupPositions, groupExclusions, periodicBoxVectors, usePeriodic, (float) (1.01*cutoffDistance), threads);
+    const int blockSize = neighborList->getBlockSize();
+    for (int blockIndex = 0; blockIndex < neighborList->getNumBlocks(); blockIndex++) {
+        const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
+        const vector<int16_t>& blockExclusions = neighborList->getBlockExclusions(blockIndex);
+        int numNeighbors = neighbors.size();
+        for (int i = 0; i < blockSize; i++) {
+            int p1 = neighborList->getSortedAtoms()[blockSize*blockIndex+i];
+            for (int j = 0; j < numNeighbors; j++) {
+                if ((blockExclusions[j] & (1<<i)) != 0)
+                    continue;
+                int p2 = neighbors[j];
+                int donor, acceptor;
+                if (p1 < numDonors && p2 >= numDonors) {
+                    donor = p1;
+                    acceptor = p2-numDonors;
+                }
+                else if (p2 < numDonors && p1 >= numDonors) {
+                    donor = p2;
+                    acceptor = p1-numDonors;
+                }
+                else
+                    continue;
+                if (exclusions[donor].find(acceptor) == exclusions[donor].end())
+                    donorNeighbors[donor].push_back(acceptor);
+            }
+        }
+    }
+}
+
+void CpuCustomHbondForce::threadComputeForce(ThreadPool& threads, int threadIndex) {
+    float* forces = &(*threadForce)[threadIndex][0];
+    ThreadData& data = *threadData[threadIndex];
+    data.energy = 0;
+    for (auto& param : *globalParameters)
+        data.expressionSet.setVariable(data.expressionSet.getVariableIndex(param.first), param.second);
+    while (true) {
+        int donor = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
+        if (donor >= numDonors)
+            break;
+        for (int j = 0; j < (int) data.donorParamIndices.size(); j++)
+            data.expressionSet.setVariable(data.donorParamIndices[j], donorParameters[donor][j]);
+        if (useCutoff) {
+            for (int acceptor : donorNeighbors[donor])
+                calculateOneIxn(donor, acceptor, forces, data);
+        }
+        else {
+            // Without a cutoff, every donor interacts with every acceptor that is not excluded.
+
+            const set<int>& excluded = exclusions[donor];
+            for (int acceptor = 0; acceptor < numAcceptors; acceptor++)
+                if (excluded.find(acceptor) == excluded.end())
+                    calculateOneIxn(donor, acceptor, forces, data);
+        }
+    }
+}
+
+void CpuCustomHbondForce::calculateOneIxn(int donor, int acceptor, float* forces, ThreadData& data) {
+    int atoms[6];
+    atoms[0] = acceptorAtoms[acceptor][0];
+    atoms[1] = acceptorAtoms[acceptor][1];
+    atoms[2] = acceptorAtoms[acceptor][2];
+    atoms[3] = donorAtoms[donor][0];
+    atoms[4] = donorAtoms[donor][1];
+    atoms[5] = donorAtoms[donor][2];
+
+    // Compute the distance between the primary donor and acceptor atoms, and compare to the cutoff.
+
+    if (useCutoff) {
+        double delta[ReferenceForce::LastDeltaRIndex];
+        computeDelta(atoms[0], atoms[3], delta);
+        if (delta[ReferenceForce::RIndex] >= cutoffDistance)
+            return;
+    }
+    CompiledExpressionSet& expressionSet = data.expressionSet;
+    for (int j = 0; j < (int) data.acceptorParamIndices.size(); j++)
+        expressionSet.setVariable(data.acceptorParamIndices[j], acceptorParameters[acceptor][j]);
+
+    // Compute all of the variables the energy can depend on.
+
+    for (auto& term : data.distanceTerms) {
+        computeDelta(atoms[term.p1], atoms[term.p2], term.delta);
+        expressionSet.setVariable(term.variableIndex, term.delta[ReferenceForce::RIndex]);
+    }
+    for (auto& term : data.angleTerms) {
+        computeDelta(atoms[term.p1], atoms[term.p2], term.delta1);
+        computeDelta(atoms[term.p3], atoms[term.p2], term.delta2);
+        expressionSet.setVariable(term.variableIndex, computeAngle(term.delta1, term.delta2));
+    }
+    for (auto& term : data.dihedralTerms) {
+        computeDelta(atoms[term.p2], atoms[term.p1], term.delta1);
+        computeDelta(atoms[term.p2], atoms[term.p3], term.delta2);
+        computeDelta(atoms[term.p4], atoms[term.p3], term.delta3);
+        double dotDihedral, signOfDihedral;
+        double* crossProduct[] = {term.cross1, term.cross2};
+        expressionSet.setVariable(term.variableIndex, ReferenceBondIxn::getDihedralAngleBetweenThreeVectors(term.delta1, term.delta2, term.delta3,
+                crossProduct, &dotDihedral, term.delta1, &signOfDihedral, 1));
+    }
+
+    if (includeForces) {
+        // Apply forces based on distances.
+
+        for (auto& term : data.distanceTerms) {
+            double dEdR = term.forceExpression.evaluate()/(term.delta[ReferenceForce::RIndex]);
+            for (int i = 0; i < 3; i++) {
+               double force = -dEdR*term.delta[i];
+               forces[4*atoms[term.p1]+i] -= force;
+               forces[4*atoms[term.p2]+i] += force;
+            }
+        }
+
+        // Apply forces based on angles.
+
+        for (auto& term : data.angleTerms) {
+            double dEdTheta = term.forceExpression.evaluate();
+            double thetaCross[ReferenceForce::LastDeltaRIndex];
+            SimTKOpenMMUtilities::crossProductVector3(term.delta1, term.delta2, thetaCross);
+            double lengthThetaCross = sqrt(DOT3(thetaCross, thetaCross));
+            if (lengthThetaCross < 1.0e-06)
+                lengthThetaCross = 1.0e-06;
+            double termA = dEdTheta/(term.delta1[ReferenceForce::R2Index]*lengthThetaCross);
+            double termC = -dEdTheta/(term.delta2[ReferenceForce::R2Index]*lengthThetaCross);
+            double deltaCrossP[3][3];
+            SimTKOpenMMUtilities::crossProductVector3(term.delta1, thetaCross, deltaCrossP[0]);
+            SimTKOpenMMUtilities::crossProductVector3(term.delta2, thetaCross, deltaCrossP[2]);
+            for (int i = 0; i < 3; i++) {
+                deltaCrossP[0][i] *= termA;
+                deltaCrossP[2][i] *= termC;
+                deltaCrossP[1][i] = -(deltaCrossP[0][i]+deltaCrossP[2][i]);
+            }
+            for (int i = 0; i < 3; i++) {
+                forces[4*atoms[term.p1]+i] += deltaCrossP[0][i];
+                forces[4*atoms[term.p2]+i] += deltaCrossP[1][i];
+                forces[4*atoms[term.p3]+i] += deltaCrossP[2][i];
+            }
+        }
+
+        // Apply forces based on dihedrals.
+
+        for (auto& term : data.dihedralTerms) {
+            double dEdTheta = term.forceExpression.evaluate();
+            double internalF[4][3];
+            double forceFactors[4];
+            double normCross1 = DOT3(term.cross1, term.cross1);
+            double normBC = term.delta2[ReferenceForce::RIndex];
+            forceFactors[0] = (-dEdTheta*normBC)/normCross1;
+            double normCross2 = DOT3(term.cross2, term.cross2);
+            forceFactors[3] = (dEdTheta*normBC)/normCross2;
+            forceFactors[1] = DOT3(term.delta1, term.delta2);
+            forceFactors[1] /= term.delta2[ReferenceForce::R2Index];
+            forceFactors[2] = DOT3(term.delta3, term.delta2);
+            forceFactors[2] /= term.delta2[ReferenceForce::R2Index];
+            for (int i = 0; i < 3; i++) {
+                internalF[0][i] = forceFactors[0]*term.cross1[i];
+                internalF[3][i] = forceFactors[3]*term.cross2[i];
+                double s = forceFactors[1]*internalF[0][i] - forceFactors[2]*internalF[3][i];
+                internalF[1][i] = internalF[0][i] - s;
+                internalF[2][i] = internalF[3][i] + s;
+            }
+            for (int i = 0; i < 3; i++) {
+                forces[4*atoms[term.p1]+i] += internalF[0][i];
+                forces[4*atoms[term.p2]+i] -= internalF[1][i];
+                forces[4*atoms[term.p3]+i] -= internalF[2][i];
+                forces[4*atoms[term.p4]+i] += internalF[3][i];
+            }
+        }
+    }
+
+    // Add the energy
+
+    if (includeEnergy)
+        data.energy += data.energyExpression.evaluate();
+}
+
+void CpuCustomHbondForce::computeDelta(int atom1, int atom2, double* delta) const {
+    vector<Vec3>& pos = *atomCoordinates;
+    if (usePeriodic)
+        ReferenceForce::getDeltaRPeriodic(pos[atom1], pos[atom2], periodicBoxVectors, delta);
+    else
+        ReferenceForce::getDeltaR(pos[atom1], pos[atom2], delta);
+}
+
+double CpuCustomHbondForce::computeAngle(double* vec1, double* vec2) {
+    double dot = DOT3(vec1, vec2);
+    double cosine = dot/sqrt((vec1[ReferenceForce::R2Index]*vec2[ReferenceForce::R2Index]));
+    double angle;
+    if (cosine >= 1)
+        angle = 0;
+    else if (cosine <= -1)
+        angle = PI_M;
+    else
+        angle = acos(cosine);
+    return angle;
+}
+
+CpuCustomHbondForce::DistanceTermInfo::DistanceTermInfo(const string& name, const vector<int>& atoms, const Lepton::CompiledExpression& forceExpression, ThreadData& data) :
+        p1(atoms[0]), p2(atoms[1]), forceExpression(forceExpression) {
+    variableIndex = data.expressionSet.getVariableIndex(name);
+}
+
+CpuCustomHbondForce::AngleTermInfo::AngleTermInfo(const string& name, const vector<int>& atoms, const Lepton::CompiledExpression& forceExpression, ThreadData& data) :
+        p1(atoms[0]), p2(atoms[1]), p3(atoms[2]), forceExpression(forceExpression) {
+    variableIndex = data.expressionSet.getVariableIndex(name);
+}
+
+CpuCustomHbondForce::DihedralTermInfo::DihedralTermInfo(const string& name, const vector<int>& atoms, const Lepton::CompiledExpression& forceExpression, ThreadData& data) :
+        p1(atoms[0]), p2(atoms[1]), p3(atoms[2]), p4(atoms[3]), forceExpression(forceExpression) {
+    variableIndex = data.expressionSet.getVariableIndex(name);
+}
+
+CpuCustomHbondForce::ThreadData::ThreadData(const CustomHbondForce& force, Lepton::ParsedExpression& energyExpr,
+            map<string, vector<int> >& distances, map<string, vector<int> >& angles, map<string, vector<int> >& dihedrals) {
+    energyExpression = energyExpr.createCompiledExpression();
+    expressionSet.registerExpression(energyExpression);
+    for (int i = 0; i < force.getNumPerDonorParameters(); i++)
+        donorParamIndices.push_back(expressionSet.getVariableIndex(force.getPerDonorParameterName(i)));
+    for (int i = 0; i < force.getNumPerAcceptorParameters(); i++)
+        acceptorParamIndices.push_back(expressionSet.getVariableIndex(force.getPerAcceptorParameterName(i)));
+
+    // Differentiate the energy to get expressions for the force.
+
+    for (auto& term : distances)
+        distanceTerms.push_back(CpuCustomHbondForce::DistanceTermInfo(term.first, term.second, energyExpr.differentiate(term.first).optimize().createCompiledExpression(), *this));
+    for (auto& term : angles)
+        angleTerms.push_back(CpuCustomHbondForce::AngleTermInfo(term.first, term.second, energyExpr.differentiate(term.first).optimize().createCompiledExpression(), *this));
+    for (auto& term : dihedrals)
+        dihedralTerms.push_back(CpuCustomHbondForce::DihedralTermInfo(term.first, term.second, energyExpr.differentiate(term.first).optimize().createCompiledExpression(), *this));
+    for (auto& term : distanceTerms)
+        expressionSet.registerExpression(term.forceExpression);
+    for (auto& term : angleTerms)
+        expressionSet.registerExpression(term.forceExpression);
+    for (auto& term : dihedralTerms)
+        expressionSet.registerExpression(term.forceExpression);
+}
@@ -55,6 +55,36 @@ CpuCustomNonbondedForce::ThreadData::ThreadData(const Lepton::CompiledExpression
         expression.setVariableLocations(variableLocations);
         expressionSet.registerExpression(expression);
     }
+
+    // When processing neighbor blocks, r and the parameters of the second atom vary between interactions
+    // and are passed to the expressions in arrays.
+
+    vector<string> batchVariables;
+    batchVariables.push_back("r");
+    for (auto& param : parameterNames)
+        batchVariables.push_back(param+"2");
+    batchParam.resize(parameterNames.size());
+    batchValues.resize(batchVariables.size());
+    this->energyExpression.setBatchVariables(batchVariables);
+    this->forceExpression.setBatchVariables(batchVariables);
+    for (auto& expression : this->energyParamDerivExpressions)
+        expression.setBatchVariables(batchVariables);
+}
+
+void CpuCustomNonbondedForce::ThreadData::resizeBatch(int size) {
+    if ((int) batchR.size() >= size)
+        return;
+    batchAtom.resize(size);
+    batchDelta.resize(size);
+    batchR.resize(size);
+    batchForce.resize(size);
+    batchEnergy.resize(size);
+    batchEnergyParamDerivs.resize(size*energyParamDerivExpressions.size());
+    batchValues[0] = &batchR[0];
+    for (int i = 0; i < (int) batchParam.size(); i++) {
+        batchParam[i].resize(size);
+        batchValues[i+1] = &batchParam[i][0];
+    }
 }
 
 CpuCustomNonbondedForce::CpuCustomNonbondedForce(const Lepton::CompiledExpression& energyExpression,
@@ -199,19 +229,35 @@ void CpuCustomNonbondedForce::threadComputeForce(ThreadPool& threads, int thread
             const int blockSize = neighborList->getBlockSize();
             const int* blockAtom = &neighborList->getSortedAtoms()[blockSize*blockIndex];
             const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
-            const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
+            const vector<int16_t>& exclusions = neighborList->getBlockExclusions(blockIndex);
+            data.resizeBatch(blockSize);
             for (int i = 0; i < (int) neighbors.size(); i++) {
                 int first = neighbors[i];
                 for (int j = 0; j < (int) paramNames.size(); j++)
                     data.particleParam[j*2] = atomParameters[first][j];
+
+                // Collect the interactions that are inside the cutoff, then evaluate them all at once.
+
+                fvec4 posI(posq+4*first);
+                int numInteractions = 0;
                 for (int k = 0; k < blockSize; k++) {
                     if ((exclusions[i] & (1<<k)) == 0) {
                         int second = blockAtom[k];
+                        fvec4 deltaR;
+                        fvec4 posJ(posq+4*second);
+                        float r2;
+                        getDeltaR(posI, posJ, deltaR, r2, boxSize, invBoxSize);
+                        if (r2 >= cutoffDistance*cutoffDistance)
+                            continue;
+                        data.batchAtom[numInteractions] = second;
+                        data.batchDelta[numInteractions] = deltaR;
+                        data.batchR[numInteractions] = sqrtf(r2);
                         for (int j = 0; j < (int) paramNames.size(); j++)
-                            data.particleParam[j*2+1] = atomParameters[second][j];
-                        calculateOneIxn(first, second, data, forces, energy, boxSize, invBoxSize);
+                            data.batchParam[j][numInteractions] = atomParameters[second][j];
+                        numInteractions++;
                     }
                 }
+                calculateBatchIxn(first, numInteractions, data, forces, energy);
             }
         }
     }
@@ -265,9 +311,11 @@ void CpuCustomNonbondedForce::calculateOneIxn(int ii, int jj, ThreadData& data,
             energy *= switchValue;
         }
     }
-    fvec4 result = deltaR*dEdR;
-    (fvec4(forces+4*ii)+result).store(forces+4*ii);
-    (fvec4(forces+4*jj)-result).store(forces+4*jj);
+    if (includeForce) {
+        fvec4 result = deltaR*dEdR;
+        (fvec4(forces+4*ii)+result).store(forces+4*ii);
+        (fvec4(forces+4*jj)-result).store(forces+4*jj);
+    }
 
     // accumulate energies
 
@@ -279,6 +327,46 @@ void CpuCustomNonbondedForce::calculateOneIxn(int ii, int jj, ThreadData& data,
         data.energyParamDerivs[i] += switchValue*data.energyParamDerivExpressions[i].evaluate();
 }
 
+void CpuCustomNonbondedForce::calculateBatchIxn(int atom1, int numInteractions, ThreadData& data, float* forces, double& totalEnergy) {
+    if (numInteractions == 0)
+        return;
+    const double* const* values = &data.batchValues[0];
+    int numDerivs = data.energyParamDerivExpressions.size();
+    int stride = data.batchR.size();
+    if (includeForce)
+        data.forceExpression.evaluateBatch(numInteractions, values, &data.batchForce[0]);
+    if (includeEnergy || useSwitch)
+        data.energyExpression.evaluateBatch(numInteractions, values, &data.batchEnergy[0]);
+    for (int i = 0; i < numDerivs; i++)
+        data.energyParamDerivExpressions[i].evaluateBatch(numInteractions, values, &data.batchEnergyParamDerivs[i*stride]);
+    for (int k = 0; k < numInteractions; k++) {
+        int atom2 = data.batchAtom[k];
+        double r = data.batchR[k];
+        double dEdR = (includeForce ? data.batchForce[k]/r : 0.0);
+        double energy = 0.0;
+        if (includeEnergy || (useSwitch && r > switchingDistance))
+            energy = data.batchEnergy[k];
+        double switchValue = 1.0;
+        if (useSwitch) {
+            if (r > switchingDistance) {
+                double t = (r-switchingDistance)/(cutoffDistance-switchingDistance);
+                switchValue = 1+t*t*t*(-10+t*(15-t*6));
+                double switchDeriv = t*t*(-30+t*(60-t*30))/(cutoffDistance-switchingDistance);
+                dEdR = switchValue*dEdR + energy*switchDeriv/r;
+                energy *= switchValue;
+            }
+        }
+        if (includeForce) {
+            fvec4 result = data.batchDelta[k]*dEdR;
+            (fvec4(forces+4*atom1)+result).store(forces+4*atom1);
+            (fvec4(forces+4*atom2)-result).store(forces+4*atom2);
+        }
+        totalEnergy += energy;
+        for (int i = 0; i < numDerivs; i++)
+            data.energyParamDerivs[i] += switchValue*data.batchEnergyParamDerivs[i*stride+k];
+    }
+}
+
 void CpuCustomNonbondedForce::getDeltaR(const fvec4& posI, const fvec4& posJ, fvec4& deltaR, float& r2, const fvec4& boxSize, const fvec4& invBoxSize) const {
     deltaR = posJ-posI;
     if (periodic) {
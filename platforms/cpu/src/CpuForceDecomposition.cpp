@@ -0,0 +1,211 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2018 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuForceDecomposition.h"
+#include "openmm/internal/vectorize.h"
+#include <algorithm>
+
+using namespace OpenMM;
+using namespace std;
+
+CpuForceDecomposition::CpuForceDecomposition(int numThreads) : enabled(false), neighborList(NULL), numAtoms(0), isDense(numThreads, false) {
+}
+
+void CpuForceDecomposition::setEnabled(bool enabled) {
+    this->enabled = enabled;
+}
+
+void CpuForceDecomposition::update(const CpuNeighborList& neighborList, int numAtoms, ThreadPool& threads) {
+    this->neighborList = &neighborList;
+    this->numAtoms = numAtoms;
+    int numThreads = threads.getNumThreads();
+    int numBlocks = neighborList.getNumBlocks();
+    int blockSize = neighborList.getBlockSize();
+
+    // Divide the blocks into contiguous ranges with roughly equal numbers of interactions.
+
+    long long totalWork = 0;
+    for (int i = 0; i < numBlocks; i++)
+        totalWork += blockSize+neighborList.getBlockNeighbors(i).size();
+    threadBlockStart.resize(numThreads+1);
+    threadBlockStart[0] = 0;
+    long long work = 0;
+    int block = 0;
+    for (int i = 1; i < numThreads; i++) {
+        long long targetWork = (totalWork*i)/numThreads;
+        while (block < numBlocks && work < targetWork) {
+            work += blockSize+neighborList.getBlockNeighbors(block).size();
+            block++;
+        }
+        threadBlockStart[i] = block;
+    }
+    threadBlockStart[numThreads] = numBlocks;
+
+    // Record which thread owns each atom, then find the atoms each thread's blocks touch that are owned
+    // by other threads.  The last block may be padded with extra copies of atom 0, so every entry in
+    // each block is checked.
+
+    atomOwner.resize(numAtoms);
+    haloAtoms.resize(numThreads);
+    const vector<int>& sortedAtoms = neighborList.getSortedAtoms();
+    threads.execute([&] (ThreadPool& threads, int threadIndex) {
+        int start, end;
+        getThreadAtomRange(threadIndex, start, end);
+        for (int i = start; i < end; i++)
+            atomOwner[sortedAtoms[i]] = threadIndex;
+        threads.syncThreads();
+        vector<vector<int> >& halo = haloAtoms[threadIndex];
+        halo.resize(numThreads);
+        for (vector<int>& atoms : halo)
+            atoms.resize(0);
+        for (int block = threadBlockStart[threadIndex]; block < threadBlockStart[threadIndex+1]; block++) {
+            for (int i = 0; i < blockSize; i++) {
+                int atom = sortedAtoms[block*blockSize+i];
+                if (atomOwner[atom] != threadIndex)
+                    halo[atomOwner[atom]].push_back(atom);
+            }
+            for (int atom : neighborList.getBlockNeighbors(block))
+                if (atomOwner[atom] != threadIndex)
+                    halo[atomOwner[atom]].push_back(atom);
+        }
+        for (vector<int>& atoms : halo) {
+            sort(atoms.begin(), atoms.end());
+            atoms.erase(unique(atoms.begin(), atoms.end()), atoms.end());
+        }
+    });
+    threads.waitForThreads();
+    threads.resumeThreads();
+    threads.waitForThreads();
+}
+
+void CpuForceDecomposition::getThreadBlockRange(int threadIndex, int& start, int& end) const {
+    start = threadBlockStart[threadIndex];
+    end = threadBlockStart[threadIndex+1];
+}
+
+void CpuForceDecomposition::getThreadAtomRange(int threadIndex, int& start, int& end) const {
+    int blockSize = neighborList->getBlockSize();
+    start = min(numAtoms, threadBlockStart[threadIndex]*blockSize);
+    end = min(numAtoms, threadBlockStart[threadIndex+1]*blockSize);
+}
+
+void CpuForceDecomposition::markDense(int threadIndex) {
+    isDense[threadIndex] = true;
+}
+
+void CpuForceDecomposition::markAllDense() {
+    for (int i = 0; i < (int) isDense.size(); i++)
+        isDense[i] = true;
+}
+
+void CpuForceDecomposition::sumForces(vector<AlignedArray<float> >& threadForce, vector<Vec3>& forces, ThreadPool& threads) {
+    int numThreads = threads.getNumThreads();
+    if (!enabled)
+        markAllDense();
+    vector<int> denseThreads;
+    for (int i = 0; i < numThreads; i++)
+        if (isDense[i])
+            denseThreads.push_back(i);
+    int numParticles = forces.size();
+    threads.execute([&] (ThreadPool& threads, int threadIndex) {
+        fvec4 zero(0.0f);
+        if (isActive()) {
+            // Sum the forces on the atoms owned by this thread.
+
+            const vector<int>& sortedAtoms = neighborList->getSortedAtoms();
+            int start, end;
+            getThreadAtomRange(threadIndex, start, end);
+            float* ownForce = &threadForce[threadIndex][0];
+            bool ownIsDense = isDense[threadIndex];
+            for (int i = start; i < end; i++) {
+                int atom = sortedAtoms[i];
+                fvec4 f(0.0f);
+                if (!ownIsDense) {
+                    f += fvec4(ownForce+4*atom);
+                    zero.store(ownForce+4*atom);
+                }
+                for (int j : denseThreads) {
+                    f += fvec4(&threadForce[j][4*atom]);
+                    zero.store(&threadForce[j][4*atom]);
+                }
+                forces[atom][0] += f[0];
+                forces[atom][1] += f[1];
+                forces[atom][2] += f[2];
+            }
+
+            // Add the contributions other threads have made to them.
+
+            for (int j = 0; j < numThreads; j++) {
+                if (j == threadIndex || isDense[j])
+                    continue;
+                float* otherForce = &threadForce[j][0];
+                for (int atom : haloAtoms[j][threadIndex]) {
+                    fvec4 f(otherForce+4*atom);
+                    zero.store(otherForce+4*atom);
+                    forces[atom][0] += f[0];
+                    forces[atom][1] += f[1];
+                    forces[atom][2] += f[2];
+                }
+            }
+        }
+        else if (denseThreads.size() > 0) {
+            // Without a decomposition, only the dense buffers can contain forces.  Divide them up by atom index.
+
+            int start = threadIndex*numParticles/numThreads;
+            int end = (threadIndex+1)*numParticles/numThreads;
+            for (int i = start; i < end; i++) {
+                fvec4 f(0.0f);
+                for (int j : denseThreads) {
+                    f += fvec4(&threadForce[j][4*i]);
+                    zero.store(&threadForce[j][4*i]);
+                }
+                forces[i][0] += f[0];
+                forces[i][1] += f[1];
+                forces[i][2] += f[2];
+            }
+        }
+    });
+    threads.waitForThreads();
+    for (int i = 0; i < numThreads; i++)
+        isDense[i] = false;
+}
+
+void CpuForceDecomposition::clearForces(vector<AlignedArray<float> >& threadForce, ThreadPool& threads) {
+    threads.execute([&] (ThreadPool& threads, int threadIndex) {
+        fvec4 zero(0.0f);
+        int numParticles = threadForce[threadIndex].size()/4;
+        for (int i = 0; i < numParticles; i++)
+            zero.store(&threadForce[threadIndex][4*i]);
+    });
+    threads.waitForThreads();
+    for (int i = 0; i < (int) isDense.size(); i++)
+        isDense[i] = false;
+}
@@ -36,7 +36,7 @@ const int CpuGBSAOBCForce::NUM_TABLE_POINTS = 4096;
 const float CpuGBSAOBCForce::TABLE_MIN = 0.25f;
 const float CpuGBSAOBCForce::TABLE_MAX = 1.5f;
 
-CpuGBSAOBCForce::CpuGBSAOBCForce() : cutoff(false), periodic(false) {
+CpuGBSAOBCForce::CpuGBSAOBCForce() : cutoff(false), periodic(false), hasFusedBornSums(false), useFusedBornSums(false), neighborList(NULL) {
     logDX = (TABLE_MAX-TABLE_MIN)/NUM_TABLE_POINTS;
     logDXInv = 1.0f/logDX;
     logTable.resize(NUM_TABLE_POINTS+4);
@@ -46,11 +46,18 @@ CpuGBSAOBCForce::CpuGBSAOBCForce() : cutoff(false), periodic(false) {
     }
 }
 
+CpuGBSAOBCForce::~CpuGBSAOBCForce() {
+}
+
 void CpuGBSAOBCForce::setUseCutoff(float distance) {
     cutoff = true;
     cutoffDistance = distance;
 }
 
+void CpuGBSAOBCForce::setNeighborList(const CpuNeighborList& neighbors) {
+    neighborList = &neighbors;
+}
+
 void CpuGBSAOBCForce::setPeriodic(float* periodicBoxSize) {
     periodic = true;
     this->periodicBoxSize[0] = periodicBoxSize[0];
@@ -84,11 +91,12 @@ void CpuGBSAOBCForce::setParticleParameters(const std::vector<std::pair<float, f
     }
 }
 
-void CpuGBSAOBCForce::computeForce(const AlignedArray<float>& posq, vector<AlignedArray<float> >& threadForce, double* totalEnergy, ThreadPool& threads) {
+void CpuGBSAOBCForce::computeForce(const AlignedArray<float>& posq, vector<AlignedArray<float> >& threadForce, bool includeForces, double* totalEnergy, ThreadPool& threads) {
     // Record the parameters for the threads.
     
     this->posq = &posq[0];
     this->threadForce = &threadForce;
+    this->includeForces = includeForces;
     includeEnergy = (totalEnergy != NULL);
     int numThreads = threads.getNumThreads();
     threadEnergy.resize(numThreads);
@@ -97,21 +105,39 @@ void CpuGBSAOBCForce::computeForce(const AlignedArray<float>& posq, vector<Align
         threadBornForces[i].resize(particleParams.size()+3);
     gmx_atomic_t counter;
     this->atomicCounter = &counter;
+    useFusedBornSums = hasFusedBornSums;
+    hasFusedBornSums = false;
+    if (neighborList != NULL) {
+        if (!useFusedBornSums)
+            findSortedIndices();
+        scaledBornForces.resize(particleParams.size());
+    }
     
-    // Signal the threads to start running and wait for them to finish.
+    // Signal the threads to start running and wait for them to finish.  If another force already accumulated
+    // the Born radius sums, the threads start by combining them.
     
     gmx_atomic_set(&counter, 0);
     threads.execute([&] (ThreadPool& threads, int threadIndex) { threadComputeForce(threads, threadIndex); });
     threads.waitForThreads(); // Compute Born radii
+    if (neighborList != NULL && !useFusedBornSums) {
+        threads.resumeThreads();
+        threads.waitForThreads(); // Combine the Born radius sums
+    }
     gmx_atomic_set(&counter, 0);
     threads.resumeThreads();
     threads.waitForThreads(); // Compute surface area term
     gmx_atomic_set(&counter, 0);
     threads.resumeThreads();
     threads.waitForThreads(); // First loop
-    gmx_atomic_set(&counter, 0);
-    threads.resumeThreads();
-    threads.waitForThreads(); // Second loop
+    if (includeForces) {
+        if (neighborList != NULL) {
+            threads.resumeThreads();
+            threads.waitForThreads(); // Combine the Born forces
+        }
+        gmx_atomic_set(&counter, 0);
+        threads.resumeThreads();
+        threads.waitForThreads(); // Second loop
+    }
     
     // Combine the energies from all the threads.
     
@@ -124,16 +150,14 @@ void CpuGBSAOBCForce::computeForce(const AlignedArray<float>& posq, vector<Align
 }
 
 void CpuGBSAOBCForce::threadComputeForce(ThreadPool& threads, int threadIndex) {
+    if (neighborList != NULL) {
+        threadComputeForceWithNeighborList(threads, threadIndex);
+        return;
+    }
     int numParticles = particleParams.size();
     int numThreads = threads.getNumThreads();
-    const float dielectricOffset = 0.009;
-    const float alphaObc = 1.0f;
-    const float betaObc = 0.8f;
-    const float gammaObc = 4.85f;
     fvec4 boxSize(periodicBoxSize[0], periodicBoxSize[1], periodicBoxSize[2], 0);
     fvec4 invBoxSize((1/periodicBoxSize[0]), (1/periodicBoxSize[1]), (1/periodicBoxSize[2]), 0);
-    int start = (threadIndex*numParticles)/numThreads;
-    int end = ((threadIndex+1)*numParticles)/numThreads;
 
     // Calculate Born radii
 
@@ -193,42 +217,15 @@ void CpuGBSAOBCForce::threadComputeForce(ThreadPool& threads, int threadIndex) {
                 }
             }
         }
-        for (int i = 0; i < numInBlock; i++) {
-            int atomIndex = blockStart+i;
-            sum[i] *= 0.5f*atomRadius[i];
-            float sum2 = sum[i]*sum[i];
-            float sum3 = sum[i]*sum2;
-            float tanhSum = tanh(alphaObc*sum[i] - betaObc*sum2 + gammaObc*sum3);
-            float radiusI = atomRadius[i] + dielectricOffset;
-            bornRadii[atomIndex] = 1.0f/(1.0f/atomRadius[i] - tanhSum/radiusI);
-            obcChain[atomIndex] = atomRadius[i]*(alphaObc - 2.0f*betaObc*sum[i] + 3.0f*gammaObc*sum2);
-            obcChain[atomIndex] = (1.0f - tanhSum*tanhSum)*obcChain[atomIndex]/radiusI;
-        }
+        for (int i = 0; i < numInBlock; i++)
+            computeBornRadius(blockStart+i, sum[i]);
     }
     threads.syncThreads();
 
     // Calculate ACE surface area term.
 
-    const float probeRadius = 0.14f;
-    double energy = 0.0;
+    double energy = computeSurfaceArea(threadIndex);
     AlignedArray<float>& bornForces = threadBornForces[threadIndex];
-    for (int i = 0; i < numParticles; i++)
-        bornForces[i] = 0.0f;
-    while (true) {
-        int atomI = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
-        if (atomI >= numParticles)
-            break;
-        if (bornRadii[atomI] > 0) {
-            float radiusI = particleParams[atomI].first + dielectricOffset;
-            float r = radiusI + probeRadius;
-            float ratio6 = powf(radiusI/bornRadii[atomI], 6.0f);
-            float saTerm = surfaceAreaFactor*r*r*ratio6;
-            energy += saTerm;
-            bornForces[atomI] = -6.0f*saTerm/bornRadii[atomI]; 
-        }
-        else
-            bornForces[atomI] = 0.0f;
-    }
     threads.syncThreads();
  
     // First loop of Born energy computation.
@@ -281,6 +278,15 @@ void CpuGBSAOBCForce::threadComputeForce(ThreadPool& threads, int threadIndex) {
             fvec4 denominator2 = r2 + alpha2_ij*expTerm;
             fvec4 denominator = sqrt(denominator2);
             fvec4 Gpol = (partialChargeI*posJ[3])/denominator; 
+            fvec4 one(1.0f);
+            ivec4 atomJMask = include & (blockAtomIndex != ivec4(atomJ));
+            fvec4 termEnergy = blend(0.0f, Gpol, include);
+            if (cutoff)
+                termEnergy -= blend(0.0f, partialChargeI*posJ[3]/cutoffDistance, atomJMask);
+            termEnergy *= blend(0.5f, 1.0f, atomJMask);
+            energy += dot4(termEnergy, one);
+            if (!includeForces)
+                continue;
             fvec4 dGpol_dr = -Gpol*(1.0f - 0.25f*expTerm)/denominator2;  
             fvec4 dGpol_dalpha2_ij = -0.5f*Gpol*expTerm*(1.0f + D_ij)/denominator2;
             dGpol_dr = blend(0.0f, dGpol_dr, include);
@@ -293,18 +299,13 @@ void CpuGBSAOBCForce::threadComputeForce(ThreadPool& threads, int threadIndex) {
             blockAtomForceZ -= fz;
             blockAtomBornForce += dGpol_dalpha2_ij*bornRadii[atomJ];
             float* atomForce = forces+4*atomJ;
-            fvec4 one(1.0f);
             atomForce[0] += dot4(fx, one);
             atomForce[1] += dot4(fy, one);
             atomForce[2] += dot4(fz, one);
-            ivec4 atomJMask = include & (blockAtomIndex != ivec4(atomJ));
-            fvec4 termEnergy = blend(0.0f, Gpol, include);
-            if (cutoff)
-                termEnergy -= blend(0.0f, partialChargeI*posJ[3]/cutoffDistance, atomJMask);
-            termEnergy *= blend(0.5f, 1.0f, atomJMask);
-            energy += dot4(termEnergy, one);
             bornForces[atomJ] += dot4(blend(0.0f, dGpol_dalpha2_ij, atomJMask), radii);
         }
+        if (!includeForces)
+            continue;
         fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
         transpose(f[0], f[1], f[2], f[3]);
         for (int i = 0; i < numInBlock; i++) {
@@ -313,6 +314,12 @@ void CpuGBSAOBCForce::threadComputeForce(ThreadPool& threads, int threadIndex) {
             bornForces[atomIndex] += blockAtomBornForce[i];
         }
     }
+    if (!includeForces) {
+        // The second loop only applies the chain rule terms to the forces, so it can be skipped.
+
+        threadEnergy[threadIndex] = energy;
+        return;
+    }
     threads.syncThreads();
 
     // Second loop of Born energy computation.
@@ -395,6 +402,349 @@ void CpuGBSAOBCForce::threadComputeForce(ThreadPool& threads, int threadIndex) {
     threadEnergy[threadIndex] = energy;
 }
 
+void CpuGBSAOBCForce::threadComputeForceWithNeighborList(ThreadPool& threads, int threadIndex) {
+    int numParticles = particleParams.size();
+    int numThreads = threads.getNumThreads();
+    int numBlocks = neighborList->getNumBlocks();
+    int start = (threadIndex*numParticles)/numThreads;
+    int end = ((threadIndex+1)*numParticles)/numThreads;
+    fvec4 boxSize(periodicBoxSize[0], periodicBoxSize[1], periodicBoxSize[2], 0);
+    fvec4 invBoxSize((1/periodicBoxSize[0]), (1/periodicBoxSize[1]), (1/periodicBoxSize[2]), 0);
+
+    // Accumulate this thread's contributions to the Born radius sums.  Each pair appears only once in the
+    // neighbor list, so both directions are computed together.  The sums share storage with the Born forces,
+    // which are not needed until later.  This is skipped if another force already computed them.
+
+    AlignedArray<float>& bornForces = threadBornForces[threadIndex];
+    if (!useFusedBornSums) {
+        for (int i = 0; i < numParticles; i++)
+            bornForces[i] = 0.0f;
+        while (true) {
+            int block = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
+            if (block >= numBlocks)
+                break;
+            computeNeighborBornSums(block, &bornForces[0], boxSize, invBoxSize);
+        }
+        threads.syncThreads();
+    }
+
+    // Combine the sums from all threads and compute the Born radii.
+
+    for (int i = start; i < end; i++) {
+        float sum = 0.0f;
+        for (int j = 0; j < numThreads; j++)
+            sum += threadBornForces[j][i];
+        computeBornRadius(i, sum);
+    }
+    threads.syncThreads();
+
+    // Calculate ACE surface area term.
+
+    double energy = computeSurfaceArea(threadIndex);
+    threads.syncThreads();
+
+    // First loop of Born energy computation.
+
+    float* forces = &(*threadForce)[threadIndex][0];
+    while (true) {
+        int block = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
+        if (block >= numBlocks)
+            break;
+        computeNeighborBornEnergy(block, forces, &bornForces[0], energy, boxSize, invBoxSize);
+    }
+    if (!includeForces) {
+        threadEnergy[threadIndex] = energy;
+        return;
+    }
+    threads.syncThreads();
+
+    // Combine the Born forces from all threads and apply the chain rule factor.
+
+    for (int i = start; i < end; i++) {
+        float bornForce = 0.0f;
+        for (int j = 0; j < numThreads; j++)
+            bornForce += threadBornForces[j][i];
+        scaledBornForces[i] = bornForce*bornRadii[i]*bornRadii[i]*obcChain[i];
+    }
+    threads.syncThreads();
+
+    // Second loop of Born energy computation.
+
+    while (true) {
+        int block = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
+        if (block >= numBlocks)
+            break;
+        computeNeighborChainRule(block, forces, boxSize, invBoxSize);
+    }
+    threadEnergy[threadIndex] = energy;
+}
+
+void CpuGBSAOBCForce::beginFusedBornSums(const float* posq, ThreadPool& threads) {
+    this->posq = posq;
+    int numThreads = threads.getNumThreads();
+    threadBornForces.resize(numThreads);
+    for (int i = 0; i < numThreads; i++)
+        threadBornForces[i].resize(particleParams.size()+3);
+    findSortedIndices();
+    hasFusedBornSums = true;
+}
+
+void CpuGBSAOBCForce::clearFusedBornSums(int threadIndex) {
+    AlignedArray<float>& sums = threadBornForces[threadIndex];
+    int numParticles = particleParams.size();
+    for (int i = 0; i < numParticles; i++)
+        sums[i] = 0.0f;
+}
+
+void CpuGBSAOBCForce::computeFusedBornSums(int blockIndex, int threadIndex, const fvec4& boxSize, const fvec4& invBoxSize) {
+    computeNeighborBornSums(blockIndex, &threadBornForces[threadIndex][0], boxSize, invBoxSize);
+}
+
+void CpuGBSAOBCForce::findSortedIndices() {
+    // Record where each atom appears in the neighbor list, so the threads can tell which block atoms
+    // each neighbor interacts with.
+
+    const vector<int>& sortedAtoms = neighborList->getSortedAtoms();
+    int numParticles = particleParams.size();
+    sortedIndex.resize(numParticles);
+    for (int i = 0; i < numParticles; i++)
+        sortedIndex[sortedAtoms[i]] = i;
+}
+
+void CpuGBSAOBCForce::computeBornRadius(int atom, float sum) {
+    const float dielectricOffset = 0.009;
+    const float alphaObc = 1.0f;
+    const float betaObc = 0.8f;
+    const float gammaObc = 4.85f;
+    float atomRadius = particleParams[atom].first;
+    sum *= 0.5f*atomRadius;
+    float sum2 = sum*sum;
+    float sum3 = sum*sum2;
+    float tanhSum = tanh(alphaObc*sum - betaObc*sum2 + gammaObc*sum3);
+    float radiusI = atomRadius + dielectricOffset;
+    bornRadii[atom] = 1.0f/(1.0f/atomRadius - tanhSum/radiusI);
+    obcChain[atom] = atomRadius*(alphaObc - 2.0f*betaObc*sum + 3.0f*gammaObc*sum2);
+    obcChain[atom] = (1.0f - tanhSum*tanhSum)*obcChain[atom]/radiusI;
+}
+
+double CpuGBSAOBCForce::computeSurfaceArea(int threadIndex) {
+    const float dielectricOffset = 0.009;
+    const float probeRadius = 0.14f;
+    int numParticles = particleParams.size();
+    double energy = 0.0;
+    AlignedArray<float>& bornForces = threadBornForces[threadIndex];
+    for (int i = 0; i < numParticles; i++)
+        bornForces[i] = 0.0f;
+    while (true) {
+        int atomI = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
+        if (atomI >= numParticles)
+            break;
+        if (bornRadii[atomI] > 0) {
+            float radiusI = particleParams[atomI].first + dielectricOffset;
+            float r = radiusI + probeRadius;
+            float ratio6 = powf(radiusI/bornRadii[atomI], 6.0f);
+            float saTerm = surfaceAreaFactor*r*r*ratio6;
+            energy += saTerm;
+            bornForces[atomI] = -6.0f*saTerm/bornRadii[atomI]; 
+        }
+        else
+            bornForces[atomI] = 0.0f;
+    }
+    return energy;
+}
+
+ivec4 CpuGBSAOBCForce::getNeighborMask(int blockIndex, int firstLane, int numInBlock, int neighbor) const {
+    // Within a block, the neighbor list only pairs an atom with the block atoms that precede it, so that
+    // each pair is listed once.  This reproduces that rule while ignoring any exclusions from other forces.
+
+    int offset = sortedIndex[neighbor]-neighborList->getBlockSize()*blockIndex;
+    int limit = (offset < 0 ? numInBlock : min(offset, numInBlock));
+    return ivec4(firstLane, firstLane+1, firstLane+2, firstLane+3) < ivec4(limit);
+}
+
+fvec4 CpuGBSAOBCForce::computeBornSumTerm(const fvec4& offsetRadiusI, const fvec4& scaledRadiusJ, const fvec4& r, const fvec4& rInverse, ivec4 include) {
+    fvec4 rScaledRadiusJ = r+scaledRadiusJ;
+    include = include & (offsetRadiusI < rScaledRadiusJ);
+    fvec4 l_ij = 1.0f/max(offsetRadiusI, abs(r-scaledRadiusJ));
+    fvec4 u_ij = 1.0f/rScaledRadiusJ;
+    fvec4 l_ij2 = l_ij*l_ij;
+    fvec4 u_ij2 = u_ij*u_ij;
+    fvec4 logRatio = fastLog(u_ij/l_ij);
+    fvec4 term = l_ij - u_ij + 0.25f*r*(u_ij2 - l_ij2) + (0.5f*rInverse*logRatio) + (0.25f*scaledRadiusJ*scaledRadiusJ*rInverse)*(l_ij2 - u_ij2);
+    term += blend(0.0f, 2.0f*(1.0f/offsetRadiusI-l_ij), offsetRadiusI < scaledRadiusJ-r);
+    return blend(0.0f, term, include);
+}
+
+fvec4 CpuGBSAOBCForce::computeChainRuleTerm(const fvec4& offsetRadiusI, const fvec4& scaledRadiusJ, const fvec4& r, const fvec4& r2Inverse, ivec4 include) {
+    fvec4 rScaledRadiusJ = r+scaledRadiusJ;
+    include = include & (offsetRadiusI < rScaledRadiusJ);
+    fvec4 l_ij = 1.0f/max(offsetRadiusI, abs(r-scaledRadiusJ));
+    fvec4 u_ij = 1.0f/rScaledRadiusJ;
+    fvec4 l_ij2 = l_ij*l_ij;
+    fvec4 u_ij2 = u_ij*u_ij;
+    fvec4 logRatio = fastLog(u_ij/l_ij);
+    fvec4 t3 = 0.125f*(1.0f + scaledRadiusJ*scaledRadiusJ*r2Inverse)*(l_ij2 - u_ij2) + 0.25f*logRatio*r2Inverse;
+    return blend(0.0f, t3, include);
+}
+
+void CpuGBSAOBCForce::computeNeighborBornSums(int blockIndex, float* sums, const fvec4& boxSize, const fvec4& invBoxSize) {
+    const int blockSize = neighborList->getBlockSize();
+    const int* blockAtom = &neighborList->getSortedAtoms()[blockSize*blockIndex];
+    const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
+    const int numInBlock = min(blockSize, (int) particleParams.size()-blockSize*blockIndex);
+    const float cutoff2 = cutoffDistance*cutoffDistance;
+    const fvec4 one(1.0f);
+    for (int lane = 0; lane < numInBlock; lane += 4) {
+        const int* atoms = blockAtom+lane;
+        fvec4 x(posq[4*atoms[0]], posq[4*atoms[1]], posq[4*atoms[2]], posq[4*atoms[3]]);
+        fvec4 y(posq[4*atoms[0]+1], posq[4*atoms[1]+1], posq[4*atoms[2]+1], posq[4*atoms[3]+1]);
+        fvec4 z(posq[4*atoms[0]+2], posq[4*atoms[1]+2], posq[4*atoms[2]+2], posq[4*atoms[3]+2]);
+        fvec4 offsetRadiusI(particleParams[atoms[0]].first, particleParams[atoms[1]].first, particleParams[atoms[2]].first, particleParams[atoms[3]].first);
+        fvec4 scaledRadiusI(particleParams[atoms[0]].second, particleParams[atoms[1]].second, particleParams[atoms[2]].second, particleParams[atoms[3]].second);
+        fvec4 blockSum(0.0f);
+        for (int atomJ : neighbors) {
+            ivec4 include = getNeighborMask(blockIndex, lane, numInBlock, atomJ);
+            if (!any(include))
+                continue;
+            fvec4 posJ(posq+4*atomJ);
+            fvec4 dx, dy, dz, r2;
+            getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
+            include = include & (r2 < cutoff2);
+            if (!any(include))
+                continue;
+            fvec4 r = sqrt(r2);
+            fvec4 rInverse = 1.0f/r;
+            blockSum += computeBornSumTerm(offsetRadiusI, fvec4(particleParams[atomJ].second), r, rInverse, include);
+            sums[atomJ] += dot4(computeBornSumTerm(fvec4(particleParams[atomJ].first), scaledRadiusI, r, rInverse, include), one);
+        }
+        for (int i = 0; i < 4 && lane+i < numInBlock; i++)
+            sums[atoms[i]] += blockSum[i];
+    }
+}
+
+void CpuGBSAOBCForce::computeNeighborBornEnergy(int blockIndex, float* forces, float* bornForces, double& energy, const fvec4& boxSize, const fvec4& invBoxSize) {
+    const int blockSize = neighborList->getBlockSize();
+    const int* blockAtom = &neighborList->getSortedAtoms()[blockSize*blockIndex];
+    const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
+    const int numInBlock = min(blockSize, (int) particleParams.size()-blockSize*blockIndex);
+    const float cutoff2 = cutoffDistance*cutoffDistance;
+    const fvec4 one(1.0f);
+    float preFactor;
+    if (soluteDielectric != 0.0f && solventDielectric != 0.0f)
+        preFactor = ONE_4PI_EPS0*((1.0f/solventDielectric) - (1.0f/soluteDielectric));
+    else
+        preFactor = 0.0f;
+    for (int lane = 0; lane < numInBlock; lane += 4) {
+        const int* atoms = blockAtom+lane;
+        fvec4 x(posq[4*atoms[0]], posq[4*atoms[1]], posq[4*atoms[2]], posq[4*atoms[3]]);
+        fvec4 y(posq[4*atoms[0]+1], posq[4*atoms[1]+1], posq[4*atoms[2]+1], posq[4*atoms[3]+1]);
+        fvec4 z(posq[4*atoms[0]+2], posq[4*atoms[1]+2], posq[4*atoms[2]+2], posq[4*atoms[3]+2]);
+        fvec4 partialChargeI = preFactor*fvec4(posq[4*atoms[0]+3], posq[4*atoms[1]+3], posq[4*atoms[2]+3], posq[4*atoms[3]+3]);
+        fvec4 radii(bornRadii[atoms[0]], bornRadii[atoms[1]], bornRadii[atoms[2]], bornRadii[atoms[3]]);
+        fvec4 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f), blockAtomBornForce(0.0f);
+        for (int atomJ : neighbors) {
+            ivec4 include = getNeighborMask(blockIndex, lane, numInBlock, atomJ);
+            if (!any(include))
+                continue;
+            fvec4 posJ(posq+4*atomJ);
+            fvec4 dx, dy, dz, r2;
+            getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
+            include = include & (r2 < cutoff2);
+            if (!any(include))
+                continue;
+            fvec4 alpha2_ij = radii*bornRadii[atomJ];
+            fvec4 D_ij = r2/(4.0f*alpha2_ij);
+            fvec4 expTerm = exp(-D_ij);
+            fvec4 denominator2 = r2 + alpha2_ij*expTerm;
+            fvec4 denominator = sqrt(denominator2);
+            fvec4 Gpol = (partialChargeI*posJ[3])/denominator;
+            fvec4 termEnergy = blend(0.0f, Gpol-partialChargeI*posJ[3]/cutoffDistance, include);
+            energy += dot4(termEnergy, one);
+            if (!includeForces)
+                continue;
+            fvec4 dGpol_dr = -Gpol*(1.0f - 0.25f*expTerm)/denominator2;
+            fvec4 dGpol_dalpha2_ij = -0.5f*Gpol*expTerm*(1.0f + D_ij)/denominator2;
+            dGpol_dr = blend(0.0f, dGpol_dr, include);
+            dGpol_dalpha2_ij = blend(0.0f, dGpol_dalpha2_ij, include);
+            fvec4 fx = dx*dGpol_dr;
+            fvec4 fy = dy*dGpol_dr;
+            fvec4 fz = dz*dGpol_dr;
+            blockAtomForceX -= fx;
+            blockAtomForceY -= fy;
+            blockAtomForceZ -= fz;
+            blockAtomBornForce += dGpol_dalpha2_ij*bornRadii[atomJ];
+            float* atomForce = forces+4*atomJ;
+            atomForce[0] += dot4(fx, one);
+            atomForce[1] += dot4(fy, one);
+            atomForce[2] += dot4(fz, one);
+            bornForces[atomJ] += dot4(dGpol_dalpha2_ij, radii);
+        }
+
+        // Add the self interaction of each block atom, which does not appear in the neighbor list.
+
+        fvec4 selfEnergy = 0.5f*partialChargeI*fvec4(posq[4*atoms[0]+3], posq[4*atoms[1]+3], posq[4*atoms[2]+3], posq[4*atoms[3]+3])/radii;
+        fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
+        transpose(f[0], f[1], f[2], f[3]);
+        for (int i = 0; i < 4 && lane+i < numInBlock; i++) {
+            energy += selfEnergy[i];
+            if (includeForces) {
+                (fvec4(forces+4*atoms[i])+f[i]).store(forces+4*atoms[i]);
+                bornForces[atoms[i]] += blockAtomBornForce[i]-selfEnergy[i]/radii[i];
+            }
+        }
+    }
+}
+
+void CpuGBSAOBCForce::computeNeighborChainRule(int blockIndex, float* forces, const fvec4& boxSize, const fvec4& invBoxSize) {
+    const int blockSize = neighborList->getBlockSize();
+    const int* blockAtom = &neighborList->getSortedAtoms()[blockSize*blockIndex];
+    const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
+    const int numInBlock = min(blockSize, (int) particleParams.size()-blockSize*blockIndex);
+    const float cutoff2 = cutoffDistance*cutoffDistance;
+    const fvec4 one(1.0f);
+    for (int lane = 0; lane < numInBlock; lane += 4) {
+        const int* atoms = blockAtom+lane;
+        fvec4 x(posq[4*atoms[0]], posq[4*atoms[1]], posq[4*atoms[2]], posq[4*atoms[3]]);
+        fvec4 y(posq[4*atoms[0]+1], posq[4*atoms[1]+1], posq[4*atoms[2]+1], posq[4*atoms[3]+1]);
+        fvec4 z(posq[4*atoms[0]+2], posq[4*atoms[1]+2], posq[4*atoms[2]+2], posq[4*atoms[3]+2]);
+        fvec4 offsetRadiusI(particleParams[atoms[0]].first, particleParams[atoms[1]].first, particleParams[atoms[2]].first, particleParams[atoms[3]].first);
+        fvec4 scaledRadiusI(particleParams[atoms[0]].second, particleParams[atoms[1]].second, particleParams[atoms[2]].second, particleParams[atoms[3]].second);
+        fvec4 bornForceI(scaledBornForces[atoms[0]], scaledBornForces[atoms[1]], scaledBornForces[atoms[2]], scaledBornForces[atoms[3]]);
+        fvec4 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f);
+        for (int atomJ : neighbors) {
+            ivec4 include = getNeighborMask(blockIndex, lane, numInBlock, atomJ);
+            if (!any(include))
+                continue;
+            fvec4 posJ(posq+4*atomJ);
+            fvec4 dx, dy, dz, r2;
+            getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
+            include = include & (r2 < cutoff2);
+            if (!any(include))
+                continue;
+            fvec4 r = sqrt(r2);
+            fvec4 rInverse = 1.0f/r;
+            fvec4 r2Inverse = rInverse*rInverse;
+            fvec4 de = bornForceI*computeChainRuleTerm(offsetRadiusI, fvec4(particleParams[atomJ].second), r, r2Inverse, include);
+            de += scaledBornForces[atomJ]*computeChainRuleTerm(fvec4(particleParams[atomJ].first), scaledRadiusI, r, r2Inverse, include);
+            de = blend(0.0f, de*rInverse, include);
+            fvec4 fx = dx*de;
+            fvec4 fy = dy*de;
+            fvec4 fz = dz*de;
+            blockAtomForceX += fx;
+            blockAtomForceY += fy;
+            blockAtomForceZ += fz;
+            float* atomForce = forces+4*atomJ;
+            atomForce[0] -= dot4(fx, one);
+            atomForce[1] -= dot4(fy, one);
+            atomForce[2] -= dot4(fz, one);
+        }
+        fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
+        transpose(f[0], f[1], f[2], f[3]);
+        for (int i = 0; i < 4 && lane+i < numInBlock; i++)
+            (fvec4(forces+4*atoms[i])+f[i]).store(forces+4*atoms[i]);
+    }
+}
+
 void CpuGBSAOBCForce::getDeltaR(const fvec4& posI, const fvec4& x, const fvec4& y, const fvec4& z, fvec4& dx, fvec4& dy, fvec4& dz, fvec4& r2, bool periodic, const fvec4& boxSize, const fvec4& invBoxSize) const {
     dx = x-posI[0];
     dy = y-posI[1];
@@ -0,0 +1,221 @@
+/* Portions copyright (c) 2006-2017 Stanford University and Simbios.
+ * Contributors: Pande Group
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "CpuGBSAOBCForceVec8.h"
+#include "openmm/OpenMMException.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace OpenMM;
+
+#ifdef _MSC_VER
+    // Workaround for a compiler bug in Visual Studio 10. Hopefully we can remove this
+    // once we move to a later version.
+    #undef __AVX__
+#endif
+
+#ifndef __AVX__
+CpuGBSAOBCForce* createCpuGBSAOBCForceVec8() {
+    throw OpenMMException("Internal error: OpenMM was compiled without AVX support");
+}
+#else
+/**
+ * Factory method to create a CpuGBSAOBCForceVec8.
+ */
+CpuGBSAOBCForce* createCpuGBSAOBCForceVec8() {
+    return new CpuGBSAOBCForceVec8();
+}
+
+CpuGBSAOBCForceVec8::CpuGBSAOBCForceVec8() {
+}
+
+void CpuGBSAOBCForceVec8::computeNeighborBornSums(int blockIndex, float* sums, const fvec4& boxSize, const fvec4& invBoxSize) {
+    const int blockSize = neighborList->getBlockSize();
+    const int* blockAtom = &neighborList->getSortedAtoms()[blockSize*blockIndex];
+    const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
+    const int numInBlock = min(blockSize, (int) particleParams.size()-blockSize*blockIndex);
+    const float cutoff2 = cutoffDistance*cutoffDistance;
+    const fvec8 one(1.0f);
+    for (int lane = 0; lane < numInBlock; lane += 8) {
+        const int* atoms = blockAtom+lane;
+        fvec8 x, y, z, offsetRadiusI, scaledRadiusI;
+        loadBlockAtoms(atoms, x, y, z, offsetRadiusI, scaledRadiusI);
+        fvec8 blockSum(0.0f);
+        for (int atomJ : neighbors) {
+            ivec8 include = getNeighborMask(blockIndex, lane, numInBlock, atomJ);
+            if (!any(include))
+                continue;
+            fvec4 posJ(posq+4*atomJ);
+            fvec8 dx, dy, dz, r2;
+            getDeltaR(posJ, x, y, z, dx, dy, dz, r2, boxSize, invBoxSize);
+            include = include & (r2 < cutoff2);
+            if (!any(include))
+                continue;
+            fvec8 r = sqrt(r2);
+            fvec8 rInverse = 1.0f/r;
+            blockSum += computeBornSumTerm(offsetRadiusI, fvec8(particleParams[atomJ].second), r, rInverse, include);
+            sums[atomJ] += dot8(computeBornSumTerm(fvec8(particleParams[atomJ].first), scaledRadiusI, r, rInverse, include), one);
+        }
+        float blockSums[8];
+        blockSum.store(blockSums);
+        for (int i = 0; i < 8 && lane+i < numInBlock; i++)
+            sums[atoms[i]] += blockSums[i];
+    }
+}
+
+void CpuGBSAOBCForceVec8::computeNeighborChainRule(int blockIndex, float* forces, const fvec4& boxSize, const fvec4& invBoxSize) {
+    const int blockSize = neighborList->getBlockSize();
+    const int* blockAtom = &neighborList->getSortedAtoms()[blockSize*blockIndex];
+    const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
+    const int numInBlock = min(blockSize, (int) particleParams.size()-blockSize*blockIndex);
+    const float cutoff2 = cutoffDistance*cutoffDistance;
+    const fvec8 one(1.0f);
+    for (int lane = 0; lane < numInBlock; lane += 8) {
+        const int* atoms = blockAtom+lane;
+        fvec8 x, y, z, offsetRadiusI, scaledRadiusI;
+        loadBlockAtoms(atoms, x, y, z, offsetRadiusI, scaledRadiusI);
+        fvec8 bornForceI(scaledBornForces[atoms[0]], scaledBornForces[atoms[1]], scaledBornForces[atoms[2]], scaledBornForces[atoms[3]],
+                         scaledBornForces[atoms[4]], scaledBornForces[atoms[5]], scaledBornForces[atoms[6]], scaledBornForces[atoms[7]]);
+        fvec8 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f);
+        for (int atomJ : neighbors) {
+            ivec8 include = getNeighborMask(blockIndex, lane, numInBlock, atomJ);
+            if (!any(include))
+                continue;
+            fvec4 posJ(posq+4*atomJ);
+            fvec8 dx, dy, dz, r2;
+            getDeltaR(posJ, x, y, z, dx, dy, dz, r2, boxSize, invBoxSize);
+            include = include & (r2 < cutoff2);
+            if (!any(include))
+                continue;
+            fvec8 r = sqrt(r2);
+            fvec8 rInverse = 1.0f/r;
+            fvec8 r2Inverse = rInverse*rInverse;
+            fvec8 de = bornForceI*computeChainRuleTerm(offsetRadiusI, fvec8(particleParams[atomJ].second), r, r2Inverse, include);
+            de += scaledBornForces[atomJ]*computeChainRuleTerm(fvec8(particleParams[atomJ].first), scaledRadiusI, r, r2Inverse, include);
+            de = blend(0.0f, de*rInverse, include);
+            fvec8 fx = dx*de;
+            fvec8 fy = dy*de;
+            fvec8 fz = dz*de;
+            blockAtomForceX += fx;
+            blockAtomForceY += fy;
+            blockAtomForceZ += fz;
+            float* atomForce = forces+4*atomJ;
+            atomForce[0] -= dot8(fx, one);
+            atomForce[1] -= dot8(fy, one);
+            atomForce[2] -= dot8(fz, one);
+        }
+        fvec4 f[8];
+        transpose(blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f, f[0], f[1], f[2], f[3], f[4], f[5], f[6], f[7]);
+        for (int i = 0; i < 8 && lane+i < numInBlock; i++)
+            (fvec4(forces+4*atoms[i])+f[i]).store(forces+4*atoms[i]);
+    }
+}
+
+void CpuGBSAOBCForceVec8::loadBlockAtoms(const int* atoms, fvec8& x, fvec8& y, fvec8& z, fvec8& offsetRadius, fvec8& scaledRadius) const {
+    fvec4 pos[8];
+    for (int i = 0; i < 8; i++)
+        pos[i] = fvec4(posq+4*atoms[i]);
+    fvec8 charge;
+    transpose(pos[0], pos[1], pos[2], pos[3], pos[4], pos[5], pos[6], pos[7], x, y, z, charge);
+    offsetRadius = fvec8(particleParams[atoms[0]].first, particleParams[atoms[1]].first, particleParams[atoms[2]].first, particleParams[atoms[3]].first,
+                         particleParams[atoms[4]].first, particleParams[atoms[5]].first, particleParams[atoms[6]].first, particleParams[atoms[7]].first);
+    scaledRadius = fvec8(particleParams[atoms[0]].second, particleParams[atoms[1]].second, particleParams[atoms[2]].second, particleParams[atoms[3]].second,
+                         particleParams[atoms[4]].second, particleParams[atoms[5]].second, particleParams[atoms[6]].second, particleParams[atoms[7]].second);
+}
+
+ivec8 CpuGBSAOBCForceVec8::getNeighborMask(int blockIndex, int firstLane, int numInBlock, int neighbor) const {
+    // This follows the same rule as the base class: within a block, an atom is only paired with the block atoms
+    // that precede it.  The mask is a window into a table of eight set lanes followed by eight clear ones.
+
+    static const int prefixMask[16] = {-1, -1, -1, -1, -1, -1, -1, -1, 0, 0, 0, 0, 0, 0, 0, 0};
+    int offset = sortedIndex[neighbor]-neighborList->getBlockSize()*blockIndex;
+    int limit = (offset < 0 ? numInBlock : min(offset, numInBlock));
+    int count = max(0, min(8, limit-firstLane));
+    return ivec8(&prefixMask[8-count]);
+}
+
+void CpuGBSAOBCForceVec8::getDeltaR(const fvec4& posI, const fvec8& x, const fvec8& y, const fvec8& z, fvec8& dx, fvec8& dy, fvec8& dz, fvec8& r2, const fvec4& boxSize, const fvec4& invBoxSize) const {
+    dx = x-posI[0];
+    dy = y-posI[1];
+    dz = z-posI[2];
+    if (periodic) {
+        dx -= round(dx*invBoxSize[0])*boxSize[0];
+        dy -= round(dy*invBoxSize[1])*boxSize[1];
+        dz -= round(dz*invBoxSize[2])*boxSize[2];
+    }
+    r2 = dx*dx + dy*dy + dz*dz;
+}
+
+fvec8 CpuGBSAOBCForceVec8::fastLog(const fvec8& x) const {
+    // Evaluate log(x) using a lookup table for speed.
+
+    fvec8 x1 = (x-TABLE_MIN)*logDXInv;
+    fvec8 floorX1 = floor(x1);
+    int index[8];
+    ivec8(floorX1).store(index);
+    for (int i = 0; i < 8; i++) {
+        if (index[i] < 0 || index[i] >= NUM_TABLE_POINTS) {
+            float values[8];
+            x.store(values);
+            for (int j = 0; j < 8; j++)
+                values[j] = logf(values[j]);
+            return fvec8(values);
+        }
+    }
+    fvec8 coeff2 = x1-floorX1;
+    fvec8 coeff1 = 1.0f-coeff2;
+    fvec8 t1, t2, t3, t4;
+    transpose(fvec4(&logTable[index[0]]), fvec4(&logTable[index[1]]), fvec4(&logTable[index[2]]), fvec4(&logTable[index[3]]),
+              fvec4(&logTable[index[4]]), fvec4(&logTable[index[5]]), fvec4(&logTable[index[6]]), fvec4(&logTable[index[7]]), t1, t2, t3, t4);
+    return coeff1*t1 + coeff2*t2;
+}
+
+fvec8 CpuGBSAOBCForceVec8::computeBornSumTerm(const fvec8& offsetRadiusI, const fvec8& scaledRadiusJ, const fvec8& r, const fvec8& rInverse, ivec8 include) const {
+    fvec8 rScaledRadiusJ = r+scaledRadiusJ;
+    include = include & (offsetRadiusI < rScaledRadiusJ);
+    fvec8 l_ij = 1.0f/max(offsetRadiusI, abs(r-scaledRadiusJ));
+    fvec8 u_ij = 1.0f/rScaledRadiusJ;
+    fvec8 l_ij2 = l_ij*l_ij;
+    fvec8 u_ij2 = u_ij*u_ij;
+
+    // Lanes that are not included are given a ratio of 1, so they never force fastLog() off the table.
+
+    fvec8 logRatio = fastLog(blend(1.0f, u_ij/l_ij, include));
+    fvec8 term = l_ij - u_ij + 0.25f*r*(u_ij2 - l_ij2) + (0.5f*rInverse*logRatio) + (0.25f*scaledRadiusJ*scaledRadiusJ*rInverse)*(l_ij2 - u_ij2);
+    term += blend(0.0f, 2.0f*(1.0f/offsetRadiusI-l_ij), offsetRadiusI < scaledRadiusJ-r);
+    return blend(0.0f, term, include);
+}
+
+fvec8 CpuGBSAOBCForceVec8::computeChainRuleTerm(const fvec8& offsetRadiusI, const fvec8& scaledRadiusJ, const fvec8& r, const fvec8& r2Inverse, ivec8 include) const {
+    fvec8 rScaledRadiusJ = r+scaledRadiusJ;
+    include = include & (offsetRadiusI < rScaledRadiusJ);
+    fvec8 l_ij = 1.0f/max(offsetRadiusI, abs(r-scaledRadiusJ));
+    fvec8 u_ij = 1.0f/rScaledRadiusJ;
+    fvec8 l_ij2 = l_ij*l_ij;
+    fvec8 u_ij2 = u_ij*u_ij;
+    fvec8 logRatio = fastLog(blend(1.0f, u_ij/l_ij, include));
+    fvec8 t3 = 0.125f*(1.0f + scaledRadiusJ*scaledRadiusJ*r2Inverse)*(l_ij2 - u_ij2) + 0.25f*logRatio*r2Inverse;
+    return blend(0.0f, t3, include);
+}
+#endif
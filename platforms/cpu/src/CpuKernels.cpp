@@ -33,24 +33,36 @@
 #include "ReferenceAngleBondIxn.h"
 #include "ReferenceBondForce.h"
 #include "ReferenceConstraints.h"
+#include "ReferenceHarmonicBondIxn.h"
 #include "ReferenceKernelFactory.h"
 #include "ReferenceKernels.h"
 #include "ReferenceLJCoulomb14.h"
 #include "ReferenceProperDihedralBond.h"
 #include "ReferenceRbDihedralBond.h"
 #include "ReferenceTabulatedFunction.h"
+#include "SimTKOpenMMUtilities.h"
+#include "jama_eig.h"
 #include "openmm/Context.h"
+#include "openmm/MonteCarloAnisotropicBarostat.h"
+#include "openmm/MonteCarloMembraneBarostat.h"
 #include "openmm/OpenMMException.h"
 #include "openmm/Vec3.h"
+#include "openmm/internal/AndersenThermostatImpl.h"
+#include "openmm/internal/CMAPTorsionForceImpl.h"
 #include "openmm/internal/ContextImpl.h"
+#include "openmm/internal/CustomCentroidBondForceImpl.h"
+#include "openmm/internal/CustomCompoundBondForceImpl.h"
 #include "openmm/internal/CustomNonbondedForceImpl.h"
 #include "openmm/internal/NonbondedForceImpl.h"
+#include "openmm/internal/timer.h"
 #include "openmm/internal/vectorize.h"
 #include "lepton/CompiledExpression.h"
 #include "lepton/CustomFunction.h"
 #include "lepton/Operation.h"
 #include "lepton/Parser.h"
 #include <iostream>
+#include <map>
+#include <tuple>
 #include "lepton/ParsedExpression.h"
 
 using namespace OpenMM;
@@ -138,26 +150,98 @@ static double computeShiftedKineticEnergy(ContextImpl& context, vector<double>&
     return 0.5*energy;
 }
 
+const int CpuCalcForcesAndEnergyKernel::PaddingTuningInterval = 200;
+const double CpuCalcForcesAndEnergyKernel::InitialPaddingScale = 1.25;
+const double CpuCalcForcesAndEnergyKernel::MinPaddingScale = 1.02;
+
 CpuCalcForcesAndEnergyKernel::CpuCalcForcesAndEnergyKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data, ContextImpl& context) :
-        CalcForcesAndEnergyKernel(name, platform), data(data) {
+        CalcForcesAndEnergyKernel(name, platform), data(data), computationInProgress(false), skipClearForEnergy(false), lastPaddedCutoff(0.0), tuningTime(0.0),
+        lastTuningCost(-1.0), bestTuningCost(-1.0), bestPadding(0.0), paddingScale(InitialPaddingScale), tuningEvaluations(0) {
     // Create a Reference platform version of this kernel.
     
     ReferenceKernelFactory referenceFactory;
     referenceKernel = Kernel(referenceFactory.createKernelImpl(name, platform, context));
 }
 
+/**
+ * Get whether the CPU kernel for a Force either leaves the per-thread force buffers alone, or writes to them
+ * in a way that is compatible with CpuForceDecomposition.  Anything not listed here is assumed to write to
+ * arbitrary elements of them.
+ */
+static bool isCompatibleWithForceDecomposition(const Force& force) {
+    return (dynamic_cast<const NonbondedForce*>(&force) != NULL ||
+            dynamic_cast<const HarmonicBondForce*>(&force) != NULL ||
+            dynamic_cast<const HarmonicAngleForce*>(&force) != NULL ||
+            dynamic_cast<const PeriodicTorsionForce*>(&force) != NULL ||
+            dynamic_cast<const RBTorsionForce*>(&force) != NULL ||
+            dynamic_cast<const CMAPTorsionForce*>(&force) != NULL ||
+            dynamic_cast<const CustomBondForce*>(&force) != NULL ||
+            dynamic_cast<const CustomAngleForce*>(&force) != NULL ||
+            dynamic_cast<const CustomTorsionForce*>(&force) != NULL ||
+            dynamic_cast<const CustomExternalForce*>(&force) != NULL ||
+            dynamic_cast<const CustomCompoundBondForce*>(&force) != NULL ||
+            dynamic_cast<const CustomCentroidBondForce*>(&force) != NULL ||
+            dynamic_cast<const CustomHbondForce*>(&force) != NULL ||
+            dynamic_cast<const CustomCVForce*>(&force) != NULL ||
+            dynamic_cast<const RMSDForce*>(&force) != NULL ||
+            dynamic_cast<const CMMotionRemover*>(&force) != NULL ||
+            dynamic_cast<const AndersenThermostat*>(&force) != NULL ||
+            dynamic_cast<const MonteCarloBarostat*>(&force) != NULL ||
+            dynamic_cast<const MonteCarloAnisotropicBarostat*>(&force) != NULL ||
+            dynamic_cast<const MonteCarloMembraneBarostat*>(&force) != NULL);
+}
+
+/**
+ * Get whether the CPU kernel for a Force leaves the per-thread force buffers untouched when only the energy is
+ * requested.  If this is true for every Force, energy-only evaluations do not need to clear the buffers afterward.
+ */
+static bool leavesForcesUntouchedForEnergy(const Force& force) {
+    return (isCompatibleWithForceDecomposition(force) ||
+            dynamic_cast<const CustomNonbondedForce*>(&force) != NULL ||
+            dynamic_cast<const GBSAOBCForce*>(&force) != NULL ||
+            dynamic_cast<const CustomManyParticleForce*>(&force) != NULL);
+}
+
 void CpuCalcForcesAndEnergyKernel::initialize(const System& system) {
     referenceKernel.getAs<ReferenceCalcForcesAndEnergyKernel>().initialize(system);
     lastPositions.resize(system.getNumParticles(), Vec3(1e10, 1e10, 1e10));
+    bool useDecomposition = true;
+    skipClearForEnergy = true;
+    for (int i = 0; i < system.getNumForces(); i++) {
+        if (!isCompatibleWithForceDecomposition(system.getForce(i)))
+            useDecomposition = false;
+        if (!leavesForcesUntouchedForEnergy(system.getForce(i)))
+            skipClearForEnergy = false;
+    }
+    data.forceDecomposition.setEnabled(useDecomposition);
 }
 
 void CpuCalcForcesAndEnergyKernel::beginComputation(ContextImpl& context, bool includeForce, bool includeEnergy, int groups) {
+    computationStartTime = getCurrentTime();
     referenceKernel.getAs<ReferenceCalcForcesAndEnergyKernel>().beginComputation(context, includeForce, includeEnergy, groups);
     
-    // Convert positions to single precision and clear the forces.
+    // The per-thread force buffers are cleared when they are summed.  If the previous computation was interrupted,
+    // they may still contain forces.
+
+    if (computationInProgress)
+        data.forceDecomposition.clearForces(data.threadForce, data.threads);
+    
+    // Convert positions to single precision.
 
     int numParticles = context.getSystem().getNumParticles();
     bool positionsValid = true;
+    
+    // While converting them, also identify particles that have moved far enough since the neighbor list was last built
+    // that it might need to be recomputed.
+    
+    bool checkNeighborList = (data.neighborList != NULL);
+    double padding = data.paddedCutoff-data.cutoff;
+    double closeCutoff2 = 0.25*padding*padding;
+    double farCutoff2 = 0.5*padding*padding;
+    int maxNumMoved = numParticles/10;
+    bool needRecompute = (data.paddedCutoff != lastPaddedCutoff);
+    threadMoved.resize(data.threads.getNumThreads());
+    vector<char> threadNeedsRecompute(data.threads.getNumThreads(), false);
     data.threads.execute([&] (ThreadPool& threads, int threadIndex) {
         // Convert the positions to single precision and apply periodic boundary conditions
 
@@ -206,11 +290,23 @@ void CpuCalcForcesAndEnergyKernel::beginComputation(ContextImpl& context, bool i
             if (posq[i] != posq[i] || posq[i+1] != posq[i+1] || posq[i+2] != posq[i+2])
                 positionsValid = false;
 
-        // Clear the forces.
-
-        fvec4 zero(0.0f);
-        for (int j = 0; j < numParticles; j++)
-            zero.store(&data.threadForce[threadIndex][j*4]);
+        // Check how far particles have moved since the neighbor list was built.
+        
+        if (checkNeighborList) {
+            vector<int>& moved = threadMoved[threadIndex];
+            moved.resize(0);
+            for (int i = start; i < end; i++) {
+                Vec3 delta = posData[i]-lastPositions[i];
+                double dist2 = delta.dot(delta);
+                if (dist2 > closeCutoff2) {
+                    moved.push_back(i);
+                    if (dist2 > farCutoff2 || (int) moved.size() > maxNumMoved) {
+                        threadNeedsRecompute[threadIndex] = true;
+                        break;
+                    }
+                }
+            }
+        }
     });
     data.threads.waitForThreads();
     if (!positionsValid)
@@ -218,77 +314,199 @@ void CpuCalcForcesAndEnergyKernel::beginComputation(ContextImpl& context, bool i
 
     // Determine whether we need to recompute the neighbor list.
         
-    if (data.neighborList != NULL) {
-        double padding = data.paddedCutoff-data.cutoff;;
-        bool needRecompute = false;
-        double closeCutoff2 = 0.25*padding*padding;
-        double farCutoff2 = 0.5*padding*padding;
-        int maxNumMoved = numParticles/10;
-        vector<int> moved;
+    if (checkNeighborList) {
         vector<Vec3>& posData = extractPositions(context);
-        for (int i = 0; i < numParticles; i++) {
-            Vec3 delta = posData[i]-lastPositions[i];
-            double dist2 = delta.dot(delta);
-            if (dist2 > closeCutoff2) {
-                moved.push_back(i);
-                if (dist2 > farCutoff2 || moved.size() > maxNumMoved) {
-                    needRecompute = true;
-                    break;
-                }
-            }
+        for (char flag : threadNeedsRecompute)
+            if (flag)
+                needRecompute = true;
+        if (!needRecompute) {
+            int numMoved = 0;
+            for (const vector<int>& moved : threadMoved)
+                numMoved += moved.size();
+            if (numMoved > maxNumMoved)
+                needRecompute = true;
+            else if (numMoved > 0)
+                needRecompute = isMovedPairMissing(posData);
+        }
+        if (needRecompute) {
+            data.neighborList->updateNeighborList(numParticles, data.posq, data.exclusions, extractBoxVectors(context), data.isPeriodic, data.paddedCutoff, data.threads);
+            data.threads.execute([&] (ThreadPool& threads, int threadIndex) {
+                int start = threadIndex*numParticles/threads.getNumThreads();
+                int end = (threadIndex+1)*numParticles/threads.getNumThreads();
+                for (int i = start; i < end; i++)
+                    lastPositions[i] = posData[i];
+            });
+            data.threads.waitForThreads();
+            if (data.forceDecomposition.isEnabled())
+                data.forceDecomposition.update(*data.neighborList, numParticles, data.threads);
+            lastPaddedCutoff = data.paddedCutoff;
         }
-        if (!needRecompute && moved.size() > 0) {
-            // Some particles have moved further than half the padding distance.  Look for pairs
-            // that are missing from the neighbor list.
-
-            int numMoved = moved.size();
-            double cutoff2 = data.cutoff*data.cutoff;
-            double paddedCutoff2 = data.paddedCutoff*data.paddedCutoff;
-            for (int i = 1; i < numMoved && !needRecompute; i++)
-                for (int j = 0; j < i; j++) {
-                    Vec3 delta = posData[moved[i]]-posData[moved[j]];
-                    if (delta.dot(delta) < cutoff2) {
-                        // These particles should interact.  See if they are in the neighbor list.
-                        
-                        Vec3 oldDelta = lastPositions[moved[i]]-lastPositions[moved[j]];
-                        if (oldDelta.dot(oldDelta) > paddedCutoff2) {
-                            needRecompute = true;
-                            break;
+    }
+    computationInProgress = true;
+}
+
+bool CpuCalcForcesAndEnergyKernel::isMovedPairMissing(const vector<Vec3>& posData) {
+    // Some particles have moved further than half the padding distance.  Look for pairs that are missing from the
+    // neighbor list.  Only pairs within the cutoff matter, so sort the moved particles into voxels whose width equals
+    // the cutoff and only compare particles in adjacent voxels.
+
+    double cutoff2 = data.cutoff*data.cutoff;
+    double paddedCutoff2 = data.paddedCutoff*data.paddedCutoff;
+    double invCutoff = 1/data.cutoff;
+    map<tuple<int, int, int>, vector<int> > voxels;
+    for (const vector<int>& moved : threadMoved)
+        for (int i : moved) {
+            Vec3 pos = posData[i];
+            int x = (int) floor(pos[0]*invCutoff);
+            int y = (int) floor(pos[1]*invCutoff);
+            int z = (int) floor(pos[2]*invCutoff);
+            for (int dx = -1; dx <= 1; dx++)
+                for (int dy = -1; dy <= 1; dy++)
+                    for (int dz = -1; dz <= 1; dz++) {
+                        auto voxel = voxels.find(make_tuple(x+dx, y+dy, z+dz));
+                        if (voxel == voxels.end())
+                            continue;
+                        for (int j : voxel->second) {
+                            Vec3 delta = pos-posData[j];
+                            if (delta.dot(delta) < cutoff2) {
+                                // These particles should interact.  See if they are in the neighbor list.
+
+                                Vec3 oldDelta = lastPositions[i]-lastPositions[j];
+                                if (oldDelta.dot(oldDelta) > paddedCutoff2)
+                                    return true;
+                            }
                         }
                     }
-                }
+            voxels[make_tuple(x, y, z)].push_back(i);
         }
-        if (needRecompute) {
-            data.neighborList->computeNeighborList(numParticles, data.posq, data.exclusions, extractBoxVectors(context), data.isPeriodic, data.paddedCutoff, data.threads);
-            lastPositions = posData;
+    return false;
+}
+
+void CpuCalcForcesAndEnergyKernel::tuneNeighborListPadding(double elapsedTime) {
+    // A larger padding means the neighbor list is rebuilt less often, but more pairs beyond the cutoff are checked on
+    // every step.  Measure the average time per evaluation (including rebuilds) over a window of evaluations, and
+    // search for the padding that minimizes it.  Each time the cost increases, reverse direction and take a smaller
+    // step.
+
+    tuningTime += elapsedTime;
+    if (++tuningEvaluations < PaddingTuningInterval)
+        return;
+    double cost = tuningTime/tuningEvaluations;
+    tuningTime = 0.0;
+    tuningEvaluations = 0;
+    double padding = data.paddedCutoff-data.cutoff;
+    if (paddingScale == 1.0) {
+        // The search has converged.  Restart it if the cost has changed substantially, for example because the
+        // temperature or density of the system has changed.
+
+        if (fabs(cost-bestTuningCost) < 0.2*bestTuningCost)
+            return;
+        paddingScale = InitialPaddingScale;
+        bestTuningCost = cost;
+        bestPadding = padding;
+    }
+    else {
+        if (bestTuningCost < 0 || cost < bestTuningCost) {
+            bestTuningCost = cost;
+            bestPadding = padding;
         }
+        if (lastTuningCost >= 0 && cost > lastTuningCost)
+            paddingScale = 1/sqrt(paddingScale);
+        if (fabs(log(paddingScale)) < log(MinPaddingScale)) {
+            paddingScale = 1.0;
+            lastTuningCost = -1.0;
+            data.paddedCutoff = data.cutoff+bestPadding;
+            return;
+        }
+    }
+    lastTuningCost = cost;
+    double minPadding = 0.05*data.cutoff;
+    double maxPadding = 0.5*data.cutoff;
+    double newPadding = min(maxPadding, max(minPadding, padding*paddingScale));
+    if (newPadding == padding) {
+        // We have reached the limit of the allowed range, so search in the other direction.
+
+        paddingScale = 1/sqrt(paddingScale);
+        newPadding = min(maxPadding, max(minPadding, padding*paddingScale));
     }
+    data.paddedCutoff = data.cutoff+newPadding;
 }
 
 double CpuCalcForcesAndEnergyKernel::finishComputation(ContextImpl& context, bool includeForce, bool includeEnergy, int groups, bool& valid) {
-    // Sum the forces from all the threads.
+    // Sum the forces from all the threads.  If forces were not requested, the reference kernel restores the
+    // previous forces anyway, so just clear the buffers.  That too can be skipped if every kernel honored
+    // the request and left them empty.
     
-    data.threads.execute([&] (ThreadPool& threads, int threadIndex) {
-        // Sum the contributions to forces that have been calculated by different threads.
-        
-        int numParticles = context.getSystem().getNumParticles();
-        int numThreads = threads.getNumThreads();
-        int start = threadIndex*numParticles/numThreads;
-        int end = (threadIndex+1)*numParticles/numThreads;
-        vector<Vec3>& forceData = extractForces(context);
-        for (int i = start; i < end; i++) {
-            fvec4 f(0.0f);
-            for (int j = 0; j < numThreads; j++)
-                f += fvec4(&data.threadForce[j][4*i]);
-            forceData[i][0] += f[0];
-            forceData[i][1] += f[1];
-            forceData[i][2] += f[2];
-        }
-    });
-    data.threads.waitForThreads();
+    if (includeForce)
+        data.forceDecomposition.sumForces(data.threadForce, extractForces(context), data.threads);
+    else if (!skipClearForEnergy)
+        data.forceDecomposition.clearForces(data.threadForce, data.threads);
+    computationInProgress = false;
+    if (includeForce && data.tuneNeighborListPadding && data.neighborList != NULL)
+        tuneNeighborListPadding(getCurrentTime()-computationStartTime);
     return referenceKernel.getAs<ReferenceCalcForcesAndEnergyKernel>().finishComputation(context, includeForce, includeEnergy, groups, valid);
 }
 
+CpuCalcHarmonicBondForceKernel::~CpuCalcHarmonicBondForceKernel() {
+    if (bondIndexArray != NULL) {
+        for (int i = 0; i < numBonds; i++) {
+            delete[] bondIndexArray[i];
+            delete[] bondParamArray[i];
+        }
+        delete[] bondIndexArray;
+        delete[] bondParamArray;
+    }
+}
+
+void CpuCalcHarmonicBondForceKernel::initialize(const System& system, const HarmonicBondForce& force) {
+    numBonds = force.getNumBonds();
+    bondIndexArray = new int*[numBonds];
+    for (int i = 0; i < numBonds; i++)
+        bondIndexArray[i] = new int[2];
+    bondParamArray = new double*[numBonds];
+    for (int i = 0; i < numBonds; i++)
+        bondParamArray[i] = new double[2];
+    for (int i = 0; i < numBonds; ++i) {
+        int particle1, particle2;
+        double length, k;
+        force.getBondParameters(i, particle1, particle2, length, k);
+        bondIndexArray[i][0] = particle1;
+        bondIndexArray[i][1] = particle2;
+        bondParamArray[i][0] = length;
+        bondParamArray[i][1] = k;
+    }
+    bondForce.initialize(system.getNumParticles(), numBonds, 2, bondIndexArray, data.threads);
+    usePeriodic = force.usesPeriodicBoundaryConditions();
+}
+
+double CpuCalcHarmonicBondForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3>& forceData = extractForces(context);
+    double energy = 0;
+    ReferenceHarmonicBondIxn harmonicBond;
+    if (usePeriodic)
+        harmonicBond.setPeriodic(extractBoxVectors(context));
+    bondForce.calculateForce(posData, bondParamArray, forceData, includeEnergy ? &energy : NULL, harmonicBond, includeForces);
+    return energy;
+}
+
+void CpuCalcHarmonicBondForceKernel::copyParametersToContext(ContextImpl& context, const HarmonicBondForce& force) {
+    if (numBonds != force.getNumBonds())
+        throw OpenMMException("updateParametersInContext: The number of bonds has changed");
+
+    // Record the values.
+
+    for (int i = 0; i < numBonds; ++i) {
+        int particle1, particle2;
+        double length, k;
+        force.getBondParameters(i, particle1, particle2, length, k);
+        if (particle1 != bondIndexArray[i][0] || particle2 != bondIndexArray[i][1])
+            throw OpenMMException("updateParametersInContext: The set of particles in a bond has changed");
+        bondParamArray[i][0] = length;
+        bondParamArray[i][1] = k;
+    }
+}
+
 CpuCalcHarmonicAngleForceKernel::~CpuCalcHarmonicAngleForceKernel() {
     if (angleIndexArray != NULL) {
         for (int i = 0; i < numAngles; i++) {
@@ -329,7 +547,7 @@ double CpuCalcHarmonicAngleForceKernel::execute(ContextImpl& context, bool inclu
     ReferenceAngleBondIxn angleBond;
     if (usePeriodic)
         angleBond.setPeriodic(extractBoxVectors(context));
-    bondForce.calculateForce(posData, angleParamArray, forceData, includeEnergy ? &energy : NULL, angleBond);
+    bondForce.calculateForce(posData, angleParamArray, forceData, includeEnergy ? &energy : NULL, angleBond, includeForces);
     return energy;
 }
 
@@ -392,7 +610,7 @@ double CpuCalcPeriodicTorsionForceKernel::execute(ContextImpl& context, bool inc
     ReferenceProperDihedralBond periodicTorsionBond;
     if (usePeriodic)
         periodicTorsionBond.setPeriodic(extractBoxVectors(context));
-    bondForce.calculateForce(posData, torsionParamArray, forceData, includeEnergy ? &energy : NULL, periodicTorsionBond);
+    bondForce.calculateForce(posData, torsionParamArray, forceData, includeEnergy ? &energy : NULL, periodicTorsionBond, includeForces);
     return energy;
 }
 
@@ -459,7 +677,7 @@ double CpuCalcRBTorsionForceKernel::execute(ContextImpl& context, bool includeFo
     ReferenceRbDihedralBond rbTorsionBond;
     if (usePeriodic)
         rbTorsionBond.setPeriodic(extractBoxVectors(context));
-    bondForce.calculateForce(posData, torsionParamArray, forceData, includeEnergy ? &energy : NULL, rbTorsionBond);
+    bondForce.calculateForce(posData, torsionParamArray, forceData, includeEnergy ? &energy : NULL, rbTorsionBond, includeForces);
     return energy;
 }
 
@@ -484,185 +702,1049 @@ void CpuCalcRBTorsionForceKernel::copyParametersToContext(ContextImpl& context,
     }
 }
 
-class CpuCalcNonbondedForceKernel::PmeIO : public CalcPmeReciprocalForceKernel::IO {
-public:
-    PmeIO(float* posq, float* force, int numParticles) : posq(posq), force(force), numParticles(numParticles) {
-    }
-    float* getPosq() {
-        return posq;
-    }
-    void setForce(float* f) {
-        for (int i = 0; i < numParticles; i++) {
-            force[4*i] += f[4*i];
-            force[4*i+1] += f[4*i+1];
-            force[4*i+2] += f[4*i+2];
+CpuCalcCMAPTorsionForceKernel::~CpuCalcCMAPTorsionForceKernel() {
+    if (torsionIndexArray != NULL) {
+        for (int i = 0; i < numTorsions; i++) {
+            delete[] torsionIndexArray[i];
+            delete[] torsionParamArray[i];
         }
+        delete[] torsionIndexArray;
+        delete[] torsionParamArray;
     }
-private:
-    float* posq;
-    float* force;
-    int numParticles;
-};
-
-bool isVec8Supported();
-CpuNonbondedForce* createCpuNonbondedForceVec4();
-CpuNonbondedForce* createCpuNonbondedForceVec8();
+}
 
-CpuCalcNonbondedForceKernel::CpuCalcNonbondedForceKernel(string name, const Platform& platform, CpuPlatform::PlatformData& data) : CalcNonbondedForceKernel(name, platform),
-        data(data), bonded14IndexArray(NULL), bonded14ParamArray(NULL), hasInitializedPme(false), hasInitializedDispersionPme(false), nonbonded(NULL) {
-    if (isVec8Supported())
-        nonbonded = createCpuNonbondedForceVec8();
-    else
-        nonbonded = createCpuNonbondedForceVec4();
+void CpuCalcCMAPTorsionForceKernel::initialize(const System& system, const CMAPTorsionForce& force) {
+    computeCoefficients(force);
+    numTorsions = force.getNumTorsions();
+    torsionIndexArray = new int*[numTorsions];
+    for (int i = 0; i < numTorsions; i++)
+        torsionIndexArray[i] = new int[8];
+    torsionParamArray = new double*[numTorsions];
+    for (int i = 0; i < numTorsions; i++)
+        torsionParamArray[i] = new double[1];
+    for (int i = 0; i < numTorsions; i++) {
+        int map;
+        int* index = torsionIndexArray[i];
+        force.getTorsionParameters(i, map, index[0], index[1], index[2], index[3], index[4], index[5], index[6], index[7]);
+        torsionParamArray[i][0] = map;
+    }
+    bondForce.initialize(system.getNumParticles(), numTorsions, 8, torsionIndexArray, data.threads);
+    usePeriodic = force.usesPeriodicBoundaryConditions();
 }
 
-CpuCalcNonbondedForceKernel::~CpuCalcNonbondedForceKernel() {
-    if (bonded14ParamArray != NULL) {
-        for (int i = 0; i < num14; i++) {
-            delete[] bonded14IndexArray[i];
-            delete[] bonded14ParamArray[i];
-        }
-        delete[] bonded14IndexArray;
-        delete[] bonded14ParamArray;
+void CpuCalcCMAPTorsionForceKernel::computeCoefficients(const CMAPTorsionForce& force) {
+    int numMaps = force.getNumMaps();
+    coeff.clear();
+    mapOffset.resize(numMaps);
+    mapSize.resize(numMaps);
+    vector<double> energy;
+    vector<vector<double> > c;
+    for (int i = 0; i < numMaps; i++) {
+        int size;
+        force.getMapParameters(i, size, energy);
+        CMAPTorsionForceImpl::calcMapDerivatives(size, energy, c);
+        mapOffset[i] = coeff.size();
+        mapSize[i] = size;
+        for (int j = 0; j < size*size; j++)
+            coeff.insert(coeff.end(), c[j].begin(), c[j].begin()+16);
     }
-    if (nonbonded != NULL)
-        delete nonbonded;
 }
 
-void CpuCalcNonbondedForceKernel::initialize(const System& system, const NonbondedForce& force) {
+double CpuCalcCMAPTorsionForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3>& forceData = extractForces(context);
+    double energy = 0;
+    CpuCMAPTorsionIxn torsion(coeff, mapOffset, mapSize);
+    if (usePeriodic)
+        torsion.setPeriodic(extractBoxVectors(context));
+    torsion.setIncludeForces(includeForces);
 
-    // Identify which exceptions are 1-4 interactions.
+    // Each thread computes the torsions assigned to it by the CpuBondForce, four at a time.
 
-    numParticles = force.getNumParticles();
-    exclusions.resize(numParticles);
-    vector<int> nb14s;
-    for (int i = 0; i < force.getNumExceptions(); i++) {
-        int particle1, particle2;
-        double chargeProd, sigma, epsilon;
-        force.getExceptionParameters(i, particle1, particle2, chargeProd, sigma, epsilon);
-        exclusions[particle1].insert(particle2);
-        exclusions[particle2].insert(particle1);
-        if (chargeProd != 0.0 || epsilon != 0.0)
-            nb14s.push_back(i);
+    int numThreads = data.threads.getNumThreads();
+    vector<double> threadEnergy(numThreads, 0.0);
+    data.threads.execute([&] (ThreadPool& threads, int threadIndex) {
+        const vector<int>& bonds = bondForce.getThreadBonds(threadIndex);
+        double* totalEnergy = (includeEnergy ? &threadEnergy[threadIndex] : NULL);
+        int numBonds = bonds.size();
+        int i = 0;
+        for (; i+3 < numBonds; i += 4) {
+            int* atoms[4];
+            double* params[4];
+            for (int k = 0; k < 4; k++) {
+                atoms[k] = torsionIndexArray[bonds[i+k]];
+                params[k] = torsionParamArray[bonds[i+k]];
+            }
+            torsion.calculateBlockIxn(atoms, posData, params, forceData, totalEnergy);
+        }
+        for (; i < numBonds; i++)
+            torsion.calculateBondIxn(torsionIndexArray[bonds[i]], posData, torsionParamArray[bonds[i]], forceData, totalEnergy, NULL);
+    });
+    data.threads.waitForThreads();
+    for (int bond : bondForce.getExtraBonds())
+        torsion.calculateBondIxn(torsionIndexArray[bond], posData, torsionParamArray[bond], forceData, includeEnergy ? &energy : NULL, NULL);
+    for (double e : threadEnergy)
+        energy += e;
+    return energy;
+}
+
+void CpuCalcCMAPTorsionForceKernel::copyParametersToContext(ContextImpl& context, const CMAPTorsionForce& force) {
+    int numMaps = force.getNumMaps();
+    if ((int) mapSize.size() != numMaps)
+        throw OpenMMException("updateParametersInContext: The number of maps has changed");
+    if (numTorsions != force.getNumTorsions())
+        throw OpenMMException("updateParametersInContext: The number of CMAP torsions has changed");
+    vector<double> energy;
+    for (int i = 0; i < numMaps; i++) {
+        int size;
+        force.getMapParameters(i, size, energy);
+        if (size != mapSize[i])
+            throw OpenMMException("updateParametersInContext: The size of a map has changed");
     }
 
-    // Record the particle parameters.
+    // Update the maps.
 
-    num14 = nb14s.size();
-    bonded14IndexArray = new int*[num14];
-    for (int i = 0; i < num14; i++)
-        bonded14IndexArray[i] = new int[2];
-    bonded14ParamArray = new double*[num14];
-    for (int i = 0; i < num14; i++)
-        bonded14ParamArray[i] = new double[3];
-    particleParams.resize(numParticles);
-    C6params.resize(numParticles);
-    double sumSquaredCharges = 0.0;
-    for (int i = 0; i < numParticles; ++i) {
-        double charge, radius, depth;
-        force.getParticleParameters(i, charge, radius, depth);
-        data.posq[4*i+3] = (float) charge;
-        particleParams[i] = make_pair((float) (0.5*radius), (float) (2.0*sqrt(depth)));
-        C6params[i] = 8.0*pow(particleParams[i].first, 3.0) * particleParams[i].second;
-        sumSquaredCharges += charge*charge;
-    }
-    
-    // Recorded exception parameters.
-    
-    for (int i = 0; i < num14; ++i) {
-        int particle1, particle2;
-        double charge, radius, depth;
-        force.getExceptionParameters(nb14s[i], particle1, particle2, charge, radius, depth);
-        bonded14IndexArray[i][0] = particle1;
-        bonded14IndexArray[i][1] = particle2;
-        bonded14ParamArray[i][0] = radius;
-        bonded14ParamArray[i][1] = 4.0*depth;
-        bonded14ParamArray[i][2] = charge;
-    }
-    bondForce.initialize(system.getNumParticles(), num14, 2, bonded14IndexArray, data.threads);
-    
-    // Record other parameters.
-    
-    nonbondedMethod = CalcNonbondedForceKernel::NonbondedMethod(force.getNonbondedMethod());
-    nonbondedCutoff = force.getCutoffDistance();
-    if (nonbondedMethod == NoCutoff)
-        useSwitchingFunction = false;
-    else {
-        data.requestNeighborList(nonbondedCutoff, 0.25*nonbondedCutoff, true, exclusions);
-        useSwitchingFunction = force.getUseSwitchingFunction();
-        switchingDistance = force.getSwitchingDistance();
-    }
-    if (nonbondedMethod == Ewald) {
-        double alpha;
-        NonbondedForceImpl::calcEwaldParameters(system, force, alpha, kmax[0], kmax[1], kmax[2]);
-        ewaldAlpha = alpha;
-    }
-    else if (nonbondedMethod == PME) {
-        double alpha;
-        NonbondedForceImpl::calcPMEParameters(system, force, alpha, gridSize[0], gridSize[1], gridSize[2], false);
-        ewaldAlpha = alpha;
-    }
-    else if (nonbondedMethod == LJPME) {
-        double alpha;
-        NonbondedForceImpl::calcPMEParameters(system, force, alpha, gridSize[0], gridSize[1], gridSize[2], false);
-        ewaldAlpha = alpha;
-        NonbondedForceImpl::calcPMEParameters(system, force, alpha, dispersionGridSize[0], dispersionGridSize[1], dispersionGridSize[2], true);
-        ewaldDispersionAlpha = alpha;
-        useSwitchingFunction = false;
+    computeCoefficients(force);
+
+    // Update the torsions.
+
+    for (int i = 0; i < numTorsions; i++) {
+        int map, index[8];
+        force.getTorsionParameters(i, map, index[0], index[1], index[2], index[3], index[4], index[5], index[6], index[7]);
+        for (int j = 0; j < 8; j++)
+            if (index[j] != torsionIndexArray[i][j])
+                throw OpenMMException("updateParametersInContext: The set of particles in a CMAP torsion has changed");
+        torsionParamArray[i][0] = map;
     }
+}
 
-    if (nonbondedMethod == Ewald || nonbondedMethod == PME || nonbondedMethod == LJPME) {
-        ewaldSelfEnergy = -ONE_4PI_EPS0*ewaldAlpha*sumSquaredCharges/sqrt(M_PI);
-        if(nonbondedMethod == LJPME){
-            for (int atom = 0; atom < numParticles; atom++) {
-                // Dispersion self term
-                ewaldSelfEnergy += pow(ewaldDispersionAlpha, 6.0) * C6params[atom]*C6params[atom] / 12.0;
-            }
+CpuCalcCustomBondForceKernel::~CpuCalcCustomBondForceKernel() {
+    if (bondIndexArray != NULL) {
+        for (int i = 0; i < numBonds; i++) {
+            delete[] bondIndexArray[i];
+            delete[] bondParamArray[i];
         }
-    } else {
-        ewaldSelfEnergy = 0.0;
+        delete[] bondIndexArray;
+        delete[] bondParamArray;
     }
-    rfDielectric = force.getReactionFieldDielectric();
-    if (force.getUseDispersionCorrection())
-        dispersionCoefficient = NonbondedForceImpl::calcDispersionCorrection(system, force);
-    else
-        dispersionCoefficient = 0.0;
-    data.isPeriodic = (nonbondedMethod == CutoffPeriodic || nonbondedMethod == Ewald || nonbondedMethod == PME || nonbondedMethod == LJPME);
+    for (auto ixn : threadIxns)
+        delete ixn;
 }
 
-double CpuCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy, bool includeDirect, bool includeReciprocal) {
-    if (!hasInitializedPme) {
-        hasInitializedPme = true;
-        useOptimizedPme = false;
-        if (nonbondedMethod == PME) {
-            // If available, use the optimized PME implementation.
+void CpuCalcCustomBondForceKernel::initialize(const System& system, const CustomBondForce& force) {
+    numBonds = force.getNumBonds();
+    int numParameters = force.getNumPerBondParameters();
+    usePeriodic = force.usesPeriodicBoundaryConditions();
 
-            vector<string> kernelNames;
-            kernelNames.push_back("CalcPmeReciprocalForce");
-            useOptimizedPme = getPlatform().supportsKernels(kernelNames);
-            if (useOptimizedPme) {
-                optimizedPme = getPlatform().createKernel(CalcPmeReciprocalForceKernel::Name(), context);
-                optimizedPme.getAs<CalcPmeReciprocalForceKernel>().initialize(gridSize[0], gridSize[1], gridSize[2], numParticles, ewaldAlpha, data.deterministicForces);
-            }
-        }
-        if (nonbondedMethod == LJPME) {
-            // If available, use the optimized PME implementation.
+    // Build the arrays.
 
-            vector<string> kernelNames;
-            kernelNames.push_back("CalcPmeReciprocalForce");
-            useOptimizedPme = getPlatform().supportsKernels(kernelNames);
-            if (useOptimizedPme) {
-                optimizedPme = getPlatform().createKernel(CalcPmeReciprocalForceKernel::Name(), context);
-                optimizedPme.getAs<CalcPmeReciprocalForceKernel>().initialize(gridSize[0], gridSize[1], gridSize[2], numParticles, ewaldAlpha, data.deterministicForces);
-                optimizedDispersionPme = getPlatform().createKernel(CalcDispersionPmeReciprocalForceKernel::Name(), context);
-                optimizedDispersionPme.getAs<CalcDispersionPmeReciprocalForceKernel>().initialize(dispersionGridSize[0], dispersionGridSize[1],
-                                                                                                  dispersionGridSize[2], numParticles, ewaldDispersionAlpha, data.deterministicForces);
-            }
-        }
+    bondIndexArray = new int*[numBonds];
+    for (int i = 0; i < numBonds; i++)
+        bondIndexArray[i] = new int[2];
+    bondParamArray = new double*[numBonds];
+    for (int i = 0; i < numBonds; i++)
+        bondParamArray[i] = new double[numParameters];
+    vector<double> params;
+    for (int i = 0; i < numBonds; ++i) {
+        int particle1, particle2;
+        force.getBondParameters(i, particle1, particle2, params);
+        bondIndexArray[i][0] = particle1;
+        bondIndexArray[i][1] = particle2;
+        for (int j = 0; j < numParameters; j++)
+            bondParamArray[i][j] = params[j];
     }
-    AlignedArray<float>& posq = data.posq;
-    vector<Vec3>& posData = extractPositions(context);
-    vector<Vec3>& forceData = extractForces(context);
+    bondForce.initialize(system.getNumParticles(), numBonds, 2, bondIndexArray, data.threads);
+
+    // Parse the expression used to calculate the force.
+
+    Lepton::ParsedExpression expression = Lepton::Parser::parse(force.getEnergyFunction()).optimize();
+    Lepton::CompiledExpression energyExpression = expression.createCompiledExpression();
+    Lepton::CompiledExpression forceExpression = expression.differentiate("r").createCompiledExpression();
+    vector<string> parameterNames;
+    for (int i = 0; i < numParameters; i++)
+        parameterNames.push_back(force.getPerBondParameterName(i));
+    for (int i = 0; i < force.getNumGlobalParameters(); i++)
+        globalParameterNames.push_back(force.getGlobalParameterName(i));
+    vector<Lepton::CompiledExpression> energyParamDerivExpressions;
+    for (int i = 0; i < force.getNumEnergyParameterDerivatives(); i++) {
+        string param = force.getEnergyParameterDerivativeName(i);
+        energyParamDerivNames.push_back(param);
+        energyParamDerivExpressions.push_back(expression.differentiate(param).createCompiledExpression());
+    }
+    set<string> variables;
+    variables.insert("r");
+    variables.insert(parameterNames.begin(), parameterNames.end());
+    variables.insert(globalParameterNames.begin(), globalParameterNames.end());
+    validateVariables(expression.getRootNode(), variables);
+
+    // Each thread needs its own copy of the expressions.
+
+    map<string, double> globalParameters;
+    for (int i = 0; i < force.getNumGlobalParameters(); i++)
+        globalParameters[force.getGlobalParameterName(i)] = force.getGlobalParameterDefaultValue(i);
+    for (int i = 0; i < data.threads.getNumThreads(); i++)
+        threadIxns.push_back(new ReferenceCustomBondIxn(energyExpression, forceExpression, parameterNames, globalParameters, energyParamDerivExpressions));
+}
+
+double CpuCalcCustomBondForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3>& forceData = extractForces(context);
+    double energy = 0;
+    map<string, double> globalParameters;
+    for (auto& name : globalParameterNames)
+        globalParameters[name] = context.getParameter(name);
+    vector<ReferenceBondIxn*> ixns;
+    for (auto ixn : threadIxns) {
+        ixn->setGlobalParameters(globalParameters);
+        if (usePeriodic)
+            ixn->setPeriodic(extractBoxVectors(context));
+        ixns.push_back(ixn);
+    }
+    vector<double> energyParamDerivValues(energyParamDerivNames.size(), 0.0);
+    bondForce.calculateForce(posData, bondParamArray, forceData, includeEnergy ? &energy : NULL, ixns, energyParamDerivValues, includeForces);
+    map<string, double>& energyParamDerivs = extractEnergyParameterDerivatives(context);
+    for (int i = 0; i < (int) energyParamDerivNames.size(); i++)
+        energyParamDerivs[energyParamDerivNames[i]] += energyParamDerivValues[i];
+    return energy;
+}
+
+void CpuCalcCustomBondForceKernel::copyParametersToContext(ContextImpl& context, const CustomBondForce& force) {
+    if (numBonds != force.getNumBonds())
+        throw OpenMMException("updateParametersInContext: The number of bonds has changed");
+
+    // Record the values.
+
+    int numParameters = force.getNumPerBondParameters();
+    vector<double> params;
+    for (int i = 0; i < numBonds; ++i) {
+        int particle1, particle2;
+        force.getBondParameters(i, particle1, particle2, params);
+        if (particle1 != bondIndexArray[i][0] || particle2 != bondIndexArray[i][1])
+            throw OpenMMException("updateParametersInContext: The set of particles in a bond has changed");
+        for (int j = 0; j < numParameters; j++)
+            bondParamArray[i][j] = params[j];
+    }
+}
+
+CpuCalcCustomAngleForceKernel::~CpuCalcCustomAngleForceKernel() {
+    if (angleIndexArray != NULL) {
+        for (int i = 0; i < numAngles; i++) {
+            delete[] angleIndexArray[i];
+            delete[] angleParamArray[i];
+        }
+        delete[] angleIndexArray;
+        delete[] angleParamArray;
+    }
+    for (auto ixn : threadIxns)
+        delete ixn;
+}
+
+void CpuCalcCustomAngleForceKernel::initialize(const System& system, const CustomAngleForce& force) {
+    numAngles = force.getNumAngles();
+    int numParameters = force.getNumPerAngleParameters();
+    usePeriodic = force.usesPeriodicBoundaryConditions();
+
+    // Build the arrays.
+
+    angleIndexArray = new int*[numAngles];
+    for (int i = 0; i < numAngles; i++)
+        angleIndexArray[i] = new int[3];
+    angleParamArray = new double*[numAngles];
+    for (int i = 0; i < numAngles; i++)
+        angleParamArray[i] = new double[numParameters];
+    vector<double> params;
+    for (int i = 0; i < numAngles; ++i) {
+        int particle1, particle2, particle3;
+        force.getAngleParameters(i, particle1, particle2, particle3, params);
+        angleIndexArray[i][0] = particle1;
+        angleIndexArray[i][1] = particle2;
+        angleIndexArray[i][2] = particle3;
+        for (int j = 0; j < numParameters; j++)
+            angleParamArray[i][j] = params[j];
+    }
+    bondForce.initialize(system.getNumParticles(), numAngles, 3, angleIndexArray, data.threads);
+
+    // Parse the expression used to calculate the force.
+
+    Lepton::ParsedExpression expression = Lepton::Parser::parse(force.getEnergyFunction()).optimize();
+    Lepton::CompiledExpression energyExpression = expression.createCompiledExpression();
+    Lepton::CompiledExpression forceExpression = expression.differentiate("theta").createCompiledExpression();
+    vector<string> parameterNames;
+    for (int i = 0; i < numParameters; i++)
+        parameterNames.push_back(force.getPerAngleParameterName(i));
+    for (int i = 0; i < force.getNumGlobalParameters(); i++)
+        globalParameterNames.push_back(force.getGlobalParameterName(i));
+    vector<Lepton::CompiledExpression> energyParamDerivExpressions;
+    for (int i = 0; i < force.getNumEnergyParameterDerivatives(); i++) {
+        string param = force.getEnergyParameterDerivativeName(i);
+        energyParamDerivNames.push_back(param);
+        energyParamDerivExpressions.push_back(expression.differentiate(param).createCompiledExpression());
+    }
+    set<string> variables;
+    variables.insert("theta");
+    variables.insert(parameterNames.begin(), parameterNames.end());
+    variables.insert(globalParameterNames.begin(), globalParameterNames.end());
+    validateVariables(expression.getRootNode(), variables);
+
+    // Each thread needs its own copy of the expressions.
+
+    map<string, double> globalParameters;
+    for (int i = 0; i < force.getNumGlobalParameters(); i++)
+        globalParameters[force.getGlobalParameterName(i)] = force.getGlobalParameterDefaultValue(i);
+    for (int i = 0; i < data.threads.getNumThreads(); i++)
+        threadIxns.push_back(new ReferenceCustomAngleIxn(energyExpression, forceExpression, parameterNames, globalParameters, energyParamDerivExpressions));
+}
+
+double CpuCalcCustomAngleForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3>& forceData = extractForces(context);
+    double energy = 0;
+    map<string, double> globalParameters;
+    for (auto& name : globalParameterNames)
+        globalParameters[name] = context.getParameter(name);
+    vector<ReferenceBondIxn*> ixns;
+    for (auto ixn : threadIxns) {
+        ixn->setGlobalParameters(globalParameters);
+        if (usePeriodic)
+            ixn->setPeriodic(extractBoxVectors(context));
+        ixns.push_back(ixn);
+    }
+    vector<double> energyParamDerivValues(energyParamDerivNames.size(), 0.0);
+    bondForce.calculateForce(posData, angleParamArray, forceData, includeEnergy ? &energy : NULL, ixns, energyParamDerivValues, includeForces);
+    map<string, double>& energyParamDerivs = extractEnergyParameterDerivatives(context);
+    for (int i = 0; i < (int) energyParamDerivNames.size(); i++)
+        energyParamDerivs[energyParamDerivNames[i]] += energyParamDerivValues[i];
+    return energy;
+}
+
+void CpuCalcCustomAngleForceKernel::copyParametersToContext(ContextImpl& context, const CustomAngleForce& force) {
+    if (numAngles != force.getNumAngles())
+        throw OpenMMException("updateParametersInContext: The number of angles has changed");
+
+    // Record the values.
+
+    int numParameters = force.getNumPerAngleParameters();
+    vector<double> params;
+    for (int i = 0; i < numAngles; ++i) {
+        int particle1, particle2, particle3;
+        force.getAngleParameters(i, particle1, particle2, particle3, params);
+        if (particle1 != angleIndexArray[i][0] || particle2 != angleIndexArray[i][1] || particle3 != angleIndexArray[i][2])
+            throw OpenMMException("updateParametersInContext: The set of particles in an angle has changed");
+        for (int j = 0; j < numParameters; j++)
+            angleParamArray[i][j] = params[j];
+    }
+}
+
+CpuCalcCustomTorsionForceKernel::~CpuCalcCustomTorsionForceKernel() {
+    if (torsionIndexArray != NULL) {
+        for (int i = 0; i < numTorsions; i++) {
+            delete[] torsionIndexArray[i];
+            delete[] torsionParamArray[i];
+        }
+        delete[] torsionIndexArray;
+        delete[] torsionParamArray;
+    }
+    for (auto ixn : threadIxns)
+        delete ixn;
+}
+
+void CpuCalcCustomTorsionForceKernel::initialize(const System& system, const CustomTorsionForce& force) {
+    numTorsions = force.getNumTorsions();
+    int numParameters = force.getNumPerTorsionParameters();
+    usePeriodic = force.usesPeriodicBoundaryConditions();
+
+    // Build the arrays.
+
+    torsionIndexArray = new int*[numTorsions];
+    for (int i = 0; i < numTorsions; i++)
+        torsionIndexArray[i] = new int[4];
+    torsionParamArray = new double*[numTorsions];
+    for (int i = 0; i < numTorsions; i++)
+        torsionParamArray[i] = new double[numParameters];
+    vector<double> params;
+    for (int i = 0; i < numTorsions; ++i) {
+        int particle1, particle2, particle3, particle4;
+        force.getTorsionParameters(i, particle1, particle2, particle3, particle4, params);
+        torsionIndexArray[i][0] = particle1;
+        torsionIndexArray[i][1] = particle2;
+        torsionIndexArray[i][2] = particle3;
+        torsionIndexArray[i][3] = particle4;
+        for (int j = 0; j < numParameters; j++)
+            torsionParamArray[i][j] = params[j];
+    }
+    bondForce.initialize(system.getNumParticles(), numTorsions, 4, torsionIndexArray, data.threads);
+
+    // Parse the expression used to calculate the force.
+
+    Lepton::ParsedExpression expression = Lepton::Parser::parse(force.getEnergyFunction()).optimize();
+    Lepton::CompiledExpression energyExpression = expression.createCompiledExpression();
+    Lepton::CompiledExpression forceExpression = expression.differentiate("theta").createCompiledExpression();
+    vector<string> parameterNames;
+    for (int i = 0; i < numParameters; i++)
+        parameterNames.push_back(force.getPerTorsionParameterName(i));
+    for (int i = 0; i < force.getNumGlobalParameters(); i++)
+        globalParameterNames.push_back(force.getGlobalParameterName(i));
+    vector<Lepton::CompiledExpression> energyParamDerivExpressions;
+    for (int i = 0; i < force.getNumEnergyParameterDerivatives(); i++) {
+        string param = force.getEnergyParameterDerivativeName(i);
+        energyParamDerivNames.push_back(param);
+        energyParamDerivExpressions.push_back(expression.differentiate(param).createCompiledExpression());
+    }
+    set<string> variables;
+    variables.insert("theta");
+    variables.insert(parameterNames.begin(), parameterNames.end());
+    variables.insert(globalParameterNames.begin(), globalParameterNames.end());
+    validateVariables(expression.getRootNode(), variables);
+
+    // Each thread needs its own copy of the expressions.
+
+    map<string, double> globalParameters;
+    for (int i = 0; i < force.getNumGlobalParameters(); i++)
+        globalParameters[force.getGlobalParameterName(i)] = force.getGlobalParameterDefaultValue(i);
+    for (int i = 0; i < data.threads.getNumThreads(); i++)
+        threadIxns.push_back(new ReferenceCustomTorsionIxn(energyExpression, forceExpression, parameterNames, globalParameters, energyParamDerivExpressions));
+}
+
+double CpuCalcCustomTorsionForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3>& forceData = extractForces(context);
+    double energy = 0;
+    map<string, double> globalParameters;
+    for (auto& name : globalParameterNames)
+        globalParameters[name] = context.getParameter(name);
+    vector<ReferenceBondIxn*> ixns;
+    for (auto ixn : threadIxns) {
+        ixn->setGlobalParameters(globalParameters);
+        if (usePeriodic)
+            ixn->setPeriodic(extractBoxVectors(context));
+        ixns.push_back(ixn);
+    }
+    vector<double> energyParamDerivValues(energyParamDerivNames.size(), 0.0);
+    bondForce.calculateForce(posData, torsionParamArray, forceData, includeEnergy ? &energy : NULL, ixns, energyParamDerivValues, includeForces);
+    map<string, double>& energyParamDerivs = extractEnergyParameterDerivatives(context);
+    for (int i = 0; i < (int) energyParamDerivNames.size(); i++)
+        energyParamDerivs[energyParamDerivNames[i]] += energyParamDerivValues[i];
+    return energy;
+}
+
+void CpuCalcCustomTorsionForceKernel::copyParametersToContext(ContextImpl& context, const CustomTorsionForce& force) {
+    if (numTorsions != force.getNumTorsions())
+        throw OpenMMException("updateParametersInContext: The number of torsions has changed");
+
+    // Record the values.
+
+    int numParameters = force.getNumPerTorsionParameters();
+    vector<double> params;
+    for (int i = 0; i < numTorsions; ++i) {
+        int particle1, particle2, particle3, particle4;
+        force.getTorsionParameters(i, particle1, particle2, particle3, particle4, params);
+        if (particle1 != torsionIndexArray[i][0] || particle2 != torsionIndexArray[i][1] || particle3 != torsionIndexArray[i][2] || particle4 != torsionIndexArray[i][3])
+            throw OpenMMException("updateParametersInContext: The set of particles in a torsion has changed");
+        for (int j = 0; j < numParameters; j++)
+            torsionParamArray[i][j] = params[j];
+    }
+}
+
+class CpuCalcCustomExternalForceKernel::ThreadIxn : public ReferenceBondIxn {
+public:
+    ThreadIxn(const Lepton::CompiledExpression& energyExpression, const Lepton::CompiledExpression& forceExpressionX,
+              const Lepton::CompiledExpression& forceExpressionY, const Lepton::CompiledExpression& forceExpressionZ,
+              const vector<string>& parameterNames, map<string, double> globalParameters) :
+            ixn(energyExpression, forceExpressionX, forceExpressionY, forceExpressionZ, parameterNames, globalParameters) {
+    }
+    void setGlobalParameters(map<string, double> globalParameters) {
+        ixn.setGlobalParameters(globalParameters);
+    }
+    void calculateBondIxn(int* atomIndices, vector<Vec3>& atomCoordinates, double* parameters, vector<Vec3>& forces,
+                          double* totalEnergy, double* energyParamDerivs) {
+        ixn.calculateForce(atomIndices[0], atomCoordinates, parameters, forces, totalEnergy, includeForces);
+    }
+private:
+    ReferenceCustomExternalIxn ixn;
+};
+
+CpuCalcCustomExternalForceKernel::~CpuCalcCustomExternalForceKernel() {
+    if (particleIndexArray != NULL) {
+        for (int i = 0; i < numParticles; i++) {
+            delete[] particleIndexArray[i];
+            delete[] particleParamArray[i];
+        }
+        delete[] particleIndexArray;
+        delete[] particleParamArray;
+    }
+    for (auto ixn : threadIxns)
+        delete ixn;
+}
+
+void CpuCalcCustomExternalForceKernel::initialize(const System& system, const CustomExternalForce& force) {
+    numParticles = force.getNumParticles();
+    int numParameters = force.getNumPerParticleParameters();
+
+    // Build the arrays.  Each particle is treated as a one atom "bond" so it can be partitioned
+    // between threads by CpuBondForce.
+
+    particleIndexArray = new int*[numParticles];
+    for (int i = 0; i < numParticles; i++)
+        particleIndexArray[i] = new int[1];
+    particleParamArray = new double*[numParticles];
+    for (int i = 0; i < numParticles; i++)
+        particleParamArray[i] = new double[numParameters];
+    vector<double> params;
+    for (int i = 0; i < numParticles; ++i) {
+        force.getParticleParameters(i, particleIndexArray[i][0], params);
+        for (int j = 0; j < numParameters; j++)
+            particleParamArray[i][j] = params[j];
+    }
+    bondForce.initialize(system.getNumParticles(), numParticles, 1, particleIndexArray, data.threads);
+
+    // Parse the expression used to calculate the force.
+
+    map<string, Lepton::CustomFunction*> functions;
+    ReferenceCalcCustomExternalForceKernel::PeriodicDistanceFunction periodicDistance(&boxVectors);
+    functions["periodicdistance"] = &periodicDistance;
+    Lepton::ParsedExpression expression = Lepton::Parser::parse(force.getEnergyFunction(), functions).optimize();
+    Lepton::CompiledExpression energyExpression = expression.createCompiledExpression();
+    Lepton::CompiledExpression forceExpressionX = expression.differentiate("x").createCompiledExpression();
+    Lepton::CompiledExpression forceExpressionY = expression.differentiate("y").createCompiledExpression();
+    Lepton::CompiledExpression forceExpressionZ = expression.differentiate("z").createCompiledExpression();
+    vector<string> parameterNames;
+    for (int i = 0; i < numParameters; i++)
+        parameterNames.push_back(force.getPerParticleParameterName(i));
+    for (int i = 0; i < force.getNumGlobalParameters(); i++)
+        globalParameterNames.push_back(force.getGlobalParameterName(i));
+    set<string> variables;
+    variables.insert("x");
+    variables.insert("y");
+    variables.insert("z");
+    variables.insert(parameterNames.begin(), parameterNames.end());
+    variables.insert(globalParameterNames.begin(), globalParameterNames.end());
+    validateVariables(expression.getRootNode(), variables);
+
+    // Each thread needs its own copy of the expressions.
+
+    map<string, double> globalParameters;
+    for (int i = 0; i < force.getNumGlobalParameters(); i++)
+        globalParameters[force.getGlobalParameterName(i)] = force.getGlobalParameterDefaultValue(i);
+    for (int i = 0; i < data.threads.getNumThreads(); i++)
+        threadIxns.push_back(new ThreadIxn(energyExpression, forceExpressionX, forceExpressionY, forceExpressionZ, parameterNames, globalParameters));
+}
+
+double CpuCalcCustomExternalForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3>& forceData = extractForces(context);
+    boxVectors = extractBoxVectors(context);
+    double energy = 0;
+    map<string, double> globalParameters;
+    for (auto& name : globalParameterNames)
+        globalParameters[name] = context.getParameter(name);
+    vector<ReferenceBondIxn*> ixns;
+    for (auto ixn : threadIxns) {
+        ixn->setGlobalParameters(globalParameters);
+        ixns.push_back(ixn);
+    }
+    vector<double> energyParamDerivValues;
+    bondForce.calculateForce(posData, particleParamArray, forceData, includeEnergy ? &energy : NULL, ixns, energyParamDerivValues, includeForces);
+    return energy;
+}
+
+void CpuCalcCustomExternalForceKernel::copyParametersToContext(ContextImpl& context, const CustomExternalForce& force) {
+    if (numParticles != force.getNumParticles())
+        throw OpenMMException("updateParametersInContext: The number of particles has changed");
+
+    // Record the values.
+
+    int numParameters = force.getNumPerParticleParameters();
+    vector<double> params;
+    for (int i = 0; i < numParticles; ++i) {
+        int particle;
+        force.getParticleParameters(i, particle, params);
+        if (particle != particleIndexArray[i][0])
+            throw OpenMMException("updateParametersInContext: A particle index has changed");
+        for (int j = 0; j < numParameters; j++)
+            particleParamArray[i][j] = params[j];
+    }
+}
+
+CpuCalcCustomCompoundBondForceKernel::~CpuCalcCustomCompoundBondForceKernel() {
+    if (bondIndexArray != NULL) {
+        for (int i = 0; i < numBonds; i++) {
+            delete[] bondIndexArray[i];
+            delete[] bondParamArray[i];
+        }
+        delete[] bondIndexArray;
+        delete[] bondParamArray;
+    }
+    for (auto ixn : threadIxns)
+        delete ixn;
+}
+
+void CpuCalcCustomCompoundBondForceKernel::initialize(const System& system, const CustomCompoundBondForce& force) {
+    numBonds = force.getNumBonds();
+    numParticlesPerBond = force.getNumParticlesPerBond();
+    int numParameters = force.getNumPerBondParameters();
+    usePeriodic = force.usesPeriodicBoundaryConditions();
+
+    // Build the arrays.
+
+    vector<vector<int> > bondParticles(numBonds);
+    bondIndexArray = new int*[numBonds];
+    bondParamArray = new double*[numBonds];
+    vector<double> params;
+    for (int i = 0; i < numBonds; i++) {
+        force.getBondParameters(i, bondParticles[i], params);
+        bondIndexArray[i] = new int[numParticlesPerBond];
+        bondParamArray[i] = new double[numParameters];
+        for (int j = 0; j < numParticlesPerBond; j++)
+            bondIndexArray[i][j] = bondParticles[i][j];
+        for (int j = 0; j < numParameters; j++)
+            bondParamArray[i][j] = params[j];
+    }
+    bondForce.initialize(system.getNumParticles(), numBonds, numParticlesPerBond, bondIndexArray, data.threads);
+
+    // Create custom functions for the tabulated functions.
+
+    map<string, Lepton::CustomFunction*> functions;
+    for (int i = 0; i < force.getNumFunctions(); i++)
+        functions[force.getTabulatedFunctionName(i)] = createReferenceTabulatedFunction(force.getTabulatedFunction(i));
+
+    // Parse the expression.
+
+    map<string, vector<int> > distances;
+    map<string, vector<int> > angles;
+    map<string, vector<int> > dihedrals;
+    Lepton::ParsedExpression energyExpression = CustomCompoundBondForceImpl::prepareExpression(force, functions, distances, angles, dihedrals);
+    vector<string> bondParameterNames;
+    for (int i = 0; i < numParameters; i++)
+        bondParameterNames.push_back(force.getPerBondParameterName(i));
+    for (int i = 0; i < force.getNumGlobalParameters(); i++)
+        globalParameterNames.push_back(force.getGlobalParameterName(i));
+    vector<Lepton::CompiledExpression> energyParamDerivExpressions;
+    for (int i = 0; i < force.getNumEnergyParameterDerivatives(); i++) {
+        string param = force.getEnergyParameterDerivativeName(i);
+        energyParamDerivNames.push_back(param);
+        energyParamDerivExpressions.push_back(energyExpression.differentiate(param).createCompiledExpression());
+    }
+
+    // Each thread needs its own copy of the expressions.
+
+    for (int i = 0; i < data.threads.getNumThreads(); i++)
+        threadIxns.push_back(new ReferenceCustomCompoundBondIxn(numParticlesPerBond, bondParticles, energyExpression, bondParameterNames, distances, angles, dihedrals, energyParamDerivExpressions));
+
+    // Delete the custom functions.
+
+    for (auto& function : functions)
+        delete function.second;
+}
+
+double CpuCalcCustomCompoundBondForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3>& forceData = extractForces(context);
+    double energy = 0;
+    map<string, double> globalParameters;
+    for (auto& name : globalParameterNames)
+        globalParameters[name] = context.getParameter(name);
+    vector<ReferenceBondIxn*> ixns;
+    for (auto ixn : threadIxns) {
+        ixn->setGlobalParameters(globalParameters);
+        if (usePeriodic)
+            ixn->setPeriodic(extractBoxVectors(context));
+        ixns.push_back(ixn);
+    }
+    vector<double> energyParamDerivValues(energyParamDerivNames.size(), 0.0);
+    bondForce.calculateForce(posData, bondParamArray, forceData, includeEnergy ? &energy : NULL, ixns, energyParamDerivValues, includeForces);
+    map<string, double>& energyParamDerivs = extractEnergyParameterDerivatives(context);
+    for (int i = 0; i < (int) energyParamDerivNames.size(); i++)
+        energyParamDerivs[energyParamDerivNames[i]] += energyParamDerivValues[i];
+    return energy;
+}
+
+void CpuCalcCustomCompoundBondForceKernel::copyParametersToContext(ContextImpl& context, const CustomCompoundBondForce& force) {
+    if (numBonds != force.getNumBonds())
+        throw OpenMMException("updateParametersInContext: The number of bonds has changed");
+
+    // Record the values.
+
+    int numParameters = force.getNumPerBondParameters();
+    vector<int> particles;
+    vector<double> params;
+    for (int i = 0; i < numBonds; ++i) {
+        force.getBondParameters(i, particles, params);
+        for (int j = 0; j < numParticlesPerBond; j++)
+            if (particles[j] != bondIndexArray[i][j])
+                throw OpenMMException("updateParametersInContext: The set of particles in a bond has changed");
+        for (int j = 0; j < numParameters; j++)
+            bondParamArray[i][j] = params[j];
+    }
+}
+
+CpuCalcCustomCentroidBondForceKernel::~CpuCalcCustomCentroidBondForceKernel() {
+    if (bondIndexArray != NULL) {
+        for (int i = 0; i < numBonds; i++) {
+            delete[] bondIndexArray[i];
+            delete[] bondParamArray[i];
+        }
+        delete[] bondIndexArray;
+        delete[] bondParamArray;
+    }
+    for (auto ixn : threadIxns)
+        delete ixn;
+}
+
+void CpuCalcCustomCentroidBondForceKernel::initialize(const System& system, const CustomCentroidBondForce& force) {
+    numGroups = force.getNumGroups();
+    numBonds = force.getNumBonds();
+    numGroupsPerBond = force.getNumGroupsPerBond();
+    int numParameters = force.getNumPerBondParameters();
+    usePeriodic = force.usesPeriodicBoundaryConditions();
+
+    // Build the tables of the atoms in each group and the groups each atom belongs to.
+
+    vector<vector<int> > groupAtomLists(numGroups);
+    vector<double> ignored;
+    for (int i = 0; i < numGroups; i++)
+        force.getGroupParameters(i, groupAtomLists[i], ignored);
+    vector<vector<double> > normalizedWeights;
+    CustomCentroidBondForceImpl::computeNormalizedWeights(force, system, normalizedWeights);
+    int numAtoms = system.getNumParticles();
+    vector<vector<pair<int, double> > > atomGroupLists(numAtoms);
+    groupAtomStart.push_back(0);
+    for (int i = 0; i < numGroups; i++) {
+        for (int j = 0; j < (int) groupAtomLists[i].size(); j++) {
+            int atom = groupAtomLists[i][j];
+            groupAtoms.push_back(atom);
+            groupAtomWeights.push_back(normalizedWeights[i][j]);
+            atomGroupLists[atom].push_back(make_pair(i, normalizedWeights[i][j]));
+        }
+        groupAtomStart.push_back(groupAtoms.size());
+    }
+    atomGroupStart.push_back(0);
+    for (int i = 0; i < numAtoms; i++) {
+        if (atomGroupLists[i].size() == 0)
+            continue;
+        forceAtoms.push_back(i);
+        for (auto& group : atomGroupLists[i]) {
+            atomGroups.push_back(group.first);
+            atomGroupWeights.push_back(group.second);
+        }
+        atomGroupStart.push_back(atomGroups.size());
+    }
+    groupCenters.resize(numGroups);
+    groupForces.resize(numGroups);
+
+    // Build the arrays of bond parameters.
+
+    vector<vector<int> > bondGroups(numBonds);
+    bondIndexArray = new int*[numBonds];
+    bondParamArray = new double*[numBonds];
+    vector<double> params;
+    for (int i = 0; i < numBonds; i++) {
+        force.getBondParameters(i, bondGroups[i], params);
+        bondIndexArray[i] = new int[numGroupsPerBond];
+        bondParamArray[i] = new double[numParameters];
+        for (int j = 0; j < numGroupsPerBond; j++)
+            bondIndexArray[i][j] = bondGroups[i][j];
+        for (int j = 0; j < numParameters; j++)
+            bondParamArray[i][j] = params[j];
+    }
+    bondForce.initialize(numGroups, numBonds, numGroupsPerBond, bondIndexArray, data.threads);
+
+    // Create custom functions for the tabulated functions.
+
+    map<string, Lepton::CustomFunction*> functions;
+    for (int i = 0; i < force.getNumFunctions(); i++)
+        functions[force.getTabulatedFunctionName(i)] = createReferenceTabulatedFunction(force.getTabulatedFunction(i));
+
+    // Parse the expression.
+
+    map<string, vector<int> > distances;
+    map<string, vector<int> > angles;
+    map<string, vector<int> > dihedrals;
+    Lepton::ParsedExpression energyExpression = CustomCentroidBondForceImpl::prepareExpression(force, functions, distances, angles, dihedrals);
+    vector<string> bondParameterNames;
+    for (int i = 0; i < numParameters; i++)
+        bondParameterNames.push_back(force.getPerBondParameterName(i));
+    for (int i = 0; i < force.getNumGlobalParameters(); i++)
+        globalParameterNames.push_back(force.getGlobalParameterName(i));
+    vector<Lepton::CompiledExpression> energyParamDerivExpressions;
+    for (int i = 0; i < force.getNumEnergyParameterDerivatives(); i++) {
+        string param = force.getEnergyParameterDerivativeName(i);
+        energyParamDerivNames.push_back(param);
+        energyParamDerivExpressions.push_back(energyExpression.differentiate(param).createCompiledExpression());
+    }
+
+    // Each thread needs its own copy of the expressions.
+
+    for (int i = 0; i < data.threads.getNumThreads(); i++)
+        threadIxns.push_back(new ReferenceCustomCentroidBondIxn(numGroupsPerBond, groupAtomLists, normalizedWeights, bondGroups, energyExpression,
+                bondParameterNames, distances, angles, dihedrals, energyParamDerivExpressions));
+
+    // Delete the custom functions.
+
+    for (auto& function : functions)
+        delete function.second;
+}
+
+double CpuCalcCustomCentroidBondForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3>& forceData = extractForces(context);
+    int numThreads = data.threads.getNumThreads();
+
+    // Compute the center of each group.
+
+    data.threads.execute([&] (ThreadPool& threads, int threadIndex) {
+        int start = threadIndex*numGroups/numThreads;
+        int end = (threadIndex+1)*numGroups/numThreads;
+        for (int group = start; group < end; group++) {
+            Vec3 center;
+            for (int i = groupAtomStart[group]; i < groupAtomStart[group+1]; i++)
+                center += posData[groupAtoms[i]]*groupAtomWeights[i];
+            groupCenters[group] = center;
+            groupForces[group] = Vec3();
+        }
+    });
+    data.threads.waitForThreads();
+
+    // Compute the forces on groups.
+
+    double energy = 0;
+    map<string, double> globalParameters;
+    for (auto& name : globalParameterNames)
+        globalParameters[name] = context.getParameter(name);
+    vector<ReferenceBondIxn*> ixns;
+    for (auto ixn : threadIxns) {
+        ixn->setGlobalParameters(globalParameters);
+        if (usePeriodic)
+            ixn->setPeriodic(extractBoxVectors(context));
+        ixns.push_back(ixn);
+    }
+    vector<double> energyParamDerivValues(energyParamDerivNames.size(), 0.0);
+    bondForce.calculateForce(groupCenters, bondParamArray, groupForces, includeEnergy ? &energy : NULL, ixns, energyParamDerivValues, includeForces);
+    map<string, double>& energyParamDerivs = extractEnergyParameterDerivatives(context);
+    for (int i = 0; i < (int) energyParamDerivNames.size(); i++)
+        energyParamDerivs[energyParamDerivNames[i]] += energyParamDerivValues[i];
+
+    // Apply the forces to the individual atoms.
+
+    if (includeForces) {
+        int numForceAtoms = forceAtoms.size();
+        data.threads.execute([&] (ThreadPool& threads, int threadIndex) {
+            int start = threadIndex*numForceAtoms/numThreads;
+            int end = (threadIndex+1)*numForceAtoms/numThreads;
+            for (int i = start; i < end; i++) {
+                Vec3 f;
+                for (int j = atomGroupStart[i]; j < atomGroupStart[i+1]; j++)
+                    f += groupForces[atomGroups[j]]*atomGroupWeights[j];
+                forceData[forceAtoms[i]] += f;
+            }
+        });
+        data.threads.waitForThreads();
+    }
+    return energy;
+}
+
+void CpuCalcCustomCentroidBondForceKernel::copyParametersToContext(ContextImpl& context, const CustomCentroidBondForce& force) {
+    if (numBonds != force.getNumBonds())
+        throw OpenMMException("updateParametersInContext: The number of bonds has changed");
+
+    // Record the values.
+
+    int numParameters = force.getNumPerBondParameters();
+    vector<int> groups;
+    vector<double> params;
+    for (int i = 0; i < numBonds; ++i) {
+        force.getBondParameters(i, groups, params);
+        for (int j = 0; j < numGroupsPerBond; j++)
+            if (groups[j] != bondIndexArray[i][j])
+                throw OpenMMException("updateParametersInContext: The set of groups in a bond has changed");
+        for (int j = 0; j < numParameters; j++)
+            bondParamArray[i][j] = params[j];
+    }
+}
+
+class CpuCalcNonbondedForceKernel::PmeIO : public CalcPmeReciprocalForceKernel::IO {
+public:
+    PmeIO(float* posq, float* force, int numParticles) : posq(posq), force(force), numParticles(numParticles) {
+    }
+    float* getPosq() {
+        return posq;
+    }
+    void setForce(float* f) {
+        if (force == NULL)
+            return; // Only the energy was requested.
+        for (int i = 0; i < numParticles; i++) {
+            force[4*i] += f[4*i];
+            force[4*i+1] += f[4*i+1];
+            force[4*i+2] += f[4*i+2];
+        }
+    }
+private:
+    float* posq;
+    float* force;
+    int numParticles;
+};
+
+CpuNonbondedForce* createCpuNonbondedForceVec4();
+CpuNonbondedForce* createCpuNonbondedForceVec8();
+CpuNonbondedForce* createCpuNonbondedForceVec16();
+
+CpuCalcNonbondedForceKernel::CpuCalcNonbondedForceKernel(string name, const Platform& platform, CpuPlatform::PlatformData& data) : CalcNonbondedForceKernel(name, platform),
+        data(data), bonded14IndexArray(NULL), bonded14ParamArray(NULL), hasInitializedPme(false), hasInitializedDispersionPme(false), nonbonded(NULL) {
+    if (data.vectorWidth == 16)
+        nonbonded = createCpuNonbondedForceVec16();
+    else if (data.vectorWidth == 8)
+        nonbonded = createCpuNonbondedForceVec8();
+    else
+        nonbonded = createCpuNonbondedForceVec4();
+}
+
+CpuCalcNonbondedForceKernel::~CpuCalcNonbondedForceKernel() {
+    if (bonded14ParamArray != NULL) {
+        for (int i = 0; i < num14; i++) {
+            delete[] bonded14IndexArray[i];
+            delete[] bonded14ParamArray[i];
+        }
+        delete[] bonded14IndexArray;
+        delete[] bonded14ParamArray;
+    }
+    if (nonbonded != NULL)
+        delete nonbonded;
+}
+
+void CpuCalcNonbondedForceKernel::initialize(const System& system, const NonbondedForce& force) {
+
+    // Identify which exceptions are 1-4 interactions.
+
+    numParticles = force.getNumParticles();
+    exclusions.resize(numParticles);
+    vector<int> nb14s;
+    for (int i = 0; i < force.getNumExceptions(); i++) {
+        int particle1, particle2;
+        double chargeProd, sigma, epsilon;
+        force.getExceptionParameters(i, particle1, particle2, chargeProd, sigma, epsilon);
+        exclusions[particle1].insert(particle2);
+        exclusions[particle2].insert(particle1);
+        if (chargeProd != 0.0 || epsilon != 0.0)
+            nb14s.push_back(i);
+    }
+
+    // Record the particle parameters.
+
+    num14 = nb14s.size();
+    bonded14IndexArray = new int*[num14];
+    for (int i = 0; i < num14; i++)
+        bonded14IndexArray[i] = new int[2];
+    bonded14ParamArray = new double*[num14];
+    for (int i = 0; i < num14; i++)
+        bonded14ParamArray[i] = new double[3];
+    particleParams.resize(numParticles);
+    C6params.resize(numParticles);
+    double sumSquaredCharges = 0.0;
+    for (int i = 0; i < numParticles; ++i) {
+        double charge, radius, depth;
+        force.getParticleParameters(i, charge, radius, depth);
+        data.posq[4*i+3] = (float) charge;
+        particleParams[i] = make_pair((float) (0.5*radius), (float) (2.0*sqrt(depth)));
+        C6params[i] = 8.0*pow(particleParams[i].first, 3.0) * particleParams[i].second;
+        sumSquaredCharges += charge*charge;
+    }
+    
+    // Recorded exception parameters.
+    
+    for (int i = 0; i < num14; ++i) {
+        int particle1, particle2;
+        double charge, radius, depth;
+        force.getExceptionParameters(nb14s[i], particle1, particle2, charge, radius, depth);
+        bonded14IndexArray[i][0] = particle1;
+        bonded14IndexArray[i][1] = particle2;
+        bonded14ParamArray[i][0] = radius;
+        bonded14ParamArray[i][1] = 4.0*depth;
+        bonded14ParamArray[i][2] = charge;
+    }
+    bondForce.initialize(system.getNumParticles(), num14, 2, bonded14IndexArray, data.threads);
+    
+    // Record other parameters.
+    
+    nonbondedMethod = CalcNonbondedForceKernel::NonbondedMethod(force.getNonbondedMethod());
+    nonbondedCutoff = force.getCutoffDistance();
+    if (nonbondedMethod == NoCutoff)
+        useSwitchingFunction = false;
+    else {
+        data.requestNeighborList(nonbondedCutoff, 0.25*nonbondedCutoff, true, exclusions);
+        useSwitchingFunction = force.getUseSwitchingFunction();
+        switchingDistance = force.getSwitchingDistance();
+    }
+    if (nonbondedMethod == Ewald) {
+        double alpha;
+        NonbondedForceImpl::calcEwaldParameters(system, force, alpha, kmax[0], kmax[1], kmax[2]);
+        ewaldAlpha = alpha;
+    }
+    else if (nonbondedMethod == PME) {
+        double alpha;
+        NonbondedForceImpl::calcPMEParameters(system, force, alpha, gridSize[0], gridSize[1], gridSize[2], false);
+        ewaldAlpha = alpha;
+    }
+    else if (nonbondedMethod == LJPME) {
+        double alpha;
+        NonbondedForceImpl::calcPMEParameters(system, force, alpha, gridSize[0], gridSize[1], gridSize[2], false);
+        ewaldAlpha = alpha;
+        NonbondedForceImpl::calcPMEParameters(system, force, alpha, dispersionGridSize[0], dispersionGridSize[1], dispersionGridSize[2], true);
+        ewaldDispersionAlpha = alpha;
+        useSwitchingFunction = false;
+    }
+
+    if (nonbondedMethod == Ewald || nonbondedMethod == PME || nonbondedMethod == LJPME) {
+        ewaldSelfEnergy = -ONE_4PI_EPS0*ewaldAlpha*sumSquaredCharges/sqrt(M_PI);
+        if(nonbondedMethod == LJPME){
+            for (int atom = 0; atom < numParticles; atom++) {
+                // Dispersion self term
+                ewaldSelfEnergy += pow(ewaldDispersionAlpha, 6.0) * C6params[atom]*C6params[atom] / 12.0;
+            }
+        }
+    } else {
+        ewaldSelfEnergy = 0.0;
+    }
+    pmeOrder = force.getPMEInterpolationOrder();
+    rfDielectric = force.getReactionFieldDielectric();
+    if (force.getUseDispersionCorrection())
+        dispersionCoefficient = NonbondedForceImpl::calcDispersionCorrection(system, force);
+    else
+        dispersionCoefficient = 0.0;
+    data.isPeriodic = (nonbondedMethod == CutoffPeriodic || nonbondedMethod == Ewald || nonbondedMethod == PME || nonbondedMethod == LJPME);
+}
+
+double CpuCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy, bool includeDirect, bool includeReciprocal) {
+    if (!hasInitializedPme) {
+        hasInitializedPme = true;
+        useOptimizedPme = false;
+        if (nonbondedMethod == PME) {
+            // If available, use the optimized PME implementation.
+
+            vector<string> kernelNames;
+            kernelNames.push_back("CalcPmeReciprocalForce");
+            useOptimizedPme = getPlatform().supportsKernels(kernelNames);
+            if (useOptimizedPme) {
+                optimizedPme = getPlatform().createKernel(CalcPmeReciprocalForceKernel::Name(), context);
+                optimizedPme.getAs<CalcPmeReciprocalForceKernel>().initialize(gridSize[0], gridSize[1], gridSize[2], pmeOrder, numParticles, ewaldAlpha, data.deterministicForces);
+            }
+        }
+        if (nonbondedMethod == LJPME) {
+            // If available, use the optimized PME implementation.
+
+            vector<string> kernelNames;
+            kernelNames.push_back("CalcPmeReciprocalForce");
+            useOptimizedPme = getPlatform().supportsKernels(kernelNames);
+            if (useOptimizedPme) {
+                optimizedPme = getPlatform().createKernel(CalcPmeReciprocalForceKernel::Name(), context);
+                optimizedPme.getAs<CalcPmeReciprocalForceKernel>().initialize(gridSize[0], gridSize[1], gridSize[2], pmeOrder, numParticles, ewaldAlpha, data.deterministicForces);
+                optimizedDispersionPme = getPlatform().createKernel(CalcDispersionPmeReciprocalForceKernel::Name(), context);
+                optimizedDispersionPme.getAs<CalcDispersionPmeReciprocalForceKernel>().initialize(dispersionGridSize[0], dispersionGridSize[1],
+                                                                                                  dispersionGridSize[2], pmeOrder, numParticles, ewaldDispersionAlpha, data.deterministicForces);
+            }
+        }
+    }
+    AlignedArray<float>& posq = data.posq;
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3>& forceData = extractForces(context);
     Vec3* boxVectors = extractBoxVectors(context);
     double energy = (includeReciprocal ? ewaldSelfEnergy : 0.0);
     bool ewald  = (nonbondedMethod == Ewald);
@@ -687,14 +1769,25 @@ double CpuCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeFo
         nonbonded->setUsePME(ewaldAlpha, gridSize);
         nonbonded->setUseLJPME(ewaldDispersionAlpha, dispersionGridSize);
     }
+    if (pme || ljpme)
+        nonbonded->setPMEInterpolationOrder(pmeOrder);
+    if (nonbondedMethod != NoCutoff && data.forceDecomposition.isActive())
+        nonbonded->setForceDecomposition(&data.forceDecomposition);
+    else {
+        nonbonded->setForceDecomposition(NULL);
+        data.forceDecomposition.markAllDense();
+    }
+    nonbonded->setFusedGBSAOBC(data.fusedGBSAOBC);
     double nonbondedEnergy = 0;
     if (includeDirect)
-        nonbonded->calculateDirectIxn(numParticles, &posq[0], posData, particleParams, C6params, exclusions, data.threadForce, includeEnergy ? &nonbondedEnergy : NULL, data.threads);
+        nonbonded->calculateDirectIxn(numParticles, &posq[0], posData, particleParams, C6params, exclusions, data.threadForce, includeForces, includeEnergy ? &nonbondedEnergy : NULL, data.threads);
     if (includeReciprocal) {
         if (useOptimizedPme) {
-            PmeIO io(&posq[0], &data.threadForce[0][0], numParticles);
+            PmeIO io(&posq[0], includeForces ? &data.threadForce[0][0] : NULL, numParticles);
+            if (includeForces)
+                data.forceDecomposition.markDense(0);
             Vec3 periodicBoxVectors[3] = {boxVectors[0], boxVectors[1], boxVectors[2]};
-            optimizedPme.getAs<CalcPmeReciprocalForceKernel>().beginComputation(io, periodicBoxVectors, includeEnergy);
+            optimizedPme.getAs<CalcPmeReciprocalForceKernel>().beginComputation(io, periodicBoxVectors, includeForces, includeEnergy);
             nonbondedEnergy += optimizedPme.getAs<CalcPmeReciprocalForceKernel>().finishComputation(io);
         }
         else
@@ -703,7 +1796,7 @@ double CpuCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeFo
     energy += nonbondedEnergy;
     if (includeDirect) {
         ReferenceLJCoulomb14 nonbonded14;
-        bondForce.calculateForce(posData, bonded14ParamArray, forceData, includeEnergy ? &energy : NULL, nonbonded14);
+        bondForce.calculateForce(posData, bonded14ParamArray, forceData, includeEnergy ? &energy : NULL, nonbonded14, includeForces);
         if (data.isPeriodic && nonbondedMethod != LJPME)
             energy += dispersionCoefficient/(boxVectors[0][0]*boxVectors[1][1]*boxVectors[2][2]);
     }
@@ -960,7 +2053,50 @@ void CpuCalcCustomNonbondedForceKernel::copyParametersToContext(ContextImpl& con
     }
 }
 
+CpuGBSAOBCForce* createCpuGBSAOBCForceVec8();
+
+CpuCalcGBSAOBCForceKernel::CpuCalcGBSAOBCForceKernel(string name, const Platform& platform, CpuPlatform::PlatformData& data) : CalcGBSAOBCForceKernel(name, platform),
+        data(data), obc(NULL) {
+    if (data.vectorWidth >= 8)
+        obc = createCpuGBSAOBCForceVec8();
+    else
+        obc = new CpuGBSAOBCForce();
+}
+
 CpuCalcGBSAOBCForceKernel::~CpuCalcGBSAOBCForceKernel() {
+    if (data.fusedGBSAOBC == obc)
+        data.fusedGBSAOBC = NULL;
+    if (obc != NULL)
+        delete obc;
+}
+
+/**
+ * Get whether the Born radius sums for a GBSAOBCForce can be accumulated during the direct space pass of a
+ * NonbondedForce.  This requires that the System contain a single NonbondedForce, that it come before the
+ * GBSAOBCForce so it is evaluated first, and that both use the same cutoff, periodicity, and force group.
+ */
+static bool canFuseWithNonbonded(const System& system, const GBSAOBCForce& force) {
+    if (force.getNonbondedMethod() == GBSAOBCForce::NoCutoff)
+        return false;
+    const NonbondedForce* nonbonded = NULL;
+    int numNonbonded = 0;
+    bool foundForce = false;
+    for (int i = 0; i < system.getNumForces(); i++) {
+        if (&system.getForce(i) == &force)
+            foundForce = true;
+        const NonbondedForce* f = dynamic_cast<const NonbondedForce*>(&system.getForce(i));
+        if (f != NULL) {
+            numNonbonded++;
+            if (!foundForce)
+                nonbonded = f;
+        }
+    }
+    if (numNonbonded != 1 || nonbonded == NULL || nonbonded->getNonbondedMethod() == NonbondedForce::NoCutoff)
+        return false;
+    bool nonbondedIsPeriodic = (nonbonded->getNonbondedMethod() != NonbondedForce::CutoffNonPeriodic);
+    bool gbsaIsPeriodic = (force.getNonbondedMethod() == GBSAOBCForce::CutoffPeriodic);
+    return (nonbonded->getCutoffDistance() == force.getCutoffDistance() && nonbondedIsPeriodic == gbsaIsPeriodic &&
+            nonbonded->getForceGroup() == force.getForceGroup());
 }
 
 void CpuCalcGBSAOBCForceKernel::initialize(const System& system, const GBSAOBCForce& force) {
@@ -973,29 +2109,45 @@ void CpuCalcGBSAOBCForceKernel::initialize(const System& system, const GBSAOBCFo
         radius -= 0.009;
         particleParams[i] = make_pair((float) radius, (float) (scalingFactor*radius));
     }
-    obc.setParticleParameters(particleParams);
-    obc.setSolventDielectric((float) force.getSolventDielectric());
-    obc.setSoluteDielectric((float) force.getSoluteDielectric());
-    obc.setSurfaceAreaEnergy((float) force.getSurfaceAreaEnergy());
-    if (force.getNonbondedMethod() != GBSAOBCForce::NoCutoff)
-        obc.setUseCutoff((float) force.getCutoffDistance());
+    obc->setParticleParameters(particleParams);
+    obc->setSolventDielectric((float) force.getSolventDielectric());
+    obc->setSoluteDielectric((float) force.getSoluteDielectric());
+    obc->setSurfaceAreaEnergy((float) force.getSurfaceAreaEnergy());
+    if (force.getNonbondedMethod() != GBSAOBCForce::NoCutoff) {
+        double cutoff = force.getCutoffDistance();
+        obc->setUseCutoff((float) cutoff);
+        data.requestNeighborList(cutoff, 0.25*cutoff, false, vector<set<int> >(numParticles));
+        obc->setNeighborList(*data.neighborList);
+    }
     data.isPeriodic = (force.getNonbondedMethod() == GBSAOBCForce::CutoffPeriodic);
+    if (data.fusedGBSAOBC == NULL && canFuseWithNonbonded(system, force)) {
+        // The NonbondedForce will accumulate the Born radius sums before execute() is first called, so enable
+        // periodic boundary conditions now.  The box size used for the sums comes from the NonbondedForce.
+
+        if (data.isPeriodic) {
+            Vec3 boxVectors[3];
+            system.getDefaultPeriodicBoxVectors(boxVectors[0], boxVectors[1], boxVectors[2]);
+            float floatBoxSize[3] = {(float) boxVectors[0][0], (float) boxVectors[1][1], (float) boxVectors[2][2]};
+            obc->setPeriodic(floatBoxSize);
+        }
+        data.fusedGBSAOBC = obc;
+    }
 }
 
 double CpuCalcGBSAOBCForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
     if (data.isPeriodic) {
         Vec3& boxSize = extractBoxSize(context);
         float floatBoxSize[3] = {(float) boxSize[0], (float) boxSize[1], (float) boxSize[2]};
-        obc.setPeriodic(floatBoxSize);
+        obc->setPeriodic(floatBoxSize);
     }
     double energy = 0.0;
-    obc.computeForce(data.posq, data.threadForce, includeEnergy ? &energy : NULL, data.threads);
+    obc->computeForce(data.posq, data.threadForce, includeForces, includeEnergy ? &energy : NULL, data.threads);
     return energy;
 }
 
 void CpuCalcGBSAOBCForceKernel::copyParametersToContext(ContextImpl& context, const GBSAOBCForce& force) {
     int numParticles = force.getNumParticles();
-    if (numParticles != obc.getParticleParameters().size())
+    if (numParticles != obc->getParticleParameters().size())
         throw OpenMMException("updateParametersInContext: The number of particles has changed");
 
     // Record the values.
@@ -1007,7 +2159,7 @@ void CpuCalcGBSAOBCForceKernel::copyParametersToContext(ContextImpl& context, co
         radius -= 0.009;
         particleParams[i] = make_pair((float) radius, (float) (scalingFactor*radius));
     }
-    obc.setParticleParameters(particleParams);
+    obc->setParticleParameters(particleParams);
 }
 
 CpuCalcCustomGBForceKernel::~CpuCalcCustomGBForceKernel() {
@@ -1270,6 +2422,103 @@ void CpuCalcCustomManyParticleForceKernel::copyParametersToContext(ContextImpl&
     }
 }
 
+CpuCalcCustomHbondForceKernel::~CpuCalcCustomHbondForceKernel() {
+    if (donorParamArray != NULL) {
+        for (int i = 0; i < numDonors; i++)
+            delete[] donorParamArray[i];
+        delete[] donorParamArray;
+    }
+    if (acceptorParamArray != NULL) {
+        for (int i = 0; i < numAcceptors; i++)
+            delete[] acceptorParamArray[i];
+        delete[] acceptorParamArray;
+    }
+    if (ixn != NULL)
+        delete ixn;
+}
+
+void CpuCalcCustomHbondForceKernel::initialize(const System& system, const CustomHbondForce& force) {
+
+    // Build the arrays.
+
+    numDonors = force.getNumDonors();
+    numAcceptors = force.getNumAcceptors();
+    int numDonorParameters = force.getNumPerDonorParameters();
+    donorParamArray = new double*[numDonors];
+    for (int i = 0; i < numDonors; i++) {
+        vector<double> parameters;
+        int d1, d2, d3;
+        force.getDonorParameters(i, d1, d2, d3, parameters);
+        donorParamArray[i] = new double[numDonorParameters];
+        for (int j = 0; j < numDonorParameters; j++)
+            donorParamArray[i][j] = parameters[j];
+    }
+    int numAcceptorParameters = force.getNumPerAcceptorParameters();
+    acceptorParamArray = new double*[numAcceptors];
+    for (int i = 0; i < numAcceptors; i++) {
+        vector<double> parameters;
+        int a1, a2, a3;
+        force.getAcceptorParameters(i, a1, a2, a3, parameters);
+        acceptorParamArray[i] = new double[numAcceptorParameters];
+        for (int j = 0; j < numAcceptorParameters; j++)
+            acceptorParamArray[i][j] = parameters[j];
+    }
+    for (int i = 0; i < force.getNumGlobalParameters(); i++)
+        globalParameterNames.push_back(force.getGlobalParameterName(i));
+    ixn = new CpuCustomHbondForce(force, data.threads);
+    nonbondedMethod = CalcCustomHbondForceKernel::NonbondedMethod(force.getNonbondedMethod());
+    cutoffDistance = force.getCutoffDistance();
+}
+
+double CpuCalcCustomHbondForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    map<string, double> globalParameters;
+    for (auto& name : globalParameterNames)
+        globalParameters[name] = context.getParameter(name);
+    if (nonbondedMethod == CutoffPeriodic) {
+        Vec3* boxVectors = extractBoxVectors(context);
+        double minAllowedSize = 2*cutoffDistance;
+        if (boxVectors[0][0] < minAllowedSize || boxVectors[1][1] < minAllowedSize || boxVectors[2][2] < minAllowedSize)
+            throw OpenMMException("The periodic box size has decreased to less than twice the nonbonded cutoff.");
+        ixn->setPeriodic(boxVectors);
+    }
+    if (includeForces)
+        data.forceDecomposition.markAllDense();
+    double energy = 0;
+    ixn->calculateIxn(extractPositions(context), donorParamArray, acceptorParamArray, globalParameters, data.threadForce, includeForces, includeEnergy, energy);
+    return energy;
+}
+
+void CpuCalcCustomHbondForceKernel::copyParametersToContext(ContextImpl& context, const CustomHbondForce& force) {
+    if (numDonors != force.getNumDonors())
+        throw OpenMMException("updateParametersInContext: The number of donors has changed");
+    if (numAcceptors != force.getNumAcceptors())
+        throw OpenMMException("updateParametersInContext: The number of acceptors has changed");
+
+    // Record the values.
+
+    vector<double> parameters;
+    int numDonorParameters = force.getNumPerDonorParameters();
+    const vector<vector<int> >& donorAtoms = ixn->getDonorAtoms();
+    for (int i = 0; i < numDonors; ++i) {
+        int d1, d2, d3;
+        force.getDonorParameters(i, d1, d2, d3, parameters);
+        if (d1 != donorAtoms[i][0] || d2 != donorAtoms[i][1] || d3 != donorAtoms[i][2])
+            throw OpenMMException("updateParametersInContext: The set of particles in a donor group has changed");
+        for (int j = 0; j < numDonorParameters; j++)
+            donorParamArray[i][j] = parameters[j];
+    }
+    int numAcceptorParameters = force.getNumPerAcceptorParameters();
+    const vector<vector<int> >& acceptorAtoms = ixn->getAcceptorAtoms();
+    for (int i = 0; i < numAcceptors; ++i) {
+        int a1, a2, a3;
+        force.getAcceptorParameters(i, a1, a2, a3, parameters);
+        if (a1 != acceptorAtoms[i][0] || a2 != acceptorAtoms[i][1] || a3 != acceptorAtoms[i][2])
+            throw OpenMMException("updateParametersInContext: The set of particles in an acceptor group has changed");
+        for (int j = 0; j < numAcceptorParameters; j++)
+            acceptorParamArray[i][j] = parameters[j];
+    }
+}
+
 CpuCalcGayBerneForceKernel::~CpuCalcGayBerneForceKernel() {
     if (ixn != NULL)
         delete ixn;
@@ -1294,6 +2543,219 @@ void CpuCalcGayBerneForceKernel::copyParametersToContext(ContextImpl& context, c
     ixn = new CpuGayBerneForce(force);
 }
 
+void CpuCalcRMSDForceKernel::initialize(const System& system, const RMSDForce& force) {
+    setReferencePositions(force.getReferencePositions(), force.getParticles(), system.getNumParticles());
+}
+
+void CpuCalcRMSDForceKernel::setReferencePositions(const vector<Vec3>& positions, const vector<int>& particleList, int numParticles) {
+    numReferencePositions = positions.size();
+    particles = particleList;
+    if (particles.size() == 0)
+        for (int i = 0; i < numParticles; i++)
+            particles.push_back(i);
+    int numSelected = particles.size();
+    Vec3 center;
+    for (int i : particles)
+        center += positions[i];
+    center /= numSelected;
+
+    // Store the centered reference positions in structure-of-arrays form, in the order of the
+    // selected particles, so the inner loops can be vectorized.
+
+    refX.resize(numSelected);
+    refY.resize(numSelected);
+    refZ.resize(numSelected);
+    posX.resize(numSelected);
+    posY.resize(numSelected);
+    posZ.resize(numSelected);
+    sumRefSquared = 0.0;
+    for (int i = 0; i < numSelected; i++) {
+        Vec3 p = positions[particles[i]]-center;
+        refX[i] = p[0];
+        refY[i] = p[1];
+        refZ[i] = p[2];
+        sumRefSquared += p.dot(p);
+    }
+}
+
+double CpuCalcRMSDForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    // This uses the same algorithm as ReferenceRMSDForce (Coutsias et al, doi: 10.1002/jcc.20110),
+    // but finds the centroid and correlation matrix in a single parallel pass.  Positions are taken
+    // relative to the first selected particle.  Because the reference positions are centered, the
+    // correlation matrix is unaffected by that shift, and the sums can be corrected for the true
+    // centroid afterward.
+
+    vector<Vec3>& posData = extractPositions(context);
+    int numSelected = particles.size();
+    int numThreads = data.threads.getNumThreads();
+    const int sumsPerThread = 13;
+    threadSums.resize(numThreads*sumsPerThread);
+    Vec3 origin = posData[particles[0]];
+    data.threads.execute([&] (ThreadPool& threads, int threadIndex) {
+        int start = threadIndex*numSelected/numThreads;
+        int end = (threadIndex+1)*numSelected/numThreads;
+        for (int i = start; i < end; i++) {
+            const Vec3& p = posData[particles[i]];
+            posX[i] = p[0]-origin[0];
+            posY[i] = p[1]-origin[1];
+            posZ[i] = p[2]-origin[2];
+        }
+
+        // Each sum is split into four independent accumulators, one per lane.  The loop over lanes has no
+        // dependence between iterations, so the compiler can turn it into SIMD instructions without
+        // reordering any floating point additions.
+
+        double acc[sumsPerThread][4] = {{0}};
+        auto accumulate = [&] (int i, int lane) {
+            double x = posX[i], y = posY[i], z = posZ[i];
+            acc[0][lane] += x;
+            acc[1][lane] += y;
+            acc[2][lane] += z;
+            acc[3][lane] += x*x + y*y + z*z;
+            acc[4][lane] += x*refX[i];
+            acc[5][lane] += x*refY[i];
+            acc[6][lane] += x*refZ[i];
+            acc[7][lane] += y*refX[i];
+            acc[8][lane] += y*refY[i];
+            acc[9][lane] += y*refZ[i];
+            acc[10][lane] += z*refX[i];
+            acc[11][lane] += z*refY[i];
+            acc[12][lane] += z*refZ[i];
+        };
+        int i = start;
+        for (; i+4 <= end; i += 4)
+            for (int lane = 0; lane < 4; lane++)
+                accumulate(i+lane, lane);
+        for (; i < end; i++)
+            accumulate(i, 0);
+        double* sums = &threadSums[threadIndex*sumsPerThread];
+        for (int j = 0; j < sumsPerThread; j++)
+            sums[j] = (acc[j][0]+acc[j][1]) + (acc[j][2]+acc[j][3]);
+    });
+    data.threads.waitForThreads();
+    double sums[sumsPerThread] = {0};
+    for (int i = 0; i < numThreads; i++)
+        for (int j = 0; j < sumsPerThread; j++)
+            sums[j] += threadSums[i*sumsPerThread+j];
+    Vec3 offset = Vec3(sums[0], sums[1], sums[2])/numSelected;
+    double sumPosSquared = sums[3] - numSelected*offset.dot(offset);
+    double R[3][3] = {{sums[4], sums[5], sums[6]}, {sums[7], sums[8], sums[9]}, {sums[10], sums[11], sums[12]}};
+
+    // Compute the F matrix.
+
+    Array2D<double> F(4, 4);
+    F[0][0] =  R[0][0] + R[1][1] + R[2][2];
+    F[1][0] =  R[1][2] - R[2][1];
+    F[2][0] =  R[2][0] - R[0][2];
+    F[3][0] =  R[0][1] - R[1][0];
+
+    F[0][1] =  R[1][2] - R[2][1];
+    F[1][1] =  R[0][0] - R[1][1] - R[2][2];
+    F[2][1] =  R[0][1] + R[1][0];
+    F[3][1] =  R[0][2] + R[2][0];
+
+    F[0][2] =  R[2][0] - R[0][2];
+    F[1][2] =  R[0][1] + R[1][0];
+    F[2][2] = -R[0][0] + R[1][1] - R[2][2];
+    F[3][2] =  R[1][2] + R[2][1];
+
+    F[0][3] =  R[0][1] - R[1][0];
+    F[1][3] =  R[0][2] + R[2][0];
+    F[2][3] =  R[1][2] + R[2][1];
+    F[3][3] = -R[0][0] - R[1][1] + R[2][2];
+
+    // Find the maximum eigenvalue and eigenvector.
+
+    JAMA::Eigenvalue<double> eigen(F);
+    Array1D<double> values;
+    eigen.getRealEigenvalues(values);
+    Array2D<double> vectors;
+    eigen.getV(vectors);
+
+    // Compute the RMSD.
+
+    double msd = (sumPosSquared+sumRefSquared-2*values[3])/numSelected;
+    if (msd < 1e-20) {
+        // The particles are perfectly aligned, so all the forces should be zero.
+        // Numerical error can lead to NaNs, so just return 0 now.
+        return 0.0;
+    }
+    double rmsd = sqrt(msd);
+    if (!includeForces)
+        return rmsd;
+
+    // Compute the rotation matrix.
+
+    double q[] = {vectors[0][3], vectors[1][3], vectors[2][3], vectors[3][3]};
+    double q00 = q[0]*q[0], q01 = q[0]*q[1], q02 = q[0]*q[2], q03 = q[0]*q[3];
+    double q11 = q[1]*q[1], q12 = q[1]*q[2], q13 = q[1]*q[3];
+    double q22 = q[2]*q[2], q23 = q[2]*q[3];
+    double q33 = q[3]*q[3];
+    double U[3][3] = {{q00+q11-q22-q33, 2*(q12-q03), 2*(q13+q02)},
+                      {2*(q12+q03), q00-q11+q22-q33, 2*(q23-q01)},
+                      {2*(q13-q02), 2*(q23+q01), q00-q11-q22+q33}};
+
+    // Rotate the reference positions and compute the forces.  Each particle appears only once in the
+    // list, so the threads can write to the force array directly.
+
+    vector<Vec3>& forceData = extractForces(context);
+    double scale = 1.0/(rmsd*numSelected);
+    data.threads.execute([&] (ThreadPool& threads, int threadIndex) {
+        int start = threadIndex*numSelected/numThreads;
+        int end = (threadIndex+1)*numSelected/numThreads;
+        for (int i = start; i < end; i++) {
+            double rx = U[0][0]*refX[i] + U[1][0]*refY[i] + U[2][0]*refZ[i];
+            double ry = U[0][1]*refX[i] + U[1][1]*refY[i] + U[2][1]*refZ[i];
+            double rz = U[0][2]*refX[i] + U[1][2]*refY[i] + U[2][2]*refZ[i];
+            forceData[particles[i]] -= Vec3(posX[i]-offset[0]-rx, posY[i]-offset[1]-ry, posZ[i]-offset[2]-rz)*scale;
+        }
+    });
+    data.threads.waitForThreads();
+    return rmsd;
+}
+
+void CpuCalcRMSDForceKernel::copyParametersToContext(ContextImpl& context, const RMSDForce& force) {
+    if (numReferencePositions != (int) force.getReferencePositions().size())
+        throw OpenMMException("updateParametersInContext: The number of reference positions has changed");
+    setReferencePositions(force.getReferencePositions(), force.getParticles(), numReferencePositions);
+}
+
+CpuIntegrateVerletStepKernel::~CpuIntegrateVerletStepKernel() {
+    if (dynamics)
+        delete dynamics;
+}
+
+void CpuIntegrateVerletStepKernel::initialize(const System& system, const VerletIntegrator& integrator) {
+    int numParticles = system.getNumParticles();
+    masses.resize(numParticles);
+    for (int i = 0; i < numParticles; ++i)
+        masses[i] = system.getParticleMass(i);
+}
+
+void CpuIntegrateVerletStepKernel::execute(ContextImpl& context, const VerletIntegrator& integrator) {
+    double stepSize = integrator.getStepSize();
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3>& velData = extractVelocities(context);
+    vector<Vec3>& forceData = extractForces(context);
+    if (dynamics == NULL || stepSize != prevStepSize) {
+        // Recreate the computation objects with the new parameters.
+        
+        if (dynamics)
+            delete dynamics;
+        dynamics = new CpuVerletDynamics(context.getSystem().getNumParticles(), stepSize, data.threads);
+        dynamics->setReferenceConstraintAlgorithm(&extractConstraints(context));
+        prevStepSize = stepSize;
+    }
+    dynamics->update(context.getSystem(), posData, velData, forceData, masses, integrator.getConstraintTolerance());
+    ReferencePlatform::PlatformData* refData = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
+    refData->time += stepSize;
+    refData->stepCount++;
+}
+
+double CpuIntegrateVerletStepKernel::computeKineticEnergy(ContextImpl& context, const VerletIntegrator& integrator) {
+    return computeShiftedKineticEnergy(context, masses, 0.5*integrator.getStepSize());
+}
+
 CpuIntegrateLangevinStepKernel::~CpuIntegrateLangevinStepKernel() {
     if (dynamics)
         delete dynamics;
@@ -1334,3 +2796,364 @@ void CpuIntegrateLangevinStepKernel::execute(ContextImpl& context, const Langevi
 double CpuIntegrateLangevinStepKernel::computeKineticEnergy(ContextImpl& context, const LangevinIntegrator& integrator) {
     return computeShiftedKineticEnergy(context, masses, 0.5*integrator.getStepSize());
 }
+
+CpuIntegrateBrownianStepKernel::~CpuIntegrateBrownianStepKernel() {
+    if (dynamics)
+        delete dynamics;
+}
+
+void CpuIntegrateBrownianStepKernel::initialize(const System& system, const BrownianIntegrator& integrator) {
+    int numParticles = system.getNumParticles();
+    masses.resize(numParticles);
+    for (int i = 0; i < numParticles; ++i)
+        masses[i] = system.getParticleMass(i);
+    data.random.initialize(integrator.getRandomNumberSeed(), data.threads.getNumThreads());
+}
+
+void CpuIntegrateBrownianStepKernel::execute(ContextImpl& context, const BrownianIntegrator& integrator) {
+    double temperature = integrator.getTemperature();
+    double friction = integrator.getFriction();
+    double stepSize = integrator.getStepSize();
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3>& velData = extractVelocities(context);
+    vector<Vec3>& forceData = extractForces(context);
+    if (dynamics == NULL || temperature != prevTemp || friction != prevFriction || stepSize != prevStepSize) {
+        // Recreate the computation objects with the new parameters.
+        
+        if (dynamics)
+            delete dynamics;
+        dynamics = new CpuBrownianDynamics(context.getSystem().getNumParticles(), stepSize, friction, temperature, data.threads, data.random);
+        dynamics->setReferenceConstraintAlgorithm(&extractConstraints(context));
+        prevTemp = temperature;
+        prevFriction = friction;
+        prevStepSize = stepSize;
+    }
+    dynamics->update(context.getSystem(), posData, velData, forceData, masses, integrator.getConstraintTolerance());
+    ReferencePlatform::PlatformData* refData = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
+    refData->time += stepSize;
+    refData->stepCount++;
+}
+
+double CpuIntegrateBrownianStepKernel::computeKineticEnergy(ContextImpl& context, const BrownianIntegrator& integrator) {
+    return computeShiftedKineticEnergy(context, masses, 0);
+}
+
+CpuIntegrateVariableLangevinStepKernel::~CpuIntegrateVariableLangevinStepKernel() {
+    if (dynamics)
+        delete dynamics;
+}
+
+void CpuIntegrateVariableLangevinStepKernel::initialize(const System& system, const VariableLangevinIntegrator& integrator) {
+    int numParticles = system.getNumParticles();
+    masses.resize(numParticles);
+    for (int i = 0; i < numParticles; ++i)
+        masses[i] = system.getParticleMass(i);
+    data.random.initialize(integrator.getRandomNumberSeed(), data.threads.getNumThreads());
+}
+
+double CpuIntegrateVariableLangevinStepKernel::execute(ContextImpl& context, const VariableLangevinIntegrator& integrator, double maxTime) {
+    double temperature = integrator.getTemperature();
+    double friction = integrator.getFriction();
+    double errorTol = integrator.getErrorTolerance();
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3>& velData = extractVelocities(context);
+    vector<Vec3>& forceData = extractForces(context);
+    if (dynamics == NULL || temperature != prevTemp || friction != prevFriction || errorTol != prevErrorTol) {
+        // Recreate the computation objects with the new parameters.
+
+        if (dynamics)
+            delete dynamics;
+        dynamics = new CpuVariableLangevinDynamics(context.getSystem().getNumParticles(), friction, temperature, errorTol, data.threads, data.random);
+        dynamics->setReferenceConstraintAlgorithm(&extractConstraints(context));
+        prevTemp = temperature;
+        prevFriction = friction;
+        prevErrorTol = errorTol;
+    }
+    ReferencePlatform::PlatformData* refData = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
+    double maxStepSize = maxTime-refData->time;
+    dynamics->update(context.getSystem(), posData, velData, forceData, masses, maxStepSize, integrator.getConstraintTolerance());
+    refData->time += dynamics->getDeltaT();
+    if (dynamics->getDeltaT() == maxStepSize)
+        refData->time = maxTime; // Avoid round-off error
+    refData->stepCount++;
+    return dynamics->getDeltaT();
+}
+
+double CpuIntegrateVariableLangevinStepKernel::computeKineticEnergy(ContextImpl& context, const VariableLangevinIntegrator& integrator) {
+    return computeShiftedKineticEnergy(context, masses, 0.5*integrator.getStepSize());
+}
+
+CpuIntegrateVariableVerletStepKernel::~CpuIntegrateVariableVerletStepKernel() {
+    if (dynamics)
+        delete dynamics;
+}
+
+void CpuIntegrateVariableVerletStepKernel::initialize(const System& system, const VariableVerletIntegrator& integrator) {
+    int numParticles = system.getNumParticles();
+    masses.resize(numParticles);
+    for (int i = 0; i < numParticles; ++i)
+        masses[i] = system.getParticleMass(i);
+}
+
+double CpuIntegrateVariableVerletStepKernel::execute(ContextImpl& context, const VariableVerletIntegrator& integrator, double maxTime) {
+    double errorTol = integrator.getErrorTolerance();
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3>& velData = extractVelocities(context);
+    vector<Vec3>& forceData = extractForces(context);
+    if (dynamics == NULL || errorTol != prevErrorTol) {
+        // Recreate the computation objects with the new parameters.
+
+        if (dynamics)
+            delete dynamics;
+        dynamics = new CpuVariableVerletDynamics(context.getSystem().getNumParticles(), errorTol, data.threads);
+        dynamics->setReferenceConstraintAlgorithm(&extractConstraints(context));
+        prevErrorTol = errorTol;
+    }
+    ReferencePlatform::PlatformData* refData = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
+    double maxStepSize = maxTime-refData->time;
+    dynamics->update(context.getSystem(), posData, velData, forceData, masses, maxStepSize, integrator.getConstraintTolerance());
+    refData->time += dynamics->getDeltaT();
+    if (dynamics->getDeltaT() == maxStepSize)
+        refData->time = maxTime; // Avoid round-off error
+    refData->stepCount++;
+    return dynamics->getDeltaT();
+}
+
+double CpuIntegrateVariableVerletStepKernel::computeKineticEnergy(ContextImpl& context, const VariableVerletIntegrator& integrator) {
+    return computeShiftedKineticEnergy(context, masses, 0.5*integrator.getStepSize());
+}
+
+CpuIntegrateCustomStepKernel::~CpuIntegrateCustomStepKernel() {
+    if (dynamics)
+        delete dynamics;
+}
+
+void CpuIntegrateCustomStepKernel::initialize(const System& system, const CustomIntegrator& integrator) {
+    int numParticles = system.getNumParticles();
+    masses.resize(numParticles);
+    for (int i = 0; i < numParticles; ++i)
+        masses[i] = system.getParticleMass(i);
+    perDofValues.resize(integrator.getNumPerDofVariables());
+    for (auto& values : perDofValues)
+        values.resize(numParticles);
+
+    // Create the computation objects.  Per-DOF random numbers come from the per-thread generators, while
+    // global computations use the same generator as the reference platform.
+
+    dynamics = new CpuCustomDynamics(numParticles, integrator, data.threads, data.random);
+    data.random.initialize(integrator.getRandomNumberSeed(), data.threads.getNumThreads());
+    SimTKOpenMMUtilities::setRandomNumberSeed((unsigned int) integrator.getRandomNumberSeed());
+}
+
+void CpuIntegrateCustomStepKernel::execute(ContextImpl& context, CustomIntegrator& integrator, bool& forcesAreValid) {
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3>& velData = extractVelocities(context);
+    vector<Vec3>& forceData = extractForces(context);
+    
+    // Record global variables.
+    
+    map<string, double> globals;
+    globals["dt"] = integrator.getStepSize();
+    for (int i = 0; i < integrator.getNumGlobalVariables(); i++)
+        globals[integrator.getGlobalVariableName(i)] = globalValues[i];
+    
+    // Execute the step.
+    
+    dynamics->setReferenceConstraintAlgorithm(&extractConstraints(context));
+    dynamics->update(context, context.getSystem().getNumParticles(), posData, velData, forceData, masses, globals, perDofValues, forcesAreValid, integrator.getConstraintTolerance());
+    
+    // Record changed global variables.
+    
+    integrator.setStepSize(globals["dt"]);
+    for (int i = 0; i < (int) globalValues.size(); i++)
+        globalValues[i] = globals[integrator.getGlobalVariableName(i)];
+    ReferencePlatform::PlatformData* refData = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
+    refData->time += dynamics->getDeltaT();
+    refData->stepCount++;
+}
+
+double CpuIntegrateCustomStepKernel::computeKineticEnergy(ContextImpl& context, CustomIntegrator& integrator, bool& forcesAreValid) {
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3>& velData = extractVelocities(context);
+    vector<Vec3>& forceData = extractForces(context);
+    
+    // Record global variables.
+    
+    map<string, double> globals;
+    globals["dt"] = integrator.getStepSize();
+    for (int i = 0; i < integrator.getNumGlobalVariables(); i++)
+        globals[integrator.getGlobalVariableName(i)] = globalValues[i];
+    
+    // Compute the kinetic energy.
+    
+    return dynamics->computeKineticEnergy(context, context.getSystem().getNumParticles(), posData, velData, forceData, masses, globals, perDofValues, forcesAreValid);
+}
+
+void CpuIntegrateCustomStepKernel::getGlobalVariables(ContextImpl& context, vector<double>& values) const {
+    values = globalValues;
+}
+
+void CpuIntegrateCustomStepKernel::setGlobalVariables(ContextImpl& context, const vector<double>& values) {
+    globalValues = values;
+}
+
+void CpuIntegrateCustomStepKernel::getPerDofVariable(ContextImpl& context, int variable, vector<Vec3>& values) const {
+    values = perDofValues[variable];
+}
+
+void CpuIntegrateCustomStepKernel::setPerDofVariable(ContextImpl& context, int variable, const vector<Vec3>& values) {
+    perDofValues[variable] = values;
+}
+
+void CpuApplyAndersenThermostatKernel::initialize(const System& system, const AndersenThermostat& thermostat) {
+    int numParticles = system.getNumParticles();
+    masses.resize(numParticles);
+    for (int i = 0; i < numParticles; ++i)
+        masses[i] = system.getParticleMass(i);
+    particleGroups = AndersenThermostatImpl::calcParticleGroups(system);
+    SimTKOpenMMUtilities::setRandomNumberSeed((unsigned int) thermostat.getRandomNumberSeed());
+    random.initialize(thermostat.getRandomNumberSeed(), data.threads.getNumThreads());
+}
+
+void CpuApplyAndersenThermostatKernel::execute(ContextImpl& context) {
+    vector<Vec3>& velData = extractVelocities(context);
+    double temperature = context.getParameter(AndersenThermostat::Temperature());
+    double collisionFrequency = context.getParameter(AndersenThermostat::CollisionFrequency());
+    double collisionProbability = 1.0-exp(-collisionFrequency*context.getIntegrator().getStepSize());
+    int numGroups = particleGroups.size();
+    int numThreads = data.threads.getNumThreads();
+
+    // Each thread handles a fixed range of groups and draws from its own random stream.  The streams
+    // are reseeded from the reference generator every time, since that is the generator whose state
+    // is saved in checkpoints.
+
+    random.setSeed(1+(int) (SimTKOpenMMUtilities::getUniformlyDistributedRandomNumber()*2147483646.0));
+
+    data.threads.execute([&] (ThreadPool& threads, int threadIndex) {
+        int start = threadIndex*numGroups/numThreads;
+        int end = (threadIndex+1)*numGroups/numThreads;
+        for (int i = start; i < end; i++) {
+            if (random.getUniformRandom(threadIndex) >= collisionProbability)
+                continue;
+
+            // A collision occurred, so set the velocities to new values chosen from a Boltzmann distribution.
+
+            for (int atom : particleGroups[i]) {
+                if (masses[atom] != 0) {
+                    double velocityScale = sqrt(BOLTZ*temperature/masses[atom]);
+                    velData[atom][0] = velocityScale*random.getGaussianRandom(threadIndex);
+                    velData[atom][1] = velocityScale*random.getGaussianRandom(threadIndex);
+                    velData[atom][2] = velocityScale*random.getGaussianRandom(threadIndex);
+                }
+            }
+        }
+    });
+    data.threads.waitForThreads();
+}
+
+void CpuApplyMonteCarloBarostatKernel::initialize(const System& system, const Force& barostat) {
+}
+
+void CpuApplyMonteCarloBarostatKernel::scaleCoordinates(ContextImpl& context, double scaleX, double scaleY, double scaleZ) {
+    if (moleculeStart.size() == 0) {
+        // Build the table of atoms in each molecule.
+
+        moleculeStart.push_back(0);
+        for (auto& molecule : context.getMolecules()) {
+            moleculeAtoms.insert(moleculeAtoms.end(), molecule.begin(), molecule.end());
+            moleculeStart.push_back(moleculeAtoms.size());
+        }
+        savedPositions.resize(context.getSystem().getNumParticles());
+    }
+    vector<Vec3>& posData = extractPositions(context);
+    Vec3* boxVectors = extractBoxVectors(context);
+    int numMolecules = moleculeStart.size()-1;
+    int numThreads = data.threads.getNumThreads();
+    data.threads.execute([&] (ThreadPool& threads, int threadIndex) {
+        int start = threadIndex*numMolecules/numThreads;
+        int end = (threadIndex+1)*numMolecules/numThreads;
+        for (int i = start; i < end; i++) {
+            // Find the molecule center.
+
+            Vec3 pos(0, 0, 0);
+            for (int j = moleculeStart[i]; j < moleculeStart[i+1]; j++)
+                pos += posData[moleculeAtoms[j]];
+            pos /= moleculeStart[i+1]-moleculeStart[i];
+
+            // Move it into the first periodic box.
+
+            Vec3 newPos = pos;
+            newPos -= boxVectors[2]*floor(newPos[2]/boxVectors[2][2]);
+            newPos -= boxVectors[1]*floor(newPos[1]/boxVectors[1][1]);
+            newPos -= boxVectors[0]*floor(newPos[0]/boxVectors[0][0]);
+
+            // Now scale the position of the molecule center.
+
+            newPos[0] *= scaleX;
+            newPos[1] *= scaleY;
+            newPos[2] *= scaleZ;
+            Vec3 offset = newPos-pos;
+            for (int j = moleculeStart[i]; j < moleculeStart[i+1]; j++) {
+                int atom = moleculeAtoms[j];
+                savedPositions[atom] = posData[atom]+offset;
+            }
+        }
+    });
+    data.threads.waitForThreads();
+
+    // Every atom belongs to exactly one molecule, so savedPositions now holds a complete set of scaled positions.
+    // Swapping puts them into the context and keeps the old ones for restoreCoordinates().
+
+    posData.swap(savedPositions);
+}
+
+void CpuApplyMonteCarloBarostatKernel::restoreCoordinates(ContextImpl& context) {
+    extractPositions(context).swap(savedPositions);
+}
+
+void CpuRemoveCMMotionKernel::initialize(const System& system, const CMMotionRemover& force) {
+    frequency = force.getFrequency();
+    masses.resize(system.getNumParticles());
+    totalMass = 0.0;
+    for (size_t i = 0; i < masses.size(); ++i) {
+        masses[i] = system.getParticleMass(i);
+        totalMass += masses[i];
+    }
+}
+
+void CpuRemoveCMMotionKernel::execute(ContextImpl& context) {
+    ReferencePlatform::PlatformData* refData = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
+    if (refData->stepCount%frequency != 0)
+        return;
+    vector<Vec3>& velData = extractVelocities(context);
+    int numParticles = masses.size();
+    int numThreads = data.threads.getNumThreads();
+
+    // Calculate the center of mass momentum.  Each thread sums a range of particles.
+
+    vector<Vec3> threadMomentum(numThreads);
+    data.threads.execute([&] (ThreadPool& threads, int threadIndex) {
+        int start = threadIndex*numParticles/numThreads;
+        int end = (threadIndex+1)*numParticles/numThreads;
+        Vec3 momentum;
+        for (int i = start; i < end; i++)
+            momentum += velData[i]*masses[i];
+        threadMomentum[threadIndex] = momentum;
+    });
+    data.threads.waitForThreads();
+    Vec3 momentum;
+    for (int i = 0; i < numThreads; i++)
+        momentum += threadMomentum[i];
+
+    // Adjust the particle velocities.
+
+    Vec3 velocity = momentum/totalMass;
+    data.threads.execute([&] (ThreadPool& threads, int threadIndex) {
+        int start = threadIndex*numParticles/numThreads;
+        int end = (threadIndex+1)*numParticles/numThreads;
+        for (int i = start; i < end; i++)
+            if (masses[i] != 0.0)
+                velData[i] -= velocity;
+    });
+    data.threads.waitForThreads();
+}
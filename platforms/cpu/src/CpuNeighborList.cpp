@@ -59,8 +59,8 @@ public:
  */
 class CpuNeighborList::Voxels {
 public:
-    Voxels(int blockSize, float vsy, float vsz, float miny, float maxy, float minz, float maxz, const Vec3* boxVectors, bool usePeriodic) :
-            blockSize(blockSize), voxelSizeY(vsy), voxelSizeZ(vsz), miny(miny), maxy(maxy), minz(minz), maxz(maxz), usePeriodic(usePeriodic) {
+    Voxels(int blockSize, int numAtoms, float vsy, float vsz, float miny, float maxy, float minz, float maxz, const Vec3* boxVectors, bool usePeriodic) :
+            blockSize(blockSize), voxelSizeY(vsy), voxelSizeZ(vsz), miny(miny), maxy(maxy), minz(minz), maxz(maxz), usePeriodic(usePeriodic), atomVoxel(numAtoms) {
         for (int i = 0; i < 3; i++)
             for (int j = 0; j < 3; j++)
                 periodicBoxVectors[i][j] = (float) boxVectors[i][j];
@@ -80,8 +80,12 @@ public:
             voxelSizeZ = boxVectors[2][2]/nz;
         }
         else {
-            ny = max(1, (int) floorf((maxy-miny)/voxelSizeY+0.5f));
-            nz = max(1, (int) floorf((maxz-minz)/voxelSizeZ+0.5f));
+            // Limit the number of voxels based on the number of atoms.  Otherwise a few atoms that have
+            // drifted far away (for example, in a simulation that is blowing up) could require a huge grid.
+
+            float maxVoxels = 2*floorf(sqrtf((float) numAtoms))+1;
+            ny = max(1, (int) min(maxVoxels, floorf((maxy-miny)/voxelSizeY+0.5f)));
+            nz = max(1, (int) min(maxVoxels, floorf((maxz-minz)/voxelSizeZ+0.5f)));
             if (maxy > miny)
                 voxelSizeY = (maxy-miny)/ny;
             if (maxz > minz)
@@ -100,8 +104,59 @@ public:
      */
     void insert(const int& atom, const float* location) {
         VoxelIndex voxelIndex = getVoxelIndex(location);
+        atomVoxel[atom] = voxelIndex;
         bins[voxelIndex.y][voxelIndex.z].push_back(make_pair(location[0], atom));
     }
+
+    /**
+     * Get whether a location lies within the region covered by the voxels.  This is always true with periodic
+     * boundary conditions.
+     */
+    bool isInside(const float* location) const {
+        if (usePeriodic)
+            return true;
+        return (location[1] >= miny && location[1] <= maxy && location[2] >= minz && location[2] <= maxz);
+    }
+
+    /**
+     * Record the voxel containing a particle that has moved.  Returns true if it is different from the voxel
+     * the particle was in before.  The bins are not modified until updateBins() is called.
+     */
+    bool updateVoxel(int atom, const float* location) {
+        VoxelIndex voxelIndex = getVoxelIndex(location);
+        if (voxelIndex.y == atomVoxel[atom].y && voxelIndex.z == atomVoxel[atom].z)
+            return false;
+        atomVoxel[atom] = voxelIndex;
+        return true;
+    }
+
+    /**
+     * Update the bins in one row of voxels (all voxels with the same y index) to reflect the current locations
+     * of the particles.  Particles that are still in the same voxel have their x coordinates updated in place.
+     * Only the ones in movedAtoms are removed from their old bins and inserted into new ones.
+     */
+    void updateBins(int y, const vector<float>& sortedPositions, const vector<vector<int> >& movedAtoms) {
+        for (int z = 0; z < nz; z++) {
+            vector<pair<float, int> >& bin = bins[y][z];
+            int numKept = 0;
+            for (int i = 0; i < (int) bin.size(); i++) {
+                int atom = bin[i].second;
+                if (atomVoxel[atom].y == y && atomVoxel[atom].z == z)
+                    bin[numKept++] = make_pair(sortedPositions[4*atom], atom);
+            }
+            bin.resize(numKept);
+        }
+        for (const vector<int>& moved : movedAtoms)
+            for (int atom : moved)
+                if (atomVoxel[atom].y == y)
+                    bins[y][atomVoxel[atom].z].push_back(make_pair(sortedPositions[4*atom], atom));
+        for (int z = 0; z < nz; z++)
+            sort(bins[y][z].begin(), bins[y][z].end());
+    }
+
+    int getNumRows() const {
+        return ny;
+    }
     
     /**
      * Sort the particles in each voxel by x coordinate.
@@ -156,7 +211,7 @@ public:
             yperiodic = location[1]-periodicBoxVectors[2][1]*scale2;
             zperiodic = location[2]-periodicBoxVectors[2][2]*scale2;
             float scale1 = floorf(yperiodic*recipBoxSize[1]);
-            yperiodic -= periodicBoxVectors[1][0]*scale1;
+            yperiodic -= periodicBoxVectors[1][1]*scale1;
         }
         int y = max(0, min(ny-1, int(floorf(yperiodic / voxelSizeY))));
         int z = max(0, min(nz-1, int(floorf(zperiodic / voxelSizeZ))));
@@ -164,7 +219,7 @@ public:
         return VoxelIndex(y, z);
     }
         
-    void getNeighbors(vector<int>& neighbors, int blockIndex, const fvec4& blockCenter, const fvec4& blockWidth, const vector<int>& sortedAtoms, vector<char>& exclusions, float maxDistance, const vector<int>& blockAtoms, const vector<float>& blockAtomX, const vector<float>& blockAtomY, const vector<float>& blockAtomZ, const vector<float>& sortedPositions, const vector<VoxelIndex>& atomVoxelIndex) const {
+    void getNeighbors(vector<int>& neighbors, int blockIndex, const fvec4& blockCenter, const fvec4& blockWidth, const vector<int>& sortedAtoms, vector<int16_t>& exclusions, float maxDistance, const vector<int>& blockAtoms, const vector<float>& blockAtomX, const vector<float>& blockAtomY, const vector<float>& blockAtomZ, const vector<float>& sortedPositions, const vector<VoxelIndex>& atomVoxelIndex, bool blockIsWrapped) const {
         neighbors.resize(0);
         exclusions.resize(0);
         fvec4 boxSize(periodicBoxSize[0], periodicBoxSize[1], periodicBoxSize[2], 0);
@@ -282,8 +337,8 @@ public:
                             delta2 -= round(delta2*invBoxSize)*boxSize;
                         }
                         fvec4 delta = min(abs(delta1), abs(delta2));
-                        float dy = (y == atomVoxelIndex[k].y ? 0.0f : delta[1]);
-                        float dz = (z == atomVoxelIndex[k].z ? 0.0f : delta[2]);
+                        float dy = (voxelIndex.y == atomVoxelIndex[k].y ? 0.0f : delta[1]);
+                        float dz = (voxelIndex.z == atomVoxelIndex[k].z ? 0.0f : delta[2]);
                         float dist2 = maxDistanceSquared-dy*dy-dz*dz;
                         if (dist2 > 0) {
                             float dist = sqrtf(dist2);
@@ -294,7 +349,7 @@ public:
                 }
                 if (minx == maxx)
                     continue;
-                bool needPeriodic = usePeriodic && (centerPos[1]-blockWidth[1] < maxDistance || centerPos[1]+blockWidth[1] > periodicBoxSize[1]-maxDistance ||
+                bool needPeriodic = usePeriodic && (blockIsWrapped || centerPos[1]-blockWidth[1] < maxDistance || centerPos[1]+blockWidth[1] > periodicBoxSize[1]-maxDistance ||
                                                     centerPos[2]-blockWidth[2] < maxDistance || centerPos[2]+blockWidth[2] > periodicBoxSize[2]-maxDistance ||
                                                     minx < 0.0f || maxx > periodicBoxVectors[0][0]);
                 int numRanges;
@@ -389,7 +444,7 @@ public:
                             exclusions.push_back(0);
                         else {
                             int mask = (1<<blockSize)-1;
-                            exclusions.push_back(mask & (mask<<(sortedIndex-blockSize*blockIndex)));
+                            exclusions.push_back((int16_t) (mask & (mask<<(sortedIndex-blockSize*blockIndex))));
                         }
                     }
                 }
@@ -406,10 +461,24 @@ private:
     bool triclinic;
     float periodicBoxVectors[3][3];
     const bool usePeriodic;
+    vector<VoxelIndex> atomVoxel;
     vector<vector<vector<pair<float, int> > > > bins;
 };
 
-CpuNeighborList::CpuNeighborList(int blockSize) : blockSize(blockSize) {
+/**
+ * Incremental updates keep the assignment of atoms to blocks from the last full build, so the blocks grow less
+ * compact as atoms move.  The list is rebuilt from scratch after this many consecutive incremental updates, or
+ * once any atom has moved more than this fraction of the cutoff since the last full build.
+ */
+static const int MaxIncrementalUpdates = 10;
+static const float MaxIncrementalDisplacement = 0.25f;
+
+CpuNeighborList::CpuNeighborList(int blockSize) : blockSize(blockSize), voxels(NULL), numAtoms(0), numIncrementalUpdates(0) {
+}
+
+CpuNeighborList::~CpuNeighborList() {
+    if (voxels != NULL)
+        delete voxels;
 }
 
 void CpuNeighborList::computeNeighborList(int numAtoms, const AlignedArray<float>& atomLocations, const vector<set<int> >& exclusions,
@@ -463,16 +532,19 @@ void CpuNeighborList::computeNeighborList(int numAtoms, const AlignedArray<float
         edgeSizeY = 0.6f*periodicBoxVectors[1][1]/floorf(periodicBoxVectors[1][1]/maxDistance);
         edgeSizeZ = 0.6f*periodicBoxVectors[2][2]/floorf(periodicBoxVectors[2][2]/maxDistance);
     }
-    Voxels voxels(blockSize, edgeSizeY, edgeSizeZ, miny, maxy, minz, maxz, periodicBoxVectors, usePeriodic);
+    if (voxels != NULL)
+        delete voxels;
+    voxels = new Voxels(blockSize, numAtoms, edgeSizeY, edgeSizeZ, miny, maxy, minz, maxz, periodicBoxVectors, usePeriodic);
     for (int i = 0; i < numAtoms; i++) {
         int atomIndex = atomBins[i].second;
         sortedAtoms[i] = atomIndex;
         fvec4 atomPos(&atomLocations[4*atomIndex]);
         atomPos.store(&sortedPositions[4*i]);
-        voxels.insert(i, &atomLocations[4*atomIndex]);
+        voxels->insert(i, &atomLocations[4*atomIndex]);
     }
-    voxels.sortItems();
-    this->voxels = &voxels;
+    voxels->sortItems();
+    builtPositions = sortedPositions;
+    numIncrementalUpdates = 0;
 
     // Signal the threads to start running and wait for them to finish.
     
@@ -482,12 +554,90 @@ void CpuNeighborList::computeNeighborList(int numAtoms, const AlignedArray<float
     
     // Add padding atoms to fill up the last block.
     
+    int numPadding = numBlocks*blockSize-numAtoms;
+    for (int i = 0; i < numPadding; i++)
+        sortedAtoms.push_back(0);
+    excludePaddingAtoms();
+}
+
+void CpuNeighborList::updateNeighborList(int numAtoms, const AlignedArray<float>& atomLocations, const vector<set<int> >& exclusions,
+            const Vec3* periodicBoxVectors, bool usePeriodic, float maxDistance, ThreadPool& threads) {
+    // The voxels can only be reused if nothing has changed except the atom positions.
+
+    bool canUpdate = (voxels != NULL && numAtoms == this->numAtoms && usePeriodic == this->usePeriodic && maxDistance == this->maxDistance &&
+            numIncrementalUpdates < MaxIncrementalUpdates);
+    if (canUpdate && usePeriodic)
+        for (int i = 0; i < 3; i++)
+            if (periodicBoxVectors[i] != this->periodicBoxVectors[i])
+                canUpdate = false;
+    if (!canUpdate) {
+        computeNeighborList(numAtoms, atomLocations, exclusions, periodicBoxVectors, usePeriodic, maxDistance, threads);
+        return;
+    }
+    this->exclusions = &exclusions;
+    this->atomLocations = &atomLocations[0];
+    
+    // Find which atoms have changed voxels.  The Hilbert curve ordering from the last full build is kept.
+    
+    int numThreads = threads.getNumThreads();
+    threadMovedAtoms.resize(numThreads);
+    fvec4 boxVectors[3];
+    for (int i = 0; i < 3; i++)
+        boxVectors[i] = fvec4((float) periodicBoxVectors[i][0], (float) periodicBoxVectors[i][1], (float) periodicBoxVectors[i][2], 0);
+    float invBoxSize[3] = {(float) (1/periodicBoxVectors[0][0]), (float) (1/periodicBoxVectors[1][1]), (float) (1/periodicBoxVectors[2][2])};
+    float maxDisplacement2 = MaxIncrementalDisplacement*MaxIncrementalDisplacement*maxDistance*maxDistance;
+    bool needFullBuild = false;
+    threads.execute([&] (ThreadPool& threads, int threadIndex) {
+        vector<int>& moved = threadMovedAtoms[threadIndex];
+        moved.resize(0);
+        int start = threadIndex*numAtoms/numThreads;
+        int end = (threadIndex+1)*numAtoms/numThreads;
+        for (int i = start; i < end; i++) {
+            const float* pos = &atomLocations[4*sortedAtoms[i]];
+            fvec4 posVec(pos);
+            posVec.store(&sortedPositions[4*i]);
+            fvec4 delta = posVec-fvec4(&builtPositions[4*i]);
+            if (usePeriodic) {
+                delta -= boxVectors[2]*floorf(delta[2]*invBoxSize[2]+0.5f);
+                delta -= boxVectors[1]*floorf(delta[1]*invBoxSize[1]+0.5f);
+                delta -= boxVectors[0]*floorf(delta[0]*invBoxSize[0]+0.5f);
+            }
+            if (dot3(delta, delta) > maxDisplacement2 || !voxels->isInside(pos)) {
+                needFullBuild = true;
+                break;
+            }
+            if (voxels->updateVoxel(i, pos))
+                moved.push_back(i);
+        }
+    });
+    threads.waitForThreads();
+    if (needFullBuild) {
+        // Either an atom has moved too far or it has left the region covered by the voxels, so we need to start over.
+        
+        computeNeighborList(numAtoms, atomLocations, exclusions, periodicBoxVectors, usePeriodic, maxDistance, threads);
+        return;
+    }
+    
+    // Move the atoms that changed voxels, then find the neighbors of each block.
+
+    threads.execute([&] (ThreadPool& threads, int threadIndex) {
+        for (int y = threadIndex; y < voxels->getNumRows(); y += numThreads)
+            voxels->updateBins(y, sortedPositions, threadMovedAtoms);
+    });
+    threads.waitForThreads();
+    gmx_atomic_set(&atomicCounter, 0);
+    threads.execute([&] (ThreadPool& threads, int threadIndex) { threadFindBlockNeighbors(); });
+    threads.waitForThreads();
+    excludePaddingAtoms();
+    numIncrementalUpdates++;
+}
+
+void CpuNeighborList::excludePaddingAtoms() {
+    int numBlocks = blockExclusions.size();
     int numPadding = numBlocks*blockSize-numAtoms;
     if (numPadding > 0) {
-        char mask = ((0xFFFF-(1<<blockSize)+1) >> numPadding);
-        for (int i = 0; i < numPadding; i++)
-            sortedAtoms.push_back(0);
-        vector<char>& exc = blockExclusions[blockExclusions.size()-1];
+        int16_t mask = (int16_t) (((1<<blockSize)-1) & ~((1<<(blockSize-numPadding))-1));
+        vector<int16_t>& exc = blockExclusions[numBlocks-1];
         for (int i = 0; i < (int) exc.size(); i++)
             exc[i] |= mask;
     }
@@ -509,7 +659,7 @@ const std::vector<int>& CpuNeighborList::getBlockNeighbors(int blockIndex) const
     return blockNeighbors[blockIndex];
 }
 
-const std::vector<char>& CpuNeighborList::getBlockExclusions(int blockIndex) const {
+const std::vector<int16_t>& CpuNeighborList::getBlockExclusions(int blockIndex) const {
     return blockExclusions[blockIndex];
     
 }
@@ -530,13 +680,20 @@ void CpuNeighborList::threadComputeNeighborList(ThreadPool& threads, int threadI
         atomBins[i] = pair<int, int>(bin, i);
     }
     threads.syncThreads();
+    threadFindBlockNeighbors();
+}
 
+void CpuNeighborList::threadFindBlockNeighbors() {
     // Compute this thread's subset of neighbors.
 
     int numBlocks = blockNeighbors.size();
     vector<int> blockAtoms;
     vector<float> blockAtomX(blockSize), blockAtomY(blockSize), blockAtomZ(blockSize);
     vector<VoxelIndex> atomVoxelIndex;
+    fvec4 boxVectors[3];
+    for (int j = 0; j < 3; j++)
+        boxVectors[j] = fvec4((float) periodicBoxVectors[j][0], (float) periodicBoxVectors[j][1], (float) periodicBoxVectors[j][2], 0);
+    float invBoxSize[3] = {(float) (1/periodicBoxVectors[0][0]), (float) (1/periodicBoxVectors[1][1]), (float) (1/periodicBoxVectors[2][2])};
     while (true) {
         int i = gmx_atomic_fetch_add(&atomicCounter, 1);
         if (i >= numBlocks)
@@ -552,33 +709,49 @@ void CpuNeighborList::threadComputeNeighborList(ThreadPool& threads, int threadI
             blockAtoms[j] = sortedAtoms[firstIndex+j];
             atomVoxelIndex[j] = voxels->getVoxelIndex(&atomLocations[4*blockAtoms[j]]);
         }
-        fvec4 minPos(&sortedPositions[4*firstIndex]);
-        fvec4 maxPos = minPos;
-        for (int j = 1; j < atomsInBlock; j++) {
+
+        // Compute the bounding box of the block.  After an incremental update, a block may contain atoms on opposite
+        // sides of a periodic boundary, so use the periodic image of each atom that is closest to the first one.
+
+        fvec4 firstPos(&sortedPositions[4*firstIndex]);
+        fvec4 minPos = firstPos;
+        fvec4 maxPos = firstPos;
+        bool blockIsWrapped = false;
+        for (int j = 0; j < atomsInBlock; j++) {
             fvec4 pos(&sortedPositions[4*(firstIndex+j)]);
+            if (usePeriodic) {
+                fvec4 delta = pos-firstPos;
+                float scale3 = floorf(delta[2]*invBoxSize[2]+0.5f);
+                delta -= boxVectors[2]*scale3;
+                float scale2 = floorf(delta[1]*invBoxSize[1]+0.5f);
+                delta -= boxVectors[1]*scale2;
+                float scale1 = floorf(delta[0]*invBoxSize[0]+0.5f);
+                delta -= boxVectors[0]*scale1;
+                if (scale1 != 0 || scale2 != 0 || scale3 != 0)
+                    blockIsWrapped = true;
+                pos = firstPos+delta;
+            }
             minPos = min(minPos, pos);
             maxPos = max(maxPos, pos);
-        }
-        for (int j = 0; j < atomsInBlock; j++) {
-            blockAtomX[j] = sortedPositions[4*(firstIndex+j)];
-            blockAtomY[j] = sortedPositions[4*(firstIndex+j)+1];
-            blockAtomZ[j] = sortedPositions[4*(firstIndex+j)+2];
+            blockAtomX[j] = pos[0];
+            blockAtomY[j] = pos[1];
+            blockAtomZ[j] = pos[2];
         }
         for (int j = atomsInBlock; j < blockSize; j++) {
             blockAtomX[j] = 1e10;
             blockAtomY[j] = 1e10;
             blockAtomZ[j] = 1e10;
         }
-        voxels->getNeighbors(blockNeighbors[i], i, (maxPos+minPos)*0.5f, (maxPos-minPos)*0.5f, sortedAtoms, blockExclusions[i], maxDistance, blockAtoms, blockAtomX, blockAtomY, blockAtomZ, sortedPositions, atomVoxelIndex);
+        voxels->getNeighbors(blockNeighbors[i], i, (maxPos+minPos)*0.5f, (maxPos-minPos)*0.5f, sortedAtoms, blockExclusions[i], maxDistance, blockAtoms, blockAtomX, blockAtomY, blockAtomZ, sortedPositions, atomVoxelIndex, blockIsWrapped);
 
         // Record the exclusions for this block.
 
-        map<int, char> atomFlags;
+        map<int, int16_t> atomFlags;
         for (int j = 0; j < atomsInBlock; j++) {
             const set<int>& atomExclusions = (*exclusions)[sortedAtoms[firstIndex+j]];
-            char mask = 1<<j;
+            int16_t mask = (int16_t) (1<<j);
             for (int exclusion : atomExclusions) {
-                map<int, char>::iterator thisAtomFlags = atomFlags.find(exclusion);
+                map<int, int16_t>::iterator thisAtomFlags = atomFlags.find(exclusion);
                 if (thisAtomFlags == atomFlags.end())
                     atomFlags[exclusion] = mask;
                 else
@@ -588,7 +761,7 @@ void CpuNeighborList::threadComputeNeighborList(ThreadPool& threads, int threadI
         int numNeighbors = blockNeighbors[i].size();
         for (int k = 0; k < numNeighbors; k++) {
             int atomIndex = blockNeighbors[i][k];
-            map<int, char>::iterator thisAtomFlags = atomFlags.find(atomIndex);
+            map<int, int16_t>::iterator thisAtomFlags = atomFlags.find(atomIndex);
             if (thisAtomFlags != atomFlags.end())
                 blockExclusions[i][k] |= thisAtomFlags->second;
         }
@@ -48,8 +48,8 @@ const int CpuNonbondedForce::NUM_TABLE_POINTS = 2048;
 
    --------------------------------------------------------------------------------------- */
 
-CpuNonbondedForce::CpuNonbondedForce() : cutoff(false), useSwitch(false), periodic(false), ewald(false), pme(false), ljpme(false), tableIsValid(false), expTableIsValid(false),
-    cutoffDistance(0.0f), alphaDispersionEwald(0.0f), alphaEwald(0.0f) {
+CpuNonbondedForce::CpuNonbondedForce() : cutoff(false), useSwitch(false), periodic(false), ewald(false), pme(false), ljpme(false), tableIsValid(false), expTableIsValid(false), decomposition(NULL),
+    fusedGBSAOBC(NULL), cutoffDistance(0.0f), alphaDispersionEwald(0.0f), alphaEwald(0.0f), pmeOrder(5) {
 }
 
 CpuNonbondedForce::~CpuNonbondedForce() {
@@ -203,6 +203,17 @@ void CpuNonbondedForce::setUseLJPME(float alpha, int meshSize[3]) {
     }
 }
 
+void CpuNonbondedForce::setPMEInterpolationOrder(int order) {
+    pmeOrder = order;
+}
+
+void CpuNonbondedForce::setForceDecomposition(const CpuForceDecomposition* decomposition) {
+    this->decomposition = decomposition;
+}
+
+void CpuNonbondedForce::setFusedGBSAOBC(CpuGBSAOBCForce* gbsa) {
+    fusedGBSAOBC = gbsa;
+}
 
 void CpuNonbondedForce::tabulateEwaldScaleFactor() {
     if (tableIsValid)
@@ -255,7 +266,7 @@ void CpuNonbondedForce::calculateReciprocalIxn(int numberOfAtoms, float* posq, c
 
     if (pme) {
         pme_t pmedata;
-        pme_init(&pmedata, alphaEwald, numberOfAtoms, meshDim, 5, 1);
+        pme_init(&pmedata, alphaEwald, numberOfAtoms, meshDim, pmeOrder, 1);
         vector<double> charges(numberOfAtoms);
         for (int i = 0; i < numberOfAtoms; i++)
             charges[i] = posq[4*i+3];
@@ -267,7 +278,7 @@ void CpuNonbondedForce::calculateReciprocalIxn(int numberOfAtoms, float* posq, c
 
         if (ljpme) {
             // Dispersion reciprocal space terms
-            pme_init(&pmedata,alphaDispersionEwald,numberOfAtoms,dispersionMeshDim,5,1);
+            pme_init(&pmedata,alphaDispersionEwald,numberOfAtoms,dispersionMeshDim,pmeOrder,1);
 
             std::vector<Vec3> dpmeforces;
             for (int i = 0; i < numberOfAtoms; i++){
@@ -377,7 +388,7 @@ void CpuNonbondedForce::calculateReciprocalIxn(int numberOfAtoms, float* posq, c
 
 
 void CpuNonbondedForce::calculateDirectIxn(int numberOfAtoms, float* posq, const vector<Vec3>& atomCoordinates, const vector<pair<float, float> >& atomParameters,
-                                           const vector<float>& C6params, const vector<set<int> >& exclusions, vector<AlignedArray<float> >& threadForce, double* totalEnergy, ThreadPool& threads) {
+                                           const vector<float>& C6params, const vector<set<int> >& exclusions, vector<AlignedArray<float> >& threadForce, bool includeForces, double* totalEnergy, ThreadPool& threads) {
     // Record the parameters for the threads.
     
     this->numberOfAtoms = numberOfAtoms;
@@ -387,11 +398,14 @@ void CpuNonbondedForce::calculateDirectIxn(int numberOfAtoms, float* posq, const
     this->C6params = &C6params[0];
     this->exclusions = &exclusions[0];
     this->threadForce = &threadForce;
+    this->includeForces = includeForces;
     includeEnergy = (totalEnergy != NULL);
     threadEnergy.resize(threads.getNumThreads());
     gmx_atomic_t counter;
     gmx_atomic_set(&counter, 0);
     this->atomicCounter = &counter;
+    if (fusedGBSAOBC != NULL)
+        fusedGBSAOBC->beginFusedBornSums(posq, threads);
     
     // Signal the threads to start running and wait for them to finish.
     
@@ -426,74 +440,76 @@ void CpuNonbondedForce::threadComputeDirect(ThreadPool& threads, int threadIndex
     float* forces = &(*threadForce)[threadIndex][0];
     fvec4 boxSize(periodicBoxVectors[0][0], periodicBoxVectors[1][1], periodicBoxVectors[2][2], 0);
     fvec4 invBoxSize(recipBoxSize[0], recipBoxSize[1], recipBoxSize[2], 0);
+    if (fusedGBSAOBC != NULL)
+        fusedGBSAOBC->clearFusedBornSums(threadIndex);
     if (ewald || pme || ljpme) {
-        // Compute the interactions from the neighbor list.
-        while (true) {
-            int nextBlock = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
-            if (nextBlock >= neighborList->getNumBlocks())
-                break;
-            calculateBlockEwaldIxn(nextBlock, forces, energyPtr, boxSize, invBoxSize);
+        // Compute the interactions from the neighbor list.  If requested, accumulate the Born radius sums for
+        // each block while its data is still in cache.
+        if (decomposition != NULL) {
+            int start, end;
+            decomposition->getThreadBlockRange(threadIndex, start, end);
+            for (int block = start; block < end; block++) {
+                calculateBlockEwaldIxn(block, forces, energyPtr, boxSize, invBoxSize);
+                if (fusedGBSAOBC != NULL)
+                    fusedGBSAOBC->computeFusedBornSums(block, threadIndex, boxSize, invBoxSize);
+            }
+        }
+        else {
+            while (true) {
+                int nextBlock = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
+                if (nextBlock >= neighborList->getNumBlocks())
+                    break;
+                calculateBlockEwaldIxn(nextBlock, forces, energyPtr, boxSize, invBoxSize);
+                if (fusedGBSAOBC != NULL)
+                    fusedGBSAOBC->computeFusedBornSums(nextBlock, threadIndex, boxSize, invBoxSize);
+            }
         }
 
         // Now subtract off the exclusions, since they were implicitly included in the reciprocal space sum.
 
         threads.syncThreads();
-        const int groupSize = max(1, numberOfAtoms/(10*numThreads));
-        while (true) {
-            int start = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), groupSize);
-            if (start >= numberOfAtoms)
-                break;
-            int end = min(start+groupSize, numberOfAtoms);
-            for (int i = start; i < end; i++) {
-                fvec4 posI((float) atomCoordinates[i][0], (float) atomCoordinates[i][1], (float) atomCoordinates[i][2], 0.0f);
-                float scaledChargeI = (float) (ONE_4PI_EPS0*posq[4*i+3]);
-                for (int excluded : exclusions[i]) {
-                    if (excluded > i) {
-                        int j = excluded;
-                        fvec4 deltaR;
-                        fvec4 posJ((float) atomCoordinates[j][0], (float) atomCoordinates[j][1], (float) atomCoordinates[j][2], 0.0f);
-                        float r2;
-                        getDeltaR(posJ, posI, deltaR, r2, false, boxSize, invBoxSize);
-                        float r = sqrtf(r2);
-                        float alphaR = alphaEwald*r;
-                        float erfAlphaR = erf(alphaR);
-                        if (erfAlphaR > 1e-6f) {
-                            float inverseR = 1/r;
-                            float chargeProdOverR = scaledChargeI*posq[4*j+3]*inverseR;
-                            float dEdR = chargeProdOverR*inverseR*inverseR;
-                            dEdR = dEdR * (erfAlphaR-TWO_OVER_SQRT_PI*alphaR*(float)exp(-alphaR*alphaR));
-                            fvec4 result = deltaR*dEdR;
-                            (fvec4(forces+4*i)-result).store(forces+4*i);
-                            (fvec4(forces+4*j)+result).store(forces+4*j);
-                            if (includeEnergy)
-                                threadEnergy[threadIndex] -= chargeProdOverR*erfAlphaR;
-                        }
-                        else if (includeEnergy)
-                            threadEnergy[threadIndex] -= alphaEwald*TWO_OVER_SQRT_PI*scaledChargeI*posq[4*j+3];
-                        if (ljpme) {
-                            float C6ij = C6params[i]*C6params[j];
-                            float inverseR2 = 1.0f/r2;
-                            float emult = C6ij*inverseR2*inverseR2*inverseR2*exptermsApprox(r);
-                            if(includeEnergy)
-                                threadEnergy[threadIndex] += emult;
-                            float dEdR = -6.0f*C6ij*inverseR2*inverseR2*inverseR2*inverseR2*dExptermsApprox(r);
-                            fvec4 result = deltaR*dEdR;
-                            (fvec4(forces+4*i)-result).store(forces+4*i);
-                            (fvec4(forces+4*j)+result).store(forces+4*j);
-                        }
-                    }
-                }
+        if (decomposition != NULL && includeForces) {
+            // Each thread only applies forces to the atoms it owns, so it processes every exclusion of those atoms.
+
+            const vector<int>& sortedAtoms = neighborList->getSortedAtoms();
+            int start, end;
+            decomposition->getThreadAtomRange(threadIndex, start, end);
+            for (int i = start; i < end; i++)
+                subtractExclusions(sortedAtoms[i], true, forces, threadEnergy[threadIndex], boxSize, invBoxSize);
+        }
+        else {
+            const int groupSize = max(1, numberOfAtoms/(10*numThreads));
+            while (true) {
+                int start = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), groupSize);
+                if (start >= numberOfAtoms)
+                    break;
+                int end = min(start+groupSize, numberOfAtoms);
+                for (int i = start; i < end; i++)
+                    subtractExclusions(i, false, forces, threadEnergy[threadIndex], boxSize, invBoxSize);
             }
         }
     }
     else if (cutoff) {
-        // Compute the interactions from the neighbor list.
-
-        while (true) {
-            int nextBlock = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
-            if (nextBlock >= neighborList->getNumBlocks())
-                break;
-            calculateBlockIxn(nextBlock, forces, energyPtr, boxSize, invBoxSize);
+        // Compute the interactions from the neighbor list, and the Born radius sums if requested.
+
+        if (decomposition != NULL) {
+            int start, end;
+            decomposition->getThreadBlockRange(threadIndex, start, end);
+            for (int block = start; block < end; block++) {
+                calculateBlockIxn(block, forces, energyPtr, boxSize, invBoxSize);
+                if (fusedGBSAOBC != NULL)
+                    fusedGBSAOBC->computeFusedBornSums(block, threadIndex, boxSize, invBoxSize);
+            }
+        }
+        else {
+            while (true) {
+                int nextBlock = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
+                if (nextBlock >= neighborList->getNumBlocks())
+                    break;
+                calculateBlockIxn(nextBlock, forces, energyPtr, boxSize, invBoxSize);
+                if (fusedGBSAOBC != NULL)
+                    fusedGBSAOBC->computeFusedBornSums(nextBlock, threadIndex, boxSize, invBoxSize);
+            }
         }
     }
     else {
@@ -510,6 +526,57 @@ void CpuNonbondedForce::threadComputeDirect(ThreadPool& threads, int threadIndex
     }
 }
 
+void CpuNonbondedForce::subtractExclusions(int i, bool ownedOnly, float* forces, double& energy, const fvec4& boxSize, const fvec4& invBoxSize) {
+    // If ownedOnly is true, forces are only applied to atom i, and every exclusion of i is processed.  Otherwise,
+    // forces are applied to both atoms, and only exclusions with a higher index are processed.
+
+    fvec4 posI((float) atomCoordinates[i][0], (float) atomCoordinates[i][1], (float) atomCoordinates[i][2], 0.0f);
+    float scaledChargeI = (float) (ONE_4PI_EPS0*posq[4*i+3]);
+    for (int excluded : exclusions[i]) {
+        if (excluded == i || (excluded < i && !ownedOnly))
+            continue;
+        int j = excluded;
+        bool includeEnergy = (this->includeEnergy && j > i);
+        fvec4 deltaR;
+        fvec4 posJ((float) atomCoordinates[j][0], (float) atomCoordinates[j][1], (float) atomCoordinates[j][2], 0.0f);
+        float r2;
+        getDeltaR(posJ, posI, deltaR, r2, false, boxSize, invBoxSize);
+        float r = sqrtf(r2);
+        float alphaR = alphaEwald*r;
+        float erfAlphaR = erf(alphaR);
+        if (erfAlphaR > 1e-6f) {
+            float inverseR = 1/r;
+            float chargeProdOverR = scaledChargeI*posq[4*j+3]*inverseR;
+            if (includeForces) {
+                float dEdR = chargeProdOverR*inverseR*inverseR;
+                dEdR = dEdR * (erfAlphaR-TWO_OVER_SQRT_PI*alphaR*(float)exp(-alphaR*alphaR));
+                fvec4 result = deltaR*dEdR;
+                (fvec4(forces+4*i)-result).store(forces+4*i);
+                if (!ownedOnly)
+                    (fvec4(forces+4*j)+result).store(forces+4*j);
+            }
+            if (includeEnergy)
+                energy -= chargeProdOverR*erfAlphaR;
+        }
+        else if (includeEnergy)
+            energy -= alphaEwald*TWO_OVER_SQRT_PI*scaledChargeI*posq[4*j+3];
+        if (ljpme) {
+            float C6ij = C6params[i]*C6params[j];
+            float inverseR2 = 1.0f/r2;
+            float emult = C6ij*inverseR2*inverseR2*inverseR2*exptermsApprox(r);
+            if (includeEnergy)
+                energy += emult;
+            if (includeForces) {
+                float dEdR = -6.0f*C6ij*inverseR2*inverseR2*inverseR2*inverseR2*dExptermsApprox(r);
+                fvec4 result = deltaR*dEdR;
+                (fvec4(forces+4*i)-result).store(forces+4*i);
+                if (!ownedOnly)
+                    (fvec4(forces+4*j)+result).store(forces+4*j);
+            }
+        }
+    }
+}
+
 void CpuNonbondedForce::calculateOneIxn(int ii, int jj, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) {
     // get deltaR, R2, and R between 2 atoms
 
@@ -559,9 +626,11 @@ void CpuNonbondedForce::calculateOneIxn(int ii, int jj, float* forces, double* t
 
     // accumulate forces
 
-    fvec4 result = deltaR*dEdR;
-    (fvec4(forces+4*ii)+result).store(forces+4*ii);
-    (fvec4(forces+4*jj)-result).store(forces+4*jj);
+    if (includeForces) {
+        fvec4 result = deltaR*dEdR;
+        (fvec4(forces+4*ii)+result).store(forces+4*ii);
+        (fvec4(forces+4*jj)-result).store(forces+4*jj);
+    }
 }
 
 void CpuNonbondedForce::getDeltaR(const fvec4& posI, const fvec4& posJ, fvec4& deltaR, float& r2, bool periodic, const fvec4& boxSize, const fvec4& invBoxSize) const {
@@ -121,7 +121,7 @@ void CpuNonbondedForceVec4::calculateBlockIxnImpl(int blockIndex, float* forces,
     // Loop over neighbors for this block.
     
     const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
-    const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
+    const vector<int16_t>& exclusions = neighborList->getBlockExclusions(blockIndex);
     for (int i = 0; i < (int) neighbors.size(); i++) {
         // Load the next neighbor.
         
@@ -135,7 +135,7 @@ void CpuNonbondedForceVec4::calculateBlockIxnImpl(int blockIndex, float* forces,
             atomPos -= floor((atomPos-blockCenter)*invBoxSize+0.5f)*boxSize;
         getDeltaR<PERIODIC_TYPE>(atomPos, blockAtomX, blockAtomY, blockAtomZ, dx, dy, dz, r2, needPeriodic, boxSize, invBoxSize);
         ivec4 include;
-        char excl = exclusions[i];
+        int16_t excl = exclusions[i];
         if (excl == 0)
             include = -1;
         else
@@ -189,6 +189,9 @@ void CpuNonbondedForceVec4::calculateBlockIxnImpl(int blockIndex, float* forces,
             *totalEnergy += dot4(energy, one);
         }
 
+        if (!includeForces)
+            continue;
+
         // Accumulate forces.
 
         dEdR = blend(0.0f, dEdR, include);
@@ -206,6 +209,8 @@ void CpuNonbondedForceVec4::calculateBlockIxnImpl(int blockIndex, float* forces,
     
     // Record the forces on the block atoms.
 
+    if (!includeForces)
+        return;
     fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
     transpose(f[0], f[1], f[2], f[3]);
     for (int j = 0; j < 4; j++)
@@ -284,7 +289,7 @@ void CpuNonbondedForceVec4::calculateBlockEwaldIxnImpl(int blockIndex, float* fo
     // Loop over neighbors for this block.
     
     const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
-    const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
+    const vector<int16_t>& exclusions = neighborList->getBlockExclusions(blockIndex);
     for (int i = 0; i < (int) neighbors.size(); i++) {
         // Load the next neighbor.
         
@@ -298,7 +303,7 @@ void CpuNonbondedForceVec4::calculateBlockEwaldIxnImpl(int blockIndex, float* fo
             atomPos -= floor((atomPos-blockCenter)*invBoxSize+0.5f)*boxSize;
         getDeltaR<PERIODIC_TYPE>(atomPos, blockAtomX, blockAtomY, blockAtomZ, dx, dy, dz, r2, needPeriodic, boxSize, invBoxSize);
         ivec4 include;
-        char excl = exclusions[i];
+        int16_t excl = exclusions[i];
         if (excl == 0)
             include = -1;
         else
@@ -358,6 +363,9 @@ void CpuNonbondedForceVec4::calculateBlockEwaldIxnImpl(int blockIndex, float* fo
             *totalEnergy += dot4(energy, one);
         }
 
+        if (!includeForces)
+            continue;
+
         // Accumulate forces.
 
         dEdR = blend(0.0f, dEdR, include);
@@ -375,6 +383,8 @@ void CpuNonbondedForceVec4::calculateBlockEwaldIxnImpl(int blockIndex, float* fo
     
     // Record the forces on the block atoms.
 
+    if (!includeForces)
+        return;
     fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
     transpose(f[0], f[1], f[2], f[3]);
     for (int j = 0; j < 4; j++)
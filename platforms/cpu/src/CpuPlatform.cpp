@@ -30,6 +30,7 @@
  * -------------------------------------------------------------------------- */
 
 #include "CpuPlatform.h"
+#include "CpuCCMA.h"
 #include "CpuKernelFactory.h"
 #include "CpuKernels.h"
 #include "CpuSETTLE.h"
@@ -64,18 +65,38 @@ CpuPlatform::CpuPlatform() {
     deprecatedPropertyReplacements["CpuThreads"] = CpuThreads();
     CpuKernelFactory* factory = new CpuKernelFactory();
     registerKernelFactory(CalcForcesAndEnergyKernel::Name(), factory);
+    registerKernelFactory(CalcHarmonicBondForceKernel::Name(), factory);
     registerKernelFactory(CalcHarmonicAngleForceKernel::Name(), factory);
     registerKernelFactory(CalcPeriodicTorsionForceKernel::Name(), factory);
     registerKernelFactory(CalcRBTorsionForceKernel::Name(), factory);
+    registerKernelFactory(CalcCMAPTorsionForceKernel::Name(), factory);
+    registerKernelFactory(CalcCustomBondForceKernel::Name(), factory);
+    registerKernelFactory(CalcCustomAngleForceKernel::Name(), factory);
+    registerKernelFactory(CalcCustomTorsionForceKernel::Name(), factory);
+    registerKernelFactory(CalcCustomExternalForceKernel::Name(), factory);
     registerKernelFactory(CalcNonbondedForceKernel::Name(), factory);
     registerKernelFactory(CalcCustomNonbondedForceKernel::Name(), factory);
+    registerKernelFactory(CalcCustomCompoundBondForceKernel::Name(), factory);
+    registerKernelFactory(CalcCustomCentroidBondForceKernel::Name(), factory);
+    registerKernelFactory(CalcCustomHbondForceKernel::Name(), factory);
     registerKernelFactory(CalcCustomManyParticleForceKernel::Name(), factory);
     registerKernelFactory(CalcGBSAOBCForceKernel::Name(), factory);
     registerKernelFactory(CalcCustomGBForceKernel::Name(), factory);
     registerKernelFactory(CalcGayBerneForceKernel::Name(), factory);
+    registerKernelFactory(CalcRMSDForceKernel::Name(), factory);
+    registerKernelFactory(IntegrateVerletStepKernel::Name(), factory);
     registerKernelFactory(IntegrateLangevinStepKernel::Name(), factory);
+    registerKernelFactory(IntegrateBrownianStepKernel::Name(), factory);
+    registerKernelFactory(IntegrateVariableLangevinStepKernel::Name(), factory);
+    registerKernelFactory(IntegrateVariableVerletStepKernel::Name(), factory);
+    registerKernelFactory(IntegrateCustomStepKernel::Name(), factory);
+    registerKernelFactory(ApplyAndersenThermostatKernel::Name(), factory);
+    registerKernelFactory(ApplyMonteCarloBarostatKernel::Name(), factory);
+    registerKernelFactory(RemoveCMMotionKernel::Name(), factory);
     platformProperties.push_back(CpuThreads());
     platformProperties.push_back(CpuDeterministicForces());
+    platformProperties.push_back(CpuNeighborListPadding());
+    platformProperties.push_back(CpuInstructionSet());
     int threads = getNumProcessors();
     char* threadsEnv = getenv("OPENMM_CPU_THREADS");
     if (threadsEnv != NULL)
@@ -84,6 +105,8 @@ CpuPlatform::CpuPlatform() {
     defaultThreads << threads;
     setPropertyDefaultValue(CpuThreads(), defaultThreads.str());
     setPropertyDefaultValue(CpuDeterministicForces(), "false");
+    setPropertyDefaultValue(CpuNeighborListPadding(), "");
+    setPropertyDefaultValue(CpuInstructionSet(), "auto");
 }
 
 const string& CpuPlatform::getPropertyValue(const Context& context, const string& property) const {
@@ -110,6 +133,25 @@ bool CpuPlatform::isProcessorSupported() {
     return isVec4Supported();
 }
 
+bool isVec8Supported();
+bool isVec16Supported();
+
+int CpuPlatform::getMaxVectorWidth() {
+    if (isVec16Supported())
+        return 16;
+    if (isVec8Supported())
+        return 8;
+    return 4;
+}
+
+static string getInstructionSetName(int vectorWidth) {
+    if (vectorWidth == 16)
+        return "AVX512";
+    if (vectorWidth == 8)
+        return "AVX";
+    return "SSE4.1";
+}
+
 void CpuPlatform::contextCreated(ContextImpl& context, const map<string, string>& properties) const {
     ReferencePlatform::contextCreated(context, properties);
     const string& threadsPropValue = (properties.find(CpuThreads()) == properties.end() ?
@@ -120,14 +162,48 @@ void CpuPlatform::contextCreated(ContextImpl& context, const map<string, string>
     stringstream(threadsPropValue) >> numThreads;
     transform(deterministicForcesValue.begin(), deterministicForcesValue.end(), deterministicForcesValue.begin(), ::tolower);
     bool deterministicForces = (deterministicForcesValue == "true");
-    PlatformData* data = new PlatformData(context.getSystem().getNumParticles(), numThreads, deterministicForces);
+    string paddingValue = (properties.find(CpuNeighborListPadding()) == properties.end() ?
+            getPropertyDefaultValue(CpuNeighborListPadding()) : properties.find(CpuNeighborListPadding())->second);
+    transform(paddingValue.begin(), paddingValue.end(), paddingValue.begin(), ::tolower);
+    double padding = -1.0;
+    bool tunePadding = (paddingValue == "auto");
+    if (paddingValue != "auto" && paddingValue != "") {
+        stringstream paddingStream(paddingValue);
+        paddingStream >> padding;
+        if (paddingStream.fail() || padding < 0)
+            throw OpenMMException("Illegal value for "+CpuNeighborListPadding()+": "+paddingValue);
+    }
+    string instructionSetValue = (properties.find(CpuInstructionSet()) == properties.end() ?
+            getPropertyDefaultValue(CpuInstructionSet()) : properties.find(CpuInstructionSet())->second);
+    transform(instructionSetValue.begin(), instructionSetValue.end(), instructionSetValue.begin(), ::tolower);
+    int vectorWidth = getMaxVectorWidth();
+    if (instructionSetValue != "auto") {
+        int requestedWidth;
+        if (instructionSetValue == "sse4.1" || instructionSetValue == "sse")
+            requestedWidth = 4;
+        else if (instructionSetValue == "avx")
+            requestedWidth = 8;
+        else if (instructionSetValue == "avx512")
+            requestedWidth = 16;
+        else
+            throw OpenMMException("Illegal value for "+CpuInstructionSet()+": "+instructionSetValue);
+        if (requestedWidth > vectorWidth)
+            throw OpenMMException("The requested instruction set is not supported by this processor: "+getInstructionSetName(requestedWidth));
+        vectorWidth = requestedWidth;
+    }
+    PlatformData* data = new PlatformData(context.getSystem().getNumParticles(), numThreads, deterministicForces, padding, tunePadding, vectorWidth);
     contextData[&context] = data;
     ReferenceConstraints& constraints = *(ReferenceConstraints*) reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData())->constraints;
     if (constraints.settle != NULL) {
-        CpuSETTLE* parallelSettle = new CpuSETTLE(context.getSystem(), *(ReferenceSETTLEAlgorithm*) constraints.settle, data->threads);
+        CpuSETTLE* parallelSettle = new CpuSETTLE(context.getSystem(), *(ReferenceSETTLEAlgorithm*) constraints.settle, data->threads, data->vectorWidth >= 8);
         delete constraints.settle;
         constraints.settle = parallelSettle;
     }
+    if (constraints.ccma != NULL) {
+        CpuCCMA* parallelCcma = new CpuCCMA(context.getSystem(), *(ReferenceCCMAAlgorithm*) constraints.ccma, data->threads);
+        delete constraints.ccma;
+        constraints.ccma = parallelCcma;
+    }
 }
 
 void CpuPlatform::contextDestroyed(ContextImpl& context) const {
@@ -146,17 +222,28 @@ const CpuPlatform::PlatformData& CpuPlatform::getPlatformData(const ContextImpl&
     return *contextData[&context];
 }
 
-CpuPlatform::PlatformData::PlatformData(int numParticles, int numThreads, bool deterministicForces) : posq(4*numParticles), threads(numThreads),
-        deterministicForces(deterministicForces), neighborList(NULL), cutoff(0.0), paddedCutoff(0.0), anyExclusions(false) {
+CpuPlatform::PlatformData::PlatformData(int numParticles, int numThreads, bool deterministicForces, double neighborListPadding, bool tunePadding, int vectorWidth) : posq(4*numParticles),
+        threads(numThreads), deterministicForces(deterministicForces), neighborList(NULL), forceDecomposition(threads.getNumThreads()), cutoff(0.0),
+        paddedCutoff(0.0), neighborListPadding(neighborListPadding), vectorWidth(vectorWidth), anyExclusions(false), fusedGBSAOBC(NULL) {
     numThreads = threads.getNumThreads();
     threadForce.resize(numThreads);
     for (int i = 0; i < numThreads; i++)
         threadForce[i].resize(4*numParticles);
+    forceDecomposition.clearForces(threadForce, threads);
     isPeriodic = false;
     stringstream threadsProperty;
     threadsProperty << numThreads;
     propertyValues[CpuThreads()] = threadsProperty.str();
     propertyValues[CpuDeterministicForces()] = deterministicForces ? "true" : "false";
+    tuneNeighborListPadding = (neighborListPadding < 0 && tunePadding && !deterministicForces);
+    if (neighborListPadding < 0)
+        propertyValues[CpuNeighborListPadding()] = (tunePadding ? "auto" : "");
+    else {
+        stringstream paddingProperty;
+        paddingProperty << neighborListPadding;
+        propertyValues[CpuNeighborListPadding()] = paddingProperty.str();
+    }
+    propertyValues[CpuInstructionSet()] = getInstructionSetName(vectorWidth);
 }
 
 CpuPlatform::PlatformData::~PlatformData() {
@@ -164,14 +251,14 @@ CpuPlatform::PlatformData::~PlatformData() {
         delete neighborList;
 }
 
-bool isVec8Supported();
-
 void CpuPlatform::PlatformData::requestNeighborList(double cutoffDistance, double padding, bool useExclusions, const vector<set<int> >& exclusionList) {
     if (neighborList == NULL)
-        neighborList = new CpuNeighborList(isVec8Supported() ? 8 : 4);
+        neighborList = new CpuNeighborList(vectorWidth);
     if (cutoffDistance > cutoff)
         cutoff = cutoffDistance;
-    if (cutoffDistance+padding > paddedCutoff)
+    if (neighborListPadding >= 0)
+        paddedCutoff = cutoff+neighborListPadding;
+    else if (cutoffDistance+padding > paddedCutoff)
         paddedCutoff = cutoffDistance+padding;
     if (useExclusions) {
         if (anyExclusions && exclusions != exclusionList)
@@ -44,11 +44,17 @@ void CpuRandom::initialize(int seed, int numThreads) {
             return; // Already initialized with the same seed.
         throw OpenMMException("Random number generator initialized twice with different seeds");
     }
-    randomSeed = seed;
     hasInitialized = true;
     threadRandom.resize(numThreads);
     nextGaussian.resize(numThreads);
     nextGaussianIsValid.resize(numThreads, false);
+    for (int i = 0; i < numThreads; i++)
+        threadRandom[i] = new OpenMM_SFMT::SFMT();
+    setSeed(seed);
+}
+
+void CpuRandom::setSeed(int seed) {
+    randomSeed = seed;
 
     /* Use a quick and dirty RNG to pick seeds for the real random number generator.
      * A random seed of 0 means pick a unique seed
@@ -57,10 +63,10 @@ void CpuRandom::initialize(int seed, int numThreads) {
     unsigned int r = (unsigned int) seed;
     if (r == 0)
         r = (unsigned int) osrngseed();
-    for (int i = 0; i < numThreads; i++) {
+    for (int i = 0; i < (int) threadRandom.size(); i++) {
         r = (1664525*r + 1013904223) & 0xFFFFFFFF;
-        threadRandom[i] = new OpenMM_SFMT::SFMT();
         init_gen_rand(r, *threadRandom[i]);
+        nextGaussianIsValid[i] = false;
     }
 }
 
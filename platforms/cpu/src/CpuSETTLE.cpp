@@ -30,60 +30,166 @@
  * -------------------------------------------------------------------------- */
 
 #include "CpuSETTLE.h"
+#include "CpuSETTLEVectorized.h"
 #include "openmm/internal/gmx_atomic.h"
+#include "openmm/internal/vectorize.h"
+#include <algorithm>
 
 using namespace OpenMM;
 using namespace std;
 
-CpuSETTLE::CpuSETTLE(const System& system, const ReferenceSETTLEAlgorithm& settle, ThreadPool& threads) : threads(threads) {
-    int numBlocks = 10*threads.getNumThreads();
-    int numClusters = settle.getNumClusters();
-    vector<double> mass(system.getNumParticles());
-    for (int i = 0; i < system.getNumParticles(); i++)
-        mass[i] = system.getParticleMass(i);
-    for (int i = 0; i < numBlocks; i++) {
-        int start = i*numClusters/numBlocks;
-        int end = (i+1)*numClusters/numBlocks;
-        if (start != end) {
-            int numThreadClusters = end-start;
-            vector<int> atom1(numThreadClusters), atom2(numThreadClusters), atom3(numThreadClusters);
-            vector<double> distance1(numThreadClusters), distance2(numThreadClusters);
-            for (int j = 0; j < numThreadClusters; j++)
-                settle.getClusterParameters(start+j, atom1[j], atom2[j], atom3[j], distance1[j], distance2[j]);
-            threadSettle.push_back(new ReferenceSETTLEAlgorithm(atom1, atom2, atom3, distance1, distance2, mass));
-        }
+void settlePositionsVec8(const float* m0, const float* m1, const float* m2, const float* dist1, const float* dist2,
+        const float* b0, const float* c0, float* xp0, float* xp1, float* xp2);
+void settleVelocitiesVec8(const float* m0, const float* m1, const float* m2, const float* invm0, const float* invm1, const float* invm2,
+        const float* ab, const float* bc, const float* ca, float* v0, float* v1, float* v2);
+
+CpuSETTLE::CpuSETTLE(const System& system, const ReferenceSETTLEAlgorithm& settle, ThreadPool& threads, bool useVec8) : threads(threads), useVec8(useVec8) {
+    groupWidth = (useVec8 ? 8 : 4);
+    numClusters = settle.getNumClusters();
+    int numGroups = (numClusters+groupWidth-1)/groupWidth;
+    int paddedSize = numGroups*groupWidth;
+    atom1.resize(paddedSize);
+    atom2.resize(paddedSize);
+    atom3.resize(paddedSize);
+    mass1.resize(paddedSize);
+    mass2.resize(paddedSize);
+    mass3.resize(paddedSize);
+    distance1.resize(paddedSize);
+    distance2.resize(paddedSize);
+    for (int i = 0; i < paddedSize; i++) {
+        double d1, d2;
+        settle.getClusterParameters(min(i, numClusters-1), atom1[i], atom2[i], atom3[i], d1, d2);
+        mass1[i] = (float) system.getParticleMass(atom1[i]);
+        mass2[i] = (float) system.getParticleMass(atom2[i]);
+        mass3[i] = (float) system.getParticleMass(atom3[i]);
+        distance1[i] = (float) d1;
+        distance2[i] = (float) d2;
     }
+    int numBlocks = min(10*threads.getNumThreads(), numGroups);
+    for (int i = 0; i < numBlocks; i++)
+        blockStart.push_back(i*numGroups/numBlocks);
+    blockStart.push_back(numGroups);
 }
 
 CpuSETTLE::~CpuSETTLE() {
-    for (auto settle : threadSettle)
-        delete settle;
 }
 
 void CpuSETTLE::apply(vector<OpenMM::Vec3>& atomCoordinates, vector<OpenMM::Vec3>& atomCoordinatesP, vector<double>& inverseMasses, double tolerance) {
+    int numBlocks = blockStart.size()-1;
     gmx_atomic_t atomicCounter;
     gmx_atomic_set(&atomicCounter, 0);
     threads.execute([&] (ThreadPool& threads, int threadIndex) {
         while (true) {
-            int index = gmx_atomic_fetch_add(&atomicCounter, 1);
-            if (index >= threadSettle.size())
+            int block = gmx_atomic_fetch_add(&atomicCounter, 1);
+            if (block >= numBlocks)
                 break;
-            threadSettle[index]->apply(atomCoordinates, atomCoordinatesP, inverseMasses, tolerance);
+            for (int group = blockStart[block]; group < blockStart[block+1]; group++)
+                applyToGroup(group, atomCoordinates, atomCoordinatesP);
         }
     });
     threads.waitForThreads();
 }
 
 void CpuSETTLE::applyToVelocities(vector<OpenMM::Vec3>& atomCoordinates, vector<OpenMM::Vec3>& velocities, vector<double>& inverseMasses, double tolerance) {
+    int numBlocks = blockStart.size()-1;
     gmx_atomic_t atomicCounter;
     gmx_atomic_set(&atomicCounter, 0);
     threads.execute([&] (ThreadPool& threads, int threadIndex) {
         while (true) {
-            int index = gmx_atomic_fetch_add(&atomicCounter, 1);
-            if (index >= threadSettle.size())
+            int block = gmx_atomic_fetch_add(&atomicCounter, 1);
+            if (block >= numBlocks)
                 break;
-            threadSettle[index]->applyToVelocities(atomCoordinates, velocities, inverseMasses, tolerance);
+            for (int group = blockStart[block]; group < blockStart[block+1]; group++)
+                applyToGroupVelocities(group, atomCoordinates, velocities, inverseMasses);
         }
     });
     threads.waitForThreads();
 }
+
+void CpuSETTLE::applyToGroup(int group, vector<OpenMM::Vec3>& atomCoordinates, vector<OpenMM::Vec3>& atomCoordinatesP) {
+    // Gather the coordinates into structure of arrays form, relative to the original position of the first atom.
+
+    const int L = groupWidth;
+    const int first = group*L;
+    float b0[24], c0[24], xp0[24], xp1[24], xp2[24];
+    for (int lane = 0; lane < L; lane++) {
+        int i = first+lane;
+        const Vec3& apos0 = atomCoordinates[atom1[i]];
+        const Vec3& apos1 = atomCoordinates[atom2[i]];
+        const Vec3& apos2 = atomCoordinates[atom3[i]];
+        Vec3 pos1 = apos1-apos0;
+        Vec3 pos2 = apos2-apos0;
+        Vec3 delta0 = atomCoordinatesP[atom1[i]]-apos0;
+        Vec3 delta1 = atomCoordinatesP[atom2[i]]-apos1;
+        Vec3 delta2 = atomCoordinatesP[atom3[i]]-apos2;
+        for (int j = 0; j < 3; j++) {
+            b0[lane+j*L] = (float) pos1[j];
+            c0[lane+j*L] = (float) pos2[j];
+            xp0[lane+j*L] = (float) delta0[j];
+            xp1[lane+j*L] = (float) delta1[j];
+            xp2[lane+j*L] = (float) delta2[j];
+        }
+    }
+
+    // Apply SETTLE to all clusters in the group at once.
+
+    if (useVec8)
+        settlePositionsVec8(&mass1[first], &mass2[first], &mass3[first], &distance1[first], &distance2[first], b0, c0, xp0, xp1, xp2);
+    else
+        settlePositionsVectorized<fvec4>(&mass1[first], &mass2[first], &mass3[first], &distance1[first], &distance2[first], b0, c0, xp0, xp1, xp2);
+
+    // Record the new positions.  Lanes past the end of the last group hold duplicate clusters and are ignored.
+
+    int numInGroup = min(L, numClusters-first);
+    for (int lane = 0; lane < numInGroup; lane++) {
+        int i = first+lane;
+        atomCoordinatesP[atom1[i]] = atomCoordinates[atom1[i]]+Vec3(xp0[lane], xp0[lane+L], xp0[lane+2*L]);
+        atomCoordinatesP[atom2[i]] = atomCoordinates[atom2[i]]+Vec3(xp1[lane], xp1[lane+L], xp1[lane+2*L]);
+        atomCoordinatesP[atom3[i]] = atomCoordinates[atom3[i]]+Vec3(xp2[lane], xp2[lane+L], xp2[lane+2*L]);
+    }
+}
+
+void CpuSETTLE::applyToGroupVelocities(int group, vector<OpenMM::Vec3>& atomCoordinates, vector<OpenMM::Vec3>& velocities, vector<double>& inverseMasses) {
+    // Gather the bond vectors and velocities into structure of arrays form.
+
+    const int L = groupWidth;
+    const int first = group*L;
+    float ab[24], bc[24], ca[24], v0[24], v1[24], v2[24], invMass1[8], invMass2[8], invMass3[8];
+    for (int lane = 0; lane < L; lane++) {
+        int i = first+lane;
+        const Vec3& apos0 = atomCoordinates[atom1[i]];
+        const Vec3& apos1 = atomCoordinates[atom2[i]];
+        const Vec3& apos2 = atomCoordinates[atom3[i]];
+        Vec3 eAB = apos1-apos0;
+        Vec3 eBC = apos2-apos1;
+        Vec3 eCA = apos0-apos2;
+        for (int j = 0; j < 3; j++) {
+            ab[lane+j*L] = (float) eAB[j];
+            bc[lane+j*L] = (float) eBC[j];
+            ca[lane+j*L] = (float) eCA[j];
+            v0[lane+j*L] = (float) velocities[atom1[i]][j];
+            v1[lane+j*L] = (float) velocities[atom2[i]][j];
+            v2[lane+j*L] = (float) velocities[atom3[i]][j];
+        }
+        invMass1[lane] = (float) inverseMasses[atom1[i]];
+        invMass2[lane] = (float) inverseMasses[atom2[i]];
+        invMass3[lane] = (float) inverseMasses[atom3[i]];
+    }
+
+    // Compute the velocity corrections for all clusters in the group at once.
+
+    if (useVec8)
+        settleVelocitiesVec8(&mass1[first], &mass2[first], &mass3[first], invMass1, invMass2, invMass3, ab, bc, ca, v0, v1, v2);
+    else
+        settleVelocitiesVectorized<fvec4>(&mass1[first], &mass2[first], &mass3[first], invMass1, invMass2, invMass3, ab, bc, ca, v0, v1, v2);
+
+    // Apply the corrections.
+
+    int numInGroup = min(L, numClusters-first);
+    for (int lane = 0; lane < numInGroup; lane++) {
+        int i = first+lane;
+        velocities[atom1[i]] += Vec3(v0[lane], v0[lane+L], v0[lane+2*L]);
+        velocities[atom2[i]] += Vec3(v1[lane], v1[lane+L], v1[lane+2*L]);
+        velocities[atom3[i]] += Vec3(v2[lane], v2[lane+L], v2[lane+2*L]);
+    }
+}
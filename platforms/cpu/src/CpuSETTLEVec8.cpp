@@ -0,0 +1,71 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2018 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuSETTLEVectorized.h"
+#include "openmm/OpenMMException.h"
+
+using namespace OpenMM;
+
+#ifdef _MSC_VER
+    // Workaround for a compiler bug in Visual Studio 10. Hopefully we can remove this
+    // once we move to a later version.
+    #undef __AVX__
+#endif
+
+#ifndef __AVX__
+void settlePositionsVec8(const float* m0, const float* m1, const float* m2, const float* dist1, const float* dist2,
+        const float* b0, const float* c0, float* xp0, float* xp1, float* xp2) {
+    throw OpenMMException("Internal error: OpenMM was compiled without AVX support");
+}
+
+void settleVelocitiesVec8(const float* m0, const float* m1, const float* m2, const float* invm0, const float* invm1, const float* invm2,
+        const float* ab, const float* bc, const float* ca, float* v0, float* v1, float* v2) {
+    throw OpenMMException("Internal error: OpenMM was compiled without AVX support");
+}
+#else
+#include "openmm/internal/vectorize8.h"
+
+/**
+ * Apply SETTLE to the positions of eight clusters at once.
+ */
+void settlePositionsVec8(const float* m0, const float* m1, const float* m2, const float* dist1, const float* dist2,
+        const float* b0, const float* c0, float* xp0, float* xp1, float* xp2) {
+    settlePositionsVectorized<fvec8>(m0, m1, m2, dist1, dist2, b0, c0, xp0, xp1, xp2);
+}
+
+/**
+ * Apply SETTLE to the velocities of eight clusters at once.
+ */
+void settleVelocitiesVec8(const float* m0, const float* m1, const float* m2, const float* invm0, const float* invm1, const float* invm2,
+        const float* ab, const float* bc, const float* ca, float* v0, float* v1, float* v2) {
+    settleVelocitiesVectorized<fvec8>(m0, m1, m2, invm0, invm1, invm2, ab, bc, ca, v0, v1, v2);
+}
+#endif
@@ -31,6 +31,153 @@
 
 #include "CpuTests.h"
 #include "TestGBSAOBCForce.h"
+#include "openmm/CustomIntegrator.h"
+#include "openmm/HarmonicBondForce.h"
+#include "openmm/VerletIntegrator.h"
+
+void testSharedNeighborList(double gbsaCutoff) {
+    // GBSAOBCForce shares the neighbor list with NonbondedForce, but must ignore the exclusions that
+    // NonbondedForce puts in it.  Compare to the Reference platform while the atoms move, so the
+    // neighbor list gets rebuilt along the way.
+
+    const int gridSize = 7;
+    const int numMolecules = gridSize*gridSize*gridSize;
+    const double spacing = 0.5;
+    const double boxSize = gridSize*spacing;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    GBSAOBCForce* gbsa = new GBSAOBCForce();
+    NonbondedForce* nonbonded = new NonbondedForce();
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    gbsa->setNonbondedMethod(GBSAOBCForce::CutoffPeriodic);
+    gbsa->setCutoffDistance(gbsaCutoff);
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(1.0);
+    system.addForce(gbsa);
+    system.addForce(nonbonded);
+    system.addForce(bonds);
+    vector<Vec3> positions;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numMolecules; i++) {
+        system.addParticle(10.0);
+        system.addParticle(10.0);
+        gbsa->addParticle(-0.5, 0.15, 0.8);
+        gbsa->addParticle(0.5, 0.12, 0.8);
+        nonbonded->addParticle(-0.5, 0.3, 0.5);
+        nonbonded->addParticle(0.5, 0.3, 0.5);
+        nonbonded->addException(2*i, 2*i+1, 0.0, 1.0, 0.0);
+        bonds->addBond(2*i, 2*i+1, 0.15, 10000.0);
+        Vec3 pos = Vec3(i%gridSize, (i/gridSize)%gridSize, i/(gridSize*gridSize))*spacing;
+        pos += Vec3(genrand_real2(sfmt), genrand_real2(sfmt), genrand_real2(sfmt))*0.1;
+        positions.push_back(pos);
+        positions.push_back(pos+Vec3(0.15, 0, 0));
+    }
+    VerletIntegrator integrator1(0.001);
+    VerletIntegrator integrator2(0.001);
+    ReferencePlatform reference;
+    Context context1(system, integrator1, reference);
+    Context context2(system, integrator2, platform);
+    context1.setPositions(positions);
+    for (int step = 0; step < 5; step++) {
+        State state1 = context1.getState(State::Positions | State::Forces | State::Energy);
+        context2.setPositions(state1.getPositions());
+        State state2 = context2.getState(State::Forces | State::Energy);
+        ASSERT_EQUAL_TOL(state1.getPotentialEnergy(), state2.getPotentialEnergy(), 1e-4);
+        for (int i = 0; i < system.getNumParticles(); i++)
+            ASSERT_EQUAL_VEC(state1.getForces()[i], state2.getForces()[i], 1e-3);
+        integrator1.step(20);
+    }
+}
+
+void testEnergyOnly() {
+    // Evaluate the energy without forces from a CustomIntegrator and compare it to a full evaluation.
+
+    const int numParticles = 200;
+    System system;
+    GBSAOBCForce* gbsa = new GBSAOBCForce();
+    system.addForce(gbsa);
+    vector<Vec3> positions;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        gbsa->addParticle(i%2 == 0 ? -1.0 : 1.0, 0.15, 0.8);
+        positions.push_back(Vec3(genrand_real2(sfmt), genrand_real2(sfmt), genrand_real2(sfmt))*3.0);
+    }
+    CustomIntegrator integrator(0.001);
+    integrator.addGlobalVariable("e", 0.0);
+    integrator.addComputeGlobal("e", "energy");
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    integrator.step(1);
+    State state = context.getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(state.getPotentialEnergy(), integrator.getGlobalVariableByName("e"), 1e-5);
+    VerletIntegrator fullIntegrator(0.001);
+    Context fullContext(system, fullIntegrator, platform);
+    fullContext.setPositions(positions);
+    State fullState = fullContext.getState(State::Forces);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(fullState.getForces()[i], state.getForces()[i], 1e-4);
+}
+
+void testFusedWithNonbonded(bool periodic) {
+    // When NonbondedForce comes first and uses the same cutoff, the Born radius sums are accumulated during
+    // its direct space pass.  Compare to the Reference platform with every instruction set the processor supports.
+
+    const int numParticles = 600;
+    const double boxSize = 3.0;
+    const double cutoff = 1.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    GBSAOBCForce* gbsa = new GBSAOBCForce();
+    nonbonded->setNonbondedMethod(periodic ? NonbondedForce::CutoffPeriodic : NonbondedForce::CutoffNonPeriodic);
+    nonbonded->setCutoffDistance(cutoff);
+    gbsa->setNonbondedMethod(periodic ? GBSAOBCForce::CutoffPeriodic : GBSAOBCForce::CutoffNonPeriodic);
+    gbsa->setCutoffDistance(cutoff);
+    system.addForce(nonbonded);
+    system.addForce(gbsa);
+    vector<Vec3> positions;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        double charge = (i%2 == 0 ? 0.5 : -0.5);
+        nonbonded->addParticle(charge, 0.2, 0.5);
+        gbsa->addParticle(charge, 0.15, 0.8);
+        positions.push_back(Vec3((i%10)*0.3+0.05*genrand_real2(sfmt), ((i/10)%10)*0.3+0.05*genrand_real2(sfmt), (i/100)*0.5+0.05*genrand_real2(sfmt)));
+    }
+    for (int i = 0; i < numParticles; i += 2)
+        nonbonded->addException(i, i+1, 0.0, 1.0, 0.0);
+    ReferencePlatform reference;
+    VerletIntegrator referenceIntegrator(0.001);
+    Context referenceContext(system, referenceIntegrator, reference);
+    referenceContext.setPositions(positions);
+    State referenceState = referenceContext.getState(State::Forces | State::Energy);
+    const string names[] = {"SSE4.1", "AVX", "AVX512"};
+    const int widths[] = {4, 8, 16};
+    for (int i = 0; i < 3; i++) {
+        if (widths[i] > CpuPlatform::getMaxVectorWidth())
+            continue;
+        map<string, string> properties;
+        properties[CpuPlatform::CpuInstructionSet()] = names[i];
+        VerletIntegrator integrator(0.001);
+        Context context(system, integrator, platform, properties);
+        context.setPositions(positions);
+        for (int repeat = 0; repeat < 2; repeat++) {
+            State state = context.getState(State::Forces | State::Energy);
+            ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), state.getPotentialEnergy(), 1e-4);
+            for (int j = 0; j < numParticles; j++)
+                ASSERT_EQUAL_VEC(referenceState.getForces()[j], state.getForces()[j], 1e-3);
+        }
+    }
+}
 
 void runPlatformTests() {
+    testSharedNeighborList(1.0);
+    testSharedNeighborList(1.2);
+    testEnergyOnly();
+    testFusedWithNonbonded(true);
+    testFusedWithNonbonded(false);
 }
@@ -48,7 +48,49 @@
 using namespace OpenMM;
 using namespace std;
 
-void testNeighborList(bool periodic, bool triclinic) {
+void verifyNeighborList(const CpuNeighborList& neighborList, int numParticles, const AlignedArray<float>& positions, const vector<set<int> >& exclusions,
+        const Vec3* boxVectors, bool periodic, float cutoff) {
+    const int blockSize = neighborList.getBlockSize();
+    const float boxSize[3] = {(float) boxVectors[0][0], (float) boxVectors[1][1], (float) boxVectors[2][2]};
+
+    // Convert the neighbor list to a set for faster lookup.
+    
+    set<pair<int, int> > neighbors;
+    for (int i = 0; i < (int) neighborList.getSortedAtoms().size(); i++) {
+        int blockIndex = i/blockSize;
+        int indexInBlock = i-blockIndex*blockSize;
+        int mask = 1<<indexInBlock;
+        for (int j = 0; j < (int) neighborList.getBlockExclusions(blockIndex).size(); j++) {
+            if ((neighborList.getBlockExclusions(blockIndex)[j] & mask) == 0) {
+                int atom1 = neighborList.getSortedAtoms()[i];
+                int atom2 = neighborList.getBlockNeighbors(blockIndex)[j];
+                pair<int, int> entry = make_pair(min(atom1, atom2), max(atom1, atom2));
+                ASSERT(neighbors.find(entry) == neighbors.end() && neighbors.find(make_pair(entry.second, entry.first)) == neighbors.end()); // No duplicates
+                neighbors.insert(entry);
+            }
+        }
+    }
+    
+    // Check each particle pair and figure out whether they should be in the neighbor list.
+
+    for (int i = 0; i < numParticles; i++)
+        for (int j = 0; j <= i; j++) {
+            bool shouldInclude = (exclusions[i].find(j) == exclusions[i].end());
+            Vec3 diff(positions[4*i]-positions[4*j], positions[4*i+1]-positions[4*j+1], positions[4*i+2]-positions[4*j+2]);
+            if (periodic) {
+                diff -= boxVectors[2]*floor(diff[2]/boxSize[2]+0.5);
+                diff -= boxVectors[1]*floor(diff[1]/boxSize[1]+0.5);
+                diff -= boxVectors[0]*floor(diff[0]/boxSize[0]+0.5);
+            }
+            if (diff.dot(diff) > cutoff*cutoff)
+                shouldInclude = false;
+            bool isIncluded = (neighbors.find(make_pair(i, j)) != neighbors.end() || neighbors.find(make_pair(j, i)) != neighbors.end());
+            if (shouldInclude)
+                ASSERT(isIncluded);
+        }
+}
+
+void testNeighborList(bool periodic, bool triclinic, int blockSize) {
     const int numParticles = 500;
     const float cutoff = 2.0f;
     Vec3 boxVectors[3];
@@ -63,7 +105,6 @@ void testNeighborList(bool periodic, bool triclinic) {
         boxVectors[2] = Vec3(0, 0, 11);
     }
     const float boxSize[3] = {(float) boxVectors[0][0], (float) boxVectors[1][1], (float) boxVectors[2][2]};
-    const int blockSize = 8;
     OpenMM_SFMT::SFMT sfmt;
     init_gen_rand(0, sfmt);
     AlignedArray<float> positions(4*numParticles);
@@ -81,42 +122,89 @@ void testNeighborList(bool periodic, bool triclinic) {
     ThreadPool threads;
     CpuNeighborList neighborList(blockSize);
     neighborList.computeNeighborList(numParticles, positions, exclusions, boxVectors, periodic, cutoff, threads);
+    verifyNeighborList(neighborList, numParticles, positions, exclusions, boxVectors, periodic, cutoff);
+}
+
+void testIncrementalUpdate(bool periodic, bool triclinic, int blockSize) {
+    const int numParticles = 500;
+    const float cutoff = 2.0f;
+    Vec3 boxVectors[3];
+    if (triclinic) {
+        boxVectors[0] = Vec3(10, 0, 0);
+        boxVectors[1] = Vec3(4, 9, 0);
+        boxVectors[2] = Vec3(-3, -3.5, 11);
+    }
+    else {
+        boxVectors[0] = Vec3(10, 0, 0);
+        boxVectors[1] = Vec3(0, 9, 0);
+        boxVectors[2] = Vec3(0, 0, 11);
+    }
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<Vec3> pos(numParticles);
+    for (int i = 0; i < numParticles; i++)
+        pos[i] = Vec3(10*genrand_real2(sfmt), 9*genrand_real2(sfmt), 11*genrand_real2(sfmt));
+    vector<set<int> > exclusions(numParticles);
+    for (int i = 0; i < numParticles; i++)
+        exclusions[i].insert(i);
+    ThreadPool threads;
+    CpuNeighborList neighborList(blockSize);
+    AlignedArray<float> positions(4*numParticles);
     
-    // Convert the neighbor list to a set for faster lookup.
+    // Repeatedly move the particles and update the neighbor list.  Each step moves some particles into a
+    // different voxel, and some across the periodic boundaries.
     
-    set<pair<int, int> > neighbors;
-    for (int i = 0; i < (int) neighborList.getSortedAtoms().size(); i++) {
-        int blockIndex = i/blockSize;
-        int indexInBlock = i-blockIndex*blockSize;
-        char mask = 1<<indexInBlock;
-        for (int j = 0; j < (int) neighborList.getBlockExclusions(blockIndex).size(); j++) {
-            if ((neighborList.getBlockExclusions(blockIndex)[j] & mask) == 0) {
-                int atom1 = neighborList.getSortedAtoms()[i];
-                int atom2 = neighborList.getBlockNeighbors(blockIndex)[j];
-                pair<int, int> entry = make_pair(min(atom1, atom2), max(atom1, atom2));
-                ASSERT(neighbors.find(entry) == neighbors.end() && neighbors.find(make_pair(entry.second, entry.first)) == neighbors.end()); // No duplicates
-                neighbors.insert(entry);
+    for (int step = 0; step < 10; step++) {
+        for (int i = 0; i < numParticles; i++) {
+            Vec3 p = pos[i];
+            if (periodic) {
+                p -= boxVectors[2]*floor(p[2]/boxVectors[2][2]);
+                p -= boxVectors[1]*floor(p[1]/boxVectors[1][1]);
+                p -= boxVectors[0]*floor(p[0]/boxVectors[0][0]);
+            }
+            for (int j = 0; j < 3; j++)
+                positions[4*i+j] = (float) p[j];
+        }
+        if (step == 0)
+            neighborList.computeNeighborList(numParticles, positions, exclusions, boxVectors, periodic, cutoff, threads);
+        else
+            neighborList.updateNeighborList(numParticles, positions, exclusions, boxVectors, periodic, cutoff, threads);
+        verifyNeighborList(neighborList, numParticles, positions, exclusions, boxVectors, periodic, cutoff);
+        for (int i = 0; i < numParticles; i++) {
+            pos[i] += Vec3(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5)*0.1;
+            if (!periodic) {
+                // Keep the particles inside the original region so the voxels can be reused.
+                
+                pos[i] = Vec3(max(0.5, min(9.5, pos[i][0])), max(0.5, min(8.5, pos[i][1])), max(0.5, min(10.5, pos[i][2])));
             }
         }
     }
-    
-    // Check each particle pair and figure out whether they should be in the neighbor list.
+}
 
+void testDistantParticle(int blockSize) {
+    // Without periodic boundary conditions, one particle very far from the others (as in a simulation that is
+    // blowing up) should not require a huge voxel grid.
+
+    const int numParticles = 500;
+    const float cutoff = 2.0f;
+    Vec3 boxVectors[3] = {Vec3(10, 0, 0), Vec3(0, 9, 0), Vec3(0, 0, 11)};
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    AlignedArray<float> positions(4*numParticles);
+    for (int i = 0; i < numParticles; i++) {
+        positions[4*i] = 10*genrand_real2(sfmt);
+        positions[4*i+1] = 9*genrand_real2(sfmt);
+        positions[4*i+2] = 11*genrand_real2(sfmt);
+    }
+    positions[5] = 1e6f;
+    positions[6] = -1e6f;
+    vector<set<int> > exclusions(numParticles);
     for (int i = 0; i < numParticles; i++)
-        for (int j = 0; j <= i; j++) {
-            bool shouldInclude = (exclusions[i].find(j) == exclusions[i].end());
-            Vec3 diff(positions[4*i]-positions[4*j], positions[4*i+1]-positions[4*j+1], positions[4*i+2]-positions[4*j+2]);
-            if (periodic) {
-                diff -= boxVectors[2]*floor(diff[2]/boxSize[2]+0.5);
-                diff -= boxVectors[1]*floor(diff[1]/boxSize[1]+0.5);
-                diff -= boxVectors[0]*floor(diff[0]/boxSize[0]+0.5);
-            }
-            if (diff.dot(diff) > cutoff*cutoff)
-                shouldInclude = false;
-            bool isIncluded = (neighbors.find(make_pair(i, j)) != neighbors.end() || neighbors.find(make_pair(j, i)) != neighbors.end());
-            if (shouldInclude)
-                ASSERT(isIncluded);
-        }
+        exclusions[i].insert(i);
+    ThreadPool threads;
+    CpuNeighborList neighborList(blockSize);
+    neighborList.computeNeighborList(numParticles, positions, exclusions, boxVectors, false, cutoff, threads);
+    verifyNeighborList(neighborList, numParticles, positions, exclusions, boxVectors, false, cutoff);
 }
 
 int main() {
@@ -125,9 +213,15 @@ int main() {
             cout << "CPU is not supported.  Exiting." << endl;
             return 0;
         }
-        testNeighborList(false, false);
-        testNeighborList(true, false);
-        testNeighborList(true, true);
+        for (int blockSize : {4, 8, 16}) {
+            testNeighborList(false, false, blockSize);
+            testNeighborList(true, false, blockSize);
+            testNeighborList(true, true, blockSize);
+            testIncrementalUpdate(false, false, blockSize);
+            testIncrementalUpdate(true, false, blockSize);
+            testIncrementalUpdate(true, true, blockSize);
+            testDistantParticle(blockSize);
+        }
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
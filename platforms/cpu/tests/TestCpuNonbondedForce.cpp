@@ -31,6 +31,302 @@
 
 #include "CpuTests.h"
 #include "TestNonbondedForce.h"
+#include "openmm/CustomBondForce.h"
+#include "openmm/CustomIntegrator.h"
+#include "openmm/CustomNonbondedForce.h"
+
+void testForceDecomposition(NonbondedForce::NonbondedMethod method) {
+    // Simulate a box of diatomic molecules with several threads, so that each thread accumulates forces only for
+    // its own region of space plus a halo, and compare the forces to the Reference platform at every step.
+
+    const int gridSize = 7;
+    const double spacing = 0.4;
+    const double boxSize = gridSize*spacing;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    system.addForce(nonbonded);
+    system.addForce(bonds);
+    nonbonded->setNonbondedMethod(method);
+    nonbonded->setCutoffDistance(0.8);
+    vector<Vec3> positions;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < gridSize*gridSize*gridSize; i++) {
+        system.addParticle(1.0);
+        system.addParticle(1.0);
+        nonbonded->addParticle(-0.5, 0.2, 0.5);
+        nonbonded->addParticle(0.5, 0.2, 0.5);
+        nonbonded->addException(2*i, 2*i+1, 0.0, 1.0, 0.0);
+        bonds->addBond(2*i, 2*i+1, 0.1, 10000.0);
+        Vec3 pos = Vec3(i%gridSize, (i/gridSize)%gridSize, i/(gridSize*gridSize))*spacing;
+        pos += Vec3(genrand_real2(sfmt), genrand_real2(sfmt), genrand_real2(sfmt))*0.1;
+        positions.push_back(pos);
+        positions.push_back(pos+Vec3(0.1, 0, 0));
+    }
+    VerletIntegrator integrator1(0.001);
+    VerletIntegrator integrator2(0.001);
+    ReferencePlatform reference;
+    map<string, string> properties;
+    properties[CpuPlatform::CpuThreads()] = "4";
+    Context context1(system, integrator1, reference);
+    Context context2(system, integrator2, platform, properties);
+    context1.setPositions(positions);
+    for (int step = 0; step < 10; step++) {
+        State state1 = context1.getState(State::Positions | State::Forces | State::Energy);
+        context2.setPositions(state1.getPositions());
+        State state2 = context2.getState(State::Forces | State::Energy);
+        ASSERT_EQUAL_TOL(state1.getPotentialEnergy(), state2.getPotentialEnergy(), 1e-4);
+        for (int i = 0; i < system.getNumParticles(); i++)
+            ASSERT_EQUAL_VEC(state1.getForces()[i], state2.getForces()[i], 1e-3);
+        integrator1.step(10);
+    }
+}
+
+void testEnergyOnly(NonbondedForce::NonbondedMethod method) {
+    // A CustomIntegrator step that only needs the energy evaluates it without forces.  Make sure the energy
+    // matches a full evaluation, and that nothing is left in the force buffers afterward.  Include bonded
+    // forces and 1-4 exceptions, since they also skip their force work.
+
+    const int numMolecules = 200;
+    const double boxSize = 3.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(method);
+    nonbonded->setCutoffDistance(0.9);
+    nonbonded->setUseSwitchingFunction(true);
+    nonbonded->setSwitchingDistance(0.8);
+    system.addForce(nonbonded);
+    CustomNonbondedForce* custom = new CustomNonbondedForce("a/r^6");
+    custom->addGlobalParameter("a", 0.001);
+    custom->setNonbondedMethod(method == NonbondedForce::NoCutoff ? CustomNonbondedForce::NoCutoff : CustomNonbondedForce::CutoffPeriodic);
+    custom->setCutoffDistance(0.9);
+    custom->setUseSwitchingFunction(true);
+    custom->setSwitchingDistance(0.8);
+    system.addForce(custom);
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    system.addForce(bonds);
+    CustomBondForce* customBonds = new CustomBondForce("k*(r-0.12)^4");
+    customBonds->addGlobalParameter("k", 1000.0);
+    system.addForce(customBonds);
+    vector<Vec3> positions;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numMolecules; i++) {
+        system.addParticle(1.0);
+        system.addParticle(1.0);
+        nonbonded->addParticle(-0.5, 0.2, 0.5);
+        nonbonded->addParticle(0.5, 0.2, 0.5);
+        nonbonded->addException(2*i, 2*i+1, -0.1, 0.1, 0.2);
+        custom->addParticle();
+        custom->addParticle();
+        custom->addExclusion(2*i, 2*i+1);
+        bonds->addBond(2*i, 2*i+1, 0.12, 500.0);
+        customBonds->addBond(2*i, 2*i+1);
+        Vec3 pos = Vec3(genrand_real2(sfmt), genrand_real2(sfmt), genrand_real2(sfmt))*boxSize;
+        positions.push_back(pos);
+        positions.push_back(pos+Vec3(0.1, 0, 0));
+    }
+    CustomIntegrator integrator(0.001);
+    integrator.addGlobalVariable("e", 0.0);
+    integrator.addComputeGlobal("e", "energy");
+    VerletIntegrator fullIntegrator(0.001);
+    Context context(system, integrator, platform);
+    Context fullContext(system, fullIntegrator, platform);
+    context.setPositions(positions);
+    fullContext.setPositions(positions);
+    State fullState = fullContext.getState(State::Forces | State::Energy);
+    for (int i = 0; i < 3; i++) {
+        integrator.step(1);
+        ASSERT_EQUAL_TOL(fullState.getPotentialEnergy(), integrator.getGlobalVariableByName("e"), 1e-5);
+    }
+    State state = context.getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(fullState.getPotentialEnergy(), state.getPotentialEnergy(), 1e-5);
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(fullState.getForces()[i], state.getForces()[i], 1e-4);
+}
+
+void testNeighborListPadding() {
+    // Simulate a periodic Lennard-Jones fluid with the default padding, a fixed padding, and automatic tuning, and make
+    // sure the forces are correct.
+
+    const int gridSize = 8;
+    const double spacing = 0.35;
+    const double boxSize = gridSize*spacing;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    system.addForce(nonbonded);
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(0.9);
+    vector<Vec3> positions;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < gridSize*gridSize*gridSize; i++) {
+        system.addParticle(40.0);
+        nonbonded->addParticle(0.0, 0.3, 1.0);
+        positions.push_back(Vec3(i%gridSize, (i/gridSize)%gridSize, i/(gridSize*gridSize))*spacing);
+    }
+    vector<Vec3> velocities(system.getNumParticles());
+    for (int i = 0; i < system.getNumParticles(); i++)
+        velocities[i] = Vec3(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5);
+    ReferencePlatform reference;
+    VerletIntegrator referenceIntegrator(0.002);
+    Context referenceContext(system, referenceIntegrator, reference);
+    ASSERT_EQUAL("", platform.getPropertyDefaultValue(CpuPlatform::CpuNeighborListPadding()));
+    for (string padding : {"", "0.05", "auto"}) {
+        map<string, string> properties;
+        if (padding != "")
+            properties[CpuPlatform::CpuNeighborListPadding()] = padding;
+        VerletIntegrator integrator(0.002);
+        Context context(system, integrator, platform, properties);
+        ASSERT_EQUAL(padding, platform.getPropertyValue(context, CpuPlatform::CpuNeighborListPadding()));
+        context.setPositions(positions);
+        context.setVelocities(velocities);
+        for (int i = 0; i < 10; i++) {
+            integrator.step(100);
+            State state = context.getState(State::Positions | State::Forces | State::Energy);
+            referenceContext.setPositions(state.getPositions());
+            State referenceState = referenceContext.getState(State::Forces | State::Energy);
+            ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), state.getPotentialEnergy(), 1e-4);
+            for (int j = 0; j < system.getNumParticles(); j++)
+                ASSERT_EQUAL_VEC(referenceState.getForces()[j], state.getForces()[j], 1e-3);
+        }
+    }
+
+    // An illegal value should throw an exception.
+
+    map<string, string> properties;
+    properties[CpuPlatform::CpuNeighborListPadding()] = "-1";
+    VerletIntegrator integrator(0.002);
+    bool threwException = false;
+    try {
+        Context context(system, integrator, platform, properties);
+    }
+    catch (const exception& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
+void testInstructionSet() {
+    // Compute forces with every instruction set the processor supports and compare them to the Reference platform.
+
+    const int numParticles = 600;
+    const double boxSize = 3.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    system.addForce(nonbonded);
+    nonbonded->setNonbondedMethod(NonbondedForce::Ewald);
+    nonbonded->setCutoffDistance(1.0);
+    vector<Vec3> positions;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.5 : -0.5, 0.2, 0.5);
+        positions.push_back(Vec3((i%10)*0.3+0.05*genrand_real2(sfmt), ((i/10)%10)*0.3+0.05*genrand_real2(sfmt), (i/100)*0.5+0.05*genrand_real2(sfmt)));
+    }
+    ReferencePlatform reference;
+    VerletIntegrator referenceIntegrator(0.001);
+    Context referenceContext(system, referenceIntegrator, reference);
+    referenceContext.setPositions(positions);
+    State referenceState = referenceContext.getState(State::Forces | State::Energy);
+    const string names[] = {"SSE4.1", "AVX", "AVX512"};
+    const int widths[] = {4, 8, 16};
+    for (int i = 0; i < 3; i++) {
+        map<string, string> properties;
+        properties[CpuPlatform::CpuInstructionSet()] = names[i];
+        VerletIntegrator integrator(0.001);
+        if (widths[i] > CpuPlatform::getMaxVectorWidth()) {
+            // Requesting an instruction set the processor doesn't support should throw an exception.
+
+            bool threwException = false;
+            try {
+                Context context(system, integrator, platform, properties);
+            }
+            catch (const exception& ex) {
+                threwException = true;
+            }
+            ASSERT(threwException);
+            continue;
+        }
+        Context context(system, integrator, platform, properties);
+        ASSERT_EQUAL(names[i], platform.getPropertyValue(context, CpuPlatform::CpuInstructionSet()));
+        context.setPositions(positions);
+        State state = context.getState(State::Forces | State::Energy);
+        ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), state.getPotentialEnergy(), 1e-4);
+        for (int j = 0; j < numParticles; j++)
+            ASSERT_EQUAL_VEC(referenceState.getForces()[j], state.getForces()[j], 1e-3);
+    }
+}
+
+void testPMEInterpolationOrder(NonbondedForce::NonbondedMethod method) {
+    // Compute reciprocal space forces with every supported interpolation order on a coarse grid and compare them
+    // to the Reference platform.  The grid is coarse enough that the order visibly changes the energy.
+
+    const int numParticles = 300;
+    const double boxSize = 2.5;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    system.addForce(nonbonded);
+    nonbonded->setNonbondedMethod(method);
+    nonbonded->setCutoffDistance(0.8);
+    nonbonded->setPMEParameters(3.5, 12, 12, 12);
+    nonbonded->setLJPMEParameters(2.5, 12, 12, 12);
+    nonbonded->setReciprocalSpaceForceGroup(1);
+    vector<Vec3> positions;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.5 : -0.5, 0.2, 0.5);
+        positions.push_back(Vec3(genrand_real2(sfmt), genrand_real2(sfmt), genrand_real2(sfmt))*boxSize);
+    }
+    ReferencePlatform reference;
+    double lastEnergy = 0.0;
+    for (int order = 4; order <= 8; order++) {
+        nonbonded->setPMEInterpolationOrder(order);
+        VerletIntegrator integrator1(0.001);
+        VerletIntegrator integrator2(0.001);
+        Context context1(system, integrator1, reference);
+        Context context2(system, integrator2, platform);
+        context1.setPositions(positions);
+        context2.setPositions(positions);
+        State state1 = context1.getState(State::Forces | State::Energy, false, 1<<1);
+        State state2 = context2.getState(State::Forces | State::Energy, false, 1<<1);
+        ASSERT_EQUAL_TOL(state1.getPotentialEnergy(), state2.getPotentialEnergy(), 1e-4);
+        for (int i = 0; i < numParticles; i++)
+            ASSERT_EQUAL_VEC(state1.getForces()[i], state2.getForces()[i], 1e-3);
+        if (order > 4)
+            ASSERT(fabs(state1.getPotentialEnergy()-lastEnergy) > 1e-3*fabs(lastEnergy));
+        lastEnergy = state1.getPotentialEnergy();
+    }
+
+    // Orders outside the supported range should be rejected.
+
+    bool threwException = false;
+    try {
+        nonbonded->setPMEInterpolationOrder(9);
+    }
+    catch (const exception& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
 
 void runPlatformTests() {
+    testNeighborListPadding();
+    testInstructionSet();
+    testForceDecomposition(NonbondedForce::CutoffPeriodic);
+    testForceDecomposition(NonbondedForce::PME);
+    testEnergyOnly(NonbondedForce::NoCutoff);
+    testEnergyOnly(NonbondedForce::CutoffPeriodic);
+    testEnergyOnly(NonbondedForce::PME);
+    testPMEInterpolationOrder(NonbondedForce::PME);
+    testPMEInterpolationOrder(NonbondedForce::LJPME);
 }
@@ -31,6 +31,63 @@
 
 #include "CpuTests.h"
 #include "TestSettle.h"
+#include "CpuSETTLE.h"
+#include "openmm/internal/ThreadPool.h"
+
+void testCompareToReference(bool useVec8) {
+    // Compare CpuSETTLE to ReferenceSETTLEAlgorithm on a number of clusters that is not a multiple
+    // of the vector width, so the partially filled group at the end is also tested.
+
+    const int numMolecules = 37;
+    const int numParticles = numMolecules*3;
+    System system;
+    vector<int> atom1, atom2, atom3;
+    vector<double> distance1, distance2, masses;
+    vector<Vec3> positions(numParticles);
+    for (int i = 0; i < numMolecules; i++) {
+        atom1.push_back(system.addParticle(16.0));
+        atom2.push_back(system.addParticle(1.0));
+        atom3.push_back(system.addParticle(1.0));
+        distance1.push_back(0.1);
+        distance2.push_back(0.163);
+        positions[i*3] = Vec3((i%4)*0.4, ((i/4)%4)*0.4, (i/16)*0.4);
+        positions[i*3+1] = positions[i*3]+Vec3(0.1, 0, 0);
+        positions[i*3+2] = positions[i*3]+Vec3(-0.03333, 0.09428, 0);
+    }
+    vector<double> inverseMasses;
+    for (int i = 0; i < numParticles; i++) {
+        masses.push_back(system.getParticleMass(i));
+        inverseMasses.push_back(1.0/masses[i]);
+    }
+    ReferenceSETTLEAlgorithm referenceSettle(atom1, atom2, atom3, distance1, distance2, masses);
+    ThreadPool threads(3);
+    CpuSETTLE cpuSettle(system, referenceSettle, threads, useVec8);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+
+    // Constrain perturbed positions with both implementations.
+
+    vector<Vec3> referencePos(numParticles), cpuPos(numParticles);
+    for (int i = 0; i < numParticles; i++)
+        referencePos[i] = cpuPos[i] = positions[i]+Vec3(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5)*0.01;
+    referenceSettle.apply(positions, referencePos, inverseMasses, 1e-5);
+    cpuSettle.apply(positions, cpuPos, inverseMasses, 1e-5);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(referencePos[i], cpuPos[i], 1e-5);
+
+    // Constrain random velocities with both implementations.
+
+    vector<Vec3> referenceVel(numParticles), cpuVel(numParticles);
+    for (int i = 0; i < numParticles; i++)
+        referenceVel[i] = cpuVel[i] = Vec3(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5);
+    referenceSettle.applyToVelocities(positions, referenceVel, inverseMasses, 1e-5);
+    cpuSettle.applyToVelocities(positions, cpuVel, inverseMasses, 1e-5);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(referenceVel[i], cpuVel[i], 1e-4);
+}
 
 void runPlatformTests() {
+    testCompareToReference(false);
+    if (CpuPlatform::getMaxVectorWidth() >= 8)
+        testCompareToReference(true);
 }
@@ -0,0 +1,101 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2018 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuTests.h"
+#include "TestVerletIntegrator.h"
+#include "openmm/HarmonicAngleForce.h"
+
+void testLargeConstraintCluster() {
+    // Create a long chain with every bond constrained, plus a set of small independent clusters.
+    // With multiple threads, the chain is solved in parallel by all threads while the small
+    // clusters are each solved by a single thread.
+
+    const int chainLength = 500;
+    const int numPairs = 100;
+    System system;
+    HarmonicAngleForce* angles = new HarmonicAngleForce();
+    system.addForce(angles);
+    vector<Vec3> positions;
+    double bondLength = sqrt(0.0125);
+    for (int i = 0; i < chainLength; i++) {
+        system.addParticle(i%3 == 0 ? 12.0 : 1.0);
+        positions.push_back(Vec3(0.1*i, 0.05*(i%2), 0));
+        if (i > 0)
+            system.addConstraint(i-1, i, bondLength);
+        if (i > 1)
+            angles->addAngle(i-2, i-1, i, acos(-0.6), 100.0);
+    }
+    for (int i = 0; i < numPairs; i++) {
+        int first = system.addParticle(12.0);
+        int second = system.addParticle(1.0);
+        positions.push_back(Vec3(0.3*i, 1.0, 0));
+        positions.push_back(Vec3(0.3*i+0.1, 1.0, 0));
+        system.addConstraint(first, second, 0.1);
+    }
+    int numParticles = system.getNumParticles();
+    VerletIntegrator integrator(0.001);
+    integrator.setConstraintTolerance(1e-5);
+    map<string, string> properties;
+    properties[CpuPlatform::CpuThreads()] = "4";
+    Context context(system, integrator, platform, properties);
+    context.setPositions(positions);
+    vector<Vec3> velocities(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; ++i)
+        velocities[i] = Vec3(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5);
+    context.setVelocities(velocities);
+    context.applyVelocityConstraints(1e-5);
+
+    // Simulate it and see whether the constraints remain satisfied.
+
+    double initialEnergy = 0.0;
+    for (int i = 0; i < 200; ++i) {
+        State state = context.getState(State::Positions | State::Energy);
+        for (int j = 0; j < system.getNumConstraints(); ++j) {
+            int particle1, particle2;
+            double distance;
+            system.getConstraintParameters(j, particle1, particle2, distance);
+            Vec3 delta = state.getPositions()[particle1]-state.getPositions()[particle2];
+            ASSERT_EQUAL_TOL(distance, sqrt(delta.dot(delta)), 2e-5);
+        }
+        double energy = state.getPotentialEnergy()+state.getKineticEnergy();
+        if (i == 1)
+            initialEnergy = energy;
+        else if (i > 1)
+            ASSERT_EQUAL_TOL(initialEnergy, energy, 0.01);
+        integrator.step(1);
+    }
+}
+
+void runPlatformTests() {
+    testLargeConstraintCluster();
+}
@@ -1469,7 +1469,7 @@ public:
     }
     void computeForceAndEnergy(bool includeForces, bool includeEnergy, int groups) {
         Vec3 boxVectors[3] = {Vec3(cu.getPeriodicBoxSize().x, 0, 0), Vec3(0, cu.getPeriodicBoxSize().y, 0), Vec3(0, 0, cu.getPeriodicBoxSize().z)};
-        pme.getAs<CalcPmeReciprocalForceKernel>().beginComputation(io, boxVectors, includeEnergy);
+        pme.getAs<CalcPmeReciprocalForceKernel>().beginComputation(io, boxVectors, includeForces, includeEnergy);
     }
 private:
     CudaContext& cu;
@@ -1559,6 +1559,9 @@ CudaCalcNonbondedForceKernel::~CudaCalcNonbondedForceKernel() {
 void CudaCalcNonbondedForceKernel::initialize(const System& system, const NonbondedForce& force) {
     cu.setAsCurrent();
 
+    if ((force.getNonbondedMethod() == NonbondedForce::PME || force.getNonbondedMethod() == NonbondedForce::LJPME) && force.getPMEInterpolationOrder() != PmeOrder)
+        throw OpenMMException("NonbondedForce: this platform only supports a PME interpolation order of "+cu.intToString(PmeOrder));
+
     // Identify which exceptions are 1-4 interactions.
 
     vector<pair<int, int> > exclusions;
@@ -1722,7 +1725,7 @@ void CudaCalcNonbondedForceKernel::initialize(const System& system, const Nonbon
 
                 try {
                     cpuPme = getPlatform().createKernel(CalcPmeReciprocalForceKernel::Name(), *cu.getPlatformData().context);
-                    cpuPme.getAs<CalcPmeReciprocalForceKernel>().initialize(gridSizeX, gridSizeY, gridSizeZ, numParticles, alpha, cu.getPlatformData().deterministicForces);
+                    cpuPme.getAs<CalcPmeReciprocalForceKernel>().initialize(gridSizeX, gridSizeY, gridSizeZ, PmeOrder, numParticles, alpha, cu.getPlatformData().deterministicForces);
                     CUfunction addForcesKernel = cu.getKernel(module, "addForces");
                     pmeio = new PmeIO(cu, addForcesKernel);
                     cu.addPreComputation(new PmePreComputation(cu, cpuPme, *pmeio));
@@ -1861,7 +1864,7 @@ void CudaCalcNonbondedForceKernel::initialize(const System& system, const Nonbon
                     int maxSize = max(max(xsize, ysize), zsize);
                     vector<double> data(PmeOrder);
                     vector<double> ddata(PmeOrder);
-                    vector<double> bsplines_data(maxSize);
+                    vector<double> bsplines_data(max(maxSize, PmeOrder+1));
                     data[PmeOrder-1] = 0.0;
                     data[1] = 0.0;
                     data[0] = 1.0;
@@ -1471,7 +1471,7 @@ public:
     }
     void computeForceAndEnergy(bool includeForces, bool includeEnergy, int groups) {
         Vec3 boxVectors[3] = {Vec3(cl.getPeriodicBoxSize().x, 0, 0), Vec3(0, cl.getPeriodicBoxSize().y, 0), Vec3(0, 0, cl.getPeriodicBoxSize().z)};
-        pme.getAs<CalcPmeReciprocalForceKernel>().beginComputation(io, boxVectors, includeEnergy);
+        pme.getAs<CalcPmeReciprocalForceKernel>().beginComputation(io, boxVectors, includeForces, includeEnergy);
     }
 private:
     OpenCLContext& cl;
@@ -1551,6 +1551,9 @@ OpenCLCalcNonbondedForceKernel::~OpenCLCalcNonbondedForceKernel() {
 
 void OpenCLCalcNonbondedForceKernel::initialize(const System& system, const NonbondedForce& force) {
 
+    if ((force.getNonbondedMethod() == NonbondedForce::PME || force.getNonbondedMethod() == NonbondedForce::LJPME) && force.getPMEInterpolationOrder() != PmeOrder)
+        throw OpenMMException("NonbondedForce: this platform only supports a PME interpolation order of "+cl.intToString(PmeOrder));
+
     // Identify which exceptions are 1-4 interactions.
 
     vector<pair<int, int> > exclusions;
@@ -1701,7 +1704,7 @@ void OpenCLCalcNonbondedForceKernel::initialize(const System& system, const Nonb
 
                 try {
                     cpuPme = getPlatform().createKernel(CalcPmeReciprocalForceKernel::Name(), *cl.getPlatformData().context);
-                    cpuPme.getAs<CalcPmeReciprocalForceKernel>().initialize(gridSizeX, gridSizeY, gridSizeZ, numParticles, alpha, false);
+                    cpuPme.getAs<CalcPmeReciprocalForceKernel>().initialize(gridSizeX, gridSizeY, gridSizeZ, PmeOrder, numParticles, alpha, false);
                     cl::Program program = cl.createProgram(OpenCLKernelSources::pme, pmeDefines);
                     cl::Kernel addForcesKernel = cl::Kernel(program, "addForces");
                     pmeio = new PmeIO(cl, addForcesKernel);
@@ -1793,7 +1796,7 @@ void OpenCLCalcNonbondedForceKernel::initialize(const System& system, const Nonb
                     int maxSize = max(max(xsize, ysize), zsize);
                     vector<double> data(PmeOrder);
                     vector<double> ddata(PmeOrder);
-                    vector<double> bsplines_data(maxSize);
+                    vector<double> bsplines_data(max(maxSize, PmeOrder+1));
                     data[PmeOrder-1] = 0.0;
                     data[1] = 0.0;
                     data[0] = 1.0;
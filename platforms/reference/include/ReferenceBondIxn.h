@@ -51,7 +51,7 @@ class OPENMM_EXPORT ReferenceBondIxn {
       
          --------------------------------------------------------------------------------------- */
 
-       ~ReferenceBondIxn();
+       virtual ~ReferenceBondIxn();
 
       /**---------------------------------------------------------------------------------------
       
@@ -69,6 +69,18 @@ class OPENMM_EXPORT ReferenceBondIxn {
                                     double* parameters, std::vector<OpenMM::Vec3>& forces,
                                     double* totalEnergy, double* energyParamDerivs);
       
+      /**---------------------------------------------------------------------------------------
+      
+         Set whether calculateBondIxn() should compute forces.  If this is false, only the
+         energy and its derivatives with respect to parameters are computed.  The default
+         is true.
+      
+         @param includeForces    true if forces should be computed
+      
+         --------------------------------------------------------------------------------------- */
+      
+      void setIncludeForces(bool includeForces);
+      
       /**---------------------------------------------------------------------------------------
       
          Get normed dot product between two vectors
@@ -124,6 +136,10 @@ class OPENMM_EXPORT ReferenceBondIxn {
                                                         double* cosineOfAngle, double* signVector, 
                                                         double* signOfAngle, int hasREntry);
       
+   protected:
+
+      bool includeForces;
+      
 };
 
 } // namespace OpenMM
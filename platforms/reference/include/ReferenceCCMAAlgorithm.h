@@ -78,6 +78,16 @@ public:
      */
     int getNumberOfConstraints() const;
 
+    /**
+     * Get the parameters describing one constraint.
+     *
+     * @param index     the index of the constraint
+     * @param atom1     the index of the first atom in the constraint
+     * @param atom2     the index of the second atom in the constraint
+     * @param distance  the constrained distance between the two atoms
+     */
+    void getConstraintParameters(int index, int& atom1, int& atom2, double& distance) const;
+
     /**
      * Get the maximum number of iterations to perform.
      */
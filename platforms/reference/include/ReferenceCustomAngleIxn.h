@@ -29,7 +29,7 @@
 
 namespace OpenMM {
 
-class ReferenceCustomAngleIxn : public ReferenceBondIxn {
+class OPENMM_EXPORT ReferenceCustomAngleIxn : public ReferenceBondIxn {
 
    private:
       Lepton::CompiledExpression energyExpression;
@@ -72,6 +72,16 @@ class ReferenceCustomAngleIxn : public ReferenceBondIxn {
       
       void setPeriodic(OpenMM::Vec3* vectors);
 
+      /**---------------------------------------------------------------------------------------
+
+         Set the values of global parameters.
+
+         @param globalParameters  the values of all global parameters, keyed by name
+
+         --------------------------------------------------------------------------------------- */
+
+      void setGlobalParameters(std::map<std::string, double> globalParameters);
+
       /**---------------------------------------------------------------------------------------
 
          Calculate Custom Angle Ixn
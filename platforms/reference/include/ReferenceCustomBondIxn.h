@@ -30,7 +30,7 @@
 
 namespace OpenMM {
 
-class ReferenceCustomBondIxn : public ReferenceBondIxn {
+class OPENMM_EXPORT ReferenceCustomBondIxn : public ReferenceBondIxn {
 
    private:
       Lepton::CompiledExpression energyExpression;
@@ -73,6 +73,16 @@ class ReferenceCustomBondIxn : public ReferenceBondIxn {
       
       void setPeriodic(OpenMM::Vec3* vectors);
 
+      /**---------------------------------------------------------------------------------------
+
+         Set the values of global parameters.
+
+         @param globalParameters  the values of all global parameters, keyed by name
+
+         --------------------------------------------------------------------------------------- */
+
+      void setGlobalParameters(std::map<std::string, double> globalParameters);
+
       /**---------------------------------------------------------------------------------------
 
          Calculate Custom Bond Ixn
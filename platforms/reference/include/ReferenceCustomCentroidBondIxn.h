@@ -61,14 +61,14 @@ class ReferenceCustomCentroidBondIxn : public ReferenceBondIxn {
 
          Calculate custom interaction for one bond
 
-         @param bond             the index of the bond
+         @param groups           the indices of the groups in the bond
          @param groupCenters     group center coordinates
          @param forces           force array (forces added)
          @param totalEnergy      total energy
 
          --------------------------------------------------------------------------------------- */
 
-      void calculateOneIxn(int bond, std::vector<OpenMM::Vec3>& groupCenters,
+      void calculateOneIxn(const int* groups, std::vector<OpenMM::Vec3>& groupCenters,
                            std::vector<OpenMM::Vec3>& forces, double* totalEnergy, double* energyParamDerivs);
 
       void computeDelta(int group1, int group2, double* delta, std::vector<OpenMM::Vec3>& groupCenters) const;
@@ -134,6 +134,36 @@ class ReferenceCustomCentroidBondIxn : public ReferenceBondIxn {
                             const std::map<std::string, double>& globalParameters,
                             std::vector<OpenMM::Vec3>& forces, double* totalEnergy, double* energyParamDerivs);
 
+      /**---------------------------------------------------------------------------------------
+
+         Set the values of global parameters.  This is needed when bonds are evaluated
+         one at a time with calculateBondIxn().
+
+         @param globalParameters  the values of all global parameters, keyed by name
+
+         --------------------------------------------------------------------------------------- */
+
+      void setGlobalParameters(const std::map<std::string, double>& globalParameters);
+
+      /**---------------------------------------------------------------------------------------
+
+         Calculate the interaction for a single bond, given the centers of the groups rather than
+         the atom positions.  Forces are applied to the groups; distributing them to atoms is left
+         to the caller.  Global parameters must already have been set with setGlobalParameters().
+
+         @param groupIndices     the indices of the groups in the bond
+         @param groupCenters     the center of every group
+         @param parameters       the parameter values for the bond
+         @param groupForces      forces on groups (forces added)
+         @param totalEnergy      if not null, the energy will be added to this
+         @param energyParamDerivs  derivatives of the energy with respect to parameters are added to this
+
+         --------------------------------------------------------------------------------------- */
+
+      void calculateBondIxn(int* groupIndices, std::vector<OpenMM::Vec3>& groupCenters,
+                            double* parameters, std::vector<OpenMM::Vec3>& groupForces,
+                            double* totalEnergy, double* energyParamDerivs);
+
 // ---------------------------------------------------------------------------------------
 
 };
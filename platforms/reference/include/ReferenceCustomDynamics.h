@@ -30,6 +30,7 @@
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/internal/CustomIntegratorUtilities.h"
 #include "openmm/internal/CompiledExpressionSet.h"
+#include "openmm/internal/windowsExport.h"
 #include "lepton/CompiledExpression.h"
 
 #include <map>
@@ -38,8 +39,8 @@
 
 namespace OpenMM {
 
-class ReferenceCustomDynamics : public ReferenceDynamics {
-private:
+class OPENMM_EXPORT ReferenceCustomDynamics : public ReferenceDynamics {
+protected:
 
     class DerivFunction;
     const OpenMM::CustomIntegrator& integrator;
@@ -60,11 +61,22 @@ private:
     std::vector<int> perDofVariableIndex, stepVariableIndex;
     std::vector<double> perDofVariable;
 
-    void initialize(OpenMM::ContextImpl& context, std::vector<double>& masses, std::map<std::string, double>& globals);
+    virtual void initialize(OpenMM::ContextImpl& context, std::vector<double>& masses, std::map<std::string, double>& globals);
     
     Lepton::ExpressionTreeNode replaceDerivFunctions(const Lepton::ExpressionTreeNode& node, OpenMM::ContextImpl& context);
     
-    void computePerDof(int numberOfAtoms, std::vector<OpenMM::Vec3>& results, const std::vector<OpenMM::Vec3>& atomCoordinates,
+    /**
+     * Evaluate a per-DOF expression for every degree of freedom, storing the values in results.
+     */
+    virtual void computePerDof(int numberOfAtoms, std::vector<OpenMM::Vec3>& results, const std::vector<OpenMM::Vec3>& atomCoordinates,
+                  const std::vector<OpenMM::Vec3>& velocities, const std::vector<OpenMM::Vec3>& forces, const std::vector<double>& masses,
+                  const std::vector<std::vector<OpenMM::Vec3> >& perDof, const Lepton::CompiledExpression& expression);
+    
+    /**
+     * Evaluate a per-DOF expression for every degree of freedom and return the sum of the values.
+     * Particles with zero mass are omitted from the sum.
+     */
+    virtual double computeSum(int numberOfAtoms, const std::vector<OpenMM::Vec3>& atomCoordinates,
                   const std::vector<OpenMM::Vec3>& velocities, const std::vector<OpenMM::Vec3>& forces, const std::vector<double>& masses,
                   const std::vector<std::vector<OpenMM::Vec3> >& perDof, const Lepton::CompiledExpression& expression);
     
@@ -91,7 +103,7 @@ public:
       
          --------------------------------------------------------------------------------------- */
 
-       ~ReferenceCustomDynamics();
+       virtual ~ReferenceCustomDynamics();
 
       /**---------------------------------------------------------------------------------------
       
@@ -27,11 +27,12 @@
 
 #include "ReferenceCustomExternalIxn.h"
 #include "openmm/Vec3.h"
+#include "openmm/internal/windowsExport.h"
 #include "lepton/CompiledExpression.h"
 
 namespace OpenMM {
 
-class ReferenceCustomExternalIxn {
+class OPENMM_EXPORT ReferenceCustomExternalIxn {
 
    private:
       Lepton::CompiledExpression energyExpression;
@@ -68,6 +69,16 @@ class ReferenceCustomExternalIxn {
 
        ~ReferenceCustomExternalIxn();
 
+      /**---------------------------------------------------------------------------------------
+
+         Set the values of global parameters.
+
+         @param globalParameters  the values of all global parameters, keyed by name
+
+         --------------------------------------------------------------------------------------- */
+
+      void setGlobalParameters(std::map<std::string, double> globalParameters);
+
       /**---------------------------------------------------------------------------------------
 
          Calculate Custom External Force
@@ -77,11 +88,12 @@ class ReferenceCustomExternalIxn {
          @param parameters       parameter values
          @param forces           force array (forces added)
          @param energy           energy is added to this
+         @param includeForces    true if forces should be computed
 
          --------------------------------------------------------------------------------------- */
 
       void calculateForce(int atomIndex, std::vector<OpenMM::Vec3>& atomCoordinates,
-                          double* parameters, std::vector<OpenMM::Vec3>& forces, double* energy) const;
+                          double* parameters, std::vector<OpenMM::Vec3>& forces, double* energy, bool includeForces) const;
 
 
 };
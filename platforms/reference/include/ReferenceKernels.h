@@ -619,7 +619,7 @@ private:
     int **bonded14IndexArray;
     double **particleParamArray, **bonded14ParamArray;
     double nonbondedCutoff, switchingDistance, rfDielectric, ewaldAlpha, ewaldDispersionAlpha, dispersionCoefficient;
-    int kmax[3], gridSize[3], dispersionGridSize[3];
+    int kmax[3], gridSize[3], dispersionGridSize[3], pmeOrder;
     bool useSwitchingFunction;
     std::vector<std::set<int> > exclusions;
     NonbondedMethod nonbondedMethod;
@@ -794,8 +794,12 @@ public:
      * @param force      the CustomExternalForce to copy the parameters from
      */
     void copyParametersToContext(ContextImpl& context, const CustomExternalForce& force);
-private:
+    /**
+     * The function used to evaluate periodicdistance() in the energy expression.  It is also used by
+     * the CPU platform.
+     */
     class PeriodicDistanceFunction;
+private:
     int numParticles;
     std::vector<int> particles;
     double **particleParamArray;
@@ -804,7 +808,7 @@ private:
     Vec3* boxVectors;
 };
 
-class ReferenceCalcCustomExternalForceKernel::PeriodicDistanceFunction : public Lepton::CustomFunction {
+class OPENMM_EXPORT ReferenceCalcCustomExternalForceKernel::PeriodicDistanceFunction : public Lepton::CustomFunction {
 public:
     Vec3** boxVectorHandle;
     PeriodicDistanceFunction(Vec3** boxVectorHandle);
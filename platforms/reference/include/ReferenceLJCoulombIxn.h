@@ -46,6 +46,7 @@ class ReferenceLJCoulombIxn {
       double alphaEwald, alphaDispersionEwald;
       int numRx, numRy, numRz;
       int meshDim[3], dispersionMeshDim[3];
+      int pmeOrder;
 
       // parameter indices
 
@@ -160,6 +161,16 @@ class ReferenceLJCoulombIxn {
 
       void setUseLJPME(double dalpha, int dmeshSize[3]);
 
+      /**---------------------------------------------------------------------------------------
+
+         Set the B-spline interpolation order used for PME and LJPME.  The default is 5.
+
+         @param order    the interpolation order
+
+         --------------------------------------------------------------------------------------- */
+
+      void setPMEInterpolationOrder(int order);
+
       /**---------------------------------------------------------------------------------------
       
          Calculate LJ Coulomb pair ixn
@@ -26,12 +26,13 @@
 #define __ReferenceVariableStochasticDynamics_H__
 
 #include "ReferenceDynamics.h"
+#include "openmm/internal/windowsExport.h"
 
 namespace OpenMM {
 
-class ReferenceVariableStochasticDynamics : public ReferenceDynamics {
+class OPENMM_EXPORT ReferenceVariableStochasticDynamics : public ReferenceDynamics {
 
-   private:
+   protected:
 
       std::vector<OpenMM::Vec3> xPrime;
       std::vector<double> inverseMasses;
@@ -103,6 +104,20 @@ class ReferenceVariableStochasticDynamics : public ReferenceDynamics {
       void update(const OpenMM::System& system, std::vector<OpenMM::Vec3>& atomCoordinates,
                   std::vector<OpenMM::Vec3>& velocities, std::vector<OpenMM::Vec3>& forces, std::vector<double>& masses, double maxStepSize, double tolerance);
 
+      /**---------------------------------------------------------------------------------------
+
+         Estimate the integration error, which is used to select the step size
+
+         @param numberOfAtoms       number of atoms
+         @param forces              forces
+         @param inverseMasses       inverse atom masses
+
+         @return the RMS value of inverseMass*force over all degrees of freedom
+
+         --------------------------------------------------------------------------------------- */
+
+      virtual double computeErrorEstimate(int numberOfAtoms, std::vector<OpenMM::Vec3>& forces, std::vector<double>& inverseMasses);
+
       /**---------------------------------------------------------------------------------------
 
          First update; based on code in update.c do_update_sd() Gromacs 3.1.4
@@ -111,16 +126,13 @@ class ReferenceVariableStochasticDynamics : public ReferenceDynamics {
          @param atomCoordinates     atom coordinates
          @param velocities          velocities
          @param forces              forces
-         @param masses              atom masses
          @param inverseMasses       inverse atom masses
          @param xPrime              xPrime
-         @param maxStepSize         maximum time step
 
          --------------------------------------------------------------------------------------- */
 
-      void updatePart1(int numberOfAtoms, std::vector<OpenMM::Vec3>& atomCoordinates, std::vector<OpenMM::Vec3>& velocities,
-                       std::vector<OpenMM::Vec3>& forces, std::vector<double>& masses, std::vector<double>& inverseMasses,
-                       std::vector<OpenMM::Vec3>& xPrime, double maxStepSize);
+      virtual void updatePart1(int numberOfAtoms, std::vector<OpenMM::Vec3>& atomCoordinates, std::vector<OpenMM::Vec3>& velocities,
+                       std::vector<OpenMM::Vec3>& forces, std::vector<double>& inverseMasses, std::vector<OpenMM::Vec3>& xPrime);
 
       /**---------------------------------------------------------------------------------------
 
@@ -130,14 +142,30 @@ class ReferenceVariableStochasticDynamics : public ReferenceDynamics {
          @param atomCoordinates     atom coordinates
          @param velocities          velocities
          @param forces              forces
-         @param masses              atom masses
+         @param inverseMasses       inverse atom masses
+         @param xPrime              xPrime
 
          --------------------------------------------------------------------------------------- */
 
-      void updatePart2(int numberOfAtoms, std::vector<OpenMM::Vec3>& atomCoordinates, std::vector<OpenMM::Vec3>& velocities,
+      virtual void updatePart2(int numberOfAtoms, std::vector<OpenMM::Vec3>& atomCoordinates, std::vector<OpenMM::Vec3>& velocities,
                        std::vector<OpenMM::Vec3>& forces, std::vector<double>& inverseMasses,
                        std::vector<OpenMM::Vec3>& xPrime);
-      
+
+      /**---------------------------------------------------------------------------------------
+
+         Third update: compute the velocities from the constrained positions and copy xPrime
+         into atomCoordinates
+
+         @param numberOfAtoms       number of atoms
+         @param atomCoordinates     atom coordinates
+         @param velocities          velocities
+         @param inverseMasses       inverse atom masses
+         @param xPrime              xPrime
+
+         --------------------------------------------------------------------------------------- */
+
+      virtual void updatePart3(int numberOfAtoms, std::vector<OpenMM::Vec3>& atomCoordinates, std::vector<OpenMM::Vec3>& velocities,
+                       std::vector<double>& inverseMasses, std::vector<OpenMM::Vec3>& xPrime);
 };
 
 } // namespace OpenMM
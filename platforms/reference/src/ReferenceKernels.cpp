@@ -982,6 +982,7 @@ void ReferenceCalcNonbondedForceKernel::initialize(const System& system, const N
         ewaldDispersionAlpha = alpha;
         useSwitchingFunction = false;
     }
+    pmeOrder = force.getPMEInterpolationOrder();
     rfDielectric = force.getReactionFieldDielectric();
     if (force.getUseDispersionCorrection())
         dispersionCoefficient = NonbondedForceImpl::calcDispersionCorrection(system, force);
@@ -1017,6 +1018,8 @@ double ReferenceCalcNonbondedForceKernel::execute(ContextImpl& context, bool inc
         clj.setUsePME(ewaldAlpha, gridSize);
         clj.setUseLJPME(ewaldDispersionAlpha, dispersionGridSize);
     }
+    if (pme || ljpme)
+        clj.setPMEInterpolationOrder(pmeOrder);
     if (useSwitchingFunction)
         clj.setUseSwitchingFunction(switchingDistance);
     clj.calculatePairIxn(numParticles, posData, particleParamArray, exclusions, 0, forceData, 0, includeEnergy ? &energy : NULL, includeDirect, includeReciprocal);
@@ -1600,7 +1603,7 @@ double ReferenceCalcCustomExternalForceKernel::execute(ContextImpl& context, boo
         globalParameters[name] = context.getParameter(name);
     ReferenceCustomExternalIxn force(energyExpression, forceExpressionX, forceExpressionY, forceExpressionZ, parameterNames, globalParameters);
     for (int i = 0; i < numParticles; ++i)
-        force.calculateForce(particles[i], posData, particleParamArray[i], forceData, includeEnergy ? &energy : NULL);
+        force.calculateForce(particles[i], posData, particleParamArray[i], forceData, includeEnergy ? &energy : NULL, includeForces);
     return energy;
 }
 
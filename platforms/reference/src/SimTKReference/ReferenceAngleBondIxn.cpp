@@ -140,6 +140,13 @@ void ReferenceAngleBondIxn::calculateBondIxn(int* atomIndices,
    double energy;
    getPrefactorsGivenAngleCosine(cosine, parameters, &dEdR, &energy);
 
+   // accumulate energies
+
+   if (totalEnergy != NULL)
+       *totalEnergy += energy;
+   if (!includeForces)
+       return;
+
    double termA           =  dEdR/(deltaR[0][ReferenceForce::R2Index]*rp);
    double termC           = -dEdR/(deltaR[1][ReferenceForce::R2Index]*rp);
 
@@ -160,9 +167,4 @@ void ReferenceAngleBondIxn::calculateBondIxn(int* atomIndices,
          forces[atomIndices[jj]][ii] += deltaCrossP[jj][ii];
       }   
    }   
-
-   // accumulate energies
-
-   if (totalEnergy != NULL)
-       *totalEnergy += energy;
 }
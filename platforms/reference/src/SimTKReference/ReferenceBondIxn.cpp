@@ -38,7 +38,7 @@ using namespace OpenMM;
 
    --------------------------------------------------------------------------------------- */
 
-ReferenceBondIxn::ReferenceBondIxn() {
+ReferenceBondIxn::ReferenceBondIxn() : includeForces(true) {
 }
 
 /**---------------------------------------------------------------------------------------
@@ -50,6 +50,18 @@ ReferenceBondIxn::ReferenceBondIxn() {
 ReferenceBondIxn::~ReferenceBondIxn() {
 }
 
+/**---------------------------------------------------------------------------------------
+
+   Set whether calculateBondIxn() should compute forces
+
+   @param includeForces    true if forces should be computed
+
+   --------------------------------------------------------------------------------------- */
+
+void ReferenceBondIxn::setIncludeForces(bool includeForces) {
+    this->includeForces = includeForces;
+}
+
 /**---------------------------------------------------------------------------------------
       
    Calculate Bond Ixn -- virtual method -- does nothing
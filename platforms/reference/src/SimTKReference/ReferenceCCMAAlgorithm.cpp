@@ -205,6 +205,12 @@ int ReferenceCCMAAlgorithm::getNumberOfConstraints() const {
     return _numberOfConstraints;
 }
 
+void ReferenceCCMAAlgorithm::getConstraintParameters(int index, int& atom1, int& atom2, double& distance) const {
+    atom1 = _atomIndices[index].first;
+    atom2 = _atomIndices[index].second;
+    distance = _distance[index];
+}
+
 int ReferenceCCMAAlgorithm::getMaximumNumberOfIterations() const {
     return _maximumNumberOfIterations;
 }
@@ -49,8 +49,7 @@ ReferenceCustomAngleIxn::ReferenceCustomAngleIxn(const Lepton::CompiledExpressio
     numParameters = parameterNames.size();
     for (auto& param : parameterNames)
         angleParamIndex.push_back(expressionSet.getVariableIndex(param));
-    for (auto& param : globalParameters)
-        expressionSet.setVariable(expressionSet.getVariableIndex(param.first), param.second);
+    setGlobalParameters(globalParameters);
 }
 
 /**---------------------------------------------------------------------------------------
@@ -69,6 +68,11 @@ void ReferenceCustomAngleIxn::setPeriodic(OpenMM::Vec3* vectors) {
     boxVectors[2] = vectors[2];
 }
 
+void ReferenceCustomAngleIxn::setGlobalParameters(map<string, double> globalParameters) {
+    for (auto& param : globalParameters)
+        expressionSet.setVariable(expressionSet.getVariableIndex(param.first), param.second);
+}
+
 /**---------------------------------------------------------------------------------------
 
    Calculate Custom Angle Ixn
@@ -121,9 +125,17 @@ void ReferenceCustomAngleIxn::calculateBondIxn(int* atomIndices,
       angle = acos(cosine);
    expressionSet.setVariable(thetaIndex, angle);
 
-   // Compute the force and energy, and apply them to the atoms.
+   // Record parameter derivatives and accumulate the energy.
+
+   for (int i = 0; i < energyParamDerivExpressions.size(); i++)
+       energyParamDerivs[i] += energyParamDerivExpressions[i].evaluate();
+   if (totalEnergy != NULL)
+       *totalEnergy += energyExpression.evaluate();
+   if (!includeForces)
+       return;
+
+   // Compute the force and apply it to the atoms.
    
-   double energy = energyExpression.evaluate();
    double dEdR = forceExpression.evaluate();
    double termA =  dEdR/(deltaR[0][ReferenceForce::R2Index]*rp);
    double termC = -dEdR/(deltaR[1][ReferenceForce::R2Index]*rp);
@@ -145,15 +157,5 @@ void ReferenceCustomAngleIxn::calculateBondIxn(int* atomIndices,
          forces[atomIndices[jj]][ii] += deltaCrossP[jj][ii];
       }
    }
-
-   // Record parameter derivatives.
-
-   for (int i = 0; i < energyParamDerivExpressions.size(); i++)
-       energyParamDerivs[i] += energyParamDerivExpressions[i].evaluate();
-   
-   // accumulate energies
-
-   if (totalEnergy != NULL)
-       *totalEnergy += energy;
 }
 
@@ -50,8 +50,7 @@ ReferenceCustomBondIxn::ReferenceCustomBondIxn(const Lepton::CompiledExpression&
     numParameters = parameterNames.size();
     for (auto& param : parameterNames)
         bondParamIndex.push_back(expressionSet.getVariableIndex(param));
-    for (auto& param : globalParameters)
-        expressionSet.setVariable(expressionSet.getVariableIndex(param.first), param.second);
+    setGlobalParameters(globalParameters);
 }
 
 /**---------------------------------------------------------------------------------------
@@ -70,6 +69,11 @@ void ReferenceCustomBondIxn::setPeriodic(OpenMM::Vec3* vectors) {
     boxVectors[2] = vectors[2];
 }
 
+void ReferenceCustomBondIxn::setGlobalParameters(map<string, double> globalParameters) {
+    for (auto& param : globalParameters)
+        expressionSet.setVariable(expressionSet.getVariableIndex(param.first), param.second);
+}
+
 /**---------------------------------------------------------------------------------------
 
    Calculate Custom Bond Ixn
@@ -103,6 +107,12 @@ void ReferenceCustomBondIxn::calculateBondIxn(int* atomIndices,
        ReferenceForce::getDeltaR(atomCoordinates[atomAIndex], atomCoordinates[atomBIndex], deltaR);
    
    expressionSet.setVariable(rIndex, deltaR[ReferenceForce::RIndex]);
+   for (int i = 0; i < energyParamDerivExpressions.size(); i++)
+       energyParamDerivs[i] += energyParamDerivExpressions[i].evaluate();
+   if (totalEnergy != NULL)
+       *totalEnergy += energyExpression.evaluate();
+   if (!includeForces)
+       return;
    double dEdR            = forceExpression.evaluate();
    dEdR                   = deltaR[ReferenceForce::RIndex] > 0 ? (dEdR/deltaR[ReferenceForce::RIndex]) : 0;
 
@@ -113,9 +123,4 @@ void ReferenceCustomBondIxn::calculateBondIxn(int* atomIndices,
    forces[atomBIndex][0] -= dEdR*deltaR[ReferenceForce::XIndex];
    forces[atomBIndex][1] -= dEdR*deltaR[ReferenceForce::YIndex];
    forces[atomBIndex][2] -= dEdR*deltaR[ReferenceForce::ZIndex];
-
-   for (int i = 0; i < energyParamDerivExpressions.size(); i++)
-       energyParamDerivs[i] += energyParamDerivExpressions[i].evaluate();
-   if (totalEnergy != NULL)
-       *totalEnergy += energyExpression.evaluate();
 }
@@ -276,11 +276,7 @@ void ReferenceCustomDynamics::update(ContextImpl& context, int numberOfAtoms, ve
                 break;
             }
             case CustomIntegrator::ComputeSum: {
-                computePerDof(numberOfAtoms, sumBuffer, atomCoordinates, velocities, stepForces, masses, perDof, stepExpressions[step][0]);
-                double sum = 0.0;
-                for (int j = 0; j < numberOfAtoms; j++)
-                    if (masses[j] != 0.0)
-                        sum += sumBuffer[j][0]+sumBuffer[j][1]+sumBuffer[j][2];
+                double sum = computeSum(numberOfAtoms, atomCoordinates, velocities, stepForces, masses, perDof, stepExpressions[step][0]);
                 globals[stepVariable[step]] = sum;
                 expressionSet.setVariable(stepVariableIndex[step], sum);
                 break;
@@ -354,6 +350,17 @@ void ReferenceCustomDynamics::computePerDof(int numberOfAtoms, vector<Vec3>& res
     }
 }
 
+double ReferenceCustomDynamics::computeSum(int numberOfAtoms, const vector<Vec3>& atomCoordinates,
+              const vector<Vec3>& velocities, const vector<Vec3>& forces, const vector<double>& masses,
+              const vector<vector<Vec3> >& perDof, const CompiledExpression& expression) {
+    computePerDof(numberOfAtoms, sumBuffer, atomCoordinates, velocities, forces, masses, perDof, expression);
+    double sum = 0.0;
+    for (int j = 0; j < numberOfAtoms; j++)
+        if (masses[j] != 0.0)
+            sum += sumBuffer[j][0]+sumBuffer[j][1]+sumBuffer[j][2];
+    return sum;
+}
+
 bool ReferenceCustomDynamics::evaluateCondition(int step) {
     uniform = SimTKOpenMMUtilities::getUniformlyDistributedRandomNumber();
     gaussian = SimTKOpenMMUtilities::getNormallyDistributedRandomNumber();
@@ -416,10 +423,5 @@ double ReferenceCustomDynamics::computeKineticEnergy(OpenMM::ContextImpl& contex
         energy = context.calcForcesAndEnergy(true, true, -1);
         forcesAreValid = true;
     }
-    computePerDof(numberOfAtoms, sumBuffer, atomCoordinates, velocities, forces, masses, perDof, kineticEnergyExpression);
-    double sum = 0.0;
-    for (int j = 0; j < numberOfAtoms; j++)
-        if (masses[j] != 0.0)
-            sum += sumBuffer[j][0]+sumBuffer[j][1]+sumBuffer[j][2];
-    return sum;
+    return computeSum(numberOfAtoms, atomCoordinates, velocities, forces, masses, perDof, kineticEnergyExpression);
 }
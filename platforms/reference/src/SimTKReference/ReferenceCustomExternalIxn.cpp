@@ -63,11 +63,15 @@ ReferenceCustomExternalIxn::ReferenceCustomExternalIxn(const Lepton::CompiledExp
         forceYParams.push_back(ReferenceForce::getVariablePointer(this->forceExpressionY, param));
         forceZParams.push_back(ReferenceForce::getVariablePointer(this->forceExpressionZ, param));
     }
+    setGlobalParameters(globalParameters);
+}
+
+void ReferenceCustomExternalIxn::setGlobalParameters(map<string, double> globalParameters) {
     for (auto& param : globalParameters) {
-        ReferenceForce::setVariable(ReferenceForce::getVariablePointer(this->energyExpression, param.first), param.second);
-        ReferenceForce::setVariable(ReferenceForce::getVariablePointer(this->forceExpressionX, param.first), param.second);
-        ReferenceForce::setVariable(ReferenceForce::getVariablePointer(this->forceExpressionY, param.first), param.second);
-        ReferenceForce::setVariable(ReferenceForce::getVariablePointer(this->forceExpressionZ, param.first), param.second);
+        ReferenceForce::setVariable(ReferenceForce::getVariablePointer(energyExpression, param.first), param.second);
+        ReferenceForce::setVariable(ReferenceForce::getVariablePointer(forceExpressionX, param.first), param.second);
+        ReferenceForce::setVariable(ReferenceForce::getVariablePointer(forceExpressionY, param.first), param.second);
+        ReferenceForce::setVariable(ReferenceForce::getVariablePointer(forceExpressionZ, param.first), param.second);
     }
 }
 
@@ -89,6 +93,7 @@ ReferenceCustomExternalIxn::~ReferenceCustomExternalIxn() {
    @param parameters       parameters values
    @param forces           force array (forces added to input values)
    @param energy           energy is added to this
+   @param includeForces    true if forces should be computed
 
    --------------------------------------------------------------------------------------- */
 
@@ -96,7 +101,8 @@ void ReferenceCustomExternalIxn::calculateForce(int atomIndex,
                                                 vector<Vec3>& atomCoordinates,
                                                 double* parameters,
                                                 vector<Vec3>& forces,
-                                                double* energy) const {
+                                                double* energy,
+                                                bool includeForces) const {
 
    for (int i = 0; i < numParameters; i++) {
        ReferenceForce::setVariable(energyParams[i], parameters[i]);
@@ -119,9 +125,11 @@ void ReferenceCustomExternalIxn::calculateForce(int atomIndex,
 
    // ---------------------------------------------------------------------------------------
 
-   forces[atomIndex][0] -= forceExpressionX.evaluate();
-   forces[atomIndex][1] -= forceExpressionY.evaluate();
-   forces[atomIndex][2] -= forceExpressionZ.evaluate();
+   if (includeForces) {
+       forces[atomIndex][0] -= forceExpressionX.evaluate();
+       forces[atomIndex][1] -= forceExpressionY.evaluate();
+       forces[atomIndex][2] -= forceExpressionZ.evaluate();
+   }
    if (energy != NULL)
        *energy += energyExpression.evaluate();
 }
@@ -49,8 +49,7 @@ ReferenceCustomTorsionIxn::ReferenceCustomTorsionIxn(const Lepton::CompiledExpre
     numParameters = parameterNames.size();
     for (auto& param : parameterNames)
         torsionParamIndex.push_back(expressionSet.getVariableIndex(param));
-    for (auto& param : globalParameters)
-        expressionSet.setVariable(expressionSet.getVariableIndex(param.first), param.second);
+    setGlobalParameters(globalParameters);
 }
 
 /**---------------------------------------------------------------------------------------
@@ -69,6 +68,11 @@ void ReferenceCustomTorsionIxn::setPeriodic(OpenMM::Vec3* vectors) {
     boxVectors[2] = vectors[2];
 }
 
+void ReferenceCustomTorsionIxn::setGlobalParameters(map<string, double> globalParameters) {
+    for (auto& param : globalParameters)
+        expressionSet.setVariable(expressionSet.getVariableIndex(param.first), param.second);
+}
+
 /**---------------------------------------------------------------------------------------
 
    Calculate Custom Torsion Ixn
@@ -123,6 +127,15 @@ void ReferenceCustomTorsionIxn::calculateBondIxn(int* atomIndices,
    double angle = getDihedralAngleBetweenThreeVectors(deltaR[0], deltaR[1], deltaR[2], crossProduct, &dotDihedral, deltaR[0], &signOfAngle, 1);
    expressionSet.setVariable(thetaIndex, angle);
 
+   // Record parameter derivatives and accumulate the energy.
+
+   for (int i = 0; i < energyParamDerivExpressions.size(); i++)
+       energyParamDerivs[i] += energyParamDerivExpressions[i].evaluate();
+   if (totalEnergy != NULL)
+       *totalEnergy += energyExpression.evaluate();
+   if (!includeForces)
+       return;
+
    // evaluate delta angle, dE/d(angle)
 
    double dEdAngle = forceExpression.evaluate();
@@ -163,15 +176,5 @@ void ReferenceCustomTorsionIxn::calculateBondIxn(int* atomIndices,
       forces[atomCIndex][ii] -= internalF[2][ii];
       forces[atomDIndex][ii] += internalF[3][ii];
    }
-
-   // Record parameter derivatives.
-
-   for (int i = 0; i < energyParamDerivExpressions.size(); i++)
-       energyParamDerivs[i] += energyParamDerivExpressions[i].evaluate();
-
-   // accumulate energies
-
-   if (totalEnergy != NULL)
-       *totalEnergy += energyExpression.evaluate();
 }
 
@@ -93,6 +93,11 @@ void ReferenceHarmonicBondIxn::calculateBondIxn(int* atomIndices,
    double deltaIdeal      = deltaR[ReferenceForce::RIndex] - parameters[0];
    double deltaIdeal2     = deltaIdeal*deltaIdeal;
 
+   if (totalEnergy != NULL)
+       *totalEnergy += 0.5*parameters[1]*deltaIdeal2;
+   if (!includeForces)
+       return;
+
    double dEdR            = parameters[1]*deltaIdeal;
 
    // chain rule
@@ -106,7 +111,4 @@ void ReferenceHarmonicBondIxn::calculateBondIxn(int* atomIndices,
    forces[atomBIndex][0]     -= dEdR*deltaR[ReferenceForce::XIndex];
    forces[atomBIndex][1]     -= dEdR*deltaR[ReferenceForce::YIndex];
    forces[atomBIndex][2]     -= dEdR*deltaR[ReferenceForce::ZIndex];
-
-   if (totalEnergy != NULL)
-       *totalEnergy += 0.5*parameters[1]*deltaIdeal2;
 }
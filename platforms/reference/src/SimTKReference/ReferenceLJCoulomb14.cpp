@@ -81,6 +81,13 @@ void ReferenceLJCoulomb14::calculateBondIxn(int* atomIndices, vector<Vec3>& atom
           sig2     *= sig2;
    double sig6      = sig2*sig2*sig2;
 
+   // accumulate energies
+
+   if (totalEnergy != NULL)
+       *totalEnergy += parameters[1]*(sig6 - 1.0)*sig6 + (ONE_4PI_EPS0*parameters[2]*inverseR);
+   if (!includeForces)
+       return;
+
    double dEdR      = parameters[1]*(12.0*sig6 - 6.0)*sig6;
           dEdR     += ONE_4PI_EPS0*parameters[2]*inverseR;
           dEdR     *= inverseR*inverseR;
@@ -92,9 +99,4 @@ void ReferenceLJCoulomb14::calculateBondIxn(int* atomIndices, vector<Vec3>& atom
       forces[atomAIndex][ii] += force;
       forces[atomBIndex][ii] -= force;
    }
-
-   // accumulate energies
-
-   if (totalEnergy != NULL)
-       *totalEnergy += parameters[1]*(sig6 - 1.0)*sig6 + (ONE_4PI_EPS0*parameters[2]*inverseR);
 }
@@ -36,6 +36,7 @@
 #include "ReferencePME.h"
 #include "fftpack.h"
 #include "SimTKOpenMMRealType.h"
+#include "openmm/OpenMMException.h"
 
 using std::vector;
 
@@ -117,6 +118,9 @@ pme_calculate_bsplines_moduli(pme_t pme)
 
     order = pme->order;
 
+    /* bsplines_data holds the bspline values at 1..order */
+    nmax = (order+1 > nmax) ? order+1 : nmax;
+
     /* temp storage in this routine */
     data          = (double *) malloc(sizeof(double)*order);
     ddata         = (double *) malloc(sizeof(double)*order);
@@ -727,6 +731,13 @@ pme_init(pme_t *       ppme,
     pme_t pme;
     int   d;
 
+    /* Spreading and the bspline moduli assume each bspline wraps around the grid at most once */
+    for (d=0;d<3;d++)
+    {
+        if (ngrid[d] < pme_order)
+            throw OpenMMException("pme_init: PME grid dimensions must be at least the interpolation order");
+    }
+
     pme = (pme_t) malloc(sizeof(struct pme));
 
     pme->order       = pme_order;
@@ -121,6 +121,13 @@ void ReferenceProperDihedralBond::calculateBondIxn(int* atomIndices,
    double sinDeltaAngle  = SIN(deltaAngle);
    double dEdAngle       = -parameters[0]*parameters[2]*sinDeltaAngle;
    double energy         =  parameters[0]*(1.0 + cos(deltaAngle));
+
+   // accumulate energies
+
+   if (totalEnergy != NULL)
+       *totalEnergy += energy;
+   if (!includeForces)
+       return;
    
    // compute force
 
@@ -158,9 +165,4 @@ void ReferenceProperDihedralBond::calculateBondIxn(int* atomIndices,
       forces[atomCIndex][ii] -= internalF[2][ii];
       forces[atomDIndex][ii] += internalF[3][ii];
    }
-
-   // accumulate energies
-
-   if (totalEnergy != NULL)
-       *totalEnergy += energy;
 }
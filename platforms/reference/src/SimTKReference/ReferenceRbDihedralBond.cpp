@@ -137,6 +137,13 @@ void ReferenceRbDihedralBond::calculateBondIxn(int* atomIndices,
       energy    += cosFactor*parameters[ii];
    }
 
+   // accumulate energies
+
+   if (totalEnergy != NULL)
+       *totalEnergy += energy;
+   if (!includeForces)
+       return;
+
    dEdAngle *= SIN(dihederalAngle);
 
    double internalF[4][3];
@@ -173,9 +180,4 @@ void ReferenceRbDihedralBond::calculateBondIxn(int* atomIndices,
       forces[atomCIndex][ii] -= internalF[2][ii];
       forces[atomDIndex][ii] += internalF[3][ii];
    }
-
-   // accumulate energies
-
-   if (totalEnergy != NULL)
-       *totalEnergy += energy;
 }
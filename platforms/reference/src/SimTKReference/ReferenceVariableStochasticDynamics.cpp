@@ -99,37 +99,17 @@ double ReferenceVariableStochasticDynamics::getFriction() const {
 
 /**---------------------------------------------------------------------------------------
 
-   First SD update; based on code in update.c do_update_sd() Gromacs 3.1.4
+   Estimate the integration error, which is used to select the step size
 
    @param numberOfAtoms       number of atoms
-   @param atomCoordinates     atom coordinates
-   @param velocities          velocities
    @param forces              forces
-   @param masses              atom masses
    @param inverseMasses       inverse atom masses
-   @param xPrime              xPrime
-   @param maxStepSize         maximum time step
-
-   --------------------------------------------------------------------------------------- */
 
-void ReferenceVariableStochasticDynamics::updatePart1(int numberOfAtoms, vector<Vec3>& atomCoordinates,
-                                              vector<Vec3>& velocities,
-                                              vector<Vec3>& forces, vector<double>& masses, vector<double>& inverseMasses,
-                                              vector<Vec3>& xPrime, double maxStepSize) {
-   // first-time-through initialization
-
-   if (getTimeStep() == 0) {
-      // invert masses
+   @return the RMS value of inverseMass*force over all degrees of freedom
 
-      for (int ii = 0; ii < numberOfAtoms; ii++) {
-         if (masses[ii] == 0)
-             inverseMasses[ii] = 0;
-         else
-             inverseMasses[ii] = 1/masses[ii];
-      }
-   }
+   --------------------------------------------------------------------------------------- */
 
-   // Select the step size to use
+double ReferenceVariableStochasticDynamics::computeErrorEstimate(int numberOfAtoms, vector<Vec3>& forces, vector<double>& inverseMasses) {
     double error = 0;
     for (int i = 0; i < numberOfAtoms; ++i) {
         for (int j = 0; j < 3; ++j) {
@@ -137,18 +117,26 @@ void ReferenceVariableStochasticDynamics::updatePart1(int numberOfAtoms, vector<
             error += xerror*xerror;
         }
     }
-    error = sqrt(error/(numberOfAtoms*3));
-    double newStepSize = sqrt(getAccuracy()/error);
-    if (getDeltaT() > 0.0f)
-        newStepSize = std::min(newStepSize, getDeltaT()*2.0f); // For safety, limit how quickly dt can increase.
-    if (newStepSize > getDeltaT() && newStepSize < 1.2f*getDeltaT())
-        newStepSize = getDeltaT(); // Keeping dt constant between steps improves the behavior of the integrator.
-    if (newStepSize > maxStepSize)
-        newStepSize = maxStepSize;
-    setDeltaT(newStepSize);
- 
-    // perform first update
+    return sqrt(error/(numberOfAtoms*3));
+}
+
+/**---------------------------------------------------------------------------------------
+
+   First SD update; based on code in update.c do_update_sd() Gromacs 3.1.4
+
+   @param numberOfAtoms       number of atoms
+   @param atomCoordinates     atom coordinates
+   @param velocities          velocities
+   @param forces              forces
+   @param inverseMasses       inverse atom masses
+   @param xPrime              xPrime
 
+   --------------------------------------------------------------------------------------- */
+
+void ReferenceVariableStochasticDynamics::updatePart1(int numberOfAtoms, vector<Vec3>& atomCoordinates,
+                                              vector<Vec3>& velocities,
+                                              vector<Vec3>& forces, vector<double>& inverseMasses,
+                                              vector<Vec3>& xPrime) {
    double dt = getDeltaT();
    double friction = getFriction();
    const double vscale = exp(-dt*friction);
@@ -157,7 +145,7 @@ void ReferenceVariableStochasticDynamics::updatePart1(int numberOfAtoms, vector<
    const double noisescale = sqrt(kT*(1-vscale*vscale));
 
    for (int ii = 0; ii < numberOfAtoms; ii++) {
-       if (masses[ii] != 0) {
+       if (inverseMasses[ii] != 0) {
            double sqrtInvMass = sqrt(inverseMasses[ii]);
            for (int jj = 0; jj < 3; jj++) {
                velocities[ii][jj]  = vscale*velocities[ii][jj] + fscale*inverseMasses[ii]*forces[ii][jj] + noisescale*sqrtInvMass*SimTKOpenMMUtilities::getNormallyDistributedRandomNumber();
@@ -175,7 +163,8 @@ void ReferenceVariableStochasticDynamics::updatePart1(int numberOfAtoms, vector<
    @param atomCoordinates     atom coordinates
    @param velocities          velocities
    @param forces              forces
-   @param masses              atom masses
+   @param inverseMasses       inverse atom masses
+   @param xPrime              xPrime
 
    --------------------------------------------------------------------------------------- */
 
@@ -193,6 +182,31 @@ void ReferenceVariableStochasticDynamics::updatePart2(int numberOfAtoms, vector<
 
 }
 
+/**---------------------------------------------------------------------------------------
+
+   Third update: compute the velocities from the constrained positions and copy xPrime
+   into atomCoordinates
+
+   @param numberOfAtoms       number of atoms
+   @param atomCoordinates     atom coordinates
+   @param velocities          velocities
+   @param inverseMasses       inverse atom masses
+   @param xPrime              xPrime
+
+   --------------------------------------------------------------------------------------- */
+
+void ReferenceVariableStochasticDynamics::updatePart3(int numberOfAtoms, vector<Vec3>& atomCoordinates,
+                                              vector<Vec3>& velocities, vector<double>& inverseMasses,
+                                              vector<Vec3>& xPrime) {
+   double invStepSize = 1.0/getDeltaT();
+   for (int ii = 0; ii < numberOfAtoms; ii++) {
+       if (inverseMasses[ii] != 0.0) {
+           velocities[ii] = (xPrime[ii]-atomCoordinates[ii])*invStepSize;
+           atomCoordinates[ii] = xPrime[ii];
+       }
+   }
+}
+
 /**---------------------------------------------------------------------------------------
 
    Update -- driver routine for performing stochastic dynamics update of coordinates
@@ -210,10 +224,35 @@ void ReferenceVariableStochasticDynamics::update(const OpenMM::System& system, v
                                           vector<Vec3>& velocities,
                                           vector<Vec3>& forces, vector<double>& masses, double maxStepSize, double tolerance) {
 
-   // 1st update
+   // first-time-through initialization
 
    int numberOfAtoms = system.getNumParticles();
-   updatePart1(numberOfAtoms, atomCoordinates, velocities, forces, masses, inverseMasses, xPrime, maxStepSize);
+   if (getTimeStep() == 0) {
+      // invert masses
+
+      for (int ii = 0; ii < numberOfAtoms; ii++) {
+         if (masses[ii] == 0)
+             inverseMasses[ii] = 0;
+         else
+             inverseMasses[ii] = 1/masses[ii];
+      }
+   }
+
+   // Select the step size to use
+
+    double error = computeErrorEstimate(numberOfAtoms, forces, inverseMasses);
+    double newStepSize = sqrt(getAccuracy()/error);
+    if (getDeltaT() > 0.0f)
+        newStepSize = std::min(newStepSize, getDeltaT()*2.0f); // For safety, limit how quickly dt can increase.
+    if (newStepSize > getDeltaT() && newStepSize < 1.2f*getDeltaT())
+        newStepSize = getDeltaT(); // Keeping dt constant between steps improves the behavior of the integrator.
+    if (newStepSize > maxStepSize)
+        newStepSize = maxStepSize;
+    setDeltaT(newStepSize);
+
+   // 1st update
+
+   updatePart1(numberOfAtoms, atomCoordinates, velocities, forces, inverseMasses, xPrime);
 
    // 2nd update
 
@@ -225,13 +264,7 @@ void ReferenceVariableStochasticDynamics::update(const OpenMM::System& system, v
 
    // copy xPrime -> atomCoordinates
 
-   double invStepSize = 1.0/getDeltaT();
-   for (int ii = 0; ii < numberOfAtoms; ii++) {
-       if (masses[ii] != 0.0) {
-           velocities[ii] = (xPrime[ii]-atomCoordinates[ii])*invStepSize;
-           atomCoordinates[ii] = xPrime[ii];
-       }
-   }
+   updatePart3(numberOfAtoms, atomCoordinates, velocities, inverseMasses, xPrime);
 
    ReferenceVirtualSites::computePositions(system, atomCoordinates);
    incrementTimeStep();
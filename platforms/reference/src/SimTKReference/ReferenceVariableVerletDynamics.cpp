@@ -80,6 +80,80 @@ void ReferenceVariableVerletDynamics::setAccuracy(double accuracy) {
     _accuracy = accuracy;
 }
 
+/**---------------------------------------------------------------------------------------
+
+   Estimate the integration error, which is used to select the step size
+
+   @param numberOfAtoms       number of atoms
+   @param forces              forces
+   @param inverseMasses       inverse atom masses
+
+   @return the RMS value of inverseMass*force over all degrees of freedom
+
+   --------------------------------------------------------------------------------------- */
+
+double ReferenceVariableVerletDynamics::computeErrorEstimate(int numberOfAtoms, vector<Vec3>& forces, vector<double>& inverseMasses) {
+    double error = 0.0;
+    for (int i = 0; i < numberOfAtoms; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            double xerror = inverseMasses[i]*forces[i][j];
+            error += xerror*xerror;
+        }
+    }
+    return sqrt(error/(numberOfAtoms*3));
+}
+
+/**---------------------------------------------------------------------------------------
+
+   First update: compute the unconstrained positions
+
+   @param numberOfAtoms       number of atoms
+   @param atomCoordinates     atom coordinates
+   @param velocities          velocities
+   @param forces              forces
+   @param inverseMasses       inverse atom masses
+   @param xPrime              xPrime
+   @param velocityStep        the time interval by which to advance the velocities
+
+   --------------------------------------------------------------------------------------- */
+
+void ReferenceVariableVerletDynamics::updatePart1(int numberOfAtoms, vector<Vec3>& atomCoordinates, vector<Vec3>& velocities,
+                                                  vector<Vec3>& forces, vector<double>& inverseMasses, vector<Vec3>& xPrime,
+                                                  double velocityStep) {
+    for (int i = 0; i < numberOfAtoms; ++i) {
+        if (inverseMasses[i] != 0.0)
+            for (int j = 0; j < 3; ++j) {
+                double vPrime = velocities[i][j] + inverseMasses[i]*forces[i][j]*velocityStep;
+                xPrime[i][j] = atomCoordinates[i][j] + vPrime*getDeltaT();
+            }
+    }
+}
+
+/**---------------------------------------------------------------------------------------
+
+   Second update: compute the velocities from the constrained positions and copy xPrime
+   into atomCoordinates
+
+   @param numberOfAtoms       number of atoms
+   @param atomCoordinates     atom coordinates
+   @param velocities          velocities
+   @param inverseMasses       inverse atom masses
+   @param xPrime              xPrime
+
+   --------------------------------------------------------------------------------------- */
+
+void ReferenceVariableVerletDynamics::updatePart2(int numberOfAtoms, vector<Vec3>& atomCoordinates, vector<Vec3>& velocities,
+                                                  vector<double>& inverseMasses, vector<Vec3>& xPrime) {
+   double velocityScale = 1.0/getDeltaT();
+   for (int i = 0; i < numberOfAtoms; ++i) {
+       if (inverseMasses[i] != 0.0)
+           for (int j = 0; j < 3; ++j) {
+               velocities[i][j] = velocityScale*(xPrime[i][j] - atomCoordinates[i][j]);
+               atomCoordinates[i][j] = xPrime[i][j];
+           }
+   }
+}
+
 /**---------------------------------------------------------------------------------------
 
    Update -- driver routine for performing Verlet dynamics update of coordinates
@@ -111,14 +185,7 @@ void ReferenceVariableVerletDynamics::update(const OpenMM::System& system, vecto
        }
     }
 
-    double error = 0.0;
-    for (int i = 0; i < numberOfAtoms; ++i) {
-        for (int j = 0; j < 3; ++j) {
-            double xerror = inverseMasses[i]*forces[i][j];
-            error += xerror*xerror;
-        }
-    }
-    error = sqrt(error/(numberOfAtoms*3));
+    double error = computeErrorEstimate(numberOfAtoms, forces, inverseMasses);
     double newStepSize = sqrt(getAccuracy()/error);
     if (getDeltaT() > 0.0f)
         newStepSize = std::min(newStepSize, getDeltaT()*2.0f); // For safety, limit how quickly dt can increase.
@@ -128,27 +195,14 @@ void ReferenceVariableVerletDynamics::update(const OpenMM::System& system, vecto
         newStepSize = maxStepSize;
     double vstep = 0.5f*(newStepSize+getDeltaT()); // The time interval by which to advance the velocities
     setDeltaT(newStepSize);
-    for (int i = 0; i < numberOfAtoms; ++i) {
-        if (masses[i] != 0.0)
-            for (int j = 0; j < 3; ++j) {
-                double vPrime = velocities[i][j] + inverseMasses[i]*forces[i][j]*vstep;
-                xPrime[i][j] = atomCoordinates[i][j] + vPrime*getDeltaT();
-            }
-    }
+    updatePart1(numberOfAtoms, atomCoordinates, velocities, forces, inverseMasses, xPrime, vstep);
     ReferenceConstraintAlgorithm* referenceConstraintAlgorithm = getReferenceConstraintAlgorithm();
     if (referenceConstraintAlgorithm)
         referenceConstraintAlgorithm->apply(atomCoordinates, xPrime, inverseMasses, tolerance);
 
    // Update the positions and velocities.
 
-   double velocityScale = 1.0/getDeltaT();
-   for (int i = 0; i < numberOfAtoms; ++i) {
-       if (masses[i] != 0.0)
-           for (int j = 0; j < 3; ++j) {
-               velocities[i][j] = velocityScale*(xPrime[i][j] - atomCoordinates[i][j]);
-               atomCoordinates[i][j] = xPrime[i][j];
-           }
-   }
+   updatePart2(numberOfAtoms, atomCoordinates, velocities, inverseMasses, xPrime);
    ReferenceVirtualSites::computePositions(system, atomCoordinates);
    incrementTimeStep();
 }
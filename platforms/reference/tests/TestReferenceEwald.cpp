@@ -33,4 +33,5 @@
 #include "TestEwald.h"
 
 void runPlatformTests() {
+    testSmallGrid();
 }
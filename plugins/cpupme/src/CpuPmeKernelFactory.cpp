@@ -29,6 +29,8 @@
 #include "internal/windowsExportPme.h"
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/OpenMMException.h"
+#include <algorithm>
+#include <sstream>
 
 using namespace OpenMM;
 
@@ -53,9 +55,19 @@ extern "C" OPENMM_EXPORT_PME void registerPlatforms() {
 #endif
 
 KernelImpl* CpuPmeKernelFactory::createKernelImpl(std::string name, const Platform& platform, ContextImpl& context) const {
+    // If the platform lets the user choose how many threads to use (as the CPU platform's "Threads" property
+    // does), use the same number of threads for PME.  Likewise, follow its "InstructionSet" property if it has one.
+
+    int numThreads = 0;
+    int vectorWidth = 0;
+    const std::vector<std::string>& properties = platform.getPropertyNames();
+    if (std::find(properties.begin(), properties.end(), "Threads") != properties.end())
+        std::stringstream(platform.getPropertyValue(context.getOwner(), "Threads")) >> numThreads;
+    if (std::find(properties.begin(), properties.end(), "InstructionSet") != properties.end())
+        vectorWidth = (platform.getPropertyValue(context.getOwner(), "InstructionSet") == "SSE4.1" ? 4 : 8);
     if (name == CalcPmeReciprocalForceKernel::Name())
-        return new CpuCalcPmeReciprocalForceKernel(name, platform);
+        return new CpuCalcPmeReciprocalForceKernel(name, platform, numThreads, vectorWidth);
     if (name == CalcDispersionPmeReciprocalForceKernel::Name())
-        return new CpuCalcDispersionPmeReciprocalForceKernel(name, platform);
+        return new CpuCalcDispersionPmeReciprocalForceKernel(name, platform, numThreads, vectorWidth);
     throw OpenMMException((std::string("Tried to create kernel with illegal kernel name '")+name+"'").c_str());
 }
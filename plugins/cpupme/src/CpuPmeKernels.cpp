@@ -38,125 +38,386 @@
 #include "openmm/internal/vectorize.h"
 #include "openmm/OpenMMException.h"
 #include <cmath>
+#include <cstdio>
 #include <algorithm>
 #include <cstring>
 #include <sstream>
 #include <cstdlib>
+#ifdef _WIN32
+  #include <process.h>
+  #define getpid _getpid
+#else
+  #include <unistd.h>
+#endif
 
 using namespace OpenMM;
 using namespace std;
 
-static const int PME_ORDER = 5;
-
 bool CpuCalcDispersionPmeReciprocalForceKernel::hasInitializedThreads = false;
-int CpuCalcDispersionPmeReciprocalForceKernel::numThreads = 0;
 
-static void spreadCharge(float* posq, float* grid, int gridx, int gridy, int gridz, int numParticles, Vec3* periodicBoxVectors, Vec3* recipBoxVectors,
-        gmx_atomic_t& atomicCounter, const float epsilonFactor, int threadIndex, int numThreads, bool deterministic) {
-    float temp[4];
-    fvec4 boxSize((float) periodicBoxVectors[0][0], (float) periodicBoxVectors[1][1], (float) periodicBoxVectors[2][2], 0);
-    fvec4 invBoxSize((float) recipBoxVectors[0][0], (float) recipBoxVectors[1][1], (float) recipBoxVectors[2][2], 0);
-    fvec4 recipBoxVec0((float) recipBoxVectors[0][0], (float) recipBoxVectors[0][1], (float) recipBoxVectors[0][2], 0);
-    fvec4 recipBoxVec1((float) recipBoxVectors[1][0], (float) recipBoxVectors[1][1], (float) recipBoxVectors[1][2], 0);
-    fvec4 recipBoxVec2((float) recipBoxVectors[2][0], (float) recipBoxVectors[2][1], (float) recipBoxVectors[2][2], 0);
-    fvec4 gridSize(gridx, gridy, gridz, 0);
-    ivec4 gridSizeInt(gridx, gridy, gridz, 0);
-    fvec4 one(1);
-    fvec4 scale(1.0f/(PME_ORDER-1));
-    float posInBox[4] = {0,0,0,0};
-    memset(grid, 0, sizeof(float)*gridx*gridy*gridz);
+PmePhaseBarrier::PmePhaseBarrier(int numThreads) : numThreads(numThreads), waitCount(0), generation(0) {
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&condition, NULL);
+}
 
-    int i = threadIndex;
-    while (true) {
-        if (!deterministic)
-            i = gmx_atomic_fetch_add(&atomicCounter, 1);
-        if (i >= numParticles)
-            break;
+PmePhaseBarrier::~PmePhaseBarrier() {
+    pthread_mutex_destroy(&lock);
+    pthread_cond_destroy(&condition);
+}
 
-        // Find the position relative to the nearest grid point.
-
-        fvec4 pos(&posq[4*i]);
-        (pos-boxSize*floor(pos*invBoxSize)).store(posInBox);
-        fvec4 t = posInBox[0]*recipBoxVec0 + posInBox[1]*recipBoxVec1 + posInBox[2]*recipBoxVec2;
-        t = (t-floor(t))*gridSize;
-        ivec4 ti = t;
-        fvec4 dr = t-ti;
-        ivec4 gridIndex = ti-(gridSizeInt&ti==gridSizeInt);
-        
-        // Compute the B-spline coefficients.
-
-        fvec4 data[PME_ORDER];
-        data[PME_ORDER-1] = 0.0f;
-        data[1] = dr;
-        data[0] = one-dr;
-        for (int j = 3; j < PME_ORDER; j++) {
-            fvec4 div(1.0f/(j-1));
-            data[j-1] = div*dr*data[j-2];
-            for (int k = 1; k < j-1; k++)
-                data[j-k-1] = div*((dr+k)*data[j-k-2]+(fvec4(j-k)-dr)*data[j-k-1]);
-            data[0] = div*(one-dr)*data[0];
+void PmePhaseBarrier::sync(const function<void ()>& serialStep) {
+    pthread_mutex_lock(&lock);
+    int currentGeneration = generation;
+    if (++waitCount == numThreads) {
+        if (serialStep)
+            serialStep();
+        waitCount = 0;
+        generation++;
+        pthread_cond_broadcast(&condition);
+    }
+    else {
+        while (generation == currentGeneration)
+            pthread_cond_wait(&condition, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+bool isPmeVec8Supported();
+void spreadAtomChargeVec8(float* const* planes, const int* yindex, int gridIndexZ, int gridz, int order, const float* xtheta, const float* ytheta, const float* ztheta);
+void interpolateAtomForceVec8(float* const* planes, const int* yindex, int gridIndexZ, int gridz, int order, const float* const* theta, const float* const* dtheta, float* result);
+
+/**
+ * This holds the grid index and B-spline coefficients of every atom.  They are computed once while spreading
+ * charges and reused for interpolating forces.  Values are stored in structure-of-arrays form, so the value for
+ * atom i, axis d, and spline point j is at [(d*ORDER+j)*stride+i], and the grid index is at [d*stride+i].
+ */
+template <int ORDER>
+struct SplineCache {
+    SplineCache(vector<int>& gridIndex, vector<float>& theta, vector<float>& dtheta) :
+            gridIndex(&gridIndex[0]), theta(&theta[0]), dtheta(&dtheta[0]), stride(gridIndex.size()/3) {
+    }
+    /**
+     * Compute the values for a block of four atoms.  Each vector holds one quantity for all four atoms.
+     */
+    void computeBlock(const float* posq, int block, int numParticles, int gridx, int gridy, int gridz, Vec3* periodicBoxVectors, Vec3* recipBoxVectors) {
+        int first = 4*block;
+        fvec4 x, y, z, q;
+        if (first+4 <= numParticles) {
+            x = fvec4(&posq[4*first]);
+            y = fvec4(&posq[4*first+4]);
+            z = fvec4(&posq[4*first+8]);
+            q = fvec4(&posq[4*first+12]);
         }
-        data[PME_ORDER-1] = scale*dr*data[PME_ORDER-2];
-        for (int j = 1; j < (PME_ORDER-1); j++)
-            data[PME_ORDER-j-1] = scale*((dr+j)*data[PME_ORDER-j-2]+(fvec4(PME_ORDER-j)-dr)*data[PME_ORDER-j-1]);
-        data[0] = scale*(one-dr)*data[0];
-        
-        // Spread the charges.
-        
-        int gridIndexX = gridIndex[0];
-        int gridIndexY = gridIndex[1];
-        int gridIndexZ = gridIndex[2];
-        if (gridIndexX < 0)
-            return; // This happens when a simulation blows up and coordinates become NaN.
-        int zindex[PME_ORDER];
-        for (int j = 0; j < PME_ORDER; j++) {
-            zindex[j] = gridIndexZ+j;
-            zindex[j] -= (zindex[j] >= gridz ? gridz : 0);
+        else {
+            float padded[16] = {0};
+            for (int i = 0; i < 4*(numParticles-first); i++)
+                padded[i] = posq[4*first+i];
+            x = fvec4(&padded[0]);
+            y = fvec4(&padded[4]);
+            z = fvec4(&padded[8]);
+            q = fvec4(&padded[12]);
         }
-        float charge = epsilonFactor*posq[4*i+3];
-        fvec4 zdata0to3(data[0][2], data[1][2], data[2][2], data[3][2]);
-        float zdata4 = data[4][2];
-        if (gridIndexZ+4 < gridz) {
-            for (int ix = 0; ix < PME_ORDER; ix++) {
-                int xbase = gridIndexX+ix;
-                xbase -= (xbase >= gridx ? gridx : 0);
-                xbase = xbase*gridy*gridz;
-                float xdata = charge*data[ix][0];
-                for (int iy = 0; iy < PME_ORDER; iy++) {
-                    int ybase = gridIndexY+iy;
-                    ybase -= (ybase >= gridy ? gridy : 0);
-                    ybase = xbase + ybase*gridz;
-                    float multiplier = xdata*data[iy][1];
-                    fvec4 add0to3 = zdata0to3*multiplier;
-                    (fvec4(&grid[ybase+gridIndexZ])+add0to3).store(&grid[ybase+gridIndexZ]);
-                    grid[ybase+zindex[4]] += multiplier*zdata4;
-                }
+        transpose(x, y, z, q);
+        x = x-(float) periodicBoxVectors[0][0]*floor(x*(float) recipBoxVectors[0][0]);
+        y = y-(float) periodicBoxVectors[1][1]*floor(y*(float) recipBoxVectors[1][1]);
+        z = z-(float) periodicBoxVectors[2][2]*floor(z*(float) recipBoxVectors[2][2]);
+        int gridSize[3] = {gridx, gridy, gridz};
+        fvec4 one(1);
+        fvec4 scale(1.0f/(ORDER-1));
+        for (int d = 0; d < 3; d++) {
+            // Find the position relative to the nearest grid point.
+
+            fvec4 t = x*(float) recipBoxVectors[0][d] + y*(float) recipBoxVectors[1][d] + z*(float) recipBoxVectors[2][d];
+            t = (t-floor(t))*(float) gridSize[d];
+            ivec4 ti = t;
+            fvec4 dr = t-ti;
+            ivec4 size(gridSize[d]);
+            (ti-(size&ti==size)).store(&gridIndex[d*stride+first]);
+
+            // Compute the B-spline coefficients and their derivatives.
+
+            fvec4 data[ORDER];
+            data[ORDER-1] = 0.0f;
+            data[1] = dr;
+            data[0] = one-dr;
+            for (int j = 3; j < ORDER; j++) {
+                fvec4 div(1.0f/(j-1));
+                data[j-1] = div*dr*data[j-2];
+                for (int k = 1; k < j-1; k++)
+                    data[j-k-1] = div*((dr+k)*data[j-k-2]+(fvec4(j-k)-dr)*data[j-k-1]);
+                data[0] = div*(one-dr)*data[0];
             }
+            (-data[0]).store(&dtheta[(d*ORDER)*stride+first]);
+            for (int j = 1; j < ORDER; j++)
+                (data[j-1]-data[j]).store(&dtheta[(d*ORDER+j)*stride+first]);
+            data[ORDER-1] = scale*dr*data[ORDER-2];
+            for (int j = 1; j < (ORDER-1); j++)
+                data[ORDER-j-1] = scale*((dr+j)*data[ORDER-j-2]+(fvec4(ORDER-j)-dr)*data[ORDER-j-1]);
+            data[0] = scale*(one-dr)*data[0];
+            for (int j = 0; j < ORDER; j++)
+                data[j].store(&theta[(d*ORDER+j)*stride+first]);
         }
-        else {
-            for (int ix = 0; ix < PME_ORDER; ix++) {
-                int xbase = gridIndexX+ix;
-                xbase -= (xbase >= gridx ? gridx : 0);
-                xbase = xbase*gridy*gridz;
-                float xdata = charge*data[ix][0];
-                for (int iy = 0; iy < PME_ORDER; iy++) {
-                    int ybase = gridIndexY+iy;
-                    ybase -= (ybase >= gridy ? gridy : 0);
-                    ybase = xbase + ybase*gridz;
-                    float multiplier = xdata*data[iy][1];
-                    fvec4 add0to3 = zdata0to3*multiplier;
-                    add0to3.store(temp);
-                    grid[ybase+zindex[0]] += temp[0];
-                    grid[ybase+zindex[1]] += temp[1];
-                    grid[ybase+zindex[2]] += temp[2];
-                    grid[ybase+zindex[3]] += temp[3];
-                    grid[ybase+zindex[4]] += multiplier*zdata4;
+    }
+    int getGridIndex(int atom, int axis) const {
+        return gridIndex[axis*stride+atom];
+    }
+    float getTheta(int atom, int axis, int point) const {
+        return theta[(axis*ORDER+point)*stride+atom];
+    }
+    float getDTheta(int atom, int axis, int point) const {
+        return dtheta[(axis*ORDER+point)*stride+atom];
+    }
+    int* gridIndex;
+    float* theta;
+    float* dtheta;
+    int stride;
+};
+
+/**
+ * Resize the arrays of a SplineCache to hold the values for a given number of particles and interpolation order.
+ */
+static void allocateSplineCache(vector<int>& gridIndex, vector<float>& theta, vector<float>& dtheta, int numParticles, int order) {
+    int stride = 4*((numParticles+3)/4);
+    gridIndex.resize(3*stride);
+    theta.resize(3*order*stride);
+    dtheta.resize(3*order*stride);
+}
+
+/**
+ * Spread the charge of one atom onto the grid, using its cached B-spline coefficients.  getPlane(x) must return a
+ * pointer to the start of x-plane x of the grid, where x runs from the atom's first grid index up to ORDER-1
+ * beyond it and has not been wrapped into the grid.  Along z the coefficients are added four at a time, with
+ * any remainder handled one point at a time.  If useVec8 is true, each row along z is instead handled with a
+ * single 8 component vector by spreadAtomChargeVec8().
+ */
+template <int ORDER, class PlaneLookup>
+static void spreadAtomCharge(float* posq, int atom, const SplineCache<ORDER>& splines, int gridy, int gridz, const float epsilonFactor, PlaneLookup getPlane, bool useVec8) {
+    const int NUM_ZVEC = ORDER/4;
+    float temp[4];
+    int gridIndexX = splines.getGridIndex(atom, 0);
+    int gridIndexY = splines.getGridIndex(atom, 1);
+    int gridIndexZ = splines.getGridIndex(atom, 2);
+    if (gridIndexX < 0)
+        return; // This happens when a simulation blows up and coordinates become NaN.
+    if (useVec8) {
+        float* planes[ORDER];
+        int yindex[ORDER];
+        float xtheta[ORDER], ytheta[ORDER], ztheta[ORDER];
+        float charge = epsilonFactor*posq[4*atom+3];
+        for (int j = 0; j < ORDER; j++) {
+            planes[j] = getPlane(gridIndexX+j);
+            yindex[j] = gridIndexY+j;
+            yindex[j] -= (yindex[j] >= gridy ? gridy : 0);
+            xtheta[j] = charge*splines.getTheta(atom, 0, j);
+            ytheta[j] = splines.getTheta(atom, 1, j);
+            ztheta[j] = splines.getTheta(atom, 2, j);
+        }
+        spreadAtomChargeVec8(planes, yindex, gridIndexZ, gridz, ORDER, xtheta, ytheta, ztheta);
+        return;
+    }
+    int zindex[ORDER];
+    float zdata[ORDER];
+    for (int j = 0; j < ORDER; j++) {
+        zindex[j] = gridIndexZ+j;
+        zindex[j] -= (zindex[j] >= gridz ? gridz : 0);
+        zdata[j] = splines.getTheta(atom, 2, j);
+    }
+    fvec4 zvec[NUM_ZVEC];
+    for (int j = 0; j < NUM_ZVEC; j++)
+        zvec[j] = fvec4(&zdata[4*j]);
+    float charge = epsilonFactor*posq[4*atom+3];
+    if (gridIndexZ+ORDER <= gridz) {
+        for (int ix = 0; ix < ORDER; ix++) {
+            float* plane = getPlane(gridIndexX+ix);
+            float xdata = charge*splines.getTheta(atom, 0, ix);
+            for (int iy = 0; iy < ORDER; iy++) {
+                int ybase = gridIndexY+iy;
+                ybase -= (ybase >= gridy ? gridy : 0);
+                float* row = &plane[ybase*gridz+gridIndexZ];
+                float multiplier = xdata*splines.getTheta(atom, 1, iy);
+                for (int j = 0; j < NUM_ZVEC; j++)
+                    (fvec4(&row[4*j])+zvec[j]*multiplier).store(&row[4*j]);
+                for (int j = 4*NUM_ZVEC; j < ORDER; j++)
+                    row[j] += multiplier*zdata[j];
+            }
+        }
+    }
+    else {
+        for (int ix = 0; ix < ORDER; ix++) {
+            float* plane = getPlane(gridIndexX+ix);
+            float xdata = charge*splines.getTheta(atom, 0, ix);
+            for (int iy = 0; iy < ORDER; iy++) {
+                int ybase = gridIndexY+iy;
+                ybase -= (ybase >= gridy ? gridy : 0);
+                ybase = ybase*gridz;
+                float multiplier = xdata*splines.getTheta(atom, 1, iy);
+                for (int j = 0; j < NUM_ZVEC; j++) {
+                    (zvec[j]*multiplier).store(temp);
+                    plane[ybase+zindex[4*j]] += temp[0];
+                    plane[ybase+zindex[4*j+1]] += temp[1];
+                    plane[ybase+zindex[4*j+2]] += temp[2];
+                    plane[ybase+zindex[4*j+3]] += temp[3];
                 }
+                for (int j = 4*NUM_ZVEC; j < ORDER; j++)
+                    plane[ybase+zindex[j]] += multiplier*zdata[j];
             }
         }
+    }
+}
+
+template <int ORDER>
+static void spreadCharge(float* posq, float* grid, SplineCache<ORDER>& splines, int gridx, int gridy, int gridz, int numParticles, Vec3* periodicBoxVectors, Vec3* recipBoxVectors,
+        gmx_atomic_t& atomicCounter, const float epsilonFactor, int threadIndex, int numThreads, bool deterministic, bool useVec8) {
+    auto getPlane = [&] (int x) {
+        x -= (x >= gridx ? gridx : 0);
+        return &grid[x*gridy*gridz];
+    };
+    memset(grid, 0, sizeof(float)*gridx*gridy*gridz);
+
+    // Atoms are processed in blocks of four, so the B-spline coefficients can be computed for a whole block at once.
+
+    int numBlocks = (numParticles+3)/4;
+    int block = threadIndex;
+    while (true) {
+        if (!deterministic)
+            block = gmx_atomic_fetch_add(&atomicCounter, 1);
+        if (block >= numBlocks)
+            break;
+        splines.computeBlock(posq, block, numParticles, gridx, gridy, gridz, periodicBoxVectors, recipBoxVectors);
+        for (int i = 4*block; i < min(4*block+4, numParticles); i++)
+            spreadAtomCharge(posq, i, splines, gridy, gridz, epsilonFactor, getPlane, useVec8);
         if (deterministic)
-            i += numThreads;
+            block += numThreads;
+    }
+}
+
+/**
+ * Spread charges using a slab decomposition of the grid.  Each thread owns a contiguous range of x-planes
+ * and spreads the charges of all atoms whose first grid index falls in its slab.  Contributions that spill
+ * past the end of the slab go into a small per-thread halo of ORDER-1 planes, which the next thread adds
+ * into its own slab once spreading is finished.  This requires every slab to be at least ORDER-1 planes
+ * thick.  Each slab's atoms are processed in order by a single thread, so the result is deterministic.
+ *
+ * This is executed by every thread, and synchronizes the threads with the barrier between its phases.
+ */
+template <int ORDER>
+static void spreadChargeOnSlabs(PmePhaseBarrier& barrier, int threadIndex, int numThreads, float* posq, float* grid, std::vector<float*>& haloGrid, SplineCache<ORDER>& splines,
+        int gridx, int gridy, int gridz, int numParticles, Vec3* periodicBoxVectors, Vec3* recipBoxVectors, const float epsilonFactor,
+        const vector<int>& planeSlab, vector<int>& atomSlab, vector<int>& slabAtomCount, vector<int>& sortedAtoms, bool useVec8) {
+    int planeSize = gridy*gridz;
+    int xStart = (threadIndex*gridx)/numThreads;
+    int xEnd = ((threadIndex+1)*gridx)/numThreads;
+    float* halo = haloGrid[threadIndex];
+
+    // Clear this thread's part of the grid and its halo.  Then compute the B-spline coefficients for a range
+    // of atoms, and count how many of them belong to each slab.
+
+    memset(&grid[xStart*planeSize], 0, sizeof(float)*(xEnd-xStart)*planeSize);
+    memset(halo, 0, sizeof(float)*(ORDER-1)*planeSize);
+    int numBlocks = (numParticles+3)/4;
+    int blockStart = (threadIndex*numBlocks)/numThreads;
+    int blockEnd = ((threadIndex+1)*numBlocks)/numThreads;
+    int atomStart = 4*blockStart;
+    int atomEnd = min(4*blockEnd, numParticles);
+    int* counts = &slabAtomCount[threadIndex*numThreads];
+    for (int i = 0; i < numThreads; i++)
+        counts[i] = 0;
+    for (int block = blockStart; block < blockEnd; block++)
+        splines.computeBlock(posq, block, numParticles, gridx, gridy, gridz, periodicBoxVectors, recipBoxVectors);
+    for (int i = atomStart; i < atomEnd; i++) {
+        int gridIndexX = splines.getGridIndex(i, 0);
+        int slab = (gridIndexX < 0 ? 0 : planeSlab[gridIndexX]);
+        atomSlab[i] = slab;
+        counts[slab]++;
+    }
+    barrier.sync();
+
+    // Sort the atoms by slab.  Within a slab they remain in order of index.
+
+    vector<int> offset(numThreads, 0);
+    int slabBegin = 0, slabAtoms = 0;
+    for (int slab = 0, base = 0; slab < numThreads; slab++) {
+        if (slab == threadIndex)
+            slabBegin = base;
+        for (int thread = 0; thread < numThreads; thread++) {
+            if (thread == threadIndex)
+                offset[slab] = base;
+            base += slabAtomCount[thread*numThreads+slab];
+        }
+        if (slab == threadIndex)
+            slabAtoms = base-slabBegin;
+    }
+    for (int i = atomStart; i < atomEnd; i++)
+        sortedAtoms[offset[atomSlab[i]]++] = i;
+    barrier.sync();
+
+    // Spread the charges of the atoms in this thread's slab.
+
+    auto getPlane = [&] (int x) {
+        return (x < xEnd ? &grid[x*planeSize] : &halo[(x-xEnd)*planeSize]);
+    };
+    for (int i = slabBegin; i < slabBegin+slabAtoms; i++)
+        spreadAtomCharge(posq, sortedAtoms[i], splines, gridy, gridz, epsilonFactor, getPlane, useVec8);
+}
+
+/**
+ * Add the halo of the preceding slab into the first planes of this thread's slab.
+ */
+static void sumSlabHalo(int threadIndex, int numThreads, float* grid, std::vector<float*>& haloGrid, int gridx, int gridy, int gridz, int order) {
+    int planeSize = gridy*gridz;
+    int xStart = (threadIndex*gridx)/numThreads;
+    float* halo = haloGrid[(threadIndex+numThreads-1)%numThreads];
+    float* target = &grid[xStart*planeSize];
+    int haloSize = (order-1)*planeSize;
+    int i = 0;
+    for (; i+3 < haloSize; i += 4)
+        (fvec4(&target[i])+fvec4(&halo[i])).store(&target[i]);
+    for (; i < haloSize; i++)
+        target[i] += halo[i];
+}
+
+/**
+ * Decide whether to spread charges with a slab decomposition or with a separate grid for every thread.
+ * This can be chosen by setting the OPENMM_CPU_PME_SPREADING environment variable to "slab" or "grids".
+ * By default slabs are used whenever every thread's slab would be thick enough to hold a halo.
+ */
+static bool selectSlabSpreading(int gridx, int numThreads, int order) {
+    bool slabsFit = (gridx/numThreads >= order-1);
+    char* spreadingEnv = getenv("OPENMM_CPU_PME_SPREADING");
+    if (spreadingEnv != NULL) {
+        string mode(spreadingEnv);
+        if (mode == "grids")
+            return false;
+        if (mode != "slab")
+            throw OpenMMException("Illegal value for OPENMM_CPU_PME_SPREADING: "+mode);
+        if (!slabsFit)
+            throw OpenMMException("OPENMM_CPU_PME_SPREADING: The PME grid is too small to divide into slabs for this number of threads");
+        return true;
     }
+    return (slabsFit && numThreads > 1);
+}
+
+/**
+ * Allocate the grids used for charge spreading.  Per-thread spreading needs a full grid for every thread,
+ * while slab spreading needs only a single grid and a halo for every thread.
+ */
+static void allocateSpreadingGrids(bool useSlabs, int numThreads, int gridx, int gridy, int gridz, int order, vector<float*>& tempGrid,
+        vector<float*>& haloGrid, vector<int>& planeSlab, vector<int>& atomSlab, vector<int>& slabAtomCount, vector<int>& sortedAtoms, int numParticles) {
+    if (!useSlabs) {
+        for (int i = 0; i < numThreads; i++)
+            tempGrid.push_back((float*) fftwf_malloc(sizeof(float)*(gridx*gridy*gridz+3)));
+        return;
+    }
+    tempGrid.push_back((float*) fftwf_malloc(sizeof(float)*(gridx*gridy*gridz+3)));
+    for (int i = 0; i < numThreads; i++)
+        haloGrid.push_back((float*) fftwf_malloc(sizeof(float)*((order-1)*gridy*gridz+3)));
+    planeSlab.resize(gridx);
+    for (int slab = 0; slab < numThreads; slab++)
+        for (int x = (slab*gridx)/numThreads; x < ((slab+1)*gridx)/numThreads; x++)
+            planeSlab[x] = slab;
+    atomSlab.resize(numParticles);
+    sortedAtoms.resize(numParticles);
+    slabAtomCount.resize(numThreads*numThreads);
 }
 
 #define FAST_ERFC 1
@@ -310,162 +571,163 @@ static void reciprocalConvolution(int start, int end, fftwf_complex* grid, vecto
     }
 }
 
-static void interpolateForces(float* posq, float* force, float* grid, int gridx, int gridy, int gridz, int numParticles, Vec3* periodicBoxVectors, Vec3* recipBoxVectors, gmx_atomic_t& atomicCounter, const float epsilonFactor) {
-    fvec4 boxSize((float) periodicBoxVectors[0][0], (float) periodicBoxVectors[1][1], (float) periodicBoxVectors[2][2], 0);
-    fvec4 invBoxSize((float) recipBoxVectors[0][0], (float) recipBoxVectors[1][1], (float) recipBoxVectors[2][2], 0);
-    fvec4 recipBoxVec0((float) recipBoxVectors[0][0], (float) recipBoxVectors[0][1], (float) recipBoxVectors[0][2], 0);
-    fvec4 recipBoxVec1((float) recipBoxVectors[1][0], (float) recipBoxVectors[1][1], (float) recipBoxVectors[1][2], 0);
-    fvec4 recipBoxVec2((float) recipBoxVectors[2][0], (float) recipBoxVectors[2][1], (float) recipBoxVectors[2][2], 0);
-    fvec4 gridSize(gridx, gridy, gridz, 0);
-    ivec4 gridSizeInt(gridx, gridy, gridz, 0);
-    fvec4 one(1);
-    fvec4 scale(1.0f/(PME_ORDER-1));
+template <int ORDER>
+static void interpolateForces(float* posq, float* force, float* grid, const SplineCache<ORDER>& splines, int gridx, int gridy, int gridz, int numParticles, Vec3* recipBoxVectors,
+        gmx_atomic_t& atomicCounter, const float epsilonFactor, bool useVec8) {
     while (true) {
         int i = gmx_atomic_fetch_add(&atomicCounter, 1);
         if (i >= numParticles)
             break;
 
-        // Find the position relative to the nearest grid point.
-        
-        fvec4 pos(&posq[4*i]);
-        float posInBox[4];
-        (pos-boxSize*floor(pos*invBoxSize)).store(posInBox);
-        fvec4 t = posInBox[0]*recipBoxVec0 + posInBox[1]*recipBoxVec1 + posInBox[2]*recipBoxVec2;
-        t = (t-floor(t))*gridSize;
-        ivec4 ti = t;
-        fvec4 dr = t-ti;
-        ivec4 gridIndex = ti-(gridSizeInt&ti==gridSizeInt);
-        
-        // Compute the B-spline coefficients.
-        
-        fvec4 data[PME_ORDER];
-        fvec4 ddata[PME_ORDER];
-        data[PME_ORDER-1] = 0.0f;
-        data[1] = dr;
-        data[0] = one-dr;
-        for (int j = 3; j < PME_ORDER; j++) {
-            fvec4 div(1.0f/(j-1));
-            data[j-1] = div*dr*data[j-2];
-            for (int k = 1; k < j-1; k++)
-                data[j-k-1] = div*((dr+k)*data[j-k-2]+(fvec4(j-k)-dr)*data[j-k-1]);
-            data[0] = div*(one-dr)*data[0];
-        }
-        ddata[0] = -data[0];
-        for (int j = 1; j < PME_ORDER; j++)
-            ddata[j] = data[j-1]-data[j];
-        data[PME_ORDER-1] = scale*dr*data[PME_ORDER-2];
-        for (int j = 1; j < (PME_ORDER-1); j++)
-            data[PME_ORDER-j-1] = scale*((dr+j)*data[PME_ORDER-j-2]+(fvec4(PME_ORDER-j)-dr)*data[PME_ORDER-j-1]);
-        data[0] = scale*(one-dr)*data[0];
-                
-        // Compute the force on this atom.
-        
-        int gridIndexX = gridIndex[0];
-        int gridIndexY = gridIndex[1];
-        int gridIndexZ = gridIndex[2];
+        // Compute the force on this atom from its cached B-spline coefficients.
+
+        int gridIndexX = splines.getGridIndex(i, 0);
+        int gridIndexY = splines.getGridIndex(i, 1);
+        int gridIndexZ = splines.getGridIndex(i, 2);
         if (gridIndexX < 0)
             return; // This happens when a simulation blows up and coordinates become NaN.
-        int zindex[PME_ORDER];
-        for (int j = 0; j < PME_ORDER; j++) {
-            zindex[j] = gridIndexZ+j;
-            zindex[j] -= (zindex[j] >= gridz ? gridz : 0);
+        float fc[4];
+        if (useVec8) {
+            float* planes[ORDER];
+            int yindex[ORDER];
+            float theta[3][ORDER], dtheta[3][ORDER];
+            for (int j = 0; j < ORDER; j++) {
+                int xindex = gridIndexX+j;
+                xindex -= (xindex >= gridx ? gridx : 0);
+                planes[j] = &grid[xindex*gridy*gridz];
+                yindex[j] = gridIndexY+j;
+                yindex[j] -= (yindex[j] >= gridy ? gridy : 0);
+                for (int d = 0; d < 3; d++) {
+                    theta[d][j] = splines.getTheta(i, d, j);
+                    dtheta[d][j] = splines.getDTheta(i, d, j);
+                }
+            }
+            const float* thetaPointers[3] = {theta[0], theta[1], theta[2]};
+            const float* dthetaPointers[3] = {dtheta[0], dtheta[1], dtheta[2]};
+            interpolateAtomForceVec8(planes, yindex, gridIndexZ, gridz, ORDER, thetaPointers, dthetaPointers, fc);
+            float scale = -epsilonFactor*posq[4*i+3];
+            for (int d = 0; d < 3; d++)
+                fc[d] *= scale;
         }
-        fvec4 zdata[PME_ORDER];
-        for (int j = 0; j < PME_ORDER; j++)
-            zdata[j] = fvec4(data[j][2], data[j][2], ddata[j][2], 0);
-        fvec4 f = 0.0f;
-        for (int ix = 0; ix < PME_ORDER; ix++) {
-            int xbase = gridIndexX+ix;
-            xbase -= (xbase >= gridx ? gridx : 0);
-            xbase = xbase*gridy*gridz;
-            float dx = data[ix][0];
-            float ddx = ddata[ix][0];
-            fvec4 xdata(ddx, dx, dx, 0);
-
-            for (int iy = 0; iy < PME_ORDER; iy++) {
-                int ybase = gridIndexY+iy;
-                ybase -= (ybase >= gridy ? gridy : 0);
-                ybase = xbase + ybase*gridz;
-                float dy = data[iy][1];
-                float ddy = ddata[iy][1];
-                fvec4 xydata = xdata*fvec4(dy, ddy, dy, 0);
-
-                for (int iz = 0; iz < PME_ORDER; iz++) {
-                    fvec4 gridValue(grid[ybase+zindex[iz]]);
-                    f = f+xydata*zdata[iz]*gridValue;
+        else {
+            int zindex[ORDER];
+            for (int j = 0; j < ORDER; j++) {
+                zindex[j] = gridIndexZ+j;
+                zindex[j] -= (zindex[j] >= gridz ? gridz : 0);
+            }
+            fvec4 zdata[ORDER];
+            for (int j = 0; j < ORDER; j++) {
+                float dz = splines.getTheta(i, 2, j);
+                zdata[j] = fvec4(dz, dz, splines.getDTheta(i, 2, j), 0);
+            }
+            fvec4 f = 0.0f;
+            for (int ix = 0; ix < ORDER; ix++) {
+                int xbase = gridIndexX+ix;
+                xbase -= (xbase >= gridx ? gridx : 0);
+                xbase = xbase*gridy*gridz;
+                float dx = splines.getTheta(i, 0, ix);
+                float ddx = splines.getDTheta(i, 0, ix);
+                fvec4 xdata(ddx, dx, dx, 0);
+
+                for (int iy = 0; iy < ORDER; iy++) {
+                    int ybase = gridIndexY+iy;
+                    ybase -= (ybase >= gridy ? gridy : 0);
+                    ybase = xbase + ybase*gridz;
+                    float dy = splines.getTheta(i, 1, iy);
+                    float ddy = splines.getDTheta(i, 1, iy);
+                    fvec4 xydata = xdata*fvec4(dy, ddy, dy, 0);
+
+                    for (int iz = 0; iz < ORDER; iz++) {
+                        fvec4 gridValue(grid[ybase+zindex[iz]]);
+                        f = f+xydata*zdata[iz]*gridValue;
+                    }
                 }
             }
+            f *= -epsilonFactor*posq[4*i+3];
+            f.store(fc);
         }
-        f *= -epsilonFactor*posq[4*i+3];
-        float fc[4];
-        f.store(fc);
         force[4*i+0] = fc[0]*gridx*(float)recipBoxVectors[0][0];
         force[4*i+1] = fc[0]*gridx*(float)recipBoxVectors[1][0]+fc[1]*gridy*(float)recipBoxVectors[1][1];
         force[4*i+2] = fc[0]*gridx*(float)recipBoxVectors[2][0]+fc[1]*gridy*(float)recipBoxVectors[2][1]+fc[2]*gridz*(float)recipBoxVectors[2][2];
     }
 }
 
-static void* threadBody(void* args) {
-    CpuCalcPmeReciprocalForceKernel& owner = *reinterpret_cast<CpuCalcPmeReciprocalForceKernel*>(args);
-    owner.runMainThread();
-    return 0;
+/**
+ * Get the file FFTW wisdom for a grid should be cached in, or an empty string if wisdom should not be cached.
+ * Setting the OPENMM_CPU_PME_WISDOM_DIR environment variable enables caching.  Each combination of grid
+ * dimensions and thread count gets its own file in that directory.
+ */
+static string getWisdomFileName(int gridx, int gridy, int gridz, int numThreads) {
+    char* wisdomDir = getenv("OPENMM_CPU_PME_WISDOM_DIR");
+    if (wisdomDir == NULL || wisdomDir[0] == 0)
+        return "";
+    stringstream name;
+    name << wisdomDir << "/pme-" << gridx << "x" << gridy << "x" << gridz << "-" << numThreads << "threads.wisdom";
+    return name.str();
+}
+
+/**
+ * Create the forward and backward FFT plans.  If a wisdom file exists for this grid it is loaded first, so FFTW
+ * can skip the measurements.  Otherwise the wisdom gathered while planning is saved for next time.  It is
+ * written to a temporary file and then renamed, so processes creating contexts at the same time never see a
+ * partially written file.
+ */
+static void createFFTPlans(int gridx, int gridy, int gridz, int numThreads, float* realGrid, fftwf_complex* complexGrid, fftwf_plan& forwardFFT, fftwf_plan& backwardFFT) {
+    string wisdomFile = getWisdomFileName(gridx, gridy, gridz, numThreads);
+    bool loadedWisdom = (wisdomFile.size() > 0 && fftwf_import_wisdom_from_filename(wisdomFile.c_str()));
+    fftwf_plan_with_nthreads(numThreads);
+    forwardFFT = fftwf_plan_dft_r2c_3d(gridx, gridy, gridz, realGrid, complexGrid, FFTW_MEASURE);
+    backwardFFT = fftwf_plan_dft_c2r_3d(gridx, gridy, gridz, complexGrid, realGrid, FFTW_MEASURE);
+    if (wisdomFile.size() > 0 && !loadedWisdom) {
+        stringstream tempFile;
+        tempFile << wisdomFile << "." << getpid() << ".tmp";
+        if (!fftwf_export_wisdom_to_filename(tempFile.str().c_str()) || rename(tempFile.str().c_str(), wisdomFile.c_str()) != 0)
+            remove(tempFile.str().c_str());
+    }
 }
 
-void CpuCalcPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize, int numParticles, double alpha, bool deterministic) {
+void CpuCalcPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize, int order, int numParticles, double alpha, bool deterministic) {
+    if (order < 4 || order > 8)
+        throw OpenMMException("CpuCalcPmeReciprocalForceKernel: PME interpolation order must be between 4 and 8");
     if (!hasInitializedThreads) {
-        numThreads = getNumProcessors();
-        char* threadsEnv = getenv("OPENMM_CPU_THREADS");
-        if (threadsEnv != NULL)
-            stringstream(threadsEnv) >> numThreads;
         fftwf_init_threads();
         hasInitializedThreads = true;
     }
     threadEnergy.resize(numThreads);
-    gridx = findFFTDimension(xsize, false);
-    gridy = findFFTDimension(ysize, false);
-    gridz = findFFTDimension(zsize, true);
+    // Spreading assumes an atom's B-spline wraps around the grid at most once, so every dimension must be
+    // at least the interpolation order.
+
+    gridx = findFFTDimension(std::max(xsize, order), false);
+    gridy = findFFTDimension(std::max(ysize, order), false);
+    gridz = findFFTDimension(std::max(zsize, order), true);
     this->numParticles = numParticles;
+    this->pmeOrder = order;
     this->alpha = alpha;
     this->deterministic = deterministic;
+    useVec8 = (vectorWidth != 4 && isPmeVec8Supported());
     force.resize(4*numParticles);
+    allocateSplineCache(splineGridIndex, splineTheta, splineDTheta, numParticles, pmeOrder);
     recipEterm.resize(gridx*gridy*gridz);
     
-    // Initialize threads.
-    
-    isFinished = false;
-    pthread_cond_init(&startCondition, NULL);
-    pthread_cond_init(&endCondition, NULL);
-    pthread_mutex_init(&lock, NULL);
-    pthread_create(&mainThread, NULL, threadBody, this);
-    
-    // Wait until the main thread is up and running.
-    
-    pthread_mutex_lock(&lock);
-    while (!isFinished)
-        pthread_cond_wait(&endCondition, &lock);
-    pthread_mutex_unlock(&lock);
-    
     // Initialize FFTW.
     
-    for (int i = 0; i < numThreads; i++)
-        tempGrid.push_back((float*) fftwf_malloc(sizeof(float)*(gridx*gridy*gridz+3)));
+    useSlabs = selectSlabSpreading(gridx, numThreads, pmeOrder);
+    allocateSpreadingGrids(useSlabs, numThreads, gridx, gridy, gridz, pmeOrder, tempGrid, haloGrid, planeSlab, atomSlab, slabAtomCount, sortedAtoms, numParticles);
     realGrid = tempGrid[0];
     complexGrid = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex)*gridx*gridy*(gridz/2+1));
-    fftwf_plan_with_nthreads(numThreads);
-    forwardFFT = fftwf_plan_dft_r2c_3d(gridx, gridy, gridz, realGrid, complexGrid, FFTW_MEASURE);
-    backwardFFT = fftwf_plan_dft_c2r_3d(gridx, gridy, gridz, complexGrid, realGrid, FFTW_MEASURE);
+    createFFTPlans(gridx, gridy, gridz, numThreads, realGrid, complexGrid, forwardFFT, backwardFFT);
     hasCreatedPlan = true;
     
     // Initialize the b-spline moduli.
 
     int maxSize = std::max(std::max(gridx, gridy), gridz);
-    vector<double> data(PME_ORDER);
-    vector<double> ddata(PME_ORDER);
-    vector<double> bsplinesData(maxSize);
-    data[PME_ORDER-1] = 0.0;
+    vector<double> data(pmeOrder);
+    vector<double> ddata(pmeOrder);
+    vector<double> bsplinesData(std::max(maxSize, pmeOrder+1));
+    data[pmeOrder-1] = 0.0;
     data[1] = 0.0;
     data[0] = 1.0;
-    for (int i = 3; i < PME_ORDER; i++) {
+    for (int i = 3; i < pmeOrder; i++) {
         double div = 1.0/(i-1.0);
         data[i-1] = 0.0;
         for (int j = 1; j < (i-1); j++)
@@ -476,16 +738,16 @@ void CpuCalcPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize
     // Differentiate.
 
     ddata[0] = -data[0];
-    for (int i = 1; i < PME_ORDER; i++)
+    for (int i = 1; i < pmeOrder; i++)
         ddata[i] = data[i-1]-data[i];
-    double div = 1.0/(PME_ORDER-1);
-    data[PME_ORDER-1] = 0.0;
-    for (int i = 1; i < (PME_ORDER-1); i++)
-        data[PME_ORDER-i-1] = div*(i*data[PME_ORDER-i-2]+(PME_ORDER-i)*data[PME_ORDER-i-1]);
+    double div = 1.0/(pmeOrder-1);
+    data[pmeOrder-1] = 0.0;
+    for (int i = 1; i < (pmeOrder-1); i++)
+        data[pmeOrder-i-1] = div*(i*data[pmeOrder-i-2]+(pmeOrder-i)*data[pmeOrder-i-1]);
     data[0] = div*data[0];
     for (int i = 0; i < maxSize; i++)
         bsplinesData[i] = 0.0;
-    for (int i = 1; i <= PME_ORDER; i++)
+    for (int i = 1; i <= pmeOrder; i++)
         bsplinesData[i] = data[i-1];
 
     // Evaluate the actual bspline moduli for X/Y/Z.
@@ -513,16 +775,10 @@ void CpuCalcPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize
 }
 
 CpuCalcPmeReciprocalForceKernel::~CpuCalcPmeReciprocalForceKernel() {
-    isDeleted = true;
-    pthread_mutex_lock(&lock);
-    pthread_cond_broadcast(&startCondition);
-    pthread_mutex_unlock(&lock);
-    pthread_join(mainThread, NULL);
-    pthread_mutex_destroy(&lock);
-    pthread_cond_destroy(&startCondition);
-    pthread_cond_destroy(&endCondition);
     for (auto grid : tempGrid)
         fftwf_free(grid);
+    for (auto grid : haloGrid)
+        fftwf_free(grid);
     if (complexGrid != NULL)
         fftwf_free(complexGrid);
     if (hasCreatedPlan) {
@@ -531,52 +787,28 @@ CpuCalcPmeReciprocalForceKernel::~CpuCalcPmeReciprocalForceKernel() {
     }
 }
 
-void CpuCalcPmeReciprocalForceKernel::runMainThread() {
-    // This is the main thread that coordinates all the other ones.
-
-    pthread_mutex_lock(&lock);
-    isFinished = true;
-    pthread_cond_signal(&endCondition);
-    ThreadPool threads(numThreads);
-    while (true) {
-        // Wait for the signal to start.
-
-        pthread_cond_wait(&startCondition, &lock);
-        if (isDeleted)
+void CpuCalcPmeReciprocalForceKernel::runWorkerThread(ThreadPool& threads, int index) {
+    switch (pmeOrder) {
+        case 4:
+            runWorkerThreadForOrder<4>(threads, index);
+            break;
+        case 5:
+            runWorkerThreadForOrder<5>(threads, index);
+            break;
+        case 6:
+            runWorkerThreadForOrder<6>(threads, index);
+            break;
+        case 7:
+            runWorkerThreadForOrder<7>(threads, index);
+            break;
+        case 8:
+            runWorkerThreadForOrder<8>(threads, index);
             break;
-        posq = io->getPosq();
-        gmx_atomic_set(&atomicCounter, 0);
-        threads.execute([&] (ThreadPool& threads, int threadIndex) { runWorkerThread(threads, threadIndex); }); // Signal threads to perform charge spreading.
-        threads.waitForThreads();
-        threads.resumeThreads(); // Signal threads to sum the charge grids.
-        threads.waitForThreads();
-        fftwf_execute_dft_r2c(forwardFFT, realGrid, complexGrid);
-        if (lastBoxVectors[0] != periodicBoxVectors[0] || lastBoxVectors[1] != periodicBoxVectors[1] || lastBoxVectors[2] != periodicBoxVectors[2]) {
-            threads.resumeThreads(); // Signal threads to compute the reciprocal scale factors.
-            threads.waitForThreads();
-        }
-        if (includeEnergy) {
-            threads.resumeThreads(); // Signal threads to compute energy.
-            threads.waitForThreads();
-            for (auto e : threadEnergy)
-                energy += e;
-        }
-        threads.resumeThreads(); // Signal threads to perform reciprocal convolution.
-        threads.waitForThreads();
-        fftwf_execute_dft_c2r(backwardFFT, complexGrid, realGrid);
-        gmx_atomic_set(&atomicCounter, 0);
-        threads.resumeThreads(); // Signal threads to interpolate forces.
-        threads.waitForThreads();
-        isFinished = true;
-        lastBoxVectors[0] = periodicBoxVectors[0];
-        lastBoxVectors[1] = periodicBoxVectors[1];
-        lastBoxVectors[2] = periodicBoxVectors[2];
-        pthread_cond_signal(&endCondition);
     }
-    pthread_mutex_unlock(&lock);
 }
 
-void CpuCalcPmeReciprocalForceKernel::runWorkerThread(ThreadPool& threads, int index) {
+template <int ORDER>
+void CpuCalcPmeReciprocalForceKernel::runWorkerThreadForOrder(ThreadPool& threads, int index) {
     int gridxStart = (index*gridx)/numThreads;
     int gridxEnd = ((index+1)*gridx)/numThreads;
     int gridSize = (gridx*gridy*gridz+3)/4;
@@ -585,35 +817,49 @@ void CpuCalcPmeReciprocalForceKernel::runWorkerThread(ThreadPool& threads, int i
     int complexSize = gridx*gridy*(gridz/2+1);
     int complexStart = std::max(1, ((index*complexSize)/numThreads));
     int complexEnd = (((index+1)*complexSize)/numThreads);
+    SplineCache<ORDER> splines(splineGridIndex, splineTheta, splineDTheta);
     const float epsilonFactor = sqrt(ONE_4PI_EPS0);
-    spreadCharge(posq, tempGrid[index], gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors, atomicCounter, epsilonFactor, index, numThreads, deterministic);
-    threads.syncThreads();
-    int numGrids = tempGrid.size();
-    for (int i = gridStart; i < gridEnd; i += 4) {
-        fvec4 sum(&realGrid[i]);
-        for (int j = 1; j < numGrids; j++)
-            sum += fvec4(&tempGrid[j][i]);
-        sum.store(&realGrid[i]);
-    }
-    threads.syncThreads();
+    if (useSlabs) {
+        spreadChargeOnSlabs(barrier, index, numThreads, posq, realGrid, haloGrid, splines, gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors,
+                epsilonFactor, planeSlab, atomSlab, slabAtomCount, sortedAtoms, useVec8);
+        barrier.sync();
+        sumSlabHalo(index, numThreads, realGrid, haloGrid, gridx, gridy, gridz, ORDER);
+    }
+    else {
+        spreadCharge(posq, tempGrid[index], splines, gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors, atomicCounter, epsilonFactor, index, numThreads, deterministic, useVec8);
+        barrier.sync();
+        int numGrids = tempGrid.size();
+        for (int i = gridStart; i < gridEnd; i += 4) {
+            fvec4 sum(&realGrid[i]);
+            for (int j = 1; j < numGrids; j++)
+                sum += fvec4(&tempGrid[j][i]);
+            sum.store(&realGrid[i]);
+        }
+    }
+    barrier.sync([this] () { fftwf_execute_dft_r2c(forwardFFT, realGrid, complexGrid); });
     if (lastBoxVectors[0] != periodicBoxVectors[0] || lastBoxVectors[1] != periodicBoxVectors[1] || lastBoxVectors[2] != periodicBoxVectors[2]) {
         computeReciprocalEterm(gridxStart, gridxEnd, gridx, gridy, gridz, recipEterm, alpha, bsplineModuli, periodicBoxVectors, recipBoxVectors);
-        threads.syncThreads();
+        barrier.sync();
     }
     if (includeEnergy) {
         threadEnergy[index] = reciprocalEnergy(gridxStart, gridxEnd, complexGrid, recipEterm, gridx, gridy, gridz, alpha, bsplineModuli, periodicBoxVectors, recipBoxVectors);
-        threads.syncThreads();
+        barrier.sync();
     }
+    if (!includeForces)
+        return;
     reciprocalConvolution(complexStart, complexEnd, complexGrid, recipEterm);
-    threads.syncThreads();
-    interpolateForces(posq, &force[0], realGrid, gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors, atomicCounter, epsilonFactor);
+    barrier.sync([this] () {
+        fftwf_execute_dft_c2r(backwardFFT, complexGrid, realGrid);
+        gmx_atomic_set(&atomicCounter, 0);
+    });
+    interpolateForces(posq, &force[0], realGrid, splines, gridx, gridy, gridz, numParticles, recipBoxVectors, atomicCounter, epsilonFactor, useVec8);
 }
 
-void CpuCalcPmeReciprocalForceKernel::beginComputation(IO& io, const Vec3* periodicBoxVectors, bool includeEnergy) {
-    this->io = &io;
+void CpuCalcPmeReciprocalForceKernel::beginComputation(IO& io, const Vec3* periodicBoxVectors, bool includeForces, bool includeEnergy) {
     this->periodicBoxVectors[0] = periodicBoxVectors[0];
     this->periodicBoxVectors[1] = periodicBoxVectors[1];
     this->periodicBoxVectors[2] = periodicBoxVectors[2];
+    this->includeForces = includeForces;
     this->includeEnergy = includeEnergy;
     energy = 0.0;
 
@@ -625,24 +871,35 @@ void CpuCalcPmeReciprocalForceKernel::beginComputation(IO& io, const Vec3* perio
     recipBoxVectors[1] = Vec3(-periodicBoxVectors[1][0]*periodicBoxVectors[2][2], periodicBoxVectors[0][0]*periodicBoxVectors[2][2], 0)*scale;
     recipBoxVectors[2] = Vec3(periodicBoxVectors[1][0]*periodicBoxVectors[2][1]-periodicBoxVectors[1][1]*periodicBoxVectors[2][0], -periodicBoxVectors[0][0]*periodicBoxVectors[2][1], periodicBoxVectors[0][0]*periodicBoxVectors[1][1])*scale;
 
-    // Do the calculation.
+    // Start the threads.  They carry out the whole calculation, including the FFTs, without any further
+    // involvement from this thread, so the caller is free to do other work until finishComputation().
 
-    pthread_mutex_lock(&lock);
-    isFinished = false;
-    pthread_cond_signal(&startCondition);
-    pthread_mutex_unlock(&lock);
+    posq = io.getPosq();
+    gmx_atomic_set(&atomicCounter, 0);
+    threads.execute([this] (ThreadPool& threads, int threadIndex) { runWorkerThread(threads, threadIndex); });
 }
 
 double CpuCalcPmeReciprocalForceKernel::finishComputation(IO& io) {
-    pthread_mutex_lock(&lock);
-    while (!isFinished) {
-        pthread_cond_wait(&endCondition, &lock);
-    }
-    pthread_mutex_unlock(&lock);
-    io.setForce(&force[0]);
+    threads.waitForThreads();
+    if (includeEnergy)
+        for (auto e : threadEnergy)
+            energy += e;
+    lastBoxVectors[0] = periodicBoxVectors[0];
+    lastBoxVectors[1] = periodicBoxVectors[1];
+    lastBoxVectors[2] = periodicBoxVectors[2];
+    if (includeForces)
+        io.setForce(&force[0]);
     return energy;
 }
 
+int CpuCalcPmeReciprocalForceKernel::getDefaultNumThreads() {
+    int numThreads = getNumProcessors();
+    char* threadsEnv = getenv("OPENMM_CPU_THREADS");
+    if (threadsEnv != NULL)
+        stringstream(threadsEnv) >> numThreads;
+    return numThreads;
+}
+
 bool CpuCalcPmeReciprocalForceKernel::isProcessorSupported() {
     return isVec4Supported();
 }
@@ -683,80 +940,50 @@ int CpuCalcPmeReciprocalForceKernel::findFFTDimension(int minimum, bool isZ) {
  */
 
 bool CpuCalcPmeReciprocalForceKernel::hasInitializedThreads = false;
-int CpuCalcPmeReciprocalForceKernel::numThreads = 0;
 
 
-class CpuCalcDispersionPmeReciprocalForceKernel::ComputeTask : public ThreadPool::Task {
-public:
-    ComputeTask(CpuCalcDispersionPmeReciprocalForceKernel& owner) : owner(owner) {
-    }
-    void execute(ThreadPool& threads, int threadIndex) {
-        owner.runWorkerThread(threads, threadIndex);
-    }
-    CpuCalcDispersionPmeReciprocalForceKernel& owner;
-};
-
-static void* dispersionThreadBody(void* args) {
-    CpuCalcDispersionPmeReciprocalForceKernel& owner = *reinterpret_cast<CpuCalcDispersionPmeReciprocalForceKernel*>(args);
-    owner.runMainThread();
-    return 0;
-}
-
-void CpuCalcDispersionPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize, int numParticles, double alpha, bool deterministic) {
+void CpuCalcDispersionPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize, int order, int numParticles, double alpha, bool deterministic) {
+    if (order < 4 || order > 8)
+        throw OpenMMException("CpuCalcDispersionPmeReciprocalForceKernel: PME interpolation order must be between 4 and 8");
     if (!hasInitializedThreads) {
-        numThreads = getNumProcessors();
-        char* threadsEnv = getenv("OPENMM_CPU_THREADS");
-        if (threadsEnv != NULL)
-            stringstream(threadsEnv) >> numThreads;
         fftwf_init_threads();
         hasInitializedThreads = true;
     }
     threadEnergy.resize(numThreads);
-    gridx = findFFTDimension(xsize, false);
-    gridy = findFFTDimension(ysize, false);
-    gridz = findFFTDimension(zsize, true);
+    // Spreading assumes an atom's B-spline wraps around the grid at most once, so every dimension must be
+    // at least the interpolation order.
+
+    gridx = findFFTDimension(std::max(xsize, order), false);
+    gridy = findFFTDimension(std::max(ysize, order), false);
+    gridz = findFFTDimension(std::max(zsize, order), true);
     this->numParticles = numParticles;
+    this->pmeOrder = order;
     this->alpha = alpha;
     this->deterministic = deterministic;
+    useVec8 = (vectorWidth != 4 && isPmeVec8Supported());
     force.resize(4*numParticles);
+    allocateSplineCache(splineGridIndex, splineTheta, splineDTheta, numParticles, pmeOrder);
     recipEterm.resize(gridx*gridy*gridz);
     
-    // Initialize threads.
-    
-    isFinished = false;
-    pthread_cond_init(&startCondition, NULL);
-    pthread_cond_init(&endCondition, NULL);
-    pthread_mutex_init(&lock, NULL);
-    pthread_create(&mainThread, NULL, dispersionThreadBody, this);
-    
-    // Wait until the main thread is up and running.
-    
-    pthread_mutex_lock(&lock);
-    while (!isFinished)
-        pthread_cond_wait(&endCondition, &lock);
-    pthread_mutex_unlock(&lock);
-    
     // Initialize FFTW.
     
-    for (int i = 0; i < numThreads; i++)
-        tempGrid.push_back((float*) fftwf_malloc(sizeof(float)*(gridx*gridy*gridz+3)));
+    useSlabs = selectSlabSpreading(gridx, numThreads, pmeOrder);
+    allocateSpreadingGrids(useSlabs, numThreads, gridx, gridy, gridz, pmeOrder, tempGrid, haloGrid, planeSlab, atomSlab, slabAtomCount, sortedAtoms, numParticles);
     realGrid = tempGrid[0];
     complexGrid = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex)*gridx*gridy*(gridz/2+1));
-    fftwf_plan_with_nthreads(numThreads);
-    forwardFFT = fftwf_plan_dft_r2c_3d(gridx, gridy, gridz, realGrid, complexGrid, FFTW_MEASURE);
-    backwardFFT = fftwf_plan_dft_c2r_3d(gridx, gridy, gridz, complexGrid, realGrid, FFTW_MEASURE);
+    createFFTPlans(gridx, gridy, gridz, numThreads, realGrid, complexGrid, forwardFFT, backwardFFT);
     hasCreatedPlan = true;
     
     // Initialize the b-spline moduli.
 
     int maxSize = std::max(std::max(gridx, gridy), gridz);
-    vector<double> data(PME_ORDER);
-    vector<double> ddata(PME_ORDER);
-    vector<double> bsplinesData(maxSize);
-    data[PME_ORDER-1] = 0.0;
+    vector<double> data(pmeOrder);
+    vector<double> ddata(pmeOrder);
+    vector<double> bsplinesData(std::max(maxSize, pmeOrder+1));
+    data[pmeOrder-1] = 0.0;
     data[1] = 0.0;
     data[0] = 1.0;
-    for (int i = 3; i < PME_ORDER; i++) {
+    for (int i = 3; i < pmeOrder; i++) {
         double div = 1.0/(i-1.0);
         data[i-1] = 0.0;
         for (int j = 1; j < (i-1); j++)
@@ -767,16 +994,16 @@ void CpuCalcDispersionPmeReciprocalForceKernel::initialize(int xsize, int ysize,
     // Differentiate.
 
     ddata[0] = -data[0];
-    for (int i = 1; i < PME_ORDER; i++)
+    for (int i = 1; i < pmeOrder; i++)
         ddata[i] = data[i-1]-data[i];
-    double div = 1.0/(PME_ORDER-1);
-    data[PME_ORDER-1] = 0.0;
-    for (int i = 1; i < (PME_ORDER-1); i++)
-        data[PME_ORDER-i-1] = div*(i*data[PME_ORDER-i-2]+(PME_ORDER-i)*data[PME_ORDER-i-1]);
+    double div = 1.0/(pmeOrder-1);
+    data[pmeOrder-1] = 0.0;
+    for (int i = 1; i < (pmeOrder-1); i++)
+        data[pmeOrder-i-1] = div*(i*data[pmeOrder-i-2]+(pmeOrder-i)*data[pmeOrder-i-1]);
     data[0] = div*data[0];
     for (int i = 0; i < maxSize; i++)
         bsplinesData[i] = 0.0;
-    for (int i = 1; i <= PME_ORDER; i++)
+    for (int i = 1; i <= pmeOrder; i++)
         bsplinesData[i] = data[i-1];
 
     // Evaluate the actual bspline moduli for X/Y/Z.
@@ -804,16 +1031,10 @@ void CpuCalcDispersionPmeReciprocalForceKernel::initialize(int xsize, int ysize,
 }
 
 CpuCalcDispersionPmeReciprocalForceKernel::~CpuCalcDispersionPmeReciprocalForceKernel() {
-    isDeleted = true;
-    pthread_mutex_lock(&lock);
-    pthread_cond_broadcast(&startCondition);
-    pthread_mutex_unlock(&lock);
-    pthread_join(mainThread, NULL);
-    pthread_mutex_destroy(&lock);
-    pthread_cond_destroy(&startCondition);
-    pthread_cond_destroy(&endCondition);
     for (auto grid : tempGrid)
         fftwf_free(grid);
+    for (auto grid : haloGrid)
+        fftwf_free(grid);
     if (complexGrid != NULL)
         fftwf_free(complexGrid);
     if (hasCreatedPlan) {
@@ -822,53 +1043,28 @@ CpuCalcDispersionPmeReciprocalForceKernel::~CpuCalcDispersionPmeReciprocalForceK
     }
 }
 
-void CpuCalcDispersionPmeReciprocalForceKernel::runMainThread() {
-    // This is the main thread that coordinates all the other ones.
-
-    pthread_mutex_lock(&lock);
-    isFinished = true;
-    pthread_cond_signal(&endCondition);
-    ThreadPool threads(numThreads);
-    while (true) {
-        // Wait for the signal to start.
-
-        pthread_cond_wait(&startCondition, &lock);
-        if (isDeleted)
+void CpuCalcDispersionPmeReciprocalForceKernel::runWorkerThread(ThreadPool& threads, int index) {
+    switch (pmeOrder) {
+        case 4:
+            runWorkerThreadForOrder<4>(threads, index);
+            break;
+        case 5:
+            runWorkerThreadForOrder<5>(threads, index);
+            break;
+        case 6:
+            runWorkerThreadForOrder<6>(threads, index);
+            break;
+        case 7:
+            runWorkerThreadForOrder<7>(threads, index);
+            break;
+        case 8:
+            runWorkerThreadForOrder<8>(threads, index);
             break;
-        posq = io->getPosq();
-        ComputeTask task(*this);
-        gmx_atomic_set(&atomicCounter, 0);
-        threads.execute(task); // Signal threads to perform charge spreading.
-        threads.waitForThreads();
-        threads.resumeThreads(); // Signal threads to sum the charge grids.
-        threads.waitForThreads();
-        fftwf_execute_dft_r2c(forwardFFT, realGrid, complexGrid);
-        if (lastBoxVectors[0] != periodicBoxVectors[0] || lastBoxVectors[1] != periodicBoxVectors[1] || lastBoxVectors[2] != periodicBoxVectors[2]) {
-            threads.resumeThreads(); // Signal threads to compute the reciprocal scale factors.
-            threads.waitForThreads();
-        }
-        if (includeEnergy) {
-            threads.resumeThreads(); // Signal threads to compute energy.
-            threads.waitForThreads();
-            for (auto e : threadEnergy)
-                energy += e;
-        }
-        threads.resumeThreads(); // Signal threads to perform reciprocal convolution.
-        threads.waitForThreads();
-        fftwf_execute_dft_c2r(backwardFFT, complexGrid, realGrid);
-        gmx_atomic_set(&atomicCounter, 0);
-        threads.resumeThreads(); // Signal threads to interpolate forces.
-        threads.waitForThreads();
-        isFinished = true;
-        lastBoxVectors[0] = periodicBoxVectors[0];
-        lastBoxVectors[1] = periodicBoxVectors[1];
-        lastBoxVectors[2] = periodicBoxVectors[2];
-        pthread_cond_signal(&endCondition);
     }
-    pthread_mutex_unlock(&lock);
 }
 
-void CpuCalcDispersionPmeReciprocalForceKernel::runWorkerThread(ThreadPool& threads, int index) {
+template <int ORDER>
+void CpuCalcDispersionPmeReciprocalForceKernel::runWorkerThreadForOrder(ThreadPool& threads, int index) {
     int gridxStart = (index*gridx)/numThreads;
     int gridxEnd = ((index+1)*gridx)/numThreads;
     int gridSize = (gridx*gridy*gridz+3)/4;
@@ -877,37 +1073,51 @@ void CpuCalcDispersionPmeReciprocalForceKernel::runWorkerThread(ThreadPool& thre
     int complexSize = gridx*gridy*(gridz/2+1);
     int complexStart = std::max(1, ((index*complexSize)/numThreads));
     int complexEnd = (((index+1)*complexSize)/numThreads);
+    SplineCache<ORDER> splines(splineGridIndex, splineTheta, splineDTheta);
     const float epsilonFactor = 1.0f;
-    spreadCharge(posq, tempGrid[index], gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors, atomicCounter, epsilonFactor, index, numThreads, deterministic);
-    threads.syncThreads();
-    int numGrids = tempGrid.size();
-    for (int i = gridStart; i < gridEnd; i += 4) {
-        fvec4 sum(&realGrid[i]);
-        for (int j = 1; j < numGrids; j++)
-            sum += fvec4(&tempGrid[j][i]);
-        sum.store(&realGrid[i]);
-    }
-    threads.syncThreads();
+    if (useSlabs) {
+        spreadChargeOnSlabs(barrier, index, numThreads, posq, realGrid, haloGrid, splines, gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors,
+                epsilonFactor, planeSlab, atomSlab, slabAtomCount, sortedAtoms, useVec8);
+        barrier.sync();
+        sumSlabHalo(index, numThreads, realGrid, haloGrid, gridx, gridy, gridz, ORDER);
+    }
+    else {
+        spreadCharge(posq, tempGrid[index], splines, gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors, atomicCounter, epsilonFactor, index, numThreads, deterministic, useVec8);
+        barrier.sync();
+        int numGrids = tempGrid.size();
+        for (int i = gridStart; i < gridEnd; i += 4) {
+            fvec4 sum(&realGrid[i]);
+            for (int j = 1; j < numGrids; j++)
+                sum += fvec4(&tempGrid[j][i]);
+            sum.store(&realGrid[i]);
+        }
+    }
+    barrier.sync([this] () { fftwf_execute_dft_r2c(forwardFFT, realGrid, complexGrid); });
     if (lastBoxVectors[0] != periodicBoxVectors[0] || lastBoxVectors[1] != periodicBoxVectors[1] || lastBoxVectors[2] != periodicBoxVectors[2]) {
         computeReciprocalDispersionEterm(gridxStart, gridxEnd, gridx, gridy, gridz, recipEterm, alpha, bsplineModuli, periodicBoxVectors, recipBoxVectors);
-        threads.syncThreads();
+        barrier.sync();
     }
     if (includeEnergy) {
         threadEnergy[index] = reciprocalDispersionEnergy(gridxStart, gridxEnd, complexGrid, recipEterm, gridx, gridy, gridz, alpha, bsplineModuli, periodicBoxVectors, recipBoxVectors);
-        threads.syncThreads();
+        barrier.sync();
     }
+    if (!includeForces)
+        return;
     // For dispersion, we include the {0,0,0} term, so the start point needs to be redefined
     complexStart = (index*complexSize)/numThreads;
     reciprocalConvolution(complexStart, complexEnd, complexGrid, recipEterm);
-    threads.syncThreads();
-    interpolateForces(posq, &force[0], realGrid, gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors, atomicCounter, epsilonFactor);
+    barrier.sync([this] () {
+        fftwf_execute_dft_c2r(backwardFFT, complexGrid, realGrid);
+        gmx_atomic_set(&atomicCounter, 0);
+    });
+    interpolateForces(posq, &force[0], realGrid, splines, gridx, gridy, gridz, numParticles, recipBoxVectors, atomicCounter, epsilonFactor, useVec8);
 }
 
-void CpuCalcDispersionPmeReciprocalForceKernel::beginComputation(IO& io, const Vec3* periodicBoxVectors, bool includeEnergy) {
-    this->io = &io;
+void CpuCalcDispersionPmeReciprocalForceKernel::beginComputation(IO& io, const Vec3* periodicBoxVectors, bool includeForces, bool includeEnergy) {
     this->periodicBoxVectors[0] = periodicBoxVectors[0];
     this->periodicBoxVectors[1] = periodicBoxVectors[1];
     this->periodicBoxVectors[2] = periodicBoxVectors[2];
+    this->includeForces = includeForces;
     this->includeEnergy = includeEnergy;
     energy = 0.0;
 
@@ -919,24 +1129,35 @@ void CpuCalcDispersionPmeReciprocalForceKernel::beginComputation(IO& io, const V
     recipBoxVectors[1] = Vec3(-periodicBoxVectors[1][0]*periodicBoxVectors[2][2], periodicBoxVectors[0][0]*periodicBoxVectors[2][2], 0)*scale;
     recipBoxVectors[2] = Vec3(periodicBoxVectors[1][0]*periodicBoxVectors[2][1]-periodicBoxVectors[1][1]*periodicBoxVectors[2][0], -periodicBoxVectors[0][0]*periodicBoxVectors[2][1], periodicBoxVectors[0][0]*periodicBoxVectors[1][1])*scale;
 
-    // Do the calculation.
+    // Start the threads.  They carry out the whole calculation, including the FFTs, without any further
+    // involvement from this thread, so the caller is free to do other work until finishComputation().
 
-    pthread_mutex_lock(&lock);
-    isFinished = false;
-    pthread_cond_signal(&startCondition);
-    pthread_mutex_unlock(&lock);
+    posq = io.getPosq();
+    gmx_atomic_set(&atomicCounter, 0);
+    threads.execute([this] (ThreadPool& threads, int threadIndex) { runWorkerThread(threads, threadIndex); });
 }
 
 double CpuCalcDispersionPmeReciprocalForceKernel::finishComputation(IO& io) {
-    pthread_mutex_lock(&lock);
-    while (!isFinished) {
-        pthread_cond_wait(&endCondition, &lock);
-    }
-    pthread_mutex_unlock(&lock);
-    io.setForce(&force[0]);
+    threads.waitForThreads();
+    if (includeEnergy)
+        for (auto e : threadEnergy)
+            energy += e;
+    lastBoxVectors[0] = periodicBoxVectors[0];
+    lastBoxVectors[1] = periodicBoxVectors[1];
+    lastBoxVectors[2] = periodicBoxVectors[2];
+    if (includeForces)
+        io.setForce(&force[0]);
     return energy;
 }
 
+int CpuCalcDispersionPmeReciprocalForceKernel::getDefaultNumThreads() {
+    int numThreads = getNumProcessors();
+    char* threadsEnv = getenv("OPENMM_CPU_THREADS");
+    if (threadsEnv != NULL)
+        stringstream(threadsEnv) >> numThreads;
+    return numThreads;
+}
+
 bool CpuCalcDispersionPmeReciprocalForceKernel::isProcessorSupported() {
     return isVec4Supported();
 }
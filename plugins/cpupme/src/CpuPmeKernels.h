@@ -39,20 +39,50 @@
 #include "openmm/internal/gmx_atomic.h"
 #include "openmm/internal/ThreadPool.h"
 #include <fftw3.h>
-#include <pthread.h>
 #include <vector>
 
 namespace OpenMM {
 
+/**
+ * This lets the worker threads of a PME kernel synchronize between phases of the calculation without
+ * involving the thread that started them.  The last thread to arrive can perform a serial step, such as
+ * an FFT, before the others are released.
+ */
+class PmePhaseBarrier {
+public:
+    PmePhaseBarrier(int numThreads);
+    ~PmePhaseBarrier();
+    /**
+     * Block until all worker threads have called this.  The last one to arrive calls serialStep (if it is
+     * not empty) before releasing the others.
+     */
+    void sync(const std::function<void ()>& serialStep=std::function<void ()>());
+private:
+    int numThreads, waitCount, generation;
+    pthread_mutex_t lock;
+    pthread_cond_t condition;
+};
+
 /**
  * This is an optimized CPU implementation of CalcPmeReciprocalForceKernel.  It is both
- * vectorized (requiring SSE 4.1) and multithreaded.  It uses FFTW to perform the FFTs.
+ * vectorized (requiring SSE 4.1, and using AVX when it is available) and multithreaded.  It uses FFTW to perform the FFTs.
  */
 
 class OPENMM_EXPORT_PME CpuCalcPmeReciprocalForceKernel : public CalcPmeReciprocalForceKernel {
 public:
-    CpuCalcPmeReciprocalForceKernel(std::string name, const Platform& platform) : CalcPmeReciprocalForceKernel(name, platform),
-            hasCreatedPlan(false), isDeleted(false), realGrid(NULL), complexGrid(NULL) {
+    /**
+     * Create the kernel.
+     *
+     * @param name         the name of the kernel
+     * @param platform     the Platform that created it
+     * @param numThreads   the number of threads to use.  If this is 0, the value of the OPENMM_CPU_THREADS
+     *                     environment variable is used, or the number of processors if it is not set.
+     * @param vectorWidth  the widest vectors to use for spreading charges and interpolating forces: 4 for SSE
+     *                     or 8 for AVX.  If this is 0, the widest one supported by the processor is used.
+     */
+    CpuCalcPmeReciprocalForceKernel(std::string name, const Platform& platform, int numThreads=0, int vectorWidth=0) : CalcPmeReciprocalForceKernel(name, platform),
+            numThreads(numThreads > 0 ? numThreads : getDefaultNumThreads()), threads(this->numThreads), barrier(this->numThreads), vectorWidth(vectorWidth),
+            hasCreatedPlan(false), realGrid(NULL), complexGrid(NULL) {
     }
     /**
      * Initialize the kernel.
@@ -60,31 +90,30 @@ public:
      * @param gridx        the x size of the PME grid
      * @param gridy        the y size of the PME grid
      * @param gridz        the z size of the PME grid
+     * @param order        the B-spline interpolation order, between 4 and 8
      * @param numParticles the number of particles in the system
      * @param alpha        the Ewald blending parameter
      * @param deterministic whether it should attempt to make the resulting forces deterministic
      */
-    void initialize(int xsize, int ysize, int zsize, int numParticles, double alpha, bool deterministic);
+    void initialize(int xsize, int ysize, int zsize, int order, int numParticles, double alpha, bool deterministic);
     ~CpuCalcPmeReciprocalForceKernel();
     /**
-     * Begin computing the force and energy.
+     * Begin computing the force and energy.  This starts the worker threads on the whole calculation and
+     * returns immediately, so the caller can do other work until it calls finishComputation().
      * 
      * @param io                  an object that coordinates data transfer
      * @param periodicBoxVectors  the vectors defining the periodic box (measured in nm)
+     * @param includeForces       true if forces should be computed
      * @param includeEnergy       true if potential energy should be computed
      */
-    void beginComputation(IO& io, const Vec3* periodicBoxVectors, bool includeEnergy);
+    void beginComputation(IO& io, const Vec3* periodicBoxVectors, bool includeForces, bool includeEnergy);
     /**
-     * Finish computing the force and energy.
+     * Finish computing the force and energy.  This blocks until the worker threads are done.
      * 
      * @param io   an object that coordinates data transfer
      * @return the potential energy due to the PME reciprocal space interactions
      */
     double finishComputation(IO& io);
-    /**
-     * This routine contains the code executed by the main thread.
-     */
-    void runMainThread();
     /**
      * This routine contains the code executed by each worker thread.
      */
@@ -102,36 +131,52 @@ public:
      * @param nz      the number of grid points along the Z axis
      */
     void getPMEParameters(double& alpha, int& nx, int& ny, int& nz) const;
+    /**
+     * Get the number of threads used for spreading charges, interpolating forces, and computing FFTs.
+     */
+    int getNumThreads() const {
+        return numThreads;
+    }
 private:
+    /**
+     * The body of runWorkerThread(), specialized for a particular interpolation order.
+     */
+    template <int ORDER>
+    void runWorkerThreadForOrder(ThreadPool& threads, int index);
     /**
      * Select a size for one grid dimension that FFTW can handle efficiently.
      */
     int findFFTDimension(int minimum, bool isZ);
+    /**
+     * Get the number of threads to use if none was specified.
+     */
+    static int getDefaultNumThreads();
     static bool hasInitializedThreads;
-    static int numThreads;
-    int gridx, gridy, gridz, numParticles;
+    int numThreads;
+    ThreadPool threads;
+    PmePhaseBarrier barrier;
+    int vectorWidth;
+    int gridx, gridy, gridz, numParticles, pmeOrder;
     double alpha;
     bool deterministic;
-    bool hasCreatedPlan, isFinished, isDeleted;
+    bool hasCreatedPlan, useSlabs, useVec8;
     std::vector<float> force;
     std::vector<float> bsplineModuli[3];
     std::vector<float> recipEterm;
     Vec3 lastBoxVectors[3];
     std::vector<float> threadEnergy;
-    std::vector<float*> tempGrid;
+    std::vector<float*> tempGrid, haloGrid;
+    std::vector<int> planeSlab, atomSlab, slabAtomCount, sortedAtoms;
+    std::vector<int> splineGridIndex;
+    std::vector<float> splineTheta, splineDTheta;
     float* realGrid;
     fftwf_complex* complexGrid;
     fftwf_plan forwardFFT, backwardFFT;
-    int waitCount;
-    pthread_cond_t startCondition, endCondition;
-    pthread_mutex_t lock;
-    pthread_t mainThread;
     // The following variables are used to store information about the calculation currently being performed.
-    IO* io;
     float energy;
     float* posq;
     Vec3 periodicBoxVectors[3], recipBoxVectors[3];
-    bool includeEnergy;
+    bool includeForces, includeEnergy;
     gmx_atomic_t atomicCounter;
 };
 
@@ -139,13 +184,24 @@ private:
 
 /**
  * This is an optimized CPU implementation of CalcDispersionPmeReciprocalForceKernel.  It is both
- * vectorized (requiring SSE 4.1) and multithreaded.  It uses FFTW to perform the FFTs.
+ * vectorized (requiring SSE 4.1, and using AVX when it is available) and multithreaded.  It uses FFTW to perform the FFTs.
  */
 
 class OPENMM_EXPORT_PME CpuCalcDispersionPmeReciprocalForceKernel : public CalcPmeReciprocalForceKernel {
 public:
-    CpuCalcDispersionPmeReciprocalForceKernel(std::string name, const Platform& platform) : CalcPmeReciprocalForceKernel(name, platform),
-            hasCreatedPlan(false), isDeleted(false), realGrid(NULL), complexGrid(NULL)  {
+    /**
+     * Create the kernel.
+     *
+     * @param name         the name of the kernel
+     * @param platform     the Platform that created it
+     * @param numThreads   the number of threads to use.  If this is 0, the value of the OPENMM_CPU_THREADS
+     *                     environment variable is used, or the number of processors if it is not set.
+     * @param vectorWidth  the widest vectors to use for spreading charges and interpolating forces: 4 for SSE
+     *                     or 8 for AVX.  If this is 0, the widest one supported by the processor is used.
+     */
+    CpuCalcDispersionPmeReciprocalForceKernel(std::string name, const Platform& platform, int numThreads=0, int vectorWidth=0) : CalcPmeReciprocalForceKernel(name, platform),
+            numThreads(numThreads > 0 ? numThreads : getDefaultNumThreads()), threads(this->numThreads), barrier(this->numThreads), vectorWidth(vectorWidth),
+            hasCreatedPlan(false), realGrid(NULL), complexGrid(NULL) {
     }
     /**
      * Initialize the kernel.
@@ -153,31 +209,30 @@ public:
      * @param gridx        the x size of the PME grid
      * @param gridy        the y size of the PME grid
      * @param gridz        the z size of the PME grid
+     * @param order        the B-spline interpolation order, between 4 and 8
      * @param numParticles the number of particles in the system
      * @param alpha        the Ewald blending parameter
      * @param deterministic whether it should attempt to make the resulting forces deterministic
      */
-    void initialize(int xsize, int ysize, int zsize, int numParticles, double alpha, bool deterministic);
+    void initialize(int xsize, int ysize, int zsize, int order, int numParticles, double alpha, bool deterministic);
     ~CpuCalcDispersionPmeReciprocalForceKernel();
     /**
-     * Begin computing the force and energy.
+     * Begin computing the force and energy.  This starts the worker threads on the whole calculation and
+     * returns immediately, so the caller can do other work until it calls finishComputation().
      * 
      * @param io                  an object that coordinates data transfer
      * @param periodicBoxVectors  the vectors defining the periodic box (measured in nm)
+     * @param includeForces       true if forces should be computed
      * @param includeEnergy       true if potential energy should be computed
      */
-    void beginComputation(IO& io, const Vec3* periodicBoxVectors, bool includeEnergy);
+    void beginComputation(IO& io, const Vec3* periodicBoxVectors, bool includeForces, bool includeEnergy);
     /**
-     * Finish computing the force and energy.
+     * Finish computing the force and energy.  This blocks until the worker threads are done.
      * 
      * @param io   an object that coordinates data transfer
      * @return the potential energy due to the PME reciprocal space interactions
      */
     double finishComputation(IO& io);
-    /**
-     * This routine contains the code executed by the main thread.
-     */
-    void runMainThread();
     /**
      * This routine contains the code executed by each worker thread.
      */
@@ -195,37 +250,52 @@ public:
      * @param nz      the number of grid points along the Z axis
      */
     void getPMEParameters(double& alpha, int& nx, int& ny, int& nz) const;
+    /**
+     * Get the number of threads used for spreading charges, interpolating forces, and computing FFTs.
+     */
+    int getNumThreads() const {
+        return numThreads;
+    }
 private:
-    class ComputeTask;
+    /**
+     * The body of runWorkerThread(), specialized for a particular interpolation order.
+     */
+    template <int ORDER>
+    void runWorkerThreadForOrder(ThreadPool& threads, int index);
     /**
      * Select a size for one grid dimension that FFTW can handle efficiently.
      */
     int findFFTDimension(int minimum, bool isZ);
+    /**
+     * Get the number of threads to use if none was specified.
+     */
+    static int getDefaultNumThreads();
     static bool hasInitializedThreads;
-    static int numThreads;
-    int gridx, gridy, gridz, numParticles;
+    int numThreads;
+    ThreadPool threads;
+    PmePhaseBarrier barrier;
+    int vectorWidth;
+    int gridx, gridy, gridz, numParticles, pmeOrder;
     double alpha;
     bool deterministic;
-    bool hasCreatedPlan, isFinished, isDeleted;
+    bool hasCreatedPlan, useSlabs, useVec8;
     std::vector<float> force;
     std::vector<float> bsplineModuli[3];
     std::vector<float> recipEterm;
     Vec3 lastBoxVectors[3];
     std::vector<float> threadEnergy;
-    std::vector<float*> tempGrid;
+    std::vector<float*> tempGrid, haloGrid;
+    std::vector<int> planeSlab, atomSlab, slabAtomCount, sortedAtoms;
+    std::vector<int> splineGridIndex;
+    std::vector<float> splineTheta, splineDTheta;
     float* realGrid;
     fftwf_complex* complexGrid;
     fftwf_plan forwardFFT, backwardFFT;
-    int waitCount;
-    pthread_cond_t startCondition, endCondition;
-    pthread_mutex_t lock;
-    pthread_t mainThread;
     // The following variables are used to store information about the calculation currently being performed.
-    IO* io;
     float energy;
     float* posq;
     Vec3 periodicBoxVectors[3], recipBoxVectors[3];
-    bool includeEnergy;
+    bool includeForces, includeEnergy;
     gmx_atomic_t atomicCounter;
 };
 
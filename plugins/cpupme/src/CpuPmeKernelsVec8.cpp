@@ -0,0 +1,163 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013-2017 Stanford University and the Authors.      *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/OpenMMException.h"
+#include "openmm/internal/hardware.h"
+
+using namespace OpenMM;
+
+#ifdef _MSC_VER
+    // Workaround for a compiler bug in Visual Studio 10. Hopefully we can remove this
+    // once we move to a later version.
+    #undef __AVX__
+#endif
+
+#ifndef __AVX__
+bool isPmeVec8Supported() {
+    return false;
+}
+
+void spreadAtomChargeVec8(float* const* planes, const int* yindex, int gridIndexZ, int gridz, int order, const float* xtheta, const float* ytheta, const float* ztheta) {
+    throw OpenMMException("Internal error: OpenMM was compiled without AVX support");
+}
+
+void interpolateAtomForceVec8(float* const* planes, const int* yindex, int gridIndexZ, int gridz, int order, const float* const* theta, const float* const* dtheta, float* result) {
+    throw OpenMMException("Internal error: OpenMM was compiled without AVX support");
+}
+#else
+#include "openmm/internal/vectorize8.h"
+
+/**
+ * Check whether 8 component vectors are supported with the current CPU.
+ */
+bool isPmeVec8Supported() {
+    // Make sure the CPU supports AVX.
+
+    int cpuInfo[4];
+    cpuid(cpuInfo, 0);
+    if (cpuInfo[0] >= 1) {
+        cpuid(cpuInfo, 1);
+        return ((cpuInfo[2] & ((int) 1 << 28)) != 0);
+    }
+    return false;
+}
+
+/**
+ * Load the coefficients for the z axis into an 8 component vector, padding the unused elements with zeros.
+ */
+static fvec8 loadZCoefficients(const float* ztheta, int order) {
+    float padded[8] = {0};
+    for (int j = 0; j < order; j++)
+        padded[j] = ztheta[j];
+    return fvec8(padded);
+}
+
+/**
+ * Spread the charge of one atom onto the grid.  planes[ix] points to the start of the x-plane ix points past the
+ * atom's first grid index, and yindex[iy] is the wrapped y index of row iy.  xtheta must already be multiplied
+ * by the atom's charge.  Each row of up to 8 points along z is updated with a single vector operation.  Where the
+ * row does not wrap around the end of the grid, the elements past the end of the spline are updated too, but
+ * always with zeros.
+ */
+void spreadAtomChargeVec8(float* const* planes, const int* yindex, int gridIndexZ, int gridz, int order, const float* xtheta, const float* ytheta, const float* ztheta) {
+    fvec8 zvec = loadZCoefficients(ztheta, order);
+    if (gridIndexZ+8 <= gridz) {
+        for (int ix = 0; ix < order; ix++) {
+            float* plane = planes[ix];
+            for (int iy = 0; iy < order; iy++) {
+                float* row = &plane[yindex[iy]*gridz+gridIndexZ];
+                (fvec8(row)+zvec*(xtheta[ix]*ytheta[iy])).store(row);
+            }
+        }
+    }
+    else {
+        int zindex[8];
+        for (int j = 0; j < order; j++) {
+            zindex[j] = gridIndexZ+j;
+            zindex[j] -= (zindex[j] >= gridz ? gridz : 0);
+        }
+        float temp[8];
+        for (int ix = 0; ix < order; ix++) {
+            float* plane = planes[ix];
+            for (int iy = 0; iy < order; iy++) {
+                float* row = &plane[yindex[iy]*gridz];
+                (zvec*(xtheta[ix]*ytheta[iy])).store(temp);
+                for (int j = 0; j < order; j++)
+                    row[zindex[j]] += temp[j];
+            }
+        }
+    }
+}
+
+/**
+ * Interpolate the gradient of the potential at one atom.  planes and yindex are as for spreadAtomChargeVec8(),
+ * and theta[d] and dtheta[d] hold the B-spline coefficients and their derivatives along axis d.  On return,
+ * result[d] holds the derivative along axis d in grid units.
+ */
+void interpolateAtomForceVec8(float* const* planes, const int* yindex, int gridIndexZ, int gridz, int order, const float* const* theta, const float* const* dtheta, float* result) {
+    fvec8 zTheta = loadZCoefficients(theta[2], order);
+    fvec8 zDTheta = loadZCoefficients(dtheta[2], order);
+    bool contiguous = (gridIndexZ+8 <= gridz);
+    int zindex[8];
+    for (int j = 0; j < order; j++) {
+        zindex[j] = gridIndexZ+j;
+        zindex[j] -= (zindex[j] >= gridz ? gridz : 0);
+    }
+    float temp[8] = {0};
+    fvec8 fx(0.0f), fy(0.0f), fz(0.0f);
+    for (int ix = 0; ix < order; ix++) {
+        const float* plane = planes[ix];
+        float dx = theta[0][ix];
+        float ddx = dtheta[0][ix];
+        for (int iy = 0; iy < order; iy++) {
+            const float* row = &plane[yindex[iy]*gridz];
+            fvec8 gridValue;
+            if (contiguous)
+                gridValue = fvec8(&row[gridIndexZ]);
+            else {
+                for (int j = 0; j < order; j++)
+                    temp[j] = row[zindex[j]];
+                gridValue = fvec8(temp);
+            }
+            float dy = theta[1][iy];
+            float ddy = dtheta[1][iy];
+            fvec8 product = gridValue*zTheta;
+            fx += product*(ddx*dy);
+            fy += product*(dx*ddy);
+            fz += gridValue*zDTheta*(dx*dy);
+        }
+    }
+    fvec8 one(1.0f);
+    result[0] = dot8(fx, one);
+    result[1] = dot8(fy, one);
+    result[2] = dot8(fz, one);
+}
+#endif
@@ -42,9 +42,14 @@
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/Units.h"
 #include "../src/CpuPmeKernels.h"
+#include "../src/CpuPmeKernelFactory.h"
+#include "CpuPlatform.h"
 #include "SimTKOpenMMRealType.h"
 #include "sfmt/SFMT.h"
+#include <cstdlib>
 #include <iostream>
+#include <map>
+#include <sstream>
 #include <vector>
 
 using namespace OpenMM;
@@ -535,10 +540,10 @@ void test_water2_dpme_energies_forces_no_exclusions() {
         io.posq.push_back(c6);
         selfEwaldEnergy += dalpha6 * c6 * c6 / 12.0;
     }
-    pme.initialize(grid, grid, grid, NATOMS, dalpha, false);
+    pme.initialize(grid, grid, grid, 5, NATOMS, dalpha, false);
     Vec3 boxVectors[3];
     system.getDefaultPeriodicBoxVectors(boxVectors[0], boxVectors[1], boxVectors[2]);
-    pme.beginComputation(io, boxVectors, true);
+    pme.beginComputation(io, boxVectors, true, true);
     double recenergy = pme.finishComputation(io);
 
     ASSERT_EQUAL_TOL(recenergy, -2.179629087, 5e-3);
@@ -565,7 +570,7 @@ void test_water2_dpme_energies_forces_no_exclusions() {
 }
 
 
-void testPME(bool triclinic) {
+void testPME(bool triclinic, int order, int vectorWidth, int gridSize=0) {
     // Create a cloud of random point charges.
 
     const int numParticles = 51;
@@ -599,10 +604,26 @@ void testPME(bool triclinic) {
     force->setCutoffDistance(cutoff);
     force->setReciprocalSpaceForceGroup(1);
     force->setEwaldErrorTolerance(1e-4);
+    force->setPMEInterpolationOrder(order);
     
-    // Compute the reciprocal space forces with the reference platform.
+    // Create the optimized kernel.  It may round the grid dimensions up to sizes FFTW handles efficiently,
+    // so tell the reference platform to use the same grid.  If gridSize is specified, request that size
+    // directly, even if it is too small for the interpolation order.
     
+    double alpha;
+    int gridx, gridy, gridz;
+    NonbondedForceImpl::calcPMEParameters(system, *force, alpha, gridx, gridy, gridz, false);
+    if (gridSize > 0)
+        gridx = gridy = gridz = gridSize;
     Platform& platform = Platform::getPlatformByName("Reference");
+    CpuCalcPmeReciprocalForceKernel pme(CalcPmeReciprocalForceKernel::Name(), platform, 0, vectorWidth);
+    pme.initialize(gridx, gridy, gridz, order, numParticles, alpha, true);
+    pme.getPMEParameters(alpha, gridx, gridy, gridz);
+    ASSERT(gridx >= order && gridy >= order && gridz >= order);
+    force->setPMEParameters(alpha, gridx, gridy, gridz);
+    
+    // Compute the reciprocal space forces with the reference platform.
+    
     VerletIntegrator integrator(0.01);
     Context context(system, integrator, platform);
     context.setPositions(positions);
@@ -610,10 +631,6 @@ void testPME(bool triclinic) {
     
     // Now compute them with the optimized kernel.
     
-    double alpha;
-    int gridx, gridy, gridz;
-    NonbondedForceImpl::calcPMEParameters(system, *force, alpha, gridx, gridy, gridz, false);
-    CpuCalcPmeReciprocalForceKernel pme(CalcPmeReciprocalForceKernel::Name(), platform);
     IO io;
     double sumSquaredCharges = 0;
     for (int i = 0; i < numParticles; i++) {
@@ -626,8 +643,7 @@ void testPME(bool triclinic) {
         sumSquaredCharges += charge*charge;
     }
     double ewaldSelfEnergy = -ONE_4PI_EPS0*alpha*sumSquaredCharges/sqrt(M_PI);
-    pme.initialize(gridx, gridy, gridz, numParticles, alpha, true);
-    pme.beginComputation(io, boxVectors, true);
+    pme.beginComputation(io, boxVectors, true, true);
     double energy = pme.finishComputation(io);
 
     // See if they match.
@@ -635,6 +651,95 @@ void testPME(bool triclinic) {
     ASSERT_EQUAL_TOL(refState.getPotentialEnergy(), energy+ewaldSelfEnergy, 1e-3);
     for (int i = 0; i < numParticles; i++)
         ASSERT_EQUAL_VEC(refState.getForces()[i], Vec3(io.force[4*i], io.force[4*i+1], io.force[4*i+2]), 1e-3);
+
+    // Computing only the energy should give the same result without setting forces.
+
+    io.force = NULL;
+    pme.beginComputation(io, boxVectors, false, true);
+    ASSERT_EQUAL_TOL(energy, pme.finishComputation(io), 1e-5);
+    ASSERT(io.force == NULL);
+}
+
+/**
+ * A CpuPlatform that lets the test get the ContextImpl for a Context.
+ */
+class TestCpuPlatform : public CpuPlatform {
+public:
+    ContextImpl& getImpl(Context& context) const {
+        return getContextImpl(context);
+    }
+};
+
+static void setThreadsEnvironmentVariable(const string& value) {
+#ifdef _MSC_VER
+    _putenv_s("OPENMM_CPU_THREADS", value.c_str());
+#else
+    setenv("OPENMM_CPU_THREADS", value.c_str(), 1);
+#endif
+}
+
+void testThreadsProperty(int numThreads) {
+    // Create a CPU context with the Threads property set, while OPENMM_CPU_THREADS asks for a different number.
+    // The PME kernel should use the number from the context, and the results should match the Reference platform.
+
+    const int numParticles = 51;
+    const double boxWidth = 5.0;
+    stringstream contextThreads, environmentThreads;
+    contextThreads << numThreads;
+    environmentThreads << (numThreads == 1 ? 2 : 1);
+    setThreadsEnvironmentVariable(environmentThreads.str());
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxWidth, 0, 0), Vec3(0, boxWidth, 0), Vec3(0, 0, boxWidth));
+    NonbondedForce* force = new NonbondedForce();
+    system.addForce(force);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        force->addParticle(-1.0+i*2.0/(numParticles-1), 1.0, 0.0);
+        positions[i] = Vec3(boxWidth*genrand_real2(sfmt), boxWidth*genrand_real2(sfmt), boxWidth*genrand_real2(sfmt));
+    }
+    force->setNonbondedMethod(NonbondedForce::PME);
+    force->setCutoffDistance(1.0);
+    force->setReciprocalSpaceForceGroup(1);
+    force->setEwaldErrorTolerance(1e-4);
+    TestCpuPlatform cpu;
+    cpu.registerKernelFactory(CalcPmeReciprocalForceKernel::Name(), new CpuPmeKernelFactory());
+    map<string, string> properties;
+    properties[CpuPlatform::CpuThreads()] = contextThreads.str();
+    VerletIntegrator cpuIntegrator(0.01);
+    Context cpuContext(system, cpuIntegrator, cpu, properties);
+    cpuContext.setPositions(positions);
+    ASSERT_EQUAL(contextThreads.str(), cpu.getPropertyValue(cpuContext, CpuPlatform::CpuThreads()));
+
+    // Check the size of the thread pool used by kernels the factory creates for the context.  A kernel
+    // created without a thread count still follows the environment variable.
+
+    CpuPmeKernelFactory factory;
+    CpuCalcPmeReciprocalForceKernel* kernel = dynamic_cast<CpuCalcPmeReciprocalForceKernel*>(factory.createKernelImpl(CalcPmeReciprocalForceKernel::Name(), cpu, cpu.getImpl(cpuContext)));
+    ASSERT(kernel != NULL);
+    ASSERT_EQUAL(numThreads, kernel->getNumThreads());
+    delete kernel;
+    CpuCalcPmeReciprocalForceKernel defaultKernel(CalcPmeReciprocalForceKernel::Name(), cpu);
+    ASSERT_EQUAL(numThreads == 1 ? 2 : 1, defaultKernel.getNumThreads());
+
+    // Compare the reciprocal space forces to the Reference platform, using the same grid.  The CPU platform
+    // selects its PME implementation the first time it computes forces, so do that before querying the grid.
+
+    State cpuState = cpuContext.getState(State::Forces | State::Energy, false, 1<<1);
+    double alpha;
+    int gridx, gridy, gridz;
+    force->getPMEParametersInContext(cpuContext, alpha, gridx, gridy, gridz);
+    force->setPMEParameters(alpha, gridx, gridy, gridz);
+    Platform& reference = Platform::getPlatformByName("Reference");
+    VerletIntegrator referenceIntegrator(0.01);
+    Context referenceContext(system, referenceIntegrator, reference);
+    referenceContext.setPositions(positions);
+    State referenceState = referenceContext.getState(State::Forces | State::Energy, false, 1<<1);
+    ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), cpuState.getPotentialEnergy(), 1e-3);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(referenceState.getForces()[i], cpuState.getForces()[i], 1e-3);
 }
 
 int main(int argc, char* argv[]) {
@@ -643,9 +748,15 @@ int main(int argc, char* argv[]) {
             cout << "CPU is not supported.  Exiting." << endl;
             return 0;
         }
-        testPME(false);
-        testPME(true);
+        for (int vectorWidth = 4; vectorWidth <= 8; vectorWidth += 4) {
+            testPME(false, 5, vectorWidth);
+            for (int order = 4; order <= 8; order++)
+                testPME(true, order, vectorWidth);
+            testPME(false, 8, vectorWidth, 6);
+        }
         test_water2_dpme_energies_forces_no_exclusions();
+        for (int numThreads = 1; numThreads <= 3; numThreads++)
+            testThreadsProperty(numThreads);
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
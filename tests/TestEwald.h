@@ -425,6 +425,63 @@ void testPMEParameters() {
     ASSERT(fabs((energy1-energy2)/energy1) > 1e-5);
 }
 
+void testSmallGrid() {
+    // This is only called by platforms that support interpolation orders other than 5.
+    // With interpolation order 8, a 6x6x6 grid is smaller than the B-spline of each atom.  The grid should be
+    // enlarged, giving the same result as asking for the larger grid directly.
+
+    const int numParticles = 51;
+    const double boxWidth = 5.0;
+    const double alpha = 2.0;
+    const int order = 8;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxWidth, 0, 0), Vec3(0, boxWidth, 0), Vec3(0, 0, boxWidth));
+    NonbondedForce* force = new NonbondedForce();
+    system.addForce(force);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        force->addParticle(-1.0+i*2.0/(numParticles-1), 1.0, 0.0);
+        positions[i] = Vec3(boxWidth*genrand_real2(sfmt), boxWidth*genrand_real2(sfmt), boxWidth*genrand_real2(sfmt));
+    }
+    force->setNonbondedMethod(NonbondedForce::PME);
+    force->setCutoffDistance(1.0);
+    force->setPMEInterpolationOrder(order);
+    force->setPMEParameters(alpha, 6, 6, 6);
+    VerletIntegrator integrator1(0.01);
+    Context context1(system, integrator1, platform);
+    context1.setPositions(positions);
+    State state1 = context1.getState(State::Forces | State::Energy);
+    double actualAlpha;
+    int size[3];
+    force->getPMEParametersInContext(context1, actualAlpha, size[0], size[1], size[2]);
+    for (int i = 0; i < 3; i++)
+        ASSERT(size[i] >= order);
+
+    // Request the enlarged grid explicitly and compare.
+
+    force->setPMEParameters(alpha, size[0], size[1], size[2]);
+    VerletIntegrator integrator2(0.01);
+    Context context2(system, integrator2, platform);
+    context2.setPositions(positions);
+    State state2 = context2.getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(state2.getPotentialEnergy(), state1.getPotentialEnergy(), 1e-5);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(state2.getForces()[i], state1.getForces()[i], 1e-5);
+
+    // A grid that is no smaller than the interpolation order should be used as requested.
+
+    force->setPMEInterpolationOrder(5);
+    force->setPMEParameters(alpha, 5, 5, 5);
+    VerletIntegrator integrator3(0.01);
+    Context context3(system, integrator3, platform);
+    force->getPMEParametersInContext(context3, actualAlpha, size[0], size[1], size[2]);
+    for (int i = 0; i < 3; i++)
+        ASSERT_EQUAL(5, size[i]);
+}
+
 void runPlatformTests();
 
 int main(int argc, char* argv[]) {
@@ -114,6 +114,26 @@ void verifyEvaluation(const string& expression, double x, double y, double expec
     ASSERT_EQUAL(&x, &compiled2.getVariableReference("x"));
     ASSERT_EQUAL(&y, &compiled2.getVariableReference("y"));
 
+    // Evaluate it at a batch of points, with x varying and y held fixed.  Use an odd number of
+    // points so the final one is processed on its own.
+
+    const int numPoints = 5;
+    vector<double> xValues(numPoints), results(numPoints);
+    for (int i = 0; i < numPoints; i++)
+        xValues[i] = x+0.1*i;
+    vector<string> batchVariables;
+    batchVariables.push_back("x");
+    compiled2.setBatchVariables(batchVariables);
+    const double* batchValues[] = {&xValues[0]};
+    compiled2.evaluateBatch(numPoints, batchValues, &results[0]);
+    for (int i = 0; i < numPoints; i++) {
+        double xValue = x;
+        x = xValues[i];
+        ASSERT_EQUAL_TOL(compiled2.evaluate(), results[i], 1e-10);
+        x = xValue;
+    }
+    ASSERT_EQUAL_TOL(expectedValue, results[0], 1e-10);
+
     // Make sure that variable renaming works.
 
     variables.clear();
@@ -222,6 +242,128 @@ void testCustomFunction(const string& expression, const string& equivalent) {
     verifySameValue(deriv3, deriv4, 2.0, -3.0);
 }
 
+/**
+ * Verify that assigning one CompiledExpression to another correctly replaces its batch variables.
+ */
+
+void testBatchVariableAssignment() {
+    vector<string> batchVariables;
+    batchVariables.push_back("x");
+    const int numPoints = 3;
+    double xValues[] = {1.0, 2.0, 3.0};
+    const double* batchValues[] = {xValues};
+    vector<double> results(numPoints);
+
+    // Assign an expression with batch variables to one without them.
+
+    CompiledExpression withBatch = Parser::parse("x*y+1").createCompiledExpression();
+    withBatch.setBatchVariables(batchVariables);
+    CompiledExpression target = Parser::parse("2*y").createCompiledExpression();
+    target = withBatch;
+    target.getVariableReference("y") = 2.0;
+    target.evaluateBatch(numPoints, batchValues, &results[0]);
+    for (int i = 0; i < numPoints; i++)
+        ASSERT_EQUAL_TOL(2.0*xValues[i]+1.0, results[i], 1e-10);
+
+    // Assign one with batch variables to another that also has them, but with a different workspace layout.
+
+    CompiledExpression target2 = Parser::parse("y+sin(x)*cos(x)*exp(x)").createCompiledExpression();
+    target2.setBatchVariables(batchVariables);
+    target2 = withBatch;
+    target2.getVariableReference("y") = 3.0;
+    target2.evaluateBatch(numPoints, batchValues, &results[0]);
+    for (int i = 0; i < numPoints; i++)
+        ASSERT_EQUAL_TOL(3.0*xValues[i]+1.0, results[i], 1e-10);
+
+    // Assign an expression without batch variables to one that has them.  It should no longer accept batches.
+
+    CompiledExpression withoutBatch = Parser::parse("x-y").createCompiledExpression();
+    target = withoutBatch;
+    target.getVariableReference("x") = 5.0;
+    target.getVariableReference("y") = 2.0;
+    ASSERT_EQUAL_TOL(3.0, target.evaluate(), 1e-10);
+    bool threwException = false;
+    try {
+        target.evaluateBatch(numPoints, batchValues, &results[0]);
+    }
+    catch (const exception& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
+/**
+ * Verify that evaluateBatch() gives the same results as evaluate() for every kind of operation, and for
+ * numbers of points that do and do not fill complete SIMD blocks.
+ */
+
+void testBatchOperations() {
+    const char* expressions[] = {"x+y", "x-y", "x*y", "x/y", "-x", "sqrt(x+2)", "step(x)", "delta(x)", "x^2", "x^3",
+            "1/x", "x+3", "3*x", "exp(x)", "log(x+2)", "sin(x)*cos(y)", "x^y", "min(x,y)", "select(x,x,y)",
+            "exp(-(x-y)^2)*abs(x)+floor(x)+ceil(y)"};
+    double xValues[] = {-1.5, 0.0, 0.5, 1.0, 1.5, 2.0, -0.25, 0.75, 1.25};
+    const int maxPoints = 9;
+    for (const char* expression : expressions) {
+        CompiledExpression compiled = Parser::parse(expression).createCompiledExpression();
+        vector<string> batchVariables;
+        batchVariables.push_back("x");
+        compiled.setBatchVariables(batchVariables);
+        if (compiled.getVariables().find("y") != compiled.getVariables().end())
+            compiled.getVariableReference("y") = 1.5;
+        const double* batchValues[] = {xValues};
+        for (int numPoints = 1; numPoints <= maxPoints; numPoints++) {
+            vector<double> results(numPoints);
+            compiled.evaluateBatch(numPoints, batchValues, &results[0]);
+            for (int i = 0; i < numPoints; i++) {
+                if (compiled.getVariables().find("x") != compiled.getVariables().end())
+                    compiled.getVariableReference("x") = xValues[i];
+                assertNumbersEqual(compiled.evaluate(), results[i]);
+            }
+        }
+    }
+}
+
+/**
+ * Verify that the vectorized exponential used by evaluateBatch() is accurate, including for arguments
+ * where the result overflows, underflows, or is not a number.
+ */
+
+void testBatchExp() {
+    CompiledExpression compiled = Parser::parse("exp(x)").createCompiledExpression();
+    vector<string> batchVariables;
+    batchVariables.push_back("x");
+    compiled.setBatchVariables(batchVariables);
+    vector<double> xValues;
+    for (int i = 0; i < 1000; i++)
+        xValues.push_back(-700.0+1400.0*i/999.0);
+    for (int i = 0; i < 1000; i++)
+        xValues.push_back(-2.0+4.0*i/999.0);
+    xValues.push_back(-800.0);
+    xValues.push_back(-740.0);
+    xValues.push_back(-708.5);
+    xValues.push_back(709.5);
+    xValues.push_back(800.0);
+    xValues.push_back(numeric_limits<double>::quiet_NaN());
+    xValues.push_back(numeric_limits<double>::infinity());
+    xValues.push_back(-numeric_limits<double>::infinity());
+    int numPoints = xValues.size();
+    vector<double> results(numPoints);
+    const double* batchValues[] = {&xValues[0]};
+    compiled.evaluateBatch(numPoints, batchValues, &results[0]);
+    for (int i = 0; i < numPoints; i++) {
+        double expected = exp(xValues[i]);
+        if (expected != expected) {
+            ASSERT(results[i] != results[i]);
+        }
+        else if (expected == 0.0 || expected == numeric_limits<double>::infinity()) {
+            ASSERT_EQUAL(expected, results[i]);
+        }
+        else {
+            ASSERT_EQUAL_TOL(expected, results[i], 1e-15);
+        }
+    }
+}
+
 int main() {
     try {
         verifyEvaluation("5", 5.0);
@@ -301,6 +443,9 @@ int main() {
         verifyDerivative("select(x, x^2, 3*x)", "select(x, 2*x, 3)");
         testCustomFunction("custom(x, y)/2", "x*y");
         testCustomFunction("custom(x^2, 1)+custom(2, y-1)", "2*x^2+4*(y-1)");
+        testBatchVariableAssignment();
+        testBatchOperations();
+        testBatchExp();
         cout << Parser::parse("x*x").optimize() << endl;
         cout << Parser::parse("x*(x*x)").optimize() << endl;
         cout << Parser::parse("(x*x)*x").optimize() << endl;
@@ -0,0 +1,308 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2014-2015 Stanford University and the Authors.      *
+ * Authors: Robert T. McGibbon                                                *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+/**
+ * This tests vectorized operations.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/internal/vectorize16.h"
+#include "openmm/internal/hardware.h"
+#include <iostream>
+
+
+#ifndef __AVX512F__
+bool isVec16Supported() {
+    return false;
+}
+#else
+/**
+ * Check whether 16 component vectors are supported with the current CPU.
+ */
+bool isVec16Supported() {
+    // Make sure the CPU supports AVX-512F, and that the operating system saves the AVX-512 registers.
+
+    int cpuInfo[4];
+    cpuid(cpuInfo, 0);
+    if (cpuInfo[0] < 7)
+        return false;
+    cpuid(cpuInfo, 1);
+    if ((cpuInfo[2] & ((int) 1 << 27)) == 0)
+        return false;
+    if ((getExtendedControlRegister() & 0xE6) != 0xE6)
+        return false;
+    cpuidex(cpuInfo, 7, 0);
+    return ((cpuInfo[1] & ((int) 1 << 16)) != 0);
+}
+#endif
+
+using namespace OpenMM;
+using namespace std;
+
+#define ASSERT_VEC4_EQUAL(found, expected0, expected1, expected2, expected3) {if (std::abs((found)[0]-(expected0))>1e-6 || std::abs((found)[1]-(expected1))>1e-6 || std::abs((found)[2]-(expected2))>1e-6 || std::abs((found)[3]-(expected3))>1e-6) {std::stringstream details; details << " Expected ("<<(expected0)<<","<<(expected1)<<","<<(expected2)<<","<<(expected3)<<"), found ("<<(found)[0]<<","<<(found)[1]<<","<<(found)[2]<<","<<(found)[3]<<")"; throwException(__FILE__, __LINE__, details.str());}};
+#define ASSERT_VEC16_EQUAL(found, expected) {float values[16]; (found).store(values); for (int _i = 0; _i < 16; _i++) if (std::abs(values[_i]-(expected)[_i])>1e-6) {std::stringstream details; details << " Element "<<_i<<": expected "<<(expected)[_i]<<", found "<<values[_i]; throwException(__FILE__, __LINE__, details.str());}};
+#define ASSERT_VEC16_EQUAL_INT(found, expected) {int values[16]; (found).store(values); for (int _i = 0; _i < 16; _i++) if (values[_i] != (expected)[_i]) {std::stringstream details; details << " Element "<<_i<<": expected "<<(expected)[_i]<<", found "<<values[_i]; throwException(__FILE__, __LINE__, details.str());}};
+
+const float f1Values[] = {0.5, 1.0, 1.5, 2.0, 2.5, 3.0, 3.5, 4.0, 4.5, 5.0, 5.5, 6.0, 6.5, 7.0, 7.5, 8.0};
+const float f2Values[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+
+void testLoadStore() {
+    fvec16 f1(2.0);
+    ivec16 i1(3);
+    float expectedf[16];
+    int expectedi[16];
+    for (int i = 0; i < 16; i++) {
+        expectedf[i] = 2.0;
+        expectedi[i] = 3;
+    }
+    ASSERT_VEC16_EQUAL(f1, expectedf);
+    ASSERT_VEC16_EQUAL_INT(i1, expectedi);
+    fvec16 f2(2.5, 3.0, 3.5, 4.0, 4.5, 5.0, 5.5, 6.0, 6.5, 7.0, 7.5, 8.0, 8.5, 9.0, 9.5, 10.0);
+    ivec16 i2(2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17);
+    for (int i = 0; i < 16; i++) {
+        expectedf[i] = 2.5+0.5*i;
+        expectedi[i] = 2+i;
+    }
+    ASSERT_VEC16_EQUAL(f2, expectedf);
+    ASSERT_VEC16_EQUAL_INT(i2, expectedi);
+    float farray[16];
+    int iarray[16];
+    f2.store(farray);
+    i2.store(iarray);
+    fvec16 f3(farray);
+    ivec16 i3(iarray);
+    ASSERT_VEC16_EQUAL(f3, expectedf);
+    ASSERT_VEC16_EQUAL_INT(i3, expectedi);
+    for (int i = 0; i < 8; i++) {
+        ASSERT_EQUAL(i < 4 ? f3.lowerVec().lowerVec()[i] : f3.lowerVec().upperVec()[i-4], expectedf[i]);
+        ASSERT_EQUAL(i < 4 ? f3.upperVec().lowerVec()[i] : f3.upperVec().upperVec()[i-4], expectedf[i+8]);
+        ASSERT_EQUAL(i < 4 ? i3.lowerVec().lowerVec()[i] : i3.lowerVec().upperVec()[i-4], expectedi[i]);
+        ASSERT_EQUAL(i < 4 ? i3.upperVec().lowerVec()[i] : i3.upperVec().upperVec()[i-4], expectedi[i+8]);
+    }
+    ASSERT_VEC16_EQUAL(fvec16(f3.lowerVec(), f3.upperVec()), expectedf);
+}
+
+void testArithmetic() {
+    fvec16 f1(f1Values), f2(f2Values);
+    float sum[16], difference[16], product[16], quotient[16];
+    for (int i = 0; i < 16; i++) {
+        sum[i] = f1Values[i]+f2Values[i];
+        difference[i] = f1Values[i]-f2Values[i];
+        product[i] = f1Values[i]*f2Values[i];
+        quotient[i] = f1Values[i]/f2Values[i];
+    }
+    ASSERT_VEC16_EQUAL(f1+f2, sum);
+    ASSERT_VEC16_EQUAL(f1-f2, difference);
+    ASSERT_VEC16_EQUAL(f1*f2, product);
+    ASSERT_VEC16_EQUAL(f1/f2, quotient);
+    fvec16 f3 = f1;
+    f3 += f2;
+    ASSERT_VEC16_EQUAL(f3, sum);
+    f3 = f1;
+    f3 -= f2;
+    ASSERT_VEC16_EQUAL(f3, difference);
+    f3 = f1;
+    f3 *= f2;
+    ASSERT_VEC16_EQUAL(f3, product);
+    f3 = f1;
+    f3 /= f2;
+    ASSERT_VEC16_EQUAL(f3, quotient);
+    ivec16 i1(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16);
+    int isum[16];
+    for (int i = 0; i < 16; i++)
+        isum[i] = 2*(i+1);
+    ASSERT_VEC16_EQUAL_INT(i1+i1, isum);
+}
+
+void testLogic() {
+    int allBits = -1;
+    float allBitsf = *((float*) &allBits);
+    int maskValues[16];
+    float fmaskValues[16], expectedAnd[16];
+    int i1Values[16], expectedIntAnd[16], expectedIntOr[16];
+    for (int i = 0; i < 16; i++) {
+        bool set = (i%4 == 1 || i%4 == 2);
+        maskValues[i] = (set ? allBits : 0);
+        fmaskValues[i] = (set ? allBitsf : 0);
+        expectedAnd[i] = (set ? f1Values[i] : 0);
+        i1Values[i] = i+1;
+        expectedIntAnd[i] = (set ? i+1 : 0);
+        expectedIntOr[i] = (set ? allBits : i+1);
+    }
+    ivec16 mask(maskValues);
+    fvec16 fmask(fmaskValues);
+    fvec16 f1(f1Values);
+    ivec16 i1(i1Values);
+    ASSERT_VEC16_EQUAL(f1&fmask, expectedAnd);
+    float temp[16];
+    (f1|fmask).store(temp);
+    for (int i = 0; i < 16; i++) {
+        if (i%4 == 1 || i%4 == 2) {
+            ASSERT(temp[i] != temp[i]); // All bits set, which is nan
+        }
+        else {
+            ASSERT_EQUAL(f1Values[i], temp[i]);
+        }
+    }
+    ASSERT_VEC16_EQUAL_INT(i1&mask, expectedIntAnd);
+    ASSERT_VEC16_EQUAL_INT(i1|mask, expectedIntOr);
+    int expectedExpanded[16];
+    for (int i = 0; i < 16; i++)
+        expectedExpanded[i] = (i%3 == 0 ? -1 : 0);
+    ASSERT_VEC16_EQUAL_INT(expandMask(0x9249), expectedExpanded);
+}
+
+void testComparisons() {
+    fvec16 v1(0.0);
+    fvec16 v2(1.5);
+    float aValues[16], bValues[16];
+    for (int i = 0; i < 16; i++) {
+        aValues[i] = (i%4 == 0 ? 1.0 : i%4 == 1 ? 1.5 : i%4 == 2 ? 3.0 : 2.2)+i;
+        bValues[i] = (i%4 == 0 ? 1.1 : i%4 == 1 ? 1.5 : i%4 == 2 ? 3.0 : 2.1)+i;
+    }
+    fvec16 a(aValues), b(bValues);
+    float eq[16], ne[16], lt[16], gt[16], le[16], ge[16];
+    for (int i = 0; i < 16; i++) {
+        eq[i] = (aValues[i] == bValues[i] ? 1.5 : 0.0);
+        ne[i] = (aValues[i] != bValues[i] ? 1.5 : 0.0);
+        lt[i] = (aValues[i] < bValues[i] ? 1.5 : 0.0);
+        gt[i] = (aValues[i] > bValues[i] ? 1.5 : 0.0);
+        le[i] = (aValues[i] <= bValues[i] ? 1.5 : 0.0);
+        ge[i] = (aValues[i] >= bValues[i] ? 1.5 : 0.0);
+    }
+    ASSERT_VEC16_EQUAL(blend(v1, v2, a==b), eq);
+    ASSERT_VEC16_EQUAL(blend(v1, v2, a!=b), ne);
+    ASSERT_VEC16_EQUAL(blend(v1, v2, a<b), lt);
+    ASSERT_VEC16_EQUAL(blend(v1, v2, a>b), gt);
+    ASSERT_VEC16_EQUAL(blend(v1, v2, a<=b), le);
+    ASSERT_VEC16_EQUAL(blend(v1, v2, a>=b), ge);
+}
+
+void testMathFunctions() {
+    const float aValues[] = {0.4, 1.9, -1.2, -3.8};
+    const float bValues[] = {1.1, 1.2, 1.3, -5.0};
+    float f1Array[16], f2Array[16], positive[16];
+    float floorValues[16], ceilValues[16], roundValues[16], absValues[16], minValues[16], maxValues[16], sqrtValues[16], rsqrtValues[16], blendValues[16];
+    int blendMask[16];
+    float dot = 0;
+    for (int i = 0; i < 16; i++) {
+        f1Array[i] = aValues[i%4];
+        f2Array[i] = bValues[i%4];
+        positive[i] = 1.5+i;
+        floorValues[i] = floor(f1Array[i]);
+        ceilValues[i] = ceil(f1Array[i]);
+        roundValues[i] = (i%4 == 0 ? 0.0 : i%4 == 1 ? 2.0 : i%4 == 2 ? -1.0 : -4.0);
+        absValues[i] = fabs(f1Array[i]);
+        minValues[i] = min(f1Array[i], f2Array[i]);
+        maxValues[i] = max(f1Array[i], f2Array[i]);
+        sqrtValues[i] = sqrt(positive[i]);
+        rsqrtValues[i] = 1.0/sqrt(positive[i]);
+        blendMask[i] = (i%2 == 0 ? -1 : 0);
+        blendValues[i] = (i%2 == 0 ? f2Array[i] : f1Array[i]);
+        dot += f1Array[i]*f2Array[i];
+    }
+    fvec16 f1(f1Array), f2(f2Array);
+    ASSERT_VEC16_EQUAL(floor(f1), floorValues);
+    ASSERT_VEC16_EQUAL(ceil(f1), ceilValues);
+    ASSERT_VEC16_EQUAL(round(f1), roundValues);
+    ASSERT_VEC16_EQUAL(abs(f1), absValues);
+    ASSERT_VEC16_EQUAL(min(f1, f2), minValues);
+    ASSERT_VEC16_EQUAL(max(f1, f2), maxValues);
+    ASSERT_VEC16_EQUAL(sqrt(fvec16(positive)), sqrtValues);
+    ASSERT_VEC16_EQUAL(rsqrt(fvec16(positive)), rsqrtValues);
+    ASSERT_EQUAL_TOL(dot, dot16(f1, f2), 1e-6);
+    ASSERT(any(f1 > 0.5));
+    ASSERT(!any(f1 > 2.0));
+    ASSERT_VEC16_EQUAL(blend(f1, f2, ivec16(blendMask)), blendValues);
+}
+
+void testGather() {
+    float table[32];
+    for (int i = 0; i < 32; i++)
+        table[i] = 0.5*i;
+    int indexValues[16], nextIndexValues[16];
+    float expected[16], nextExpected[16];
+    for (int i = 0; i < 16; i++) {
+        indexValues[i] = (7*i)%31;
+        nextIndexValues[i] = indexValues[i]+1;
+        expected[i] = table[indexValues[i]];
+        nextExpected[i] = table[indexValues[i]+1];
+    }
+    ivec16 index(indexValues);
+    ASSERT_VEC16_EQUAL(gather(table, index), expected);
+    ASSERT_VEC16_EQUAL(gather(table, index+1), nextExpected);
+}
+
+void testTranspose() {
+    fvec4 in[16];
+    for (int i = 0; i < 16; i++)
+        in[i] = fvec4(10.0f*i, 10.0f*i+1, 10.0f*i+2, 10.0f*i+3);
+    fvec16 o1, o2, o3, o4;
+    transpose(in, o1, o2, o3, o4);
+    float e1[16], e2[16], e3[16], e4[16];
+    for (int i = 0; i < 16; i++) {
+        e1[i] = 10.0f*i;
+        e2[i] = 10.0f*i+1;
+        e3[i] = 10.0f*i+2;
+        e4[i] = 10.0f*i+3;
+    }
+    ASSERT_VEC16_EQUAL(o1, e1);
+    ASSERT_VEC16_EQUAL(o2, e2);
+    ASSERT_VEC16_EQUAL(o3, e3);
+    ASSERT_VEC16_EQUAL(o4, e4);
+
+    fvec4 out[16];
+    transpose(o1, o2, o3, o4, out);
+    for (int i = 0; i < 16; i++)
+        ASSERT_VEC4_EQUAL(out[i], 10.0f*i, 10.0f*i+1, 10.0f*i+2, 10.0f*i+3);
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        if (!isVec16Supported()) {
+            cout << "CPU is not supported.  Exiting." << endl;
+            return 0;
+        }
+        testLoadStore();
+        testArithmetic();
+        testLogic();
+        testComparisons();
+        testMathFunctions();
+        testGather();
+        testTranspose();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}